@@ -92,7 +92,7 @@ public:
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, _colorBuffer);
 
-		glUniform1f(glGetUniformLocation(_hdrShader.Program, "exposure"), 1.0f);
+		_hdrShader.SetUniform("exposure", 1.0f);
 
 		glBindVertexArray(_renderQuadVAO);
 		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -1,17 +1,50 @@
 #pragma once
 
 #include <std_include.h>	
+#include <cstring>
+#include <vector>
+#include <assets/AssetCache.hpp>
+#include <buffers/VariableShaderBuffer.hpp>
+#include <render/RenderQueue.hpp>
+
+/// <summary>
+/// Per-probe data of an instanced sphere draw (std430 layout of the ProbeInstances buffer)
+/// </summary>
+struct ProbeInstance {
+	/// <summary>
+	/// Sphere center in xyz, sphere scale in w
+	/// </summary>
+	glm::vec4 TranslationScale;
+	/// <summary>
+	/// Probe index in x, first probe layout of the volume in y, first irradiance entry of the volume in z,
+	/// direction lookup section of the volume in w
+	/// </summary>
+	glm::ivec4 Samples;
+};
+
+static_assert(sizeof(ProbeInstance) == 32, "Probe instance must match the std430 layout");
 
 class RadianceSphere
 {
 private:
 	glm::vec3 _color = glm::vec3(1.0f, 0.5f, 0.2f);
-	Model _sphere;
+	std::shared_ptr<Model> _sphere;
 	Shader _shader;
+	Shader _instancedShader;
 	bool _debugColor = false;
 
+	/// <summary>
+	/// Instances of the next DrawInstances() call. Binding 6 is reserved for it
+	/// </summary>
+	VariableShaderBuffer<ProbeInstance> _instancesBuffer;
+	/// <summary>
+	/// Instances added since the last DrawInstances() call, from all the volumes
+	/// </summary>
+	std::vector<ProbeInstance> _instances;
+
 public:
-	RadianceSphere() : _sphere("models/sphere.obj"), _shader("shaders/radiance.vert", "shaders/radiance.frag") {
+	RadianceSphere() : _sphere(AssetCache::Instance.GetModel("models/sphere.obj")), _shader("shaders/radiance.vert", "shaders/radiance.frag"),
+		_instancedShader("shaders/radiance_instanced.vert", "shaders/radiance.frag"), _instancesBuffer(6) {
 
 	}
 
@@ -22,21 +55,52 @@ public:
 
 	void SetDebugColor(bool value) { _debugColor = value; };
 
-	void Draw(const glm::vec3& translation, float scale, int offset, int samples)
+	void Draw(RenderQueue& queue, const glm::vec3& translation, float scale, int probeIndex, int probesBase, int irradianceBase, int lookupBase)
 	{
-		//UpdateRadianceBuffers(sampler);
-
-		_shader.Use();
-
 		glm::mat4 sphereTransform = glm::translate(glm::mat4(1.0f), translation);
 		sphereTransform = glm::scale(sphereTransform, glm::vec3(scale));
 
-		// we pass projection and view matrices to the Shader Program of the plane
-		_shader.SetUniform("modelMatrix", sphereTransform);
-		_shader.SetUniform("debugColor", (int)_debugColor);
-		_shader.SetUniform("samplesCount", samples);
-		_shader.SetUniform("sampleOffset", offset);
-		_sphere.Draw();
+		queue.Begin(_shader, 0);
+		queue.SetUniform("modelMatrix", sphereTransform);
+		queue.SetUniform("debugColor", (int)_debugColor);
+		queue.SetUniform("probeIndex", probeIndex);
+		queue.SetUniform("probesBase", probesBase);
+		queue.SetUniform("irradianceBase", irradianceBase);
+		queue.SetUniform("lookupBase", lookupBase);
+		queue.DrawModel(*_sphere);
+	}
+
+	/// <summary>
+	/// Reserves space for count instances of the next DrawInstances() call and returns the first one
+	/// </summary>
+	/// <remarks>
+	/// Many volumes can add their instances before the draw: the returned pointer is valid only until the next call
+	/// </remarks>
+	ProbeInstance* AddInstances(int count)
+	{
+		size_t first = _instances.size();
+		_instances.resize(first + count);
+		return _instances.data() + first;
+	}
+
+	/// <summary>
+	/// Submits all the instances added after the last call as a single instanced draw
+	/// </summary>
+	void DrawInstances(RenderQueue& queue)
+	{
+		const GLsizeiptr instancesCount = (GLsizeiptr)_instances.size();
+		if (instancesCount <= 0) return;
+
+		// The instances buffer is not part of the queue state, so it' s uploaded now.
+		// It' s reallocated only when the count changes
+		if (_instancesBuffer.GetVectorLength() != instancesCount) _instancesBuffer.SetVectorLength(instancesCount);
+		memcpy(_instancesBuffer.GetVectorPtr(), _instances.data(), sizeof(ProbeInstance) * instancesCount);
+		_instancesBuffer.Write();
+		_instances.clear();
+
+		queue.Begin(_instancedShader, 0);
+		queue.SetUniform("debugColor", (int)_debugColor);
+		queue.DrawModel(*_sphere, (GLsizei)instancesCount);
 	}
 };
 
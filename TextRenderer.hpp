@@ -1,30 +1,82 @@
 #pragma once
 
 #include <std_include.h>
-#include <map>
+#include <cstring>
+#include <vector>
 
 class  TextRenderer
 {
 private:
+	/// <summary>
+	/// Glyphs loaded from the font (ASCII only)
+	/// </summary>
+	static const int CharactersCount = 128;
+	/// <summary>
+	/// Width of the glyph atlas. The height is the smallest power of two that contains all the glyphs
+	/// </summary>
+	static const int AtlasWidth = 1024;
+	/// <summary>
+	/// Empty texels around each glyph, so the linear filtering does not bleed the neighbours in the quad
+	/// </summary>
+	static const int AtlasPadding = 1;
+
 	struct Character {
-		unsigned int TextureID;  // ID handle of the glyph texture
+		glm::vec2    UvMin;      // Top-left glyph coordinates in the atlas
+		glm::vec2    UvMax;      // Bottom-right glyph coordinates in the atlas
 		glm::ivec2   Size;       // Size of glyph
 		glm::ivec2   Bearing;    // Offset from baseline to left/top of glyph
 		unsigned int Advance;    // Offset to advance to next glyph
 	};
 
-	std::map<char, Character> Characters;
+	/// <summary>
+	/// Vertex of a glyph quad: position, atlas coordinates and color
+	/// </summary>
+	struct TextVertex {
+		glm::vec4 PositionUv;
+		glm::vec3 Color;
+	};
+
+	Character _characters[CharactersCount] = {};
 	Shader _shader;
 	glm::mat4 _projection = glm::ortho(0.0f, 800.0f, 0.0f, 600.0f);
-	GLuint VAO, VBO;
+	GLuint VAO = 0, VBO = 0;
+	GLuint _atlasTexture = 0;
+
+	/// <summary>
+	/// Quads of the current batch
+	/// </summary>
+	std::vector<TextVertex> _vertices;
+	/// <summary>
+	/// Number of vertices the VBO can hold
+	/// </summary>
+	size_t _vboCapacity = 0;
+	bool _batching = false;
 
 	void GenerateBuffers();
 	void SetupCharacters(FT_Face font);
+	void Flush();
 public:
+	NO_COPY_AND_ASSIGN(TextRenderer);
+
 	TextRenderer();
 	~TextRenderer();
 
-	void RenderText(const std::string& text, float x, float y, float scale, const glm::vec3& color);
+	/// <summary>
+	/// Starts collecting the text quads. All the text added until EndBatch() is drawn with a single draw call
+	/// </summary>
+	void BeginBatch();
+	/// <summary>
+	/// Draws all the text added after BeginBatch()
+	/// </summary>
+	void EndBatch();
+
+	/// <summary>
+	/// Adds a text line to the current batch. Outside a batch the line is drawn immediately
+	/// </summary>
+	void RenderText(const char* text, float x, float y, float scale, const glm::vec3& color);
+	void RenderText(const std::string& text, float x, float y, float scale, const glm::vec3& color) {
+		RenderText(text.c_str(), x, y, scale, color);
+	}
 };
 
 TextRenderer::TextRenderer() : _shader("shaders/text.vert", "shaders/text.frag")
@@ -56,7 +108,9 @@ TextRenderer::TextRenderer() : _shader("shaders/text.vert", "shaders/text.frag")
 
 TextRenderer::~TextRenderer()
 {
-
+	glDeleteTextures(1, &_atlasTexture);
+	glDeleteBuffers(1, &VBO);
+	glDeleteVertexArrays(1, &VAO);
 }
 
 void TextRenderer::GenerateBuffers()
@@ -65,98 +119,155 @@ void TextRenderer::GenerateBuffers()
 	glGenBuffers(1, &VBO);
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+	// The buffer storage is allocated by the first flush
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)offsetof(TextVertex, PositionUv));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)offsetof(TextVertex, Color));
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
 
 void TextRenderer::SetupCharacters(FT_Face font)
 {
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
-
-	for (unsigned char c = 0; c < 128; c++)
+	// We render all the glyphs first, so we know the atlas size before the packing
+	std::vector<unsigned char> bitmaps[CharactersCount];
+	for (unsigned char c = 0; c < CharactersCount; c++)
 	{
-		// load character glyph 
+		// load character glyph
 		if (FT_Error err = FT_Load_Char(font, c, FT_LOAD_RENDER))
 		{
 			std::cout << "ERROR::FREETYTPE: Failed to load Glyph " << c <<":" << err << std::endl;
 			continue;
 		}
-		// generate texture
-		unsigned int texture;
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_RED,
-			font->glyph->bitmap.width,
-			font->glyph->bitmap.rows,
-			0,
-			GL_RED,
-			GL_UNSIGNED_BYTE,
-			font->glyph->bitmap.buffer
-		);
-		// set texture options
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		// now store character for later use
-		Character character = {
-			texture,
-			glm::ivec2(font->glyph->bitmap.width, font->glyph->bitmap.rows),
-			glm::ivec2(font->glyph->bitmap_left, font->glyph->bitmap_top),
-			(unsigned int) font->glyph->advance.x
-		};
-		Characters.insert(std::pair<char, Character>(c, character));
+
+		const FT_Bitmap& bitmap = font->glyph->bitmap;
+		Character& character = _characters[c];
+		character.Size = glm::ivec2(bitmap.width, bitmap.rows);
+		character.Bearing = glm::ivec2(font->glyph->bitmap_left, font->glyph->bitmap_top);
+		character.Advance = (unsigned int)font->glyph->advance.x;
+
+		// The FreeType rows may be padded, we store them packed
+		bitmaps[c].resize(bitmap.width * bitmap.rows);
+		for (unsigned int row = 0; row < bitmap.rows; row++)
+		{
+			memcpy(bitmaps[c].data() + row * bitmap.width, bitmap.buffer + row * bitmap.pitch, bitmap.width);
+		}
 	}
+
+	// Shelf packing: glyphs are placed left to right and a new row starts when the current one is full
+	glm::ivec2 atlasPositions[CharactersCount];
+	int x = AtlasPadding, y = AtlasPadding, rowHeight = 0;
+	for (int c = 0; c < CharactersCount; c++)
+	{
+		const glm::ivec2& size = _characters[c].Size;
+		if (x + size.x + AtlasPadding > AtlasWidth) {
+			x = AtlasPadding;
+			y += rowHeight + AtlasPadding;
+			rowHeight = 0;
+		}
+		atlasPositions[c] = glm::ivec2(x, y);
+		x += size.x + AtlasPadding;
+		rowHeight = std::max(rowHeight, size.y);
+	}
+
+	int atlasHeight = 1;
+	while (atlasHeight < y + rowHeight + AtlasPadding) atlasHeight <<= 1;
+
+	std::vector<unsigned char> atlas(AtlasWidth * atlasHeight, 0);
+	for (int c = 0; c < CharactersCount; c++)
+	{
+		Character& character = _characters[c];
+		const glm::ivec2& position = atlasPositions[c];
+		for (int row = 0; row < character.Size.y; row++)
+		{
+			memcpy(atlas.data() + (position.y + row) * AtlasWidth + position.x, bitmaps[c].data() + row * character.Size.x, character.Size.x);
+		}
+		character.UvMin = glm::vec2(position) / glm::vec2(AtlasWidth, atlasHeight);
+		character.UvMax = glm::vec2(position + character.Size) / glm::vec2(AtlasWidth, atlasHeight);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
+	glGenTextures(1, &_atlasTexture);
+	glBindTexture(GL_TEXTURE_2D, _atlasTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, AtlasWidth, atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+	// set texture options
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void TextRenderer::RenderText(const std::string& text, float x, float y, float scale, const glm::vec3& color)
+void TextRenderer::BeginBatch()
 {
-	// activate corresponding render state	
-	_shader.Use();
+	_vertices.clear();
+	_batching = true;
+}
 
-	glUniformMatrix4fv(glGetUniformLocation(_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(_projection));
-	glUniform3f(glGetUniformLocation(_shader.Program, "textColor"), color.x, color.y, color.z);
+void TextRenderer::EndBatch()
+{
+	_batching = false;
+	Flush();
+}
+
+void TextRenderer::Flush()
+{
+	if (_vertices.empty() || VAO == 0) return;
+
+	// activate corresponding render state
+	_shader.Use();
+	_shader.SetUniform("projectionMatrix", _projection);
 	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, _atlasTexture);
 	glBindVertexArray(VAO);
 
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	if (_vertices.size() > _vboCapacity) {
+		// The buffer only grows: the overlay has almost the same length every frame
+		_vboCapacity = _vertices.capacity();
+		glBufferData(GL_ARRAY_BUFFER, sizeof(TextVertex) * _vboCapacity, NULL, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(TextVertex) * _vertices.size(), _vertices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)_vertices.size());
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	_vertices.clear();
+}
+
+void TextRenderer::RenderText(const char* text, float x, float y, float scale, const glm::vec3& color)
+{
 	// iterate through all characters
-	std::string::const_iterator c;
-	for (c = text.begin(); c != text.end(); c++)
+	for (const char* c = text; *c != '\0'; c++)
 	{
-		Character ch = Characters[*c];
+		unsigned char code = (unsigned char)*c;
+		if (code >= CharactersCount) continue;
+		const Character& ch = _characters[code];
 
 		float xpos = x + ch.Bearing.x * scale;
 		float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
 
 		float w = ch.Size.x * scale;
 		float h = ch.Size.y * scale;
-		// update VBO for each character
-		float vertices[6][4] = {
-			{ xpos,     ypos + h,   0.0f, 0.0f },
-			{ xpos,     ypos,       0.0f, 1.0f },
-			{ xpos + w, ypos,       1.0f, 1.0f },
-
-			{ xpos,     ypos + h,   0.0f, 0.0f },
-			{ xpos + w, ypos,       1.0f, 1.0f },
-			{ xpos + w, ypos + h,   1.0f, 0.0f }
-		};
-		// render glyph texture over quad
-		glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-		// update content of VBO memory
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		// render quad
-		glDrawArrays(GL_TRIANGLES, 0, 6);
 		// now advance cursors for next glyph (note that advance is number of 1/64 pixels)
 		x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
+		// Spaces and control characters have nothing to draw
+		if (ch.Size.x == 0 || ch.Size.y == 0) continue;
+
+		const TextVertex quad[6] = {
+			{ glm::vec4(xpos,     ypos + h, ch.UvMin.x, ch.UvMin.y), color },
+			{ glm::vec4(xpos,     ypos,     ch.UvMin.x, ch.UvMax.y), color },
+			{ glm::vec4(xpos + w, ypos,     ch.UvMax.x, ch.UvMax.y), color },
+
+			{ glm::vec4(xpos,     ypos + h, ch.UvMin.x, ch.UvMin.y), color },
+			{ glm::vec4(xpos + w, ypos,     ch.UvMax.x, ch.UvMax.y), color },
+			{ glm::vec4(xpos + w, ypos + h, ch.UvMax.x, ch.UvMin.y), color }
+		};
+		_vertices.insert(_vertices.end(), quad, quad + 6);
 	}
-	glBindVertexArray(0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if (!_batching) Flush();
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <std_include.h>
+#include <assets/AssetCache.hpp>
 #include <irradiancegrid/Grid.hpp>
 #include <BCube.hpp>
 
@@ -10,20 +11,18 @@
 class TrilinearSphere : public SceneObject
 {
 private:
-	Model _sphere;
+	std::shared_ptr<Model> _sphere;
 	BCube _boundingCube;
 	BCube _transformedBoundingCube;
 	bool _debugColor = false;
-	glm::mat3 _normalMatrix;
 protected:
 	virtual void OnTransformChanged() override{
 		_transformedBoundingCube = _boundingCube >> GetTransform();
-		_normalMatrix = glm::inverseTranspose(glm::mat3(GetTransform().Matrix()));
 	}
 
 public:
-	TrilinearSphere() : SceneObject(Shader("shaders/trilinear.vert", "shaders/trilinear.frag")), _sphere("models/sphere.obj"), _normalMatrix(glm::mat3(1.0f)) {
-		_boundingCube = BCube::FromMeshes(_sphere.meshes.cbegin(), _sphere.meshes.cend());
+	TrilinearSphere() : SceneObject(Shader("shaders/trilinear.vert", "shaders/trilinear.frag")), _sphere(AssetCache::Instance.GetModel("models/sphere.obj")) {
+		_boundingCube = BCube::FromMeshes(_sphere->meshes.cbegin(), _sphere->meshes.cend());
 
 		SetPosition(glm::vec3(-0.75f));
 		SetScale(glm::vec3(0.30));
@@ -43,14 +42,14 @@ public:
 
 	void SetDebugColor(bool value) { _debugColor = value; }
 
-	virtual void Draw() override
+	virtual void Draw(RenderQueue& queue) override
 	{
-		_shader.Use();
+		queue.Begin(_shader, 0);
 		const TransformParams& sphereTransform = GetTransform();
-		_shader.SetUniform("modelMatrix", sphereTransform.Matrix());
-		_shader.SetUniform("normalMatrix", _normalMatrix);
-		_shader.SetUniform("debugColor", (int)_debugColor);
+		queue.SetUniform("modelMatrix", sphereTransform.Matrix());
+		queue.SetUniform("normalMatrix", sphereTransform.NormalMatrix());
+		queue.SetUniform("debugColor", (int)_debugColor);
 
-		_sphere.Draw();
+		queue.DrawModel(*_sphere);
 	}
 };
\ No newline at end of file
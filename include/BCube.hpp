@@ -3,7 +3,9 @@
 #include <std_include.h>
 #include <Transform.hpp>
 #include <cmath>
+#ifndef HEADLESS
 #include <dbg/DbgLine.hpp>
+#endif
 
 struct BCube {
 
@@ -33,6 +35,7 @@ public:
 	}
 
 	/* Static section */
+#ifndef HEADLESS
 private:
 	static void UpdateMinMax(const Mesh& mesh, glm::vec3& minValues, glm::vec3& maxValues) {
 		for (const Vertex& vertex : mesh.vertices)
@@ -45,37 +48,30 @@ private:
 			if (vertex.Position.z > maxValues.z) maxValues.z = vertex.Position.z;
 		}
 	}
+#endif
 public:
 	static BCube FromMinMax(const glm::vec3& minV, const glm::vec3& maxV) {
 		return BCube(minV, maxV);
 	}
 
+#ifndef HEADLESS
+	/// <summary>
+	/// Bounds of the meshes in the model space
+	/// </summary>
+	/// <remarks>
+	/// The rotation is handled by the transform (see the BCube transform operator), so the bounds are not enlarged
+	/// </remarks>
 	template<class Iterator>
-	static BCube FromMeshes(const Iterator& begin, const Iterator& end) {
-		return FromMeshes(begin, end, false);
-	}
-
-	template<class Iterator>
-	static BCube FromMeshes(const Iterator& begin, const Iterator& end, bool considerRotation)
+	static BCube FromMeshes(const Iterator& begin, const Iterator& end)
 	{
 		glm::vec3 minValues = glm::vec3(std::numeric_limits<float>::max());
-		glm::vec3 maxValues = glm::vec3(std::numeric_limits<float>::min());
+		glm::vec3 maxValues = glm::vec3(-std::numeric_limits<float>::max());
 
 		for (Iterator it = begin; it != end; ++it)
 		{
 			const Mesh& mesh = *it;
 			UpdateMinMax(mesh, minValues, maxValues);
 		}
-
-		if (considerRotation)
-		{
-			// We get the absolute min and max and multiply them by sqrt(2) as they
-			// where 45 rotated to obtain a sligth larger AABB that should support all y rotations
-			// An OBB should be used though
-
-			minValues = glm::vec3(min(min(minValues.x, minValues.y), minValues.z)) * sqrt(2.0f);
-			maxValues = glm::vec3(max(max(maxValues.x, maxValues.y), maxValues.z)) * sqrt(2.0f);
-		}	
 		return BCube(minValues, maxValues);
 	}
 
@@ -96,10 +92,37 @@ public:
 		line.Draw(glm::vec3(cube.Max.x, cube.Max.y, cube.Min.z), glm::vec3(cube.Max.x, cube.Min.y, cube.Min.z));
 		line.Draw(glm::vec3(cube.Max.x, cube.Max.y, cube.Min.z), glm::vec3(cube.Min.x, cube.Max.y, cube.Min.z));
 	}
+#endif
 };
 
+/// <summary>
+/// Axis aligned bounds of the transformed cube (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+/// </summary>
+/// <remarks>
+/// Each column of the matrix is scaled by the min and the max of its coordinate: the smaller products go in
+/// the new min and the larger in the new max. The result is the bounds of the 8 transformed corners,
+/// so it' s exact for the rotations and the negative scales
+/// </remarks>
+BCube operator>>(const BCube& cube, const glm::mat4& matrix)
+{
+	__m128 resultMin = _mm_loadu_ps(&matrix[3][0]);
+	__m128 resultMax = resultMin;
+	for (int i = 0; i < 3; i++)
+	{
+		const __m128 column = _mm_loadu_ps(&matrix[i][0]);
+		const __m128 a = _mm_mul_ps(column, _mm_set1_ps(cube.Min[i]));
+		const __m128 b = _mm_mul_ps(column, _mm_set1_ps(cube.Max[i]));
+		resultMin = _mm_add_ps(resultMin, _mm_min_ps(a, b));
+		resultMax = _mm_add_ps(resultMax, _mm_max_ps(a, b));
+	}
+
+	alignas(16) float minValues[4], maxValues[4];
+	_mm_store_ps(minValues, resultMin);
+	_mm_store_ps(maxValues, resultMax);
+	return BCube::FromMinMax(glm::vec3(minValues[0], minValues[1], minValues[2]), glm::vec3(maxValues[0], maxValues[1], maxValues[2]));
+}
+
 BCube operator>>(const BCube& cube, const TransformParams& p)
 {
-	glm::mat4 matrix = p.AAMatrix();
-	return BCube::FromMinMax(cube.Min >> matrix, cube.Max >> matrix);
+	return cube >> p.Matrix();
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <std_include.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <immintrin.h>
+
+#include <Transform.hpp>
+#include <BCube.hpp>
+
+/// <summary>
+/// Convex hull of a model in the XZ plane, extruded between the model min and max Y
+/// </summary>
+/// <remarks>
+/// The scene objects rotate only around the Y axis, so the transformed prism has the same bounds of the
+/// transformed model: the bounds follow the real extent of the object at every angle, while the transformed
+/// AABB of the model grows up to sqrt(2) times at 45 degrees.
+/// The hull has far less points than the model, so it' s cheap enough to be transformed at every move
+/// </remarks>
+class BoundingHull {
+private:
+	/// <summary>
+	/// Hull points (x, z) in counter-clockwise order
+	/// </summary>
+	std::vector<glm::vec2> _points;
+	float _minY = 0.0f;
+	float _maxY = 0.0f;
+
+	static float Cross(const glm::vec2& o, const glm::vec2& a, const glm::vec2& b) {
+		return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+	}
+
+public:
+	/// <summary>
+	/// Builds the hull with the monotone chain algorithm
+	/// </summary>
+	static BoundingHull FromPoints(const std::vector<glm::vec3>& points) {
+		BoundingHull hull;
+		if (points.empty()) return hull;
+
+		std::vector<glm::vec2> planePoints;
+		planePoints.reserve(points.size());
+		hull._minY = std::numeric_limits<float>::max();
+		hull._maxY = -std::numeric_limits<float>::max();
+		for (const glm::vec3& point : points)
+		{
+			planePoints.push_back(glm::vec2(point.x, point.z));
+			hull._minY = std::min(hull._minY, point.y);
+			hull._maxY = std::max(hull._maxY, point.y);
+		}
+		std::sort(planePoints.begin(), planePoints.end(), [](const glm::vec2& a, const glm::vec2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+		planePoints.erase(std::unique(planePoints.begin(), planePoints.end()), planePoints.end());
+		if (planePoints.size() < 3) {
+			hull._points = planePoints;
+			return hull;
+		}
+
+		// Lower and upper chains. The last point of each chain is the first of the other one
+		std::vector<glm::vec2>& result = hull._points;
+		result.resize(planePoints.size() * 2);
+		size_t count = 0;
+		for (size_t i = 0; i < planePoints.size(); i++)
+		{
+			while (count >= 2 && Cross(result[count - 2], result[count - 1], planePoints[i]) <= 0.0f) count--;
+			result[count++] = planePoints[i];
+		}
+		for (size_t i = planePoints.size() - 1, lowerCount = count + 1; i > 0; i--)
+		{
+			while (count >= lowerCount && Cross(result[count - 2], result[count - 1], planePoints[i - 1]) <= 0.0f) count--;
+			result[count++] = planePoints[i - 1];
+		}
+		result.resize(count - 1);
+		return hull;
+	}
+
+#ifndef HEADLESS
+	template<class Iterator>
+	static BoundingHull FromMeshes(const Iterator& begin, const Iterator& end) {
+		std::vector<glm::vec3> points;
+		for (Iterator it = begin; it != end; ++it)
+		{
+			const Mesh& mesh = *it;
+			for (const Vertex& vertex : mesh.vertices) points.push_back(vertex.Position);
+		}
+		return FromPoints(points);
+	}
+#endif
+
+	size_t PointsCount() const { return _points.size(); }
+
+	/// <summary>
+	/// Axis aligned bounds of the transformed hull
+	/// </summary>
+	/// <remarks>
+	/// The Y column contributes the same term to every point (Arvo), while the X and Z columns are
+	/// accumulated for each hull point
+	/// </remarks>
+	BCube Transform(const glm::mat4& matrix) const;
+
+	BCube Transform(const TransformParams& transform) const {
+		return Transform(transform.Matrix());
+	}
+};
+
+BCube BoundingHull::Transform(const glm::mat4& matrix) const {
+	if (_points.empty()) return BCube::FromMinMax(glm::vec3(matrix[3]), glm::vec3(matrix[3]));
+
+	const __m128 columnX = _mm_loadu_ps(&matrix[0][0]);
+	const __m128 columnZ = _mm_loadu_ps(&matrix[2][0]);
+	__m128 pointsMin = _mm_set1_ps(std::numeric_limits<float>::max());
+	__m128 pointsMax = _mm_set1_ps(-std::numeric_limits<float>::max());
+	for (const glm::vec2& point : _points)
+	{
+		const __m128 transformed = _mm_add_ps(_mm_mul_ps(columnX, _mm_set1_ps(point.x)), _mm_mul_ps(columnZ, _mm_set1_ps(point.y)));
+		pointsMin = _mm_min_ps(pointsMin, transformed);
+		pointsMax = _mm_max_ps(pointsMax, transformed);
+	}
+
+	const __m128 columnY = _mm_loadu_ps(&matrix[1][0]);
+	const __m128 a = _mm_mul_ps(columnY, _mm_set1_ps(_minY));
+	const __m128 b = _mm_mul_ps(columnY, _mm_set1_ps(_maxY));
+	const __m128 translation = _mm_loadu_ps(&matrix[3][0]);
+
+	alignas(16) float minValues[4], maxValues[4];
+	_mm_store_ps(minValues, _mm_add_ps(_mm_add_ps(translation, _mm_min_ps(a, b)), pointsMin));
+	_mm_store_ps(maxValues, _mm_add_ps(_mm_add_ps(translation, _mm_max_ps(a, b)), pointsMax));
+	return BCube::FromMinMax(glm::vec3(minValues[0], minValues[1], minValues[2]), glm::vec3(maxValues[0], maxValues[1], maxValues[2]));
+}
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <core_include.h>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <SemisphereMap.hpp>
+#include <OctahedralMap.hpp>
+
+/// <summary>
+/// Available sampling direction generators
+/// </summary>
+enum class DirectionSetType : int {
+	/// <summary>
+	/// Shirley-Chiu concentric mapping on a regular grid, mirrored on the two hemispheres
+	/// </summary>
+	Concentric = 0,
+	SphericalFibonacci,
+	Hammersley,
+	/// <summary>
+	/// Cosine-weighted (around the Y axis) stratified set, mirrored on the two hemispheres
+	/// </summary>
+	CosineStratified,
+	/// <summary>
+	/// Octahedral mapping of the entire sphere on a single square
+	/// </summary>
+	Octahedral,
+	Count
+};
+
+/// <summary>
+/// Order of the samples of a probe, as read by the shaders to find the sample of a direction
+/// </summary>
+enum class DirectionLayout : int {
+	/// <summary>
+	/// Concentric map of the upper hemisphere followed by the mirrored lower one. Indexed with SemisphereToPoint()
+	/// </summary>
+	Concentric = 0,
+	/// <summary>
+	/// Single octahedral map of the sphere. Indexed with DirectionToOctahedral()
+	/// </summary>
+	Octahedral = 1,
+	/// <summary>
+	/// No spatial order: the nearest sample is read from a lookup table indexed like the concentric layout
+	/// </summary>
+	Lookup = 2
+};
+
+/// <summary>
+/// Resolution (per hemisphere side) of the direction lookup table used by the shaders for the non concentric sets
+/// </summary>
+/// <remarks>
+/// The table is indexed with the same concentric inverse mapping used for the native layout. 32 keeps the
+/// debug round-trip checks of the mapping functions valid
+/// </remarks>
+const int DirectionLookupResolution = 32;
+
+/// <summary>
+/// Generator of a set of sampling directions over the unit sphere
+/// </summary>
+/// <remarks>
+/// Every direction carries the solid angle it represents: the irradiance convolution is a weighted sum,
+/// so the sets do not need to be uniform. The weights always sum to 4 PI
+/// </remarks>
+class DirectionSet
+{
+public:
+	virtual ~DirectionSet() {
+	}
+
+	virtual DirectionSetType GetType() const = 0;
+	virtual const char* GetName() const = 0;
+
+	/// <summary>
+	/// Generates the GetSamplesCount() directions of the set with their solid angle weights
+	/// </summary>
+	virtual void Generate(int resolution, std::vector<glm::vec3>& directions, std::vector<float>& weights) const = 0;
+
+	/// <summary>
+	/// Number of directions generated for a sampler resolution
+	/// </summary>
+	virtual int GetSamplesCount(int resolution) const { return resolution * resolution * 2; }
+
+	/// <summary>
+	/// Storage order of the directions
+	/// </summary>
+	virtual DirectionLayout GetLayout() const { return DirectionLayout::Lookup; }
+
+	static std::unique_ptr<DirectionSet> Create(DirectionSetType type);
+
+	static const char* GetTypeName(DirectionSetType type) {
+		static const char* names[(int)DirectionSetType::Count] = { "concentric", "fibonacci", "hammersley", "cosine", "octahedral" };
+		return names[(int)type];
+	}
+
+	/// <summary>
+	/// Parses a set name (as returned by GetTypeName())
+	/// </summary>
+	static DirectionSetType ParseType(const std::string& name) {
+		for (int i = 0; i < (int)DirectionSetType::Count; i++) {
+			if (name == GetTypeName((DirectionSetType)i)) return (DirectionSetType)i;
+		}
+		throw std::runtime_error("Unknown direction set " + name);
+	}
+};
+
+/// <summary>
+/// Original concentric set. Each cell of the grid has the same area, so the same solid angle
+/// </summary>
+class ConcentricDirectionSet : public DirectionSet
+{
+public:
+	virtual DirectionSetType GetType() const override { return DirectionSetType::Concentric; }
+	virtual const char* GetName() const override { return "Concentric"; }
+	virtual DirectionLayout GetLayout() const override { return DirectionLayout::Concentric; }
+
+	virtual void Generate(int resolution, std::vector<glm::vec3>& directions, std::vector<float>& weights) const override {
+		const float cellSegmentSize = 1.0f / ((float)resolution);
+		const float cellHalf = cellSegmentSize / 2.0f;
+		const int hemisphereCount = resolution * resolution;
+
+		directions.resize(hemisphereCount * 2);
+		for (int col = 0; col < resolution; col++)
+		{
+			for (int row = 0; row < resolution; row++)
+			{
+				// We move our sampling point to the center of the cell
+				int i = col * resolution + row;
+				glm::vec3 point = PointToSemisphere(glm::vec2(col, row) * cellSegmentSize + cellHalf);
+
+				// We save the sampling point and the negative-y sampling point
+				directions[i] = point;
+				directions[i + hemisphereCount] = glm::vec3(point.x, -point.y, point.z);
+			}
+		}
+		weights.assign(directions.size(), 4.0f * (float)M_PI / directions.size());
+	}
+};
+
+/// <summary>
+/// Spherical Fibonacci points: an almost uniform set over the entire sphere
+/// </summary>
+class SphericalFibonacciDirectionSet : public DirectionSet
+{
+public:
+	virtual DirectionSetType GetType() const override { return DirectionSetType::SphericalFibonacci; }
+	virtual const char* GetName() const override { return "Fibonacci"; }
+
+	virtual void Generate(int resolution, std::vector<glm::vec3>& directions, std::vector<float>& weights) const override {
+		const int count = resolution * resolution * 2;
+		const double goldenRatio = (1.0 + std::sqrt(5.0)) / 2.0;
+
+		directions.resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			double y = 1.0 - (2.0 * i + 1.0) / count;
+			double radius = std::sqrt(std::max(0.0, 1.0 - y * y));
+			double phi = 2.0 * M_PI * (i / goldenRatio - std::floor(i / goldenRatio));
+			directions[i] = glm::vec3(radius * std::cos(phi), y, radius * std::sin(phi));
+		}
+		weights.assign(count, 4.0f * (float)M_PI / count);
+	}
+};
+
+/// <summary>
+/// Hammersley points mapped uniformly over the entire sphere
+/// </summary>
+class HammersleyDirectionSet : public DirectionSet
+{
+private:
+	static float RadicalInverse(uint32_t bits) {
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return (float)(bits * 2.3283064365386963e-10);
+	}
+
+public:
+	virtual DirectionSetType GetType() const override { return DirectionSetType::Hammersley; }
+	virtual const char* GetName() const override { return "Hammersley"; }
+
+	virtual void Generate(int resolution, std::vector<glm::vec3>& directions, std::vector<float>& weights) const override {
+		const int count = resolution * resolution * 2;
+
+		directions.resize(count);
+		for (int i = 0; i < count; i++)
+		{
+			float y = 1.0f - 2.0f * ((i + 0.5f) / count);
+			float radius = std::sqrt(std::max(0.0f, 1.0f - y * y));
+			float phi = 2.0f * (float)M_PI * RadicalInverse(i);
+			directions[i] = glm::vec3(radius * std::cos(phi), y, radius * std::sin(phi));
+		}
+		weights.assign(count, 4.0f * (float)M_PI / count);
+	}
+};
+
+/// <summary>
+/// Cosine-weighted stratified set: concentric disk strata projected on the hemisphere (Malley's method)
+/// </summary>
+/// <remarks>
+/// The directions are denser around the Y axis. Each stratum has the same area on the disk, its solid angle is the
+/// integral of 1 / cos(theta) over that area. The integral is estimated with a sub-grid of points because 1 / cos(theta)
+/// at the stratum center badly underestimates the strata near the horizon. The weights are then normalized to sum
+/// exactly 2 PI for each hemisphere
+/// </remarks>
+class CosineStratifiedDirectionSet : public DirectionSet
+{
+private:
+	/// <summary>
+	/// Sub-samples per stratum side used to integrate the stratum solid angle
+	/// </summary>
+	static const int SolidAngleSubSamples = 16;
+
+	/// <summary>
+	/// Shirley-Chiu concentric mapping from the unit square to the unit disk
+	/// </summary>
+	static glm::vec2 SquareToDisk(const glm::vec2& point) {
+		glm::vec2 offset = point * 2.0f - 1.0f;
+		if (offset.x == 0.0f && offset.y == 0.0f) return glm::vec2(0.0f);
+
+		float radius, theta;
+		if (std::abs(offset.x) > std::abs(offset.y)) {
+			radius = offset.x;
+			theta = (float)M_PI_4 * (offset.y / offset.x);
+		}
+		else {
+			radius = offset.y;
+			theta = (float)M_PI_2 - (float)M_PI_4 * (offset.x / offset.y);
+		}
+		return radius * glm::vec2(std::cos(theta), std::sin(theta));
+	}
+
+public:
+	virtual DirectionSetType GetType() const override { return DirectionSetType::CosineStratified; }
+	virtual const char* GetName() const override { return "Cosine"; }
+
+	virtual void Generate(int resolution, std::vector<glm::vec3>& directions, std::vector<float>& weights) const override {
+		const int hemisphereCount = resolution * resolution;
+
+		directions.resize(hemisphereCount * 2);
+		weights.resize(hemisphereCount * 2);
+		double weightsSum = 0.0;
+		for (int col = 0; col < resolution; col++)
+		{
+			for (int row = 0; row < resolution; row++)
+			{
+				int i = col * resolution + row;
+				glm::vec2 disk = SquareToDisk((glm::vec2(col, row) + 0.5f) / (float)resolution);
+				// The stratum centers are never on the disk border, so cos(theta) is always > 0
+				float cosTheta = std::sqrt(std::max(0.0f, 1.0f - glm::dot(disk, disk)));
+				assert(cosTheta > 0.0f);
+
+				directions[i] = glm::vec3(disk.x, cosTheta, disk.y);
+				directions[i + hemisphereCount] = glm::vec3(disk.x, -cosTheta, disk.y);
+
+				// Same equal-area mapping for the sub-samples, so each one covers the same disk area
+				double inverseCosSum = 0.0;
+				for (int subCol = 0; subCol < SolidAngleSubSamples; subCol++)
+				{
+					for (int subRow = 0; subRow < SolidAngleSubSamples; subRow++)
+					{
+						glm::vec2 subPoint = glm::vec2(col, row) + (glm::vec2(subCol, subRow) + 0.5f) / (float)SolidAngleSubSamples;
+						glm::vec2 subDisk = SquareToDisk(subPoint / (float)resolution);
+						inverseCosSum += 1.0 / std::sqrt(std::max(1e-6, 1.0 - (double)glm::dot(subDisk, subDisk)));
+					}
+				}
+				weights[i] = (float)(M_PI / hemisphereCount * inverseCosSum / (SolidAngleSubSamples * SolidAngleSubSamples));
+				weightsSum += weights[i];
+			}
+		}
+
+		const float normalization = (float)(2.0 * M_PI / weightsSum);
+		for (int i = 0; i < hemisphereCount; i++)
+		{
+			weights[i] *= normalization;
+			weights[i + hemisphereCount] = weights[i];
+		}
+	}
+};
+
+/// <summary>
+/// Texels centers of an octahedral map. The texels do not have the same solid angle: it' s integrated
+/// on a sub-grid of each texel and normalized to sum exactly 4 PI
+/// </summary>
+/// <remarks>
+/// The map side is resolution * sqrt(2), so the samples count is about the same of the concentric set
+/// </remarks>
+class OctahedralDirectionSet : public DirectionSet
+{
+private:
+	/// <summary>
+	/// Sub-samples per texel side used to integrate the texel solid angle
+	/// </summary>
+	static const int SolidAngleSubSamples = 8;
+
+public:
+	static int GetSide(int resolution) { return std::max(1, (int)std::lround(resolution * M_SQRT2)); }
+
+	virtual DirectionSetType GetType() const override { return DirectionSetType::Octahedral; }
+	virtual const char* GetName() const override { return "Octahedral"; }
+	virtual DirectionLayout GetLayout() const override { return DirectionLayout::Octahedral; }
+	virtual int GetSamplesCount(int resolution) const override { return GetSide(resolution) * GetSide(resolution); }
+
+	virtual void Generate(int resolution, std::vector<glm::vec3>& directions, std::vector<float>& weights) const override {
+		const int side = GetSide(resolution);
+		const float texelSize = 1.0f / side;
+
+		directions.resize(side * side);
+		weights.resize(side * side);
+		double weightsSum = 0.0;
+		for (int col = 0; col < side; col++)
+		{
+			for (int row = 0; row < side; row++)
+			{
+				// Same storage index of the shader lookup: x * side + y
+				int i = col * side + row;
+				directions[i] = OctahedralToDirection((glm::vec2(col, row) + 0.5f) * texelSize);
+
+				double density = 0.0;
+				for (int subCol = 0; subCol < SolidAngleSubSamples; subCol++)
+				{
+					for (int subRow = 0; subRow < SolidAngleSubSamples; subRow++)
+					{
+						glm::vec2 subPoint = glm::vec2(col, row) + (glm::vec2(subCol, subRow) + 0.5f) / (float)SolidAngleSubSamples;
+						density += OctahedralSolidAngleDensity(subPoint * texelSize);
+					}
+				}
+				weights[i] = (float)(density / (SolidAngleSubSamples * SolidAngleSubSamples) * texelSize * texelSize);
+				weightsSum += weights[i];
+			}
+		}
+
+		const float normalization = (float)(4.0 * M_PI / weightsSum);
+		for (float& weight : weights) weight *= normalization;
+	}
+};
+
+std::unique_ptr<DirectionSet> DirectionSet::Create(DirectionSetType type) {
+	switch (type)
+	{
+	case DirectionSetType::Concentric: return std::make_unique<ConcentricDirectionSet>();
+	case DirectionSetType::SphericalFibonacci: return std::make_unique<SphericalFibonacciDirectionSet>();
+	case DirectionSetType::Hammersley: return std::make_unique<HammersleyDirectionSet>();
+	case DirectionSetType::CosineStratified: return std::make_unique<CosineStratifiedDirectionSet>();
+	case DirectionSetType::Octahedral: return std::make_unique<OctahedralDirectionSet>();
+	default: throw std::out_of_range("Invalid direction set type");
+	}
+}
+
+/// <summary>
+/// Builds the directions descriptor read by the shaders: the layout and, for the sets without a spatial order,
+/// the table that maps a direction to the index of the nearest direction of the set
+/// </summary>
+/// <remarks>
+/// Layout (as read by the shaders): [layout][lookupResolution][upper hemisphere cells][lower hemisphere cells].
+/// A cell is addressed like the concentric samples: hemisphereOffset + x * lookupResolution + y.
+/// The concentric and octahedral layouts do not need the table, so they have a zero lookup resolution
+/// </remarks>
+std::vector<int> BuildDirectionLookup(const DirectionSet& directionSet, const std::vector<glm::vec3>& directions, int lookupResolution = DirectionLookupResolution) {
+	if (directionSet.GetLayout() != DirectionLayout::Lookup) return { (int)directionSet.GetLayout(), 0 };
+
+	const int hemisphereCells = lookupResolution * lookupResolution;
+	std::vector<int> lookup(2 + hemisphereCells * 2);
+	lookup[0] = (int)DirectionLayout::Lookup;
+	lookup[1] = lookupResolution;
+
+	for (int x = 0; x < lookupResolution; x++)
+	{
+		for (int y = 0; y < lookupResolution; y++)
+		{
+			glm::vec3 cellDirection = PointToSemisphere((glm::vec2(x, y) + 0.5f) / (float)lookupResolution);
+			for (int hemisphere = 0; hemisphere < 2; hemisphere++)
+			{
+				glm::vec3 direction = hemisphere == 0 ? cellDirection : glm::vec3(cellDirection.x, -cellDirection.y, cellDirection.z);
+
+				int nearest = 0;
+				float nearestDot = -2.0f;
+				for (int i = 0; i < (int)directions.size(); i++)
+				{
+					float dot = glm::dot(direction, directions[i]);
+					if (dot > nearestDot) {
+						nearestDot = dot;
+						nearest = i;
+					}
+				}
+				lookup[2 + hemisphere * hemisphereCells + x * lookupResolution + y] = nearest;
+			}
+		}
+	}
+	return lookup;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef _USE_MATH_DEFINES
+#define _USE_MATH_DEFINES
+#endif
+#include <math.h>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/*
+* Octahedral mapping of the unit sphere on the unit square
+*
+* The sphere is projected on the |x| + |y| + |z| = 1 octahedron. The upper (y >= 0) half is the inner
+* diamond of the square, the lower half is folded on the four corners. Neighbouring directions stay
+* neighbouring texels (also across the folds, with the mirrored borders)
+*
+* From: A Survey of Efficient Representations for Independent Unit Vectors (Cigolle et al., JCGT 2014)
+*/
+
+/// <summary>
+/// Maps a point of the unit square to a direction on the unit sphere
+/// </summary>
+glm::vec3 OctahedralToDirection(const glm::vec2& point) {
+	assert(point.x >= 0.0f && point.x <= 1.0f);
+	assert(point.y >= 0.0f && point.y <= 1.0f);
+
+	glm::vec2 square = point * 2.0f - 1.0f;
+	glm::vec3 direction(square.x, 1.0f - std::abs(square.x) - std::abs(square.y), square.y);
+
+	// Lower hemisphere: we unfold the corners
+	float fold = std::max(-direction.y, 0.0f);
+	direction.x += direction.x >= 0.0f ? -fold : fold;
+	direction.z += direction.z >= 0.0f ? -fold : fold;
+	return glm::normalize(direction);
+}
+
+/// <summary>
+/// Reverse function of OctahedralToDirection
+/// </summary>
+/// <remarks>Only abs/add operations, it' s the storage lookup of the octahedral layout in the shaders</remarks>
+glm::vec2 DirectionToOctahedral(const glm::vec3& direction) {
+	glm::vec3 octahedron = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+	glm::vec2 square(octahedron.x, octahedron.z);
+	if (octahedron.y < 0.0f) {
+		// Lower hemisphere: we fold the point on the corners
+		glm::vec2 signs(square.x >= 0.0f ? 1.0f : -1.0f, square.y >= 0.0f ? 1.0f : -1.0f);
+		square = (1.0f - glm::abs(glm::vec2(square.y, square.x))) * signs;
+	}
+	return square * 0.5f + 0.5f;
+}
+
+/// <summary>
+/// Solid angle density (dw / du dv) of the mapping at a point of the unit square
+/// </summary>
+/// <remarks>
+/// The square is mapped linearly on the octahedron faces, so the density is the solid angle subtended
+/// by a face area: 4 / |v|^3 with v the (not normalized) octahedron point
+/// </remarks>
+float OctahedralSolidAngleDensity(const glm::vec2& point) {
+	glm::vec2 square = point * 2.0f - 1.0f;
+	glm::vec3 octahedron(square.x, 1.0f - std::abs(square.x) - std::abs(square.y), square.y);
+	float fold = std::max(-octahedron.y, 0.0f);
+	octahedron.x += octahedron.x >= 0.0f ? -fold : fold;
+	octahedron.z += octahedron.z >= 0.0f ? -fold : fold;
+
+	float length = glm::length(octahedron);
+	return 4.0f / (length * length * length);
+}
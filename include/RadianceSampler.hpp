@@ -5,12 +5,154 @@
 #include <immintrin.h>
 #include <limits>
 #include <functional>
+#include <memory>
 
 #include <UnitHemisphereDirections.h>
 #include <pool/SimpleArrayPool.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
 
 #include <SceneObject.hpp>
+#include <scene/PrimitiveTable.hpp>
+#include <scene/SceneCompiler.hpp>
+#include <scene/RayQuery.hpp>
 
+/// <summary>
+/// Direction set resolutions of a sampler. Each probe is sampled with one of them (see Grid::SetAdaptiveSampling())
+/// </summary>
+enum class SamplingTier : int {
+	/// <summary>
+	/// Sampler resolution
+	/// </summary>
+	High = 0,
+	/// <summary>
+	/// Reduced resolution for the probes that are far from the viewer (see RadianceSampler::GetLowResolution())
+	/// </summary>
+	Low,
+	Count
+};
+
+/// <summary>
+/// Lowest resolution of the low sampling tier
+/// </summary>
+const int MinLowSamplingResolution = 3;
+
+/// <summary>
+/// Partial passes after which a probe convolves again the whole accumulated radiance, to drop the rounding drift of the incremental irradiance
+/// </summary>
+const int TemporalConvolutionResync = 64;
+
+/// <summary>
+/// Settings of a progressive sampling pass (see RadianceSampler::SampleProgressive())
+/// </summary>
+struct TemporalSampling {
+	/// <summary>
+	/// Number of passes needed to trace all the directions once: each pass traces one direction every Period
+	/// </summary>
+	int Period;
+	/// <summary>
+	/// Pass counter, it selects the traced subset of the directions
+	/// </summary>
+	int Frame;
+	/// <summary>
+	/// Weight of the new radiance in the exponential moving average
+	/// </summary>
+	float Blend;
+	/// <summary>
+	/// Jitters the traced directions inside their solid angle
+	/// </summary>
+	bool Jitter;
+};
+
+/// <summary>
+/// Radiance accumulated by the progressive sampling of a probe
+/// </summary>
+/// <remarks>
+/// The irradiance is not stored here: the passes read it back from the buffer written by the previous pass.
+/// The memory is reported as MetricBuffer::RadianceHistory
+/// </remarks>
+struct RadianceHistory {
+	/// <summary>
+	/// Radiance of each direction, already weighted by the direction solid angle
+	/// </summary>
+	std::vector<glm::vec4> Radiance;
+	/// <summary>
+	/// Directions the radiance was accumulated with (see RadianceSampler::GetDirectionsVersion())
+	/// </summary>
+	int DirectionsVersion = -1;
+	SamplingTier Tier = SamplingTier::High;
+	/// <summary>
+	/// Incremental passes since the last full convolution (see TemporalConvolutionResync)
+	/// </summary>
+	int PartialPasses = 0;
+	bool Valid = false;
+
+	RadianceHistory() {}
+	RadianceHistory(RadianceHistory&& other) noexcept : DirectionsVersion(other.DirectionsVersion), Tier(other.Tier),
+		PartialPasses(other.PartialPasses), Valid(other.Valid) {
+		Radiance.swap(other.Radiance);
+		other.Valid = false;
+	}
+	RadianceHistory& operator=(RadianceHistory&& other) noexcept {
+		if (this == &other) return *this;
+		Release();
+		Radiance.swap(other.Radiance);
+		DirectionsVersion = other.DirectionsVersion;
+		Tier = other.Tier;
+		PartialPasses = other.PartialPasses;
+		Valid = other.Valid;
+		other.Valid = false;
+		return *this;
+	}
+	// The memory is tracked by the metrics, so the history is only moved
+	RadianceHistory(const RadianceHistory&) = delete;
+	RadianceHistory& operator=(const RadianceHistory&) = delete;
+
+	~RadianceHistory() {
+		Metrics::Instance.AddBufferMemory(MetricBuffer::RadianceHistory, -GetByteSize());
+	}
+
+	int64_t GetByteSize() const { return (int64_t)(Radiance.capacity() * sizeof(glm::vec4)); }
+
+	/// <summary>
+	/// Resizes the accumulated radiance. The content is not valid anymore
+	/// </summary>
+	void Resize(int samplesCount) {
+		const int64_t previousBytes = GetByteSize();
+		Radiance.resize(samplesCount);
+		Radiance.shrink_to_fit();
+		Metrics::Instance.AddBufferMemory(MetricBuffer::RadianceHistory, GetByteSize() - previousBytes);
+		Valid = false;
+	}
+
+	/// <summary>
+	/// Fast reset: the next pass traces all the directions and replaces the accumulated radiance
+	/// </summary>
+	void Reset() { Valid = false; }
+	/// <summary>
+	/// Frees the accumulated radiance
+	/// </summary>
+	void Release() {
+		Metrics::Instance.AddBufferMemory(MetricBuffer::RadianceHistory, -GetByteSize());
+		std::vector<glm::vec4>().swap(Radiance);
+		Valid = false;
+	}
+};
+
+/// <summary>
+/// CPU query of the irradiance stored in the volumes, used by the secondary bounce of the sampling
+/// </summary>
+class IrradianceSource {
+public:
+	virtual ~IrradianceSource() {
+	}
+
+	/// <summary>
+	/// Returns the irradiance in a point for a surface normal
+	/// </summary>
+	/// <returns>False if no data is available in the point</returns>
+	virtual bool QueryIrradiance(const glm::vec3& point, const glm::vec3& normal, glm::vec3& irradiance) const = 0;
+};
 
 /// <summary>
 /// Component that samples the irradiance of a given scene context/part using a given resolution
@@ -28,12 +170,46 @@ private:
 	/// </summary>
 	UnitHemisphereDirections _directionsSampler;
 	/// <summary>
+	/// Directions of the low sampling tier
+	/// </summary>
+	UnitHemisphereDirections _lowDirectionsSampler;
+	/// <summary>
+	/// Direction lookup tables of the two tiers for the shaders (see GetDirectionLookup())
+	/// </summary>
+	std::vector<int> _directionLookup;
+	/// <summary>
 	/// Array pool that wll be used to avoid allocation at each sampling call
 	/// </summary>
+	/// <remarks>
+	/// The pooled arrays are initialized with the directions, so there is a pool for each tier
+	/// </remarks>
 	SimpleArrayPool<glm::vec4>* _directionRadianceArrayPool;
+	SimpleArrayPool<glm::vec4>* _lowDirectionRadianceArrayPool;
 	std::function<void(glm::vec4*)> _rentInitializer;
+	std::function<void(glm::vec4*)> _lowRentInitializer;
+	/// <summary>
+	/// Incremented at each directions change, to invalidate the radiance histories
+	/// </summary>
+	int _directionsVersion = 0;
 	const glm::vec4 _zeroVector = glm::vec4(0.0f);
 	vector<const SceneObject*> _samplingObjects;
+	/// <summary>
+	/// Flattened static geometry. It' s intersected before the sampling objects
+	/// </summary>
+	PrimitiveTable _staticPrimitives;
+	/// <summary>
+	/// Ray casting against the sampling objects
+	/// </summary>
+	std::unique_ptr<RayQueryBackend> _rayQuery;
+	/// <summary>
+	/// Irradiance of the previous updates, reflected by the hit surfaces. Null for the single bounce
+	/// </summary>
+	const IrradianceSource* _bounceSource = nullptr;
+
+	/// <summary>
+	/// Directions traced with a single ray query
+	/// </summary>
+	static constexpr int RayBatchSize = 64;
 
 	void ApplyRadianceAttenuation(glm::vec3& radiance, const RayHit& rayHit) {
 		// NB. In the radiance paper there is no mention over the radiance attenuation 
@@ -52,18 +228,64 @@ private:
 		radiance *= attFactor;
 	}
 
-	void InitializeRentedBuffer(glm::vec4* buffer);
+	void InitializeRentedBuffer(SamplingTier tier, glm::vec4* buffer);
 
 	/// <summary>
-	/// Calculates the irradiance with using the SIMD intrinsics
-	/// to avoid the glm::vec4 overhead
+	/// Integer hash mapped to [0, 1)
 	/// </summary>
-	void ComputeIrradianceFast(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const;
+	static float HashToUnit(uint32_t value) {
+		value ^= value >> 16;
+		value *= 0x7feb352dU;
+		value ^= value >> 15;
+		value *= 0x846ca68bU;
+		value ^= value >> 16;
+		return (value >> 8) * (1.0f / 16777216.0f);
+	}
 
 	/// <summary>
-	/// Basic irradiance calculation
+	/// Integer hash of the bits of a point
 	/// </summary>
-	void ComputeIrradiance(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const;
+	static uint32_t HashPoint(const glm::vec3& point) {
+		const glm::uvec3 bits = glm::floatBitsToUint(point);
+		return (bits.x * 73856093U) ^ (bits.y * 19349663U) ^ (bits.z * 83492791U);
+	}
+
+	/// <summary>
+	/// Moves a direction on its tangent plane, inside the cone with the same solid angle of the direction
+	/// </summary>
+	static glm::vec3 JitterDirection(const glm::vec3& direction, float solidAngle, uint32_t seed) {
+		const float radius = sqrt(solidAngle / glm::pi<float>());
+		const glm::vec3 helper = fabs(direction.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		const glm::vec3 tangent = glm::normalize(glm::cross(direction, helper));
+		const glm::vec3 bitangent = glm::cross(direction, tangent);
+
+		const float u = HashToUnit(seed) * 2.0f - 1.0f;
+		const float v = HashToUnit(seed ^ 0x9e3779b9U) * 2.0f - 1.0f;
+		return glm::normalize(direction + (tangent * u + bitangent * v) * radius);
+	}
+
+	/// <summary>
+	/// Rebuilds the low tier directions, the shaders lookup and the pools after a directions change
+	/// </summary>
+	void OnDirectionsChanged() {
+		_lowDirectionsSampler.SetResolution(GetLowResolution());
+		_directionsVersion++;
+
+		// The shaders find the tables of the lookup layout one after the other, so the low one is appended without its header
+		_directionLookup = _directionsSampler.GetDirectionLookup();
+		if (_directionsSampler.GetDirectionSet().GetLayout() == DirectionLayout::Lookup) {
+			const std::vector<int>& lowLookup = _lowDirectionsSampler.GetDirectionLookup();
+			_directionLookup.insert(_directionLookup.end(), lowLookup.cbegin() + 2, lowLookup.cend());
+		}
+
+		// To avoid problem, let's recreate the entire pool
+		// (resolution should not change frequently so this operation should not be
+		// problematic in term of performance
+		delete _directionRadianceArrayPool;
+		delete _lowDirectionRadianceArrayPool;
+		_directionRadianceArrayPool = new SimpleArrayPool<glm::vec4>();
+		_lowDirectionRadianceArrayPool = new SimpleArrayPool<glm::vec4>();
+	}
 
 #ifdef DEBUG
 	/// <summary>
@@ -72,6 +294,9 @@ private:
 	/// </summary>
 	void TestInverseMappingFunction(const Ray& samplingRay) const
 	{
+		// The other layouts are not indexed with the concentric inverse mapping
+		if (_directionsSampler.GetDirectionSet().GetLayout() != DirectionLayout::Concentric) return;
+
 		const float resolution = _directionsSampler.GetResolution();
 		int offset = 0;
 		glm::vec3 mapDirection = samplingRay.Direction();
@@ -88,135 +313,376 @@ private:
 	}
 #endif // DEBUG
 
-	template<class Iterator>
-	void SampleDataInDirection(const Ray& samplingRay,
-		const Iterator& iteratorStart, const Iterator& iteratorEnd,
+	/// <summary>
+	/// Traces a batch of directions from a point and stores the radiance of each one
+	/// </summary>
+	/// <param name="sampleIndexes">Index of each direction in the destination buffer</param>
+	/// <returns>Number of rays that hit a surface</returns>
+	int TraceBatch(const glm::vec3& samplingPoint, const glm::vec3* directions, const int* sampleIndexes, int count, glm::vec4* destBuffer) const {
+		assert(count <= RayBatchSize);
+
+		// The static geometry is intersected in bulk. Only the remaining objects go through the ray query
+		PrimitiveHit staticHits[RayBatchSize];
+		ObjectHit objectHits[RayBatchSize];
+		for (int i = 0; i < count; i++)
+		{
+			_staticPrimitives.IntersectClosest(Ray(samplingPoint, directions[i]), staticHits[i]);
+			objectHits[i].Distance = staticHits[i].Distance;
+		}
+		_rayQuery->IntersectClosest(samplingPoint, directions, count, objectHits);
+
+		int hits = 0;
+		for (int i = 0; i < count; i++)
+		{
+			hits += (int)ShadeHit(Ray(samplingPoint, directions[i]), staticHits[i], objectHits[i], sampleIndexes[i], destBuffer);
+		}
+		return hits;
+	}
+
+	/// <summary>
+	/// Stores the radiance coming from the closest hit of a ray
+	/// </summary>
+	/// <param name="objectHit">Object hit, if it' s nearer than the static hit</param>
+	/// <returns>True if the ray hits a surface</returns>
+	bool ShadeHit(const Ray& samplingRay, const PrimitiveHit& staticHit, const ObjectHit& objectHit,
 		int sampleIndex,
 		glm::vec4* destBuffer) const {
 #if DEBUG
 		TestInverseMappingFunction(samplingRay);
 #endif
 
-		Surface* hittedSurface = nullptr;
-		float currentMinDistance = std::numeric_limits<float>().max();
-		for (Iterator it = iteratorStart; it != iteratorEnd; ++it) {
-			const SceneObject* object = *it;
-			RayHit hitInfo = object->IsHitByRay(samplingRay);
-			if (!hitInfo.IsHit()) {
-				// No hit with the surface 
-				continue;
-			}
-			if (hitInfo.Distance() > currentMinDistance)
-			{
-				// There is another surface nea the sampling point. Ignore;
-				continue;
-			}
-			currentMinDistance = hitInfo.Distance();
-			// Here we are assuming that the object implements a precise hit algorithm
-			// that gives as the precise surface of the hitting point
-			hittedSurface = hitInfo.Surface();
-		}
-
-		if (!hittedSurface) {
+		// Here we are assuming that the object implements a precise hit algorithm
+		// that gives as the precise surface of the hitting point
+		Surface* hittedSurface = objectHit.IsHit() ? objectHit.Hit.Surface() :
+			(staticHit.IsHit() ? _staticPrimitives.GetSurface(staticHit.Index) : nullptr);
+		const float currentMinDistance = objectHit.IsHit() ? objectHit.Distance : staticHit.Distance;
+		// The object that was hit, to find the normal for the secondary bounce (the static hit otherwise)
+		const SceneObject* hitObject = objectHit.Object;
+
+		const bool emits = hittedSurface && hittedSurface->GetRadiance().has_value();
+		const bool reflects = hittedSurface && _bounceSource && hittedSurface->GetAlbedo() != glm::vec3(0.0f);
+		if (!emits && !reflects) {
 			// Ambient component (in our case a zero vector)
+			// (or a surface that neither emits nor reflects)
 			destBuffer[(sampleIndex * 2) + 1] = _zeroVector;
+			return hittedSurface != nullptr;
 		}
-		else if (hittedSurface->GetRadiance().has_value()) {
-			const glm::vec3& radiance = hittedSurface->GetRadiance().value().Value;
-			
+
+		glm::vec3 radiance(0.0f);
+		if (emits) {
 			// Paper does' t mention an attenuation by distance
 			// This may comes due to the fact that if a hitted surface is "small" and very far
 			// It may hit only a few samples so it won't "participate" much in the irradiance
 			// integral
 			// ApplyRadianceAttenuation(radiance, hitInfo);
-
-			// Let's avoid a construction of a vec4 here
-			glm::vec4* destination = destBuffer + ((sampleIndex * 2) + 1);
-			glm::vec3* destination3 = reinterpret_cast<glm::vec3*>(destination);
-			*destination3 = radiance;
-			destination->w = 0.0f;
+			radiance = hittedSurface->GetRadiance().value().Value;
 		}
-		else
-		{
-			// other cases nt taken in in account
-			destBuffer[(sampleIndex * 2) + 1] = _zeroVector;
+		if (reflects) {
+			// Secondary bounce: the hit point reflects the irradiance of the previous updates, like the
+			// diffuse surfaces in the shaders. The bounces add up over the updates without recursive rays
+			glm::vec3 hitPoint, normal;
+			if (hitObject) {
+				hitPoint = objectHit.Hit.HittingPoint();
+				normal = objectHit.Hit.Reflection().Normal();
+			}
+			else {
+				hitPoint = samplingRay.Position() + samplingRay.Direction() * currentMinDistance;
+				normal = _staticPrimitives.GetNormal(staticHit.Index, hitPoint);
+			}
+			// We need the side of the surface facing the sampling point
+			if (glm::dot(normal, samplingRay.Direction()) > 0.0f) normal = -normal;
+
+			glm::vec3 irradiance;
+			if (_bounceSource->QueryIrradiance(hitPoint, normal, irradiance)) {
+				radiance += hittedSurface->GetAlbedo() * irradiance / glm::pi<float>();
+			}
 		}
+
+		// Let's avoid a construction of a vec4 here
+		// The radiance is weighted by the direction solid angle (stored in the direction w) once here,
+		// instead of in the convolution inner loop
+		glm::vec4* destination = destBuffer + ((sampleIndex * 2) + 1);
+		glm::vec3* destination3 = reinterpret_cast<glm::vec3*>(destination);
+		*destination3 = radiance * destBuffer[sampleIndex * 2].w;
+		destination->w = 0.0f;
+		return true;
 	}
 
-	template<class Iterator>
-	void SampleData(const glm::vec3& samplingPoint,
-		const Iterator& iteratorStart, const Iterator& iteratorEnd,
-		glm::vec4* resultBuffer) const {
+	void SampleData(const glm::vec3& samplingPoint, SamplingTier tier, glm::vec4* resultBuffer) const {
+		PROFILE_SCOPE("RadianceSampler::Sample");
 
-		const vector<glm::vec3>& directions = _directionsSampler.GetSamplingDirections();
+		const UnitHemisphereDirections& tierDirections = GetDirections(tier);
+		const vector<glm::vec3>& directions = tierDirections.GetSamplingDirections();
 		int samplesCount = directions.size();
 		int requiredBufferSize = samplesCount * 2;
 
 		// To avoid allocating a new array each time, we use a pool
 		// This is necessary to provide thread safeness
-		glm::vec4* dirRadiancePoolRent = _directionRadianceArrayPool->Rent(requiredBufferSize, _rentInitializer);
+		SimpleArrayPool<glm::vec4>* pool = tier == SamplingTier::High ? _directionRadianceArrayPool : _lowDirectionRadianceArrayPool;
+		glm::vec4* dirRadiancePoolRent = pool->Rent(requiredBufferSize, tier == SamplingTier::High ? _rentInitializer : _lowRentInitializer);
 
-		int sampleIndex = 0;
-		for (const glm::vec3& direction : directions) {
-			Ray ray(samplingPoint, direction);
+		{
+			PROFILE_SCOPE("RadianceSampler::RayCasting");
+			int sampleIndexes[RayBatchSize];
+			int hits = 0;
+			for (int first = 0; first < samplesCount; first += RayBatchSize) {
+				const int count = std::min(RayBatchSize, samplesCount - first);
+				for (int i = 0; i < count; i++) sampleIndexes[i] = first + i;
+
+				hits += TraceBatch(samplingPoint, directions.data() + first, sampleIndexes, count, dirRadiancePoolRent);
+			}
 
-			SampleDataInDirection(ray, iteratorStart, iteratorEnd, sampleIndex, dirRadiancePoolRent);
-			++sampleIndex;
+			// Counters are updated once per probe
+			Metrics::Instance.Add(MetricCounter::RaysCast, samplesCount);
+			Metrics::Instance.Add(MetricCounter::RayHits, hits);
 		}
 
+		Convolve(tierDirections, dirRadiancePoolRent, resultBuffer);
+		// Always return the pooled array
+		pool->Return(dirRadiancePoolRent);
+	}
+
+	void SampleProgressiveData(const glm::vec3& samplingPoint, SamplingTier tier, const TemporalSampling& temporal, RadianceHistory& history,
+		const glm::vec4* previousIrradiance, glm::vec4* resultBuffer) const {
+		PROFILE_SCOPE("RadianceSampler::SampleProgressive");
+
+		const UnitHemisphereDirections& tierDirections = GetDirections(tier);
+		const vector<glm::vec3>& directions = tierDirections.GetSamplingDirections();
+		int samplesCount = directions.size();
+
+		// The accumulated radiance is meaningful only for the same directions
+		if (history.DirectionsVersion != _directionsVersion || history.Tier != tier || (int)history.Radiance.size() != samplesCount) {
+			history.Resize(samplesCount);
+			history.DirectionsVersion = _directionsVersion;
+			history.Tier = tier;
+		}
+		// Without a valid history we trace all the directions, so the probe is correct since the first pass
+		const bool fullTrace = !history.Valid || temporal.Period <= 1;
+		const int phase = temporal.Frame % std::max(temporal.Period, 1);
+		// A partial pass adds the change of the traced directions to the previous irradiance. Without it,
+		// or periodically to drop the rounding drift, the whole accumulated radiance is convolved again
+		const bool incremental = !fullTrace && previousIrradiance && history.PartialPasses < TemporalConvolutionResync;
+		if (!history.Valid) Metrics::Instance.Add(MetricCounter::ProbesReset, 1);
+
+		SimpleArrayPool<glm::vec4>* pool = tier == SamplingTier::High ? _directionRadianceArrayPool : _lowDirectionRadianceArrayPool;
+		glm::vec4* dirRadiancePoolRent = pool->Rent(samplesCount * 2, tier == SamplingTier::High ? _rentInitializer : _lowRentInitializer);
+
+		{
+			PROFILE_SCOPE("RadianceSampler::RayCasting");
+			int traced = 0;
+			int hits = 0;
+			glm::vec3 batchDirections[RayBatchSize];
+			int batchIndexes[RayBatchSize];
+			int batchCount = 0;
+			// The traced radiance is blended in the history once the batch is traced. In a partial pass the buffer
+			// keeps only the change of the accumulated radiance, that is convolved on top of the previous irradiance
+			auto traceBatch = [&]() {
+				hits += TraceBatch(samplingPoint, batchDirections, batchIndexes, batchCount, dirRadiancePoolRent);
+				for (int i = 0; i < batchCount; i++) {
+					glm::vec4& accumulated = history.Radiance[batchIndexes[i]];
+					glm::vec4* radiance = dirRadiancePoolRent + ((batchIndexes[i] * 2) + 1);
+					if (fullTrace) {
+						accumulated = *radiance;
+					}
+					else {
+						const glm::vec4 previous = accumulated;
+						accumulated = glm::mix(accumulated, *radiance, temporal.Blend);
+						*radiance = accumulated - previous;
+					}
+				}
+				traced += batchCount;
+				batchCount = 0;
+			};
+
+			for (int sampleIndex = 0; sampleIndex < samplesCount; ++sampleIndex) {
+				// Not traced in this pass: its radiance is already in the previous irradiance
+				if (!fullTrace && sampleIndex % temporal.Period != phase) continue;
+
+				glm::vec3 direction = directions[sampleIndex];
+				if (temporal.Jitter && !fullTrace) {
+					direction = JitterDirection(direction, dirRadiancePoolRent[sampleIndex * 2].w, (uint32_t)(temporal.Frame * 7919 + sampleIndex));
+				}
+				batchDirections[batchCount] = direction;
+				batchIndexes[batchCount++] = sampleIndex;
+				if (batchCount == RayBatchSize) traceBatch();
+			}
+			if (batchCount > 0) traceBatch();
+
+			Metrics::Instance.Add(MetricCounter::RaysCast, traced);
+			Metrics::Instance.Add(MetricCounter::RayHits, hits);
+		}
+		history.Valid = true;
+
+		// The convolution is linear in the radiance, so a partial pass costs only the traced directions
+		if (incremental) {
+			PROFILE_SCOPE("RadianceSampler::Convolution");
+			ComputeIrradianceDelta(dirRadiancePoolRent, samplesCount, phase, temporal.Period, previousIrradiance, resultBuffer);
+			history.PartialPasses++;
+		}
+		else {
+			// All the directions are convolved with their accumulated radiance, replacing the traced changes
+			if (!fullTrace) {
+				for (int i = 0; i < samplesCount; i++) dirRadiancePoolRent[(i * 2) + 1] = history.Radiance[i];
+			}
+			Convolve(tierDirections, dirRadiancePoolRent, resultBuffer);
+			// The probes traced together (e.g. after a reset) don' t resync all in the same pass
+			history.PartialPasses = fullTrace ? (int)(HashToUnit(HashPoint(samplingPoint)) * TemporalConvolutionResync) : 0;
+		}
+		pool->Return(dirRadiancePoolRent);
+	}
+
+	void Convolve(const UnitHemisphereDirections& tierDirections, const glm::vec4* dirRadianceSource, glm::vec4* resultBuffer) const {
+		PROFILE_SCOPE("RadianceSampler::Convolution");
+		int samplesCount = tierDirections.GetSamplingDirections().size();
 #if DEBUG
-		if (_directionsSampler.GetResolution() < 15)
-			ComputeIrradiance(dirRadiancePoolRent, samplesCount, resultBuffer);
+		if (tierDirections.GetResolution() < 15)
+			ComputeIrradiance(dirRadianceSource, samplesCount, resultBuffer);
 		else
-			ComputeIrradianceFast(dirRadiancePoolRent, samplesCount, resultBuffer);
+			ComputeIrradianceFast(dirRadianceSource, samplesCount, resultBuffer);
 #else
-		ComputeIrradianceFast(dirRadiancePoolRent, samplesCount, resultBuffer);
+		ComputeIrradianceFast(dirRadianceSource, samplesCount, resultBuffer);
 #endif
-		// Always return the pooled array
-		_directionRadianceArrayPool->Return(dirRadiancePoolRent);
 	}
 
 public:
-	RadianceSampler() : _directionRadianceArrayPool(nullptr)
+	RadianceSampler() : _directionRadianceArrayPool(nullptr), _lowDirectionRadianceArrayPool(nullptr), _rayQuery(std::make_unique<BruteForceRayQuery>())
 	{
 		// Setup for the array pool initializer delegate
-		_rentInitializer = std::bind(&RadianceSampler::InitializeRentedBuffer, this, std::placeholders::_1);
+		_rentInitializer = std::bind(&RadianceSampler::InitializeRentedBuffer, this, SamplingTier::High, std::placeholders::_1);
+		_lowRentInitializer = std::bind(&RadianceSampler::InitializeRentedBuffer, this, SamplingTier::Low, std::placeholders::_1);
 		SetResolution(9);
 	}
 
 	~RadianceSampler() {
 		delete _directionRadianceArrayPool;
+		delete _lowDirectionRadianceArrayPool;
 	}
 
-	void Sample(const glm::vec3& samplingPoint, glm::vec4* resultBuffer) const {
+	/// <summary>
+	/// Samples the irradiance in a point. The result buffer must hold SamplesCount(tier) values
+	/// </summary>
+	void Sample(const glm::vec3& samplingPoint, glm::vec4* resultBuffer, SamplingTier tier = SamplingTier::High) const {
 		// Here we assume resultBuffer is big enught
-		SampleData(samplingPoint, _samplingObjects.cbegin(), _samplingObjects.cend(), resultBuffer);
+		SampleData(samplingPoint, tier, resultBuffer);
 	}
 
-	int SamplesCount() const { return (_directionsSampler.GetResolution() * 2 * _directionsSampler.GetResolution()); }
+	/// <summary>
+	/// Samples the irradiance in a point tracing only a subset of the directions. The radiance of the other
+	/// directions comes from the history of the probe, which is blended with the traced radiance
+	/// </summary>
+	/// <remarks>
+	/// The history is reset (full trace) when it' s not valid or it was accumulated with other directions
+	/// </remarks>
+	/// <param name="previousIrradiance">Irradiance written by the last pass of the probe (it may be the result buffer itself),
+	/// or null if it' s not available anymore: the pass convolves all the accumulated radiance</param>
+	void SampleProgressive(const glm::vec3& samplingPoint, glm::vec4* resultBuffer, SamplingTier tier,
+		const TemporalSampling& temporal, RadianceHistory& history, const glm::vec4* previousIrradiance = nullptr) const {
+		SampleProgressiveData(samplingPoint, tier, temporal, history, previousIrradiance, resultBuffer);
+	}
+
+	/// <summary>
+	/// Calculates the irradiance with using the SIMD intrinsics
+	/// to avoid the glm::vec4 overhead
+	/// </summary>
+	/// <param name="dirRadianceSource">Interleaved direction/radiance buffer (16-byte aligned). The radiance is already weighted by the direction solid angle</param>
+	void ComputeIrradianceFast(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const;
+
+	/// <summary>
+	/// Adds the radiance change of a subset of the directions to the irradiance, with the SIMD intrinsics
+	/// </summary>
+	/// <param name="dirRadianceSource">Interleaved direction/radiance buffer (16-byte aligned). The radiance of the
+	/// directions first, first + step, ... is the change of the weighted radiance, the others are not read</param>
+	/// <param name="previousIrradiance">Irradiance of all the directions before the change. It may be the result buffer itself</param>
+	/// <param name="resultBuffer">Updated irradiance, clamped to zero</param>
+	void ComputeIrradianceDelta(const glm::vec4* dirRadianceSource, int samplesCount, int first, int step, const glm::vec4* previousIrradiance, glm::vec4* resultBuffer) const;
+
+	/// <summary>
+	/// Basic irradiance calculation
+	/// </summary>
+	/// <param name="dirRadianceSource">Interleaved direction/radiance buffer. The radiance is already weighted by the direction solid angle</param>
+	void ComputeIrradiance(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const;
+
+	int SamplesCount(SamplingTier tier = SamplingTier::High) const { return (int)GetDirections(tier).GetSamplingDirections().size(); }
 	int GetResolution() const { return _directionsSampler.GetResolution(); }
+	/// <summary>
+	/// Resolution of the low sampling tier: a third of the sampler resolution
+	/// </summary>
+	int GetLowResolution() const { return std::max(MinLowSamplingResolution, GetResolution() / 3); }
+	DirectionSetType GetDirectionSetType() const { return _directionsSampler.GetDirectionSet().GetType(); }
+	const UnitHemisphereDirections& GetDirections(SamplingTier tier = SamplingTier::High) const {
+		return tier == SamplingTier::High ? _directionsSampler : _lowDirectionsSampler;
+	}
+	/// <summary>
+	/// Direction lookup table of the shaders. With the lookup layout the table of each tier follows the previous one
+	/// </summary>
+	const std::vector<int>& GetDirectionLookup() const { return _directionLookup; }
+	int GetDirectionsVersion() const { return _directionsVersion; }
 
 	/// <summary>
 	/// Entry point to obtain the list of object to perform ray casting
 	/// </summary>
 	/// <remarks>
-	/// This may be substituted with a class that manages a better algorithm to search for object intersection
-	/// in a scene
+	/// The objects are intersected through the ray query backend: UpdateRayQuery() must be called after the
+	/// list is changed or the objects are moved
 	/// </remarks>
 	vector<const SceneObject*>& GetSamplingObjects() { return _samplingObjects; }
 
+	/// <summary>
+	/// Changes the ray casting of the sampling objects. The brute force backend is the default
+	/// </summary>
+	void SetRayQuery(std::unique_ptr<RayQueryBackend> rayQuery) {
+		_rayQuery = std::move(rayQuery);
+		UpdateRayQuery();
+	}
+	const RayQueryBackend& GetRayQuery() const { return *_rayQuery; }
+	/// <summary>
+	/// Updates the ray query backend with the sampling objects and their bounds. The grids call it before the sampling
+	/// </summary>
+	void UpdateRayQuery() {
+		PROFILE_SCOPE("RadianceSampler::UpdateRayQuery");
+		_rayQuery->Update(_samplingObjects);
+	}
+
+	/// <summary>
+	/// Static geometry intersected by the sampling rays together with the sampling objects
+	/// </summary>
+	PrimitiveTable& GetStaticPrimitives() { return _staticPrimitives; }
+
+	/// <summary>
+	/// Enables the secondary bounce: the hit surfaces reflect the irradiance queried from the source, scaled by
+	/// their albedo. The source is read while the probes are sampled, so it must not change during an update
+	/// </summary>
+	/// <param name="source">Irradiance of the previous updates, null to disable the bounce</param>
+	void SetBounceSource(const IrradianceSource* source) { _bounceSource = source; }
+	const IrradianceSource* GetBounceSource() const { return _bounceSource; }
+
+	/// <summary>
+	/// Moves the sampling objects that can be flattened in the static primitives (see SceneCompiler)
+	/// </summary>
+	/// <remarks>The compiled objects must not be moved anymore</remarks>
+	void CompileSamplingObjects() {
+		_samplingObjects = SceneCompiler::Compile(_samplingObjects.cbegin(), _samplingObjects.cend(), _staticPrimitives);
+		UpdateRayQuery();
+	}
+
 	void SetResolution(int resolution) {
 		_directionsSampler.SetResolution(resolution);
+		OnDirectionsChanged();
+	}
 
-		// To avoid problem, let's recreate the entire pool
-		// (resolution should not change frequently so this operation should not be
-		// problematic in term of performance
-		delete _directionRadianceArrayPool;
-		_directionRadianceArrayPool = new SimpleArrayPool<glm::vec4>();
+	/// <summary>
+	/// Changes the generator of the sampling directions. The samples count does not change
+	/// </summary>
+	void SetDirectionSet(DirectionSetType type) {
+		_directionsSampler.SetDirectionSet(type);
+		_lowDirectionsSampler.SetDirectionSet(type);
+
+		// The pooled arrays contain the old directions
+		OnDirectionsChanged();
 	}
 };
 
-void RadianceSampler::InitializeRentedBuffer(glm::vec4* buffer)
+void RadianceSampler::InitializeRentedBuffer(SamplingTier tier, glm::vec4* buffer)
 {
 	// With this little trick we spend only little time writing the sampling direction in our buffer
 	// This is done because
@@ -225,26 +691,26 @@ void RadianceSampler::InitializeRentedBuffer(glm::vec4* buffer)
 	// 2) If the resolution of the sampling is not changed frequenty, the array pool after the first init will reuse the already
 	// initialized array
 
-	const vector<glm::vec3>& directions = _directionsSampler.GetSamplingDirections();
+	const vector<glm::vec3>& directions = GetDirections(tier).GetSamplingDirections();
+	const vector<float>& weights = GetDirections(tier).GetSolidAngleWeights();
 	for (int i = 0; i < directions.size(); ++i)
 	{
 		glm::vec4* dirPtr = buffer + (i * 2);
 		glm::vec3* dir3Ptr = reinterpret_cast<glm::vec3*>(dirPtr);
 
 		// Let's avoid the construction of a vec4 element to write in the buffer
+		// The unused w component stores the direction solid angle, used to weight the sampled radiance
 		*dir3Ptr = directions[i];
-		dirPtr->w = 0.0f;
+		dirPtr->w = weights[i];
 	}
 }
 
 void RadianceSampler::ComputeIrradianceFast(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const {
 	// Same irradiance calculation but exploiting CPU intrinsics to avoid glm:: copy/construction/casts overhead
 
-	const float mulConst = 4.0f * (float)M_PI / samplesCount;
 	const glm::vec4* dirRadBuffer = dirRadianceSource;
 
-	// Let's prepare our mult constant and zero vector
-	__m128 multConst = _mm_set_ps(0.0f, mulConst, mulConst, mulConst);
+	// Let's prepare our zero vector
 	__m128 zero = _mm_setzero_ps();
 	for (int i = 0; i < samplesCount; i++) {
 		int mainDirectionIndex = (2 * i);
@@ -262,7 +728,6 @@ void RadianceSampler::ComputeIrradianceFast(const glm::vec4* dirRadianceSource,
 			radiance = _mm_mul_ps(radiance, dotProduct);
 			irradiance = _mm_add_ps(irradiance, radiance);
 		}
-		irradiance = _mm_mul_ps(irradiance, multConst);
 
 		float* storagePtr = reinterpret_cast<float*>(resultBuffer + i);
 		_mm_store_ps(storagePtr, irradiance);
@@ -275,9 +740,26 @@ void RadianceSampler::ComputeIrradianceFast(const glm::vec4* dirRadianceSource,
 	}
 }
 
-void RadianceSampler::ComputeIrradiance(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const {
-	const float mulConst = 4.0f * (float)M_PI / samplesCount;
+void RadianceSampler::ComputeIrradianceDelta(const glm::vec4* dirRadianceSource, int samplesCount, int first, int step, const glm::vec4* previousIrradiance, glm::vec4* resultBuffer) const {
+	const glm::vec4* dirRadBuffer = dirRadianceSource;
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < samplesCount; i++) {
+		__m128 mainDir = _mm_load_ps((float*)(dirRadBuffer + (2 * i)));
+		__m128 total = _mm_loadu_ps((const float*)(previousIrradiance + i));
+		for (int j = first; j < samplesCount; j += step) {
+			int index = j * 2;
+			__m128 direction = _mm_load_ps((float*)(dirRadBuffer + index));
+			__m128 radianceDelta = _mm_load_ps((float*)(dirRadBuffer + index + 1));
+			__m128 dotProduct = _mm_max_ps(_mm_dp_ps(direction, mainDir, 0b01110111), zero);
+			total = _mm_add_ps(total, _mm_mul_ps(radianceDelta, dotProduct));
+		}
+
+		// The rounding errors may go below zero
+		_mm_storeu_ps((float*)(resultBuffer + i), _mm_max_ps(total, zero));
+	}
+}
 
+void RadianceSampler::ComputeIrradiance(const glm::vec4* dirRadianceSource, int samplesCount, glm::vec4* resultBuffer) const {
 	const glm::vec4* dirRadBuffer = dirRadianceSource;
 	for (int i = 0; i < samplesCount; ++i) {
 		int mainDirectionIndex = (2 * i);
@@ -292,7 +774,6 @@ void RadianceSampler::ComputeIrradiance(const glm::vec4* dirRadianceSource, int
 			irr += (rad * radianceWeight);
 		}
 
-		irr *= mulConst;
 		resultBuffer[i] = glm::vec4(irr, 0.0f);
 
 		// Irradiance in xyz should always be >= zero (in w is always 0.0)
@@ -6,16 +6,41 @@
 #include <Transform.hpp>
 #include <Surface.hpp>
 #include <BCube.hpp>
+#include <scene/PrimitiveTable.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
+#ifndef HEADLESS
+#include <render/RenderQueue.hpp>
+#endif
 
 /// <summary>
 /// Represents a basic object that will be placed in the scene
 /// </summary>
+/// <remarks>
+/// The transform setters only record the new parameters: the matrices and the data derived from them
+/// (OnTransformChanged()) are rebuilt by UpdateTransforms(), once per frame for all the changed objects.
+/// GetTransform() returns the last applied transform, while the parameters getters return the recorded ones
+/// </remarks>
 class SceneObject {
 private:
+	/// <summary>
+	/// Objects whose transform is built by a single BuildBatch() call
+	/// </summary>
+	static const int TransformsBatchSize = 64;
+
 	TransformParams _transform;
+	glm::vec3 _translation = glm::vec3(0.0f);
+	glm::vec3 _scale = glm::vec3(1.0f);
+	GLfloat _yRotation = 0.0f;
+	/// <summary>
+	/// The new objects are changed, so their OnTransformChanged() runs at the first update
+	/// </summary>
+	bool _transformChanged = true;
 
 protected:
+#ifndef HEADLESS
 	Shader _shader;
+#endif
 
 	virtual void OnTransformChanged() {
 	};
@@ -23,6 +48,7 @@ protected:
 public:
 	NO_COPY_AND_ASSIGN(SceneObject);
 
+#ifndef HEADLESS
 	/// <remarks>
 	/// This is not the best. The caller have to explicitly release the resources
 	/// </remarks>
@@ -35,39 +61,126 @@ public:
 	virtual ~SceneObject() {
 		_shader.Delete();
 	}
+#else
+	/// <summary>
+	/// Headless objects are used only for the sampling so they don' t have any shader
+	/// </summary>
+	SceneObject() {
+	}
+
+	virtual ~SceneObject() {
+	}
+#endif
 
 	// A scene object has associated some 
-	const TransformParams& GetTransform() const { return _transform; };
-	const glm::vec3& GetPosition() const { return _transform.Translation(); };
-	const glm::vec3& GetScale() const { return _transform.Scale(); };
-	const GLfloat GetYRotation() const { return _transform.YRotation(); };
+	const TransformParams& GetTransform() const {
+		// The transform of a changed object is stale until the next update
+		assert(!_transformChanged);
+		return _transform;
+	};
+	const glm::vec3& GetPosition() const { return _translation; };
+	const glm::vec3& GetScale() const { return _scale; };
+	const GLfloat GetYRotation() const { return _yRotation; };
+	bool IsTransformChanged() const { return _transformChanged; }
 
 
 	void SetYRotation(GLfloat yRot) {
-		_transform = TransformParams(_transform.Translation(), _transform.Scale(), yRot);
-		OnTransformChanged();
+		_yRotation = yRot;
+		_transformChanged = true;
 	}
 
 	void SetPosition(const glm::vec3& value) {
-		_transform = TransformParams(value, _transform.Scale(), _transform.YRotation());
-		OnTransformChanged();
+		_translation = value;
+		_transformChanged = true;
 	}
 
 	virtual void SetScale(glm::vec3& value) {
-		_transform = TransformParams(_transform.Translation(), value, _transform.YRotation());
-		OnTransformChanged();
+		_scale = value;
+		_transformChanged = true;
 	};
 	virtual void SetScale(glm::vec3&& value) {
 		SetScale(value);
 	};
 
+	/// <summary>
+	/// Applies the recorded transform of this object only
+	/// </summary>
+	void UpdateTransform() {
+		SceneObject* object = this;
+		UpdateTransforms(&object, &object + 1);
+	}
+
+	/// <summary>
+	/// Builds the transforms of the changed objects in batches and notifies them
+	/// </summary>
+	/// <returns>Number of updated objects</returns>
+	template<class Iterator>
+	static int UpdateTransforms(const Iterator& begin, const Iterator& end);
+
 	/// <summary>
 	/// Abstract definition for a finding a object hit with a ray
 	/// </summary>
 	virtual RayHit IsHitByRay(const Ray& ray) const = 0;
 
+	/// <summary>
+	/// Flattens the object in the static primitive table used by the sampler (see SceneCompiler)
+	/// </summary>
+	/// <returns>False if the object can' t be flattened. It will be intersected with IsHitByRay</returns>
+	virtual bool CompileTo(PrimitiveTable& table) const {
+		return false;
+	}
+
 	virtual BCube& GetBoundingCube() = 0;
 	virtual BCube& GetTransformedBoundingCube() = 0;
 
-	virtual void Draw() = 0;
-};
\ No newline at end of file
+#ifndef HEADLESS
+	/// <summary>
+	/// Submits the object draw items. They are issued by the RenderQueue::Flush()
+	/// </summary>
+	virtual void Draw(RenderQueue& queue) = 0;
+#endif
+};
+
+template<class Iterator>
+int SceneObject::UpdateTransforms(const Iterator& begin, const Iterator& end)
+{
+	PROFILE_SCOPE("SceneObject::UpdateTransforms");
+
+	SceneObject* objects[TransformsBatchSize];
+	TransformParams* transforms[TransformsBatchSize];
+	glm::vec3 translations[TransformsBatchSize];
+	glm::vec3 scales[TransformsBatchSize];
+	GLfloat yRotations[TransformsBatchSize];
+
+	int updatedCount = 0;
+	int batchSize = 0;
+	auto flush = [&]() {
+		TransformParams::BuildBatch(transforms, translations, scales, yRotations, batchSize);
+		for (int i = 0; i < batchSize; i++)
+		{
+			// The flag is cleared first, so the objects can read their new transform
+			objects[i]->_transformChanged = false;
+			objects[i]->OnTransformChanged();
+		}
+		updatedCount += batchSize;
+		batchSize = 0;
+	};
+
+	for (Iterator it = begin; it != end; ++it)
+	{
+		// The iterators may point to raw or smart pointers
+		SceneObject* object = &**it;
+		if (!object->_transformChanged) continue;
+
+		objects[batchSize] = object;
+		transforms[batchSize] = &object->_transform;
+		translations[batchSize] = object->_translation;
+		scales[batchSize] = object->_scale;
+		yRotations[batchSize] = object->_yRotation;
+		if (++batchSize == TransformsBatchSize) flush();
+	}
+	if (batchSize > 0) flush();
+
+	Metrics::Instance.Add(MetricCounter::TransformsUpdated, updatedCount);
+	return updatedCount;
+}
@@ -5,6 +5,8 @@
 #define _USE_MATH_DEFINES
 #endif
 #include <math.h>
+#include <float.h>
+#include <immintrin.h>
 #include <glm/glm.hpp>
 
 const float OCTANT_8_OFFSET = (7 * M_PI) / 4;
@@ -251,3 +253,159 @@ glm::vec2 SemisphereToPoint(const glm::vec3& direction) {
 	assert(result.y >= 0.0 && result.y <= 1.0f);
 	return result;
 }
+
+
+/* Branch-free SIMD variants
+*
+* Same concentric mapping, rewritten in its algebraic form: the octant if-chain becomes abs/min/max/blend
+* operations and the only transcendental functions left (sin/cos of an angle in [0; PI/4] and atan of a ratio
+* in [0; 1]) are replaced by polynomials. Four points are mapped at once with SSE4.1 (the project target, so
+* there is no 8-wide AVX variant)
+*/
+
+/// <summary>
+/// Horner evaluation of a polynomial in x2 (coefficients from the highest degree)
+/// </summary>
+template<int N>
+inline __m128 EvaluatePolynomial4(__m128 x2, const float(&coefficients)[N]) {
+	__m128 result = _mm_set1_ps(coefficients[0]);
+	for (int i = 1; i < N; i++) {
+		result = _mm_add_ps(_mm_mul_ps(result, x2), _mm_set1_ps(coefficients[i]));
+	}
+	return result;
+}
+
+/// <summary>
+/// Returns the magnitude with the sign of signSource
+/// </summary>
+inline __m128 CopySign4(__m128 magnitude, __m128 signSource) {
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	return _mm_or_ps(_mm_andnot_ps(signMask, magnitude), _mm_and_ps(signMask, signSource));
+}
+
+/// <summary>
+/// atan(t) for t in [0; 1]. Abramowitz and Stegun 4.4.49, |error| <= 2e-8
+/// </summary>
+inline __m128 AtanUnit4(__m128 t) {
+	static const float coefficients[] = {
+		0.0028662257f, -0.0161657367f, 0.0429096138f, -0.0752896400f, 0.1065626393f,
+		-0.1420889944f, 0.1999355085f, -0.3333314528f, 1.0f
+	};
+	return _mm_mul_ps(t, EvaluatePolynomial4(_mm_mul_ps(t, t), coefficients));
+}
+
+/// <summary>
+/// sin(x) and cos(x) for x in [0; PI/4]. Taylor series, |error| < 3e-8 in the range
+/// </summary>
+inline void SinCosQuarter4(__m128 x, __m128& sinX, __m128& cosX) {
+	static const float sinCoefficients[] = { 1.0f / 362880.0f, -1.0f / 5040.0f, 1.0f / 120.0f, -1.0f / 6.0f, 1.0f };
+	static const float cosCoefficients[] = { 1.0f / 40320.0f, -1.0f / 720.0f, 1.0f / 24.0f, -1.0f / 2.0f, 1.0f };
+	__m128 x2 = _mm_mul_ps(x, x);
+	sinX = _mm_mul_ps(x, EvaluatePolynomial4(x2, sinCoefficients));
+	cosX = EvaluatePolynomial4(x2, cosCoefficients);
+}
+
+/// <summary>
+/// Branch-free PointToSemisphere() of four points in the unit square
+/// </summary>
+inline void PointToSemisphere4(__m128 pointX, __m128 pointY, __m128& directionX, __m128& directionY, __m128& directionZ) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	// Point in [-1; 1]
+	__m128 squareX = _mm_sub_ps(_mm_mul_ps(pointX, two), one);
+	__m128 squareY = _mm_sub_ps(_mm_mul_ps(pointY, two), one);
+	__m128 absX = _mm_andnot_ps(signMask, squareX);
+	__m128 absY = _mm_andnot_ps(signMask, squareY);
+
+	// The concentric square of the point is the disk radius, the angle from the nearest axis is
+	// linear in the minor/major coordinates ratio (the octant offsets are replaced by the swap and the signs)
+	__m128 radius = _mm_max_ps(absX, absY);
+	__m128 ratio = _mm_div_ps(_mm_min_ps(absX, absY), _mm_max_ps(radius, _mm_set1_ps(FLT_MIN)));
+	__m128 sinAngle, cosAngle;
+	SinCosQuarter4(_mm_mul_ps(ratio, _mm_set1_ps((float)M_PI_4)), sinAngle, cosAngle);
+
+	__m128 xMajor = _mm_cmpge_ps(absX, absY);
+	__m128 cosPhi = CopySign4(_mm_blendv_ps(sinAngle, cosAngle, xMajor), squareX);
+	__m128 sinPhi = CopySign4(_mm_blendv_ps(cosAngle, sinAngle, xMajor), squareY);
+
+	// cos(theta) = 1 - r^2, sin(theta) = r * sqrt(2 - r^2)
+	__m128 radius2 = _mm_mul_ps(radius, radius);
+	__m128 sinTheta = _mm_mul_ps(radius, _mm_sqrt_ps(_mm_sub_ps(two, radius2)));
+
+	directionX = _mm_mul_ps(sinTheta, cosPhi);
+	directionY = _mm_sub_ps(one, radius2);
+	directionZ = _mm_mul_ps(sinTheta, sinPhi);
+}
+
+/// <summary>
+/// Branch-free SemisphereToPoint() of four directions of the upper hemisphere
+/// </summary>
+inline void SemisphereToPoint4(__m128 directionX, __m128 directionY, __m128 directionZ, __m128& pointX, __m128& pointY) {
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	// Disk radius from cos(theta) = 1 - r^2. The direction xz has the same angle of the disk point,
+	// so we don't need to normalize it by sin(theta)
+	__m128 radius = _mm_sqrt_ps(_mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(one, directionY)));
+	__m128 absX = _mm_andnot_ps(signMask, directionX);
+	__m128 absZ = _mm_andnot_ps(signMask, directionZ);
+	__m128 major = _mm_max_ps(absX, absZ);
+	__m128 ratio = _mm_div_ps(_mm_min_ps(absX, absZ), _mm_max_ps(major, _mm_set1_ps(FLT_MIN)));
+	__m128 minor = _mm_mul_ps(radius, _mm_mul_ps(_mm_set1_ps((float)(4.0 / M_PI)), AtanUnit4(ratio)));
+
+	__m128 xMajor = _mm_cmpge_ps(absX, absZ);
+	__m128 squareX = CopySign4(_mm_blendv_ps(minor, radius, xMajor), directionX);
+	__m128 squareY = CopySign4(_mm_blendv_ps(radius, minor, xMajor), directionZ);
+
+	pointX = _mm_mul_ps(_mm_add_ps(squareX, one), half);
+	pointY = _mm_mul_ps(_mm_add_ps(squareY, one), half);
+}
+
+/// <summary>
+/// Maps a list of points in the unit square with PointToSemisphere4()
+/// </summary>
+void PointsToSemisphere(const glm::vec2* points, glm::vec3* directions, int count) {
+	alignas(16) float pointX[4], pointY[4], directionX[4], directionY[4], directionZ[4];
+	for (int first = 0; first < count; first += 4) {
+		int lanes = count - first < 4 ? count - first : 4;
+		for (int i = 0; i < 4; i++) {
+			// Unused lanes of the last block are mapped from the square center
+			pointX[i] = i < lanes ? points[first + i].x : 0.5f;
+			pointY[i] = i < lanes ? points[first + i].y : 0.5f;
+		}
+
+		__m128 x, y, z;
+		PointToSemisphere4(_mm_load_ps(pointX), _mm_load_ps(pointY), x, y, z);
+		_mm_store_ps(directionX, x);
+		_mm_store_ps(directionY, y);
+		_mm_store_ps(directionZ, z);
+
+		for (int i = 0; i < lanes; i++) directions[first + i] = glm::vec3(directionX[i], directionY[i], directionZ[i]);
+	}
+}
+
+/// <summary>
+/// Maps a list of upper hemisphere directions with SemisphereToPoint4()
+/// </summary>
+void SemisphereToPoints(const glm::vec3* directions, glm::vec2* points, int count) {
+	alignas(16) float directionX[4], directionY[4], directionZ[4], pointX[4], pointY[4];
+	for (int first = 0; first < count; first += 4) {
+		int lanes = count - first < 4 ? count - first : 4;
+		for (int i = 0; i < 4; i++) {
+			// Unused lanes of the last block are mapped from the pole
+			directionX[i] = i < lanes ? directions[first + i].x : 0.0f;
+			directionY[i] = i < lanes ? directions[first + i].y : 1.0f;
+			directionZ[i] = i < lanes ? directions[first + i].z : 0.0f;
+		}
+
+		__m128 x, y;
+		SemisphereToPoint4(_mm_load_ps(directionX), _mm_load_ps(directionY), _mm_load_ps(directionZ), x, y);
+		_mm_store_ps(pointX, x);
+		_mm_store_ps(pointY, y);
+
+		for (int i = 0; i < lanes; i++) points[first + i] = glm::vec2(pointX[i], pointY[i]);
+	}
+}
@@ -21,6 +21,10 @@ public:
 class Surface {
 private:
 	std::optional<RadianceP> _radiance;
+	/// <summary>
+	/// Diffuse reflectance, used by the secondary bounce of the sampling. Zero reflects nothing
+	/// </summary>
+	glm::vec3 _albedo = glm::vec3(0.0f);
 public:
 	const std::optional<RadianceP>& GetRadiance() const {
 		return _radiance;
@@ -29,6 +33,9 @@ public:
 	void SetRadiance(const RadianceP& radiance) {
 		_radiance.emplace(radiance);
 	}
+
+	const glm::vec3& GetAlbedo() const { return _albedo; }
+	void SetAlbedo(const glm::vec3& albedo) { _albedo = albedo; }
 };
 
 struct LazyReflection {
@@ -59,6 +66,11 @@ public:
 	glm::vec3 operator()() const {
 		return glm::normalize(glm::reflect(_normal, _direction));
 	}
+
+	/// <summary>
+	/// Normal of the hit surface
+	/// </summary>
+	const glm::vec3& Normal() const { return _normal; }
 };
 
 class RayHit {
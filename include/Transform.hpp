@@ -1,6 +1,7 @@
 #pragma once
 
 #include <std_include.h>
+#include <immintrin.h>
 
 struct TransformParams {
 private:
@@ -9,26 +10,61 @@ private:
 	GLfloat _yRotation;
 
 	glm::mat4 _matrix;
-	glm::mat4 _aaMatrix;
+	glm::mat3 _normalMatrix;
+
+	/// <summary>
+	/// Writes the matrices from the scaled rotation terms
+	/// </summary>
+	/// <remarks>
+	/// The matrix is translate * rotateY * scale, so its columns are the rotation columns scaled by the scale
+	/// components. The normal matrix (the inverse transpose of the upper 3x3) is the rotation with the inverse scale
+	/// </remarks>
+	void SetMatrices(float cosX, float sinX, float cosZ, float sinZ, float inverseCosX, float inverseSinX, const glm::vec3& inverseScale, float inverseCosZ, float inverseSinZ) {
+		_matrix = glm::mat4(
+			cosX, 0.0f, -sinX, 0.0f,
+			0.0f, _scale.y, 0.0f, 0.0f,
+			sinZ, 0.0f, cosZ, 0.0f,
+			_translation.x, _translation.y, _translation.z, 1.0f);
+		_normalMatrix = glm::mat3(
+			inverseCosX, 0.0f, -inverseSinX,
+			0.0f, inverseScale.y, 0.0f,
+			inverseSinZ, 0.0f, inverseCosZ);
+	}
+
+	void Build() {
+		const float angle = glm::radians(_yRotation);
+		const float cosAngle = std::cos(angle), sinAngle = std::sin(angle);
+		const glm::vec3 inverseScale = 1.0f / _scale;
+		SetMatrices(cosAngle * _scale.x, sinAngle * _scale.x, cosAngle * _scale.z, sinAngle * _scale.z,
+			cosAngle * inverseScale.x, sinAngle * inverseScale.x, inverseScale, cosAngle * inverseScale.z, sinAngle * inverseScale.z);
+	}
+
 public:
 
 	TransformParams() : TransformParams(glm::vec3(0.0f), glm::vec3(1.0f), 0.0f) {
 	}
 
 	TransformParams(const glm::vec3& translation, const glm::vec3& scale, GLfloat rotationAngle) : _translation(translation), _scale(scale), _yRotation(rotationAngle) {
-		_matrix = glm::translate(glm::mat4(1.0f), _translation);
-		// In the aa we don't consider the rotation
-		_aaMatrix = glm::scale(_matrix, _scale);
-
-		_matrix = glm::rotate(_matrix, glm::radians(rotationAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-		_matrix = glm::scale(_matrix, _scale);
+		Build();
 	}
 
 	const glm::vec3& Translation() const { return _translation; }
 	const glm::vec3& Scale() const { return _scale; }
 	const GLfloat YRotation() const { return _yRotation; }
 	const glm::mat4& Matrix() const { return _matrix; }
-	const glm::mat4& AAMatrix() const { return  _aaMatrix; }
+	/// <summary>
+	/// Inverse transpose of the matrix rotation and scale, for the normals
+	/// </summary>
+	const glm::mat3& NormalMatrix() const { return _normalMatrix; }
+
+	/// <summary>
+	/// Sets the parameters and builds the matrices of a batch of transforms
+	/// </summary>
+	/// <remarks>
+	/// The scaled rotation terms are computed 4 transforms at a time. The results are the same of the
+	/// constructor, that uses the same (scalar) operations
+	/// </remarks>
+	static void BuildBatch(TransformParams* const* transforms, const glm::vec3* translations, const glm::vec3* scales, const GLfloat* yRotations, int count);
 
 	TransformParams operator+(const TransformParams& b) const {
 		glm::vec3 newTranslation(_translation + b.Translation());
@@ -39,6 +75,61 @@ public:
 };
 
 
+void TransformParams::BuildBatch(TransformParams* const* transforms, const glm::vec3* translations, const glm::vec3* scales, const GLfloat* yRotations, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		alignas(16) float cosAngles[4], sinAngles[4], scaleX[4], scaleY[4], scaleZ[4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			const float angle = glm::radians(yRotations[i + lane]);
+			cosAngles[lane] = std::cos(angle);
+			sinAngles[lane] = std::sin(angle);
+			scaleX[lane] = scales[i + lane].x;
+			scaleY[lane] = scales[i + lane].y;
+			scaleZ[lane] = scales[i + lane].z;
+		}
+
+		const __m128 cosAngle = _mm_load_ps(cosAngles), sinAngle = _mm_load_ps(sinAngles);
+		const __m128 sx = _mm_load_ps(scaleX), sy = _mm_load_ps(scaleY), sz = _mm_load_ps(scaleZ);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 isx = _mm_div_ps(one, sx), isy = _mm_div_ps(one, sy), isz = _mm_div_ps(one, sz);
+
+		alignas(16) float terms[11][4];
+		_mm_store_ps(terms[0], _mm_mul_ps(cosAngle, sx));
+		_mm_store_ps(terms[1], _mm_mul_ps(sinAngle, sx));
+		_mm_store_ps(terms[2], _mm_mul_ps(cosAngle, sz));
+		_mm_store_ps(terms[3], _mm_mul_ps(sinAngle, sz));
+		_mm_store_ps(terms[4], _mm_mul_ps(cosAngle, isx));
+		_mm_store_ps(terms[5], _mm_mul_ps(sinAngle, isx));
+		_mm_store_ps(terms[6], isx);
+		_mm_store_ps(terms[7], isy);
+		_mm_store_ps(terms[8], isz);
+		_mm_store_ps(terms[9], _mm_mul_ps(cosAngle, isz));
+		_mm_store_ps(terms[10], _mm_mul_ps(sinAngle, isz));
+
+		for (int lane = 0; lane < 4; lane++)
+		{
+			TransformParams& transform = *transforms[i + lane];
+			transform._translation = translations[i + lane];
+			transform._scale = scales[i + lane];
+			transform._yRotation = yRotations[i + lane];
+			transform.SetMatrices(terms[0][lane], terms[1][lane], terms[2][lane], terms[3][lane], terms[4][lane], terms[5][lane],
+				glm::vec3(terms[6][lane], terms[7][lane], terms[8][lane]), terms[9][lane], terms[10][lane]);
+		}
+	}
+
+	// Scalar tail
+	for (; i < count; i++)
+	{
+		TransformParams& transform = *transforms[i];
+		transform._translation = translations[i];
+		transform._scale = scales[i];
+		transform._yRotation = yRotations[i];
+		transform.Build();
+	}
+}
+
 glm::vec3 operator>>(const glm::vec3& v, const glm::mat4& m)
 {
 	glm::vec4 transformedPt = m * glm::vec4(v, 1.0f);
@@ -2,9 +2,12 @@
 
 #include <std_include.h>
 #include <SemisphereMap.hpp>
+#include <DirectionSets.hpp>
+#if DEBUG && !defined(HEADLESS)
 #include <buffers/GpuBuffer.hpp>
 #include <buffers/VertexArray.hpp>
 #include <dbg/DbgSphere.hpp>
+#endif
 
 /// <summary>
 /// Provides a sampling direction list build from a unit hemisphere with a certain resolution
@@ -30,12 +33,26 @@ private:
 	/// </summary>
 	std::function<glm::vec3(const glm::vec2&)> _mapFunction;
 
+	/// <summary>
+	/// Generator of the sampling directions
+	/// </summary>
+	std::unique_ptr<DirectionSet> _directionSet;
+
 	/// <summary>
 	/// List of available sampling point given the specified resolution
 	/// </summary>
 	vector<glm::vec3> _samplingDirections;
+	/// <summary>
+	/// Solid angle of each sampling direction (same order of the directions)
+	/// </summary>
+	vector<float> _solidAngleWeights;
+	/// <summary>
+	/// Direction lookup table for the shaders (see BuildDirectionLookup())
+	/// </summary>
+	vector<int> _directionLookup;
 
-#if DEBUG
+// The debug visualization is available only when we have a GL context
+#if DEBUG && !defined(HEADLESS)
 	Shader _shader;
 	VertexArray _dbgVao;
 	GpuBufferT<GL_ARRAY_BUFFER> _dbgVbo;
@@ -46,45 +63,41 @@ private:
 #endif
 
 	void BuildSamplingPoints() {
-		_samplingDirections.clear();
-
-		// We then need the real 2D sampling point in the center of each cell
-		// In this first the se sampling point is equals to the lower left point of the cell
-		vector<glm::vec2> sampling2DPoints;
-		sampling2DPoints.reserve(_resolution * _resolution);
-		// Columns point preparation and sampling point
-		for (int col = 0; col <= _resolution; col++)
-			for (int row = 0; row <= _resolution; row++)
-			{
-				glm::vec2 point = glm::vec2(col, row);
-				if (row < _resolution && col < _resolution)
-					sampling2DPoints.push_back(point);
-			}
-
-		// We now builds the unit hemisphere to get the sampling directions
-		for (auto i = 0; i < sampling2DPoints.size(); i++)
-		{
-			// We move our sampling point to the center of the cell
-			glm::vec2 data = sampling2DPoints[i] * _cellSegmentSize + _cellHalf;
-			glm::vec3 point = _mapFunction(data);
+		_directionSet->Generate(_resolution, _samplingDirections, _solidAngleWeights);
+		_directionLookup = BuildDirectionLookup(*_directionSet, _samplingDirections);
 
+#if DEBUG
+		assert((int)_samplingDirections.size() == _directionSet->GetSamplesCount(_resolution));
+		assert(_solidAngleWeights.size() == _samplingDirections.size());
 
-			// We save the sampling point and the negative-y sampling point
-			_samplingDirections.insert(_samplingDirections.begin() + i, point);
-			_samplingDirections.push_back(glm::vec3(point.x, -point.y, point.z));
-		}
+		float weightsSum = 0.0f;
+		for (float weight : _solidAngleWeights) weightsSum += weight;
+		assert(std::abs(weightsSum - 4.0f * (float)M_PI) < 1e-3f);
 
-#if DEBUG
-		for (int i = 0; i < _samplingDirections.size() / 2; i++)
-		{
-			const glm::vec3& upperHalfVector = _samplingDirections[i];
-			const glm::vec3& lowerHalfVector = _samplingDirections[i + _samplingDirections.size() / 2];
+		if (_directionSet->GetLayout() == DirectionLayout::Concentric) {
+			// The shaders expect the lower hemisphere to mirror the upper one
+			for (int i = 0; i < (int)_samplingDirections.size() / 2; i++)
+			{
+				const glm::vec3& upperHalfVector = _samplingDirections[i];
+				const glm::vec3& lowerHalfVector = _samplingDirections[i + _samplingDirections.size() / 2];
 
-			assert(upperHalfVector.x == lowerHalfVector.x);
-			assert(-upperHalfVector.y == lowerHalfVector.y);
-			assert(upperHalfVector.z == lowerHalfVector.z);
+				assert(upperHalfVector.x == lowerHalfVector.x);
+				assert(-upperHalfVector.y == lowerHalfVector.y);
+				assert(upperHalfVector.z == lowerHalfVector.z);
+			}
+		}
+		else if (_directionSet->GetLayout() == DirectionLayout::Octahedral) {
+			// The shaders lookup (x * side + y of the inverse mapping) must find each direction in its own texel
+			const int side = (int)std::lround(std::sqrt((float)_samplingDirections.size()));
+			for (int i = 0; i < (int)_samplingDirections.size(); i++)
+			{
+				glm::ivec2 texel = glm::ivec2(DirectionToOctahedral(_samplingDirections[i]) * (float)side);
+				assert(texel.x * side + texel.y == i);
+			}
 		}
+#endif
 
+#if DEBUG && !defined(HEADLESS)
 		BuildDebugInfo();
 #endif
 	}
@@ -99,8 +112,8 @@ public:
 	NO_COPY_AND_ASSIGN(UnitHemisphereDirections);
 
 	UnitHemisphereDirections()
-		: _mapFunction(PointToSemisphere)
-#if DEBUG
+		: _mapFunction(PointToSemisphere), _directionSet(DirectionSet::Create(DirectionSetType::Concentric))
+#if DEBUG && !defined(HEADLESS)
 		, _shader("shaders/hemi.vert", "shaders/hemi.frag")
 #endif	
 	{
@@ -118,17 +131,66 @@ public:
 		BuildSamplingPoints();
 	}
 
+	const DirectionSet& GetDirectionSet() const { return *_directionSet; }
+
+	void SetDirectionSet(DirectionSetType type) {
+		_directionSet = DirectionSet::Create(type);
+		BuildSamplingPoints();
+	}
+
 	/// <summary>
 	/// Return the list of sampling direction
 	/// </summary>
 	const std::vector<glm::vec3>& GetSamplingDirections() const { return _samplingDirections; }
+	/// <summary>
+	/// Return the solid angle of each sampling direction. They sum to 4 PI
+	/// </summary>
+	const std::vector<float>& GetSolidAngleWeights() const { return _solidAngleWeights; }
+	/// <summary>
+	/// Return the direction lookup table used by the shaders to find the sample of a direction
+	/// </summary>
+	const std::vector<int>& GetDirectionLookup() const { return _directionLookup; }
 
-#if DEBUG
+	/// <summary>
+	/// Returns the index of the sample that stores a direction, with the same mapping of the shaders (radianceSimple)
+	/// </summary>
+	int GetStorageIndex(glm::vec3 direction) const;
+
+#if DEBUG && !defined(HEADLESS)
 	void Draw(const glm::vec3& position);
 #endif // DEBUG
 };
 
-#if DEBUG
+int UnitHemisphereDirections::GetStorageIndex(glm::vec3 direction) const {
+	direction = glm::normalize(direction);
+	const int samplesCount = (int)_samplingDirections.size();
+	const DirectionLayout layout = _directionSet->GetLayout();
+	if (layout == DirectionLayout::Octahedral) {
+		// The whole sphere is a single square: no hemisphere offset
+		const int side = (int)std::lround(std::sqrt((float)samplesCount));
+		glm::ivec2 texel = glm::clamp(glm::ivec2(DirectionToOctahedral(direction) * (float)side), glm::ivec2(0), glm::ivec2(side - 1));
+		return texel.x * side + texel.y;
+	}
+
+	// With a lookup table the direction is mapped on the table cells instead of the samples
+	const int resolution = layout == DirectionLayout::Lookup ? _directionLookup[1] : _resolution;
+	int hemisphereOffset = 0;
+	if (direction.y < 0) {
+		direction.y = -direction.y;
+		hemisphereOffset = resolution * resolution;
+	}
+
+	glm::vec2 point = SemisphereToPoint(direction);
+	int ptX = glm::clamp((int)floor(point.x * resolution), 0, resolution - 1);
+	int ptY = glm::clamp((int)floor(point.y * resolution), 0, resolution - 1);
+	int storageIndex = hemisphereOffset + ptX * resolution + ptY;
+	if (layout == DirectionLayout::Lookup) storageIndex = _directionLookup[2 + storageIndex];
+
+	assert(storageIndex >= 0 && storageIndex < samplesCount);
+	return storageIndex;
+}
+
+#if DEBUG && !defined(HEADLESS)
 void UnitHemisphereDirections::BuildDebugInfo() {
 	// We build the 2d point in the grid necessary to draw the grid columns lines and row lines
 	// This lines are only for debug purposes
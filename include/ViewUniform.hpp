@@ -29,6 +29,13 @@ public:
 		_underlyingData.CameraView = glm::mat4(0.0f);
 	}
 
+	const glm::mat4& GetProjection() const { return _underlyingData.Projection; }
+	const glm::mat4& GetCamera() const { return _underlyingData.CameraView; }
+	/// <summary>
+	/// Returns the world to clip space matrix (used for the frustum culling)
+	/// </summary>
+	glm::mat4 GetViewProjection() const { return _underlyingData.Projection * _underlyingData.CameraView; }
+
 	/// <summary>
 	/// Updates the view projection
 	/// </summary>
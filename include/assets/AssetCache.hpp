@@ -0,0 +1,85 @@
+#pragma once
+
+#include <std_include.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <assets/MeshCache.hpp>
+
+/// <summary>
+/// Reference counted cache of the loaded models
+/// </summary>
+/// <remarks>
+/// The same model file is loaded once and shared by all its users (the debug spheres, for example, are one
+/// for each debug line). The cache keeps only weak references: a model is released when its last user
+/// is destroyed, so the GPU buffers are freed before the GL context
+/// </remarks>
+class AssetCache {
+private:
+	std::unordered_map<std::string, std::weak_ptr<Model>> _models;
+
+	static Model LoadModel(const std::string& path);
+public:
+	static AssetCache Instance;
+
+	/// <summary>
+	/// Returns the shared instance of a model, loading it if needed
+	/// </summary>
+	std::shared_ptr<Model> GetModel(const std::string& path) {
+		auto findResult = _models.find(path);
+		if (findResult != _models.end()) {
+			std::shared_ptr<Model> model = findResult->second.lock();
+			if (model) return model;
+		}
+
+		std::shared_ptr<Model> model = std::make_shared<Model>(LoadModel(path));
+		_models[path] = model;
+		return model;
+	}
+
+	/// <summary>
+	/// Number of models still in use
+	/// </summary>
+	int GetLoadedModelsCount() const {
+		int count = 0;
+		for (const auto& it : _models) {
+			if (!it.second.expired()) ++count;
+		}
+		return count;
+	}
+};
+
+Model AssetCache::LoadModel(const std::string& path) {
+	std::vector<MeshData> meshesData;
+	if (MeshCache::TryLoad(path, meshesData)) {
+		std::vector<Mesh> meshes;
+		meshes.reserve(meshesData.size());
+		for (MeshData& meshData : meshesData) {
+			// The mesh takes the ownership of the vectors
+			meshes.emplace_back(std::move(meshData.Vertices), std::move(meshData.Indices));
+		}
+		return Model(std::move(meshes));
+	}
+
+	// Cache miss: we import the model with Assimp and we store the result for the next launches
+	Model model(path);
+	if (model.meshes.empty()) return model;
+
+	meshesData.resize(model.meshes.size());
+	for (size_t i = 0; i < model.meshes.size(); i++)
+	{
+		meshesData[i].Vertices = model.meshes[i].vertices;
+		meshesData[i].Indices = model.meshes[i].indices;
+	}
+	try {
+		MeshCache::Write(path, meshesData);
+	}
+	catch (const std::exception& e) {
+		// The model is still valid, the next launch will import it again
+		std::cout << "WARNING::MESHCACHE: " << e.what() << std::endl;
+	}
+	return model;
+}
+
+// Singleton definition
+AssetCache AssetCache::Instance;
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <std_include.h>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <utils/MappedFile.hpp>
+
+/// <summary>
+/// Current version of the binary mesh cache format
+/// </summary>
+const uint32_t MESH_CACHE_VERSION = 1;
+/// <summary>
+/// Every section in the file starts at this boundary
+/// </summary>
+const uint64_t MESH_CACHE_SECTION_ALIGNMENT = 64;
+
+/// <summary>
+/// Header of a binary mesh cache file
+/// </summary>
+/// <remarks>
+/// The file is a flat image of the data uploaded to the mesh buffers:
+/// [Header][Mesh entries][Vertices mesh 0][Indices mesh 0]...[Vertices mesh N][Indices mesh N]
+/// Each section starts at a MESH_CACHE_SECTION_ALIGNMENT boundary
+///
+/// The vertices are stored exactly as the Vertex struct (interleaved attributes), so once the file is mapped
+/// the sections are copied as a whole without any parsing or post processing
+/// </remarks>
+struct MeshCacheHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint32_t HeaderSize;
+	/// <summary>
+	/// sizeof(Vertex) used to write the file. A different layout invalidates the cache
+	/// </summary>
+	uint32_t VertexSize;
+
+	/// <summary>
+	/// Stamp of the source model. If size and time do not match we check the content hash
+	/// (for example after a checkout that only touched the file)
+	/// </summary>
+	uint64_t SourceSize;
+	int64_t SourceTime;
+	uint64_t SourceHash;
+
+	uint32_t MeshCount;
+	uint32_t Reserved;
+
+	static constexpr char ExpectedMagic[4] = { 'I', 'R', 'M', 'C' };
+};
+
+/// <summary>
+/// Location of a mesh sections in the cache file
+/// </summary>
+struct MeshCacheEntry {
+	uint64_t VerticesOffset;
+	uint64_t VerticesCount;
+	uint64_t IndicesOffset;
+	uint64_t IndicesCount;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 48, "Mesh cache header must have a fixed size");
+static_assert(sizeof(MeshCacheEntry) == 32, "Mesh cache entry must have a fixed size");
+
+/// <summary>
+/// CPU side data of a mesh
+/// </summary>
+struct MeshData {
+	std::vector<Vertex> Vertices;
+	std::vector<GLuint> Indices;
+};
+
+/// <summary>
+/// On-disk cache of the processed models, so the warm starts skip the Assimp import and post processing
+/// </summary>
+/// <remarks>
+/// The cache of a model is stored next to its source file (see GetCachePath())
+/// </remarks>
+class MeshCache {
+private:
+	struct SourceStamp {
+		uint64_t Size;
+		int64_t Time;
+	};
+
+	static uint64_t AlignSection(uint64_t offset) {
+		return (offset + MESH_CACHE_SECTION_ALIGNMENT - 1) & ~(MESH_CACHE_SECTION_ALIGNMENT - 1);
+	}
+
+	/// <summary>
+	/// The mesh entries follow the header
+	/// </summary>
+	static uint64_t GetEntriesOffset() {
+		return AlignSection(sizeof(MeshCacheHeader));
+	}
+
+	static bool GetSourceStamp(const std::string& sourcePath, SourceStamp& stamp) {
+		std::error_code error;
+		stamp.Size = std::filesystem::file_size(sourcePath, error);
+		if (error) return false;
+		stamp.Time = (int64_t)std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+		return !error;
+	}
+
+	/// <summary>
+	/// FNV-1a hash of the file content
+	/// </summary>
+	static uint64_t HashFile(const std::string& path) {
+		MappedFile file(path);
+		uint64_t hash = 14695981039346656037ULL;
+		for (uint64_t i = 0; i < file.Size(); i++)
+		{
+			hash ^= file.Data()[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static bool IsSectionValid(const MappedFile& file, uint64_t offset, uint64_t count, uint64_t elementSize) {
+		return offset % MESH_CACHE_SECTION_ALIGNMENT == 0 && offset <= file.Size() && count <= (file.Size() - offset) / elementSize;
+	}
+
+public:
+	static std::string GetCachePath(const std::string& sourcePath) {
+		return sourcePath + ".meshcache";
+	}
+
+	/// <summary>
+	/// Loads the meshes of a model from its cache
+	/// </summary>
+	/// <returns>False if the cache does not exist, it' s stale or it' s not valid</returns>
+	static bool TryLoad(const std::string& sourcePath, std::vector<MeshData>& meshes) {
+		const std::string cachePath = GetCachePath(sourcePath);
+		SourceStamp stamp;
+		if (!GetSourceStamp(sourcePath, stamp) || !std::filesystem::exists(cachePath)) return false;
+
+		try {
+			MappedFile file(cachePath);
+			if (file.Size() < sizeof(MeshCacheHeader)) return false;
+
+			const MeshCacheHeader& header = *reinterpret_cast<const MeshCacheHeader*>(file.Data());
+			if (memcmp(header.Magic, MeshCacheHeader::ExpectedMagic, sizeof(header.Magic)) != 0 ||
+				header.Version != MESH_CACHE_VERSION ||
+				header.HeaderSize != sizeof(MeshCacheHeader) ||
+				header.VertexSize != sizeof(Vertex)) {
+				return false;
+			}
+			if (header.SourceSize != stamp.Size) return false;
+			// Same size but touched: only the content can tell if the cache is still valid
+			if (header.SourceTime != stamp.Time && header.SourceHash != HashFile(sourcePath)) return false;
+			if (!IsSectionValid(file, GetEntriesOffset(), header.MeshCount, sizeof(MeshCacheEntry))) return false;
+
+			const MeshCacheEntry* entries = reinterpret_cast<const MeshCacheEntry*>(file.Data() + GetEntriesOffset());
+			std::vector<MeshData> loadedMeshes(header.MeshCount);
+			for (uint32_t i = 0; i < header.MeshCount; i++)
+			{
+				const MeshCacheEntry& entry = entries[i];
+				if (!IsSectionValid(file, entry.VerticesOffset, entry.VerticesCount, sizeof(Vertex)) ||
+					!IsSectionValid(file, entry.IndicesOffset, entry.IndicesCount, sizeof(GLuint))) {
+					return false;
+				}
+
+				const Vertex* vertices = reinterpret_cast<const Vertex*>(file.Data() + entry.VerticesOffset);
+				const GLuint* indices = reinterpret_cast<const GLuint*>(file.Data() + entry.IndicesOffset);
+				loadedMeshes[i].Vertices.assign(vertices, vertices + entry.VerticesCount);
+				loadedMeshes[i].Indices.assign(indices, indices + entry.IndicesCount);
+			}
+
+			meshes = std::move(loadedMeshes);
+			return true;
+		}
+		catch (const std::exception&) {
+			// An unreadable cache is just a cache miss
+			return false;
+		}
+	}
+
+	/// <summary>
+	/// Writes the cache of a model
+	/// </summary>
+	static void Write(const std::string& sourcePath, const std::vector<MeshData>& meshes) {
+		SourceStamp stamp;
+		if (!GetSourceStamp(sourcePath, stamp)) throw std::runtime_error("Unable to read model file " + sourcePath);
+
+		MeshCacheHeader header = {};
+		memcpy(header.Magic, MeshCacheHeader::ExpectedMagic, sizeof(header.Magic));
+		header.Version = MESH_CACHE_VERSION;
+		header.HeaderSize = sizeof(MeshCacheHeader);
+		header.VertexSize = sizeof(Vertex);
+		header.SourceSize = stamp.Size;
+		header.SourceTime = stamp.Time;
+		header.SourceHash = HashFile(sourcePath);
+		header.MeshCount = (uint32_t)meshes.size();
+
+		std::vector<MeshCacheEntry> entries(meshes.size());
+		uint64_t offset = GetEntriesOffset() + entries.size() * sizeof(MeshCacheEntry);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			entries[i].VerticesOffset = AlignSection(offset);
+			entries[i].VerticesCount = meshes[i].Vertices.size();
+			entries[i].IndicesOffset = AlignSection(entries[i].VerticesOffset + entries[i].VerticesCount * sizeof(Vertex));
+			entries[i].IndicesCount = meshes[i].Indices.size();
+			offset = entries[i].IndicesOffset + entries[i].IndicesCount * sizeof(GLuint);
+		}
+
+		const std::string cachePath = GetCachePath(sourcePath);
+		std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+		if (!file) throw std::runtime_error("Unable to create mesh cache file " + cachePath);
+
+		static const char padding[MESH_CACHE_SECTION_ALIGNMENT] = { 0 };
+		uint64_t written = 0;
+		auto writeSection = [&file, &written](uint64_t sectionOffset, const void* data, uint64_t byteSize) {
+			// We pad up to the section start
+			file.write(padding, sectionOffset - written);
+			file.write(reinterpret_cast<const char*>(data), byteSize);
+			written = sectionOffset + byteSize;
+		};
+
+		writeSection(0, &header, sizeof(MeshCacheHeader));
+		writeSection(GetEntriesOffset(), entries.data(), entries.size() * sizeof(MeshCacheEntry));
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			writeSection(entries[i].VerticesOffset, meshes[i].Vertices.data(), entries[i].VerticesCount * sizeof(Vertex));
+			writeSection(entries[i].IndicesOffset, meshes[i].Indices.data(), entries[i].IndicesCount * sizeof(GLuint));
+		}
+
+		if (!file) throw std::runtime_error("Unable to write mesh cache file " + cachePath);
+	}
+};
@@ -16,13 +16,17 @@ public:
 	GLuint CreateResource()
 	{
 		GLuint newBuffer = 0;
+#ifndef HEADLESS
 		glGenBuffers(1, &newBuffer);
+#endif
 		return  newBuffer;
 	}
 
 	void DestroyResource(GLuint buffer)
 	{
+#ifndef HEADLESS
 		glDeleteBuffers(1, &buffer);
+#endif
 	}
 };
 
@@ -40,10 +44,14 @@ class GpuBufferT : public GpuResource<GLuint, GpuBufferAllocator>
 {
 public:
 	void Bind() {
+#ifndef HEADLESS
 		glBindBuffer(BT, Resource());
+#endif
 	}
 
 	void Unbind() {
+#ifndef HEADLESS
 		glBindBuffer(BT, 0);
+#endif
 	}
 };
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include <std_include.h>
 #include <buffers/GpuBuffer.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
 
 /// <summary>
 /// OpenGl InterfaceBlock base definition
@@ -10,6 +12,9 @@
 /// The type should contain only primitive types and maybe pointers to primitive types.
 /// In case of pointer the T size will not reflect the actual size of the object so 
 /// the size MUST be corrected with the RebindBuffer() method
+/// 
+/// In a HEADLESS build there is no GPU: the block only keeps track of its size so the
+/// callers (and their checks) work in the same way
 /// </remarks>
 template <typename T>
 class InterfaceBlock
@@ -42,6 +47,23 @@ private:
 	/// Block binding port
 	/// </summary>
 	const int _bindingPort;
+	/// <summary>
+	/// Buffer tracked by the metrics (uploads and allocated memory)
+	/// </summary>
+	MetricBuffer _metricsBuffer = MetricBuffer::None;
+
+	/// <summary>
+	/// Writes a range of data in the underlying buffer
+	/// </summary>
+	void WriteBufferRange(std::size_t byteOffset, GLsizeiptr byteSize, const void* data) {
+		PROFILE_SCOPE("InterfaceBlock::Write");
+		Metrics::Instance.AddBufferUpload(_metricsBuffer, byteSize);
+#ifndef HEADLESS
+		glBindBuffer(_blockType, _buffer.Resource());
+		glBufferSubData(_blockType, byteOffset, byteSize, data);
+		glBindBuffer(_blockType, 0);
+#endif
+	}
 	
 protected:
 	// We show the buffer to the children to provide more control on the data
@@ -58,9 +80,11 @@ public:
 		  _buffer(std::move(other._buffer)),
 		  _blockType(other._blockType),
 		  _usage(other._usage),
-		  _bindingPort(other._bindingPort)
+		  _bindingPort(other._bindingPort),
+		  _metricsBuffer(other._metricsBuffer)
 	{
-		
+		// The tracked memory now belongs to this block
+		other._metricsBuffer = MetricBuffer::None;
 	}
 	
 	InterfaceBlock& operator=(InterfaceBlock&& other) noexcept
@@ -94,14 +118,49 @@ public:
 		
 		RebindBuffer(_bufferSize);
 	}	
+
+	~InterfaceBlock() {
+		Metrics::Instance.AddBufferMemory(_metricsBuffer, -_bufferSize);
+	}
+
+	/// <summary>
+	/// Tracks the uploads and the allocated memory of this block in the metrics
+	/// </summary>
+	void SetMetricsBuffer(MetricBuffer buffer) {
+		Metrics::Instance.AddBufferMemory(_metricsBuffer, -_bufferSize);
+		_metricsBuffer = buffer;
+		Metrics::Instance.AddBufferMemory(_metricsBuffer, _bufferSize);
+	}
 	
 	GpuBuffer& Bind() {
+#ifndef HEADLESS
 		glBindBuffer(_blockType, _buffer.Resource());
+#endif
 		return _buffer;
 	}
 
 	void Unbind() {
+#ifndef HEADLESS
 		glBindBuffer(_blockType, 0);
+#endif
+	}
+
+	/// <summary>
+	/// Returns the underlying buffer name, for example as the source of a buffer copy
+	/// </summary>
+	GLuint GetBufferId() const { return _buffer.Resource(); }
+	/// <summary>
+	/// Returns the current size of the underlying buffer
+	/// </summary>
+	GLsizeiptr GetByteSize() const { return _bufferSize; }
+
+	/// <summary>
+	/// Binds again the whole buffer to its binding port. Used when the port is shared between many blocks
+	/// </summary>
+	void BindBase() {
+#ifndef HEADLESS
+		glBindBufferRange(_blockType, _bindingPort, _buffer.Resource(), 0, _bufferSize);
+#endif
 	}
 
 	/// <summary>
@@ -110,12 +169,15 @@ public:
 	/// <param name="totalByteSize">Buffer size</param>
 	void RebindBuffer(GLsizeiptr totalByteSize)
 	{
+		Metrics::Instance.AddBufferMemory(_metricsBuffer, totalByteSize - _bufferSize);
 		_bufferSize = totalByteSize;
+#ifndef HEADLESS
 		glBindBuffer(_blockType, _buffer.Resource());
 		glBufferData(_blockType, _bufferSize, nullptr, _usage);
 		glBindBuffer(_blockType, 0);
 
 		glBindBufferRange(_blockType, _bindingPort, _buffer.Resource(), 0, _bufferSize);
+#endif
 	}
 	
 	/// <summary>
@@ -123,9 +185,7 @@ public:
 	/// </summary>
 	/// <param name="data"></param>
 	void UpdateData(const T& data) {
-		glBindBuffer(_blockType, _buffer.Resource());
-		glBufferSubData(_blockType, 0, _bufferSize, &data);
-		glBindBuffer(_blockType, 0);
+		WriteBufferRange(0, _bufferSize, &data);
 	}
 
 	/// <summary>
@@ -149,9 +209,7 @@ public:
 		if (requiredSize > _bufferSize) throw std::out_of_range("Underlying buffer size is too small");
 
 		// Finally we can write the data
-		glBindBuffer(_blockType, _buffer.Resource());
-		glBufferSubData(_blockType, fieldOffset, fieldSize, glm::value_ptr(fieldData));
-		glBindBuffer(_blockType, 0);
+		WriteBufferRange(fieldOffset, fieldSize, glm::value_ptr(fieldData));
 	}
 
 	/// <summary>
@@ -171,9 +229,26 @@ public:
 		if (requiredSize > _bufferSize) throw std::out_of_range("Underlying buffer size is too small");
 
 		// Finally we can write the data
-		glBindBuffer(_blockType, _buffer.Resource());
-		glBufferSubData(_blockType, fieldOffset, fieldSize, &fieldData);
-		glBindBuffer(_blockType, 0);
+		WriteBufferRange(fieldOffset, fieldSize, &fieldData);
+	}
+
+	/// <summary>
+	/// Updates a raw range of the underlying buffer
+	/// </summary>
+	/// <remarks>
+	/// Useful when the data is not owned by T (for example when it comes from a memory mapped file)
+	/// </remarks>
+	/// <param name="byteOffset">Offset in the buffer</param>
+	/// <param name="data">Data pointer</param>
+	/// <param name="byteSize">Data size</param>
+	void UpdateRangeData(std::size_t byteOffset, const void* data, GLsizeiptr byteSize) {
+		if (byteSize <= 0) throw std::out_of_range("Invalid range size");
+
+		// Always check if our underlying buffer is big enough
+		GLsizeiptr requiredSize = byteOffset + byteSize;
+		if (requiredSize > _bufferSize) throw std::out_of_range("Underlying buffer size is too small");
+
+		WriteBufferRange(byteOffset, byteSize, data);
 	}
 
 	/// <summary>
@@ -198,8 +273,6 @@ public:
 		if (requiredSize > _bufferSize) throw std::out_of_range("Underlying buffer size is too small");
 		
 		// Eventually we write the data
-		glBindBuffer(_blockType, _buffer.Resource());
-		glBufferSubData(_blockType, fieldOffset, ptrByteSize, fieldData);
-		glBindBuffer(_blockType, 0);
+		WriteBufferRange(fieldOffset, ptrByteSize, fieldData);
 	}
 };
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <std_include.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <buffers/ShaderStorageBuffer.hpp>
+
+/// <summary>
+/// Shader storage buffer of int entries bigger than a single shader storage block
+/// </summary>
+/// <remarks>
+/// The buffer is split in pages of GL_MAX_SHADER_STORAGE_BLOCK_SIZE bytes (rounded down to the offset alignment),
+/// and each page is bound as a range to its own binding port, from the first binding port onwards.
+/// The shader declares a block for each page and it reads the entry X from the page X / GetPageLength().
+/// The pages past the end of the buffer are bound to the first page, so all the shader blocks are always backed
+/// </remarks>
+class PagedStorageBuffer : public ShaderStorageBuffer<glm::ivec4>
+{
+private:
+	int _firstBindingPort;
+	int _pagesCount;
+	GLsizeiptr _pageByteSize;
+
+public:
+	PagedStorageBuffer(const PagedStorageBuffer&) = delete;
+	PagedStorageBuffer& operator=(const PagedStorageBuffer&) = delete;
+
+	/// <summary>
+	/// Creates a new paged buffer
+	/// </summary>
+	/// <param name="firstBindingPort">Binding port of the first page</param>
+	/// <param name="pagesCount">Number of pages (and of binding ports) declared by the shaders</param>
+	PagedStorageBuffer(int firstBindingPort, int pagesCount) : ShaderStorageBuffer(firstBindingPort), _firstBindingPort(firstBindingPort), _pagesCount(pagesCount) {
+		GLint offsetAlignment = (GLint)sizeof(int);
+#ifndef HEADLESS
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+#endif
+		// The pages must start at an aligned offset and they must contain whole entries
+		_pageByteSize = GetMaxSize() / offsetAlignment * offsetAlignment;
+		_pageByteSize -= _pageByteSize % sizeof(int);
+		assert(_pageByteSize % offsetAlignment == 0);
+	}
+
+	/// <summary>
+	/// Number of entries in a page
+	/// </summary>
+	int GetPageLength() const { return (int)(_pageByteSize / sizeof(int)); }
+
+	/// <summary>
+	/// Max size of the whole buffer. The entries are indexed with an int in the shaders, so it' s limited by the int range too
+	/// </summary>
+	GLsizeiptr GetMaxByteSize() const {
+		return std::min(_pageByteSize * _pagesCount, (GLsizeiptr)std::numeric_limits<int>::max() / (GLsizeiptr)sizeof(int) * (GLsizeiptr)sizeof(int));
+	}
+
+	/// <summary>
+	/// Grows the buffer if it' s smaller than the required size. The content is not preserved
+	/// </summary>
+	void EnsureSize(GLsizeiptr byteSize) {
+		if (byteSize > GetMaxByteSize()) throw std::out_of_range("Buffer max size exceeded");
+		if (GetByteSize() < byteSize) RebindBuffer(byteSize);
+		BindPages();
+	}
+
+	/// <summary>
+	/// Binds each page to its binding port
+	/// </summary>
+	void BindPages() {
+#ifndef HEADLESS
+		const GLsizeiptr byteSize = GetByteSize();
+		for (int i = 0; i < _pagesCount; i++)
+		{
+			GLsizeiptr pageOffset = _pageByteSize * i;
+			if (pageOffset >= byteSize) pageOffset = 0;
+			glBindBufferRange(BlockType, _firstBindingPort + i, GetBufferId(), pageOffset, std::min(_pageByteSize, byteSize - pageOffset));
+		}
+#endif
+	}
+};
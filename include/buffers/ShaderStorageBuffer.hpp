@@ -1,6 +1,7 @@
 #pragma once
 
 #include <std_include.h>
+#include <limits>
 #include <buffers/InterfaceBlock.hpp>
 
 /// <summary>
@@ -26,7 +27,12 @@ public:
 	}
 
 	ShaderStorageBuffer(const int bindingPort, GLenum usage) : InterfaceBlock<T>(BlockType, bindingPort, usage) {
+#ifndef HEADLESS
 		glGetIntegerv(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &_shaderBufferMaxSize);
+#else
+		// Without a GPU the only limit is the size field
+		_shaderBufferMaxSize = std::numeric_limits<int>::max();
+#endif
 	}
 
 	/// <summary>
@@ -64,6 +64,11 @@ public:
 	{
 	}
 
+	using ShaderStorageBuffer<__PointerHolder<P>>::SetMetricsBuffer;
+	using ShaderStorageBuffer<__PointerHolder<P>>::GetBufferId;
+	using ShaderStorageBuffer<__PointerHolder<P>>::GetByteSize;
+	using ShaderStorageBuffer<__PointerHolder<P>>::BindBase;
+
 	/// <summary>
 	/// Return the underlying vector length
 	/// </summary>
@@ -82,7 +87,7 @@ public:
 	/// </remarks>
 	void SetVectorLength(GLsizeiptr length)
 	{
-		if (length == _lastVectorLength) return;
+		if (length == _lastVectorLength && _buffer.Data) return;
 
 		_lastVectorLength = length;
 		delete[] _buffer.Data;
@@ -98,4 +103,31 @@ public:
 	void Write() {
 		this->template UpdatePointerFieldData<P*>(_buffer, &__PointerHolder<P>::Data, sizeof(P) * _lastVectorLength);
 	}
+
+	/// <summary>
+	/// Exchanges the underlying buffer with an external array of the same length, without copying it
+	/// </summary>
+	/// <remarks>
+	/// The GPU data is not changed
+	/// </remarks>
+	void SwapVector(std::unique_ptr<P[]>& other) {
+		P* data = other.release();
+		other.reset(_buffer.Data);
+		_buffer.Data = data;
+	}
+
+	/// <summary>
+	/// Writes an external vector directly to the GPU, without copying it in the underlying buffer
+	/// </summary>
+	/// <remarks>
+	/// The underlying buffer is released since it no longer reflects the GPU data
+	/// </remarks>
+	void WriteFrom(const P* data, GLsizeiptr length) {
+		delete[] _buffer.Data;
+		_buffer.Data = nullptr;
+
+		_lastVectorLength = length;
+		this->RebindBuffer(sizeof(P) * _lastVectorLength);
+		this->UpdateRangeData(0, data, sizeof(P) * _lastVectorLength);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+/* Core definitions shared by the application and by the headless (no GL, no display) tools */
+
+#include <Platform.hpp>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#ifdef HEADLESS
+// Without the GL loader we only need the GL scalar types and the few enums
+// used by the buffers bookkeeping. The buffers keep only their CPU side in this configuration
+typedef unsigned int GLenum;
+typedef unsigned char GLboolean;
+typedef int GLint;
+typedef int GLsizei;
+typedef unsigned int GLuint;
+typedef unsigned short GLushort;
+typedef float GLfloat;
+typedef void GLvoid;
+typedef std::ptrdiff_t GLsizeiptr;
+
+#define GL_FALSE 0
+#define GL_TRUE 1
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#else
+#include <glad/glad.h>
+#endif
+
+using namespace std;
+
+#define NO_COPY_AND_ASSIGN(T) \
+  T(const T&) = delete;   \
+  void operator=(const T&) = delete
+
+
+#define DEFAULT_COPY_AND_ASSIGN(T) \
+  T(const T&) = default;   \
+  void operator=(const T&) = default
+
+
+template <class T>
+inline void hash_combine(std::size_t& seed, const T& v)
+{
+    std::hash<T> hasher;
+    seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+std::ostream& operator<<(std::ostream& os, const glm::vec3& vec3)
+{
+    os << "x: " << vec3.x << ", y: " << vec3.y << "z: " << vec3.z;
+    return os;
+}
+
+
+namespace std
+{
+    template<> struct hash<glm::vec3>
+    {
+        std::size_t operator()(glm::vec3 const& s) const noexcept
+        {
+            std::size_t seed = 0;
+            hash_combine(seed, s.x);
+            hash_combine(seed, s.y);
+            hash_combine(seed, s.z);
+            return seed;
+        }
+    };
+}
+
+inline void DebugBreak(){
+   #ifdef ISWINPLATFORM
+        __debugbreak();
+   #else 
+   #endif     
+}
@@ -1,12 +1,13 @@
 #pragma once
 #include <std_include.h>
+#include <assets/AssetCache.hpp>
 #include <Transform.hpp>
 
 class DbgSphere
 {
 private:
 	glm::vec3 _color = glm::vec3(1.0f, 0.5f, 0.2f);
-	Model _sphere;
+	std::shared_ptr<Model> _sphere;
 	Shader _shader;
 
 	void DrawImpl(const glm::vec3& p, float scale, const TransformParams& transform)
@@ -18,7 +19,7 @@ private:
 
 		_shader.SetUniform("modelMatrix", sphereT.Matrix());
 		_shader.SetUniform("color", _color);
-		_sphere.Draw();
+		_sphere->Draw();
 	}
 public:
 	DbgSphere();
@@ -39,7 +40,7 @@ public:
 	}
 };
 
-DbgSphere::DbgSphere() : _sphere("models/sphere.obj"), _shader("shaders/simple.vert", "shaders/simple.frag")
+DbgSphere::DbgSphere() : _sphere(AssetCache::Instance.GetModel("models/sphere.obj")), _shader("shaders/simple.vert", "shaders/simple.frag")
 {
 }
 
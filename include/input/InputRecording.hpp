@@ -0,0 +1,190 @@
+#pragma once
+
+#include <core_include.h>
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+/// <summary>
+/// Number of tracked keyboard keys (same size of the application keys array)
+/// </summary>
+const int InputKeysCount = 1024;
+
+/// <summary>
+/// Application state that affects the frame workload
+/// </summary>
+struct InputFrameSettings {
+	int GridDivision = 0;
+	int MaxSubGridLevel = 0;
+	int Resolution = 0;
+	bool ParallelUpdate = false;
+	bool Wireframe = false;
+	bool PrintText = false;
+
+	bool operator==(const InputFrameSettings& other) const {
+		return GridDivision == other.GridDivision && MaxSubGridLevel == other.MaxSubGridLevel && Resolution == other.Resolution &&
+			ParallelUpdate == other.ParallelUpdate && Wireframe == other.Wireframe && PrintText == other.PrintText;
+	}
+	bool operator!=(const InputFrameSettings& other) const { return !(*this == other); }
+};
+
+/// <summary>
+/// Input of a single frame
+/// </summary>
+/// <remarks>
+/// The keys are captured after the events polling, so the edge-triggered toggles (grid division, subgrid level, resolution,
+/// parallel update) are replayed by the same code that handles them live. The settings are stored only to detect a
+/// diverging replay
+/// </remarks>
+struct InputFrame {
+	float DeltaTime = 0.0f;
+	glm::vec2 MouseOffset = glm::vec2(0.0f);
+	std::vector<int> PressedKeys;
+	InputFrameSettings Settings;
+};
+
+/// <summary>
+/// Writes the per-frame input to a text file (one frame per line)
+/// </summary>
+class InputRecorder
+{
+private:
+	std::ofstream _file;
+	int _frames = 0;
+
+public:
+	NO_COPY_AND_ASSIGN(InputRecorder);
+
+	explicit InputRecorder(const std::string& path) : _file(path) {
+		if (!_file) throw std::runtime_error("Unable to create input recording " + path);
+		_file << "# IrradianceVolumes input recording v1" << std::endl;
+		_file << "# f deltaTime mouseX mouseY division level resolution parallel wireframe text keysCount keys..." << std::endl;
+		// Round-trip precision: the replay must see exactly the same values
+		_file << std::setprecision(9);
+	}
+
+	void Record(const InputFrame& frame) {
+		const InputFrameSettings& settings = frame.Settings;
+		_file << "f " << frame.DeltaTime << " " << frame.MouseOffset.x << " " << frame.MouseOffset.y << " "
+			<< settings.GridDivision << " " << settings.MaxSubGridLevel << " " << settings.Resolution << " "
+			<< settings.ParallelUpdate << " " << settings.Wireframe << " " << settings.PrintText << " "
+			<< frame.PressedKeys.size();
+		for (int key : frame.PressedKeys) _file << " " << key;
+		_file << "\n";
+		++_frames;
+	}
+
+	int GetFramesCount() const { return _frames; }
+};
+
+/// <summary>
+/// Loads an input recording and plays it back one frame at a time
+/// </summary>
+class InputReplayer
+{
+private:
+	std::vector<InputFrame> _frames;
+	std::size_t _nextFrame = 0;
+
+public:
+	NO_COPY_AND_ASSIGN(InputReplayer);
+
+	explicit InputReplayer(const std::string& path) {
+		std::ifstream file(path);
+		if (!file) throw std::runtime_error("Unable to open input recording " + path);
+
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line)) {
+			++lineNumber;
+			if (line.empty() || line[0] == '#') continue;
+
+			std::istringstream stream(line);
+			std::string tag;
+			InputFrame frame;
+			InputFrameSettings& settings = frame.Settings;
+			std::size_t keysCount = 0;
+			stream >> tag >> frame.DeltaTime >> frame.MouseOffset.x >> frame.MouseOffset.y
+				>> settings.GridDivision >> settings.MaxSubGridLevel >> settings.Resolution
+				>> settings.ParallelUpdate >> settings.Wireframe >> settings.PrintText >> keysCount;
+
+			frame.PressedKeys.resize(keysCount);
+			for (std::size_t i = 0; i < keysCount && stream; i++) stream >> frame.PressedKeys[i];
+
+			if (tag != "f" || stream.fail()) throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid frame");
+			for (int key : frame.PressedKeys) {
+				if (key < 0 || key >= InputKeysCount) throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid key");
+			}
+			_frames.push_back(std::move(frame));
+		}
+
+		if (_frames.empty()) throw std::runtime_error("Input recording " + path + " has no frames");
+	}
+
+	bool HasNextFrame() const { return _nextFrame < _frames.size(); }
+	const InputFrame& NextFrame() { return _frames.at(_nextFrame++); }
+
+	int GetFramesCount() const { return (int)_frames.size(); }
+	/// <summary>
+	/// Index of the last frame returned by NextFrame()
+	/// </summary>
+	int GetCurrentFrameIndex() const { return (int)_nextFrame - 1; }
+};
+
+/// <summary>
+/// Collects the per-frame update/draw times of a run
+/// </summary>
+class FrameTimings
+{
+private:
+	std::vector<double> _updateMilliseconds;
+	std::vector<double> _drawMilliseconds;
+
+	static double Percentile(std::vector<double> values, double percentile) {
+		if (values.empty()) return 0.0;
+		std::sort(values.begin(), values.end());
+		// Nearest-rank percentile
+		std::size_t rank = (std::size_t)std::ceil(percentile * values.size());
+		return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+	}
+
+	static double Mean(const std::vector<double>& values) {
+		if (values.empty()) return 0.0;
+		double sum = 0.0;
+		for (double value : values) sum += value;
+		return sum / values.size();
+	}
+
+	static void PrintStats(std::ostream& stream, const std::string& name, const std::vector<double>& values) {
+		stream << name << " mean " << Mean(values) << " ms, p50 " << Percentile(values, 0.50) << " ms, p95 "
+			<< Percentile(values, 0.95) << " ms, max " << Percentile(values, 1.0) << " ms" << std::endl;
+	}
+
+public:
+	void Add(double updateMilliseconds, double drawMilliseconds) {
+		_updateMilliseconds.push_back(updateMilliseconds);
+		_drawMilliseconds.push_back(drawMilliseconds);
+	}
+
+	int GetFramesCount() const { return (int)_updateMilliseconds.size(); }
+
+	/// <summary>
+	/// Writes the per-frame timings as CSV
+	/// </summary>
+	void WriteCsv(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file) throw std::runtime_error("Unable to write frame timings " + path);
+
+		file << "frame,update_ms,draw_ms\n" << std::fixed << std::setprecision(4);
+		for (std::size_t i = 0; i < _updateMilliseconds.size(); i++) {
+			file << i << "," << _updateMilliseconds[i] << "," << _drawMilliseconds[i] << "\n";
+		}
+	}
+
+	void PrintSummary(std::ostream& stream) const {
+		stream << std::fixed << std::setprecision(3);
+		stream << GetFramesCount() << " frames" << std::endl;
+		PrintStats(stream, "Update", _updateMilliseconds);
+		PrintStats(stream, "Draw  ", _drawMilliseconds);
+	}
+};
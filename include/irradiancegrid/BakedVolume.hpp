@@ -0,0 +1,175 @@
+#pragma once
+
+#include <std_include.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <utils/MappedFile.hpp>
+
+/// <summary>
+/// Current version of the baked volume file format
+/// </summary>
+/// <remarks>
+/// Version 2 stores the cells map as a vertices lattice for each subgrid (version 1 had the eight vertices of each cell)
+/// </remarks>
+const uint32_t BAKED_VOLUME_VERSION = 2;
+/// <summary>
+/// Every section in the file starts at this boundary (it' s enough for a vec4 and for a cache line)
+/// </summary>
+const uint64_t BAKED_VOLUME_SECTION_ALIGNMENT = 64;
+
+/// <summary>
+/// Header of a baked irradiance volume file
+/// </summary>
+/// <remarks>
+/// The file is a flat little-endian image of the data that the grid uploads to the GPU:
+/// [Header][SubGrids tree][Cells vertices to samples map][Irradiance payload]
+///
+/// Each section starts at a BAKED_VOLUME_SECTION_ALIGNMENT boundary and it' s stored exactly as the shader
+/// expects it, so once the file is mapped in memory the section pointers can be handed directly to the
+/// shader buffers without any parsing or intermediate copy
+/// </remarks>
+struct BakedVolumeHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t Flags;
+
+	/// <summary>
+	/// Non transformed grid bounds
+	/// </summary>
+	glm::vec3 GridMin;
+	int32_t MaxSubGridLevel;
+	glm::vec3 GridMax;
+	/// <summary>
+	/// Number of irradiance samples stored for each probe
+	/// </summary>
+	int32_t SamplesCount;
+	glm::ivec3 NumCellsPerDimension;
+	/// <summary>
+	/// Sampler resolution used during the bake (informative)
+	/// </summary>
+	int32_t SamplesResolution;
+
+	int32_t SubGridCount;
+	int32_t ProbeCount;
+	/// <summary>
+	/// DirectionSetType used during the bake. The field was reserved (zero) in the older files, that were all concentric
+	/// </summary>
+	int32_t DirectionSet;
+	int32_t Reserved;
+
+	/// <summary>
+	/// SubGrids tree section (int). Entry X contains the cell index in witch the subgrid X + 1 lives, -1 terminated
+	/// </summary>
+	uint64_t SubGridsOffset;
+	uint64_t SubGridsLength;
+	/// <summary>
+	/// Cells vertices to samples map section (int), a (CellsX + 1) x (CellsY + 1) x (CellsZ + 1) lattice for each subgrid
+	/// </summary>
+	uint64_t CellsMapOffset;
+	uint64_t CellsMapLength;
+	/// <summary>
+	/// Irradiance section (vec4)
+	/// </summary>
+	uint64_t IrradianceOffset;
+	uint64_t IrradianceLength;
+
+	static constexpr char ExpectedMagic[4] = { 'I', 'R', 'V', 'B' };
+};
+
+static_assert(sizeof(BakedVolumeHeader) == 128, "Baked volume header must have a fixed size");
+static_assert(sizeof(glm::vec4) == 16, "Irradiance payload is stored as tightly packed vec4");
+
+/// <summary>
+/// Read-only view of a baked irradiance volume file
+/// </summary>
+/// <remarks>
+/// The file is memory mapped (see MappedFile), so only the pages effectively uploaded are read from disk
+/// </remarks>
+class BakedVolume {
+private:
+	MappedFile _file;
+	const uint8_t* _data = nullptr;
+	uint64_t _size = 0;
+
+	static uint64_t AlignSection(uint64_t offset) {
+		return (offset + BAKED_VOLUME_SECTION_ALIGNMENT - 1) & ~(BAKED_VOLUME_SECTION_ALIGNMENT - 1);
+	}
+
+	void CheckSection(uint64_t offset, uint64_t length, uint64_t elementSize) const {
+		if (offset % BAKED_VOLUME_SECTION_ALIGNMENT != 0) throw std::runtime_error("Baked volume section is not aligned");
+		if (offset > _size || length > (_size - offset) / elementSize) throw std::runtime_error("Baked volume section exceeds the file size");
+	}
+
+	void Validate() const {
+		if (_size < sizeof(BakedVolumeHeader)) throw std::runtime_error("Baked volume file is too small");
+
+		const BakedVolumeHeader& header = GetHeader();
+		if (memcmp(header.Magic, BakedVolumeHeader::ExpectedMagic, sizeof(header.Magic)) != 0) throw std::runtime_error("Invalid baked volume file");
+		if (header.Version == 1) throw std::runtime_error("Baked volume version 1 has the old cells map layout, the volume must be baked again");
+		if (header.Version != BAKED_VOLUME_VERSION) throw std::runtime_error("Unsupported baked volume version");
+		if (header.HeaderSize != sizeof(BakedVolumeHeader)) throw std::runtime_error("Invalid baked volume header size");
+
+		CheckSection(header.SubGridsOffset, header.SubGridsLength, sizeof(int32_t));
+		CheckSection(header.CellsMapOffset, header.CellsMapLength, sizeof(int32_t));
+		CheckSection(header.IrradianceOffset, header.IrradianceLength, sizeof(glm::vec4));
+
+		// The subgrids tree must always contains the main grid terminator
+		if (header.SubGridCount <= 0 || header.SubGridsLength != (uint64_t)header.SubGridCount) throw std::runtime_error("Invalid baked volume subgrids tree");
+		if (header.IrradianceLength != (uint64_t)header.ProbeCount * header.SamplesCount) throw std::runtime_error("Invalid baked volume irradiance payload");
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(BakedVolume);
+
+	/// <summary>
+	/// Opens and validates a baked volume file
+	/// </summary>
+	explicit BakedVolume(const std::string& path) : _file(path), _data(_file.Data()), _size(_file.Size()) {
+		Validate();
+	}
+
+	const BakedVolumeHeader& GetHeader() const { return *reinterpret_cast<const BakedVolumeHeader*>(_data); }
+
+	const int* GetSubGrids() const { return reinterpret_cast<const int*>(_data + GetHeader().SubGridsOffset); }
+	const int* GetCellsMap() const { return reinterpret_cast<const int*>(_data + GetHeader().CellsMapOffset); }
+	const glm::vec4* GetIrradiance() const { return reinterpret_cast<const glm::vec4*>(_data + GetHeader().IrradianceOffset); }
+
+	/// <summary>
+	/// Writes a baked volume file. Sections offsets and lengths in the header are filled by this function
+	/// </summary>
+	static void Write(const std::string& path, BakedVolumeHeader header, const int* subGrids, const int* cellsMap, const glm::vec4* irradiance) {
+		memcpy(header.Magic, BakedVolumeHeader::ExpectedMagic, sizeof(header.Magic));
+		header.Version = BAKED_VOLUME_VERSION;
+		header.HeaderSize = sizeof(BakedVolumeHeader);
+		header.SubGridsLength = header.SubGridCount;
+		header.IrradianceLength = (uint64_t)header.ProbeCount * header.SamplesCount;
+
+		header.SubGridsOffset = AlignSection(sizeof(BakedVolumeHeader));
+		header.CellsMapOffset = AlignSection(header.SubGridsOffset + header.SubGridsLength * sizeof(int32_t));
+		header.IrradianceOffset = AlignSection(header.CellsMapOffset + header.CellsMapLength * sizeof(int32_t));
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file) throw std::runtime_error("Unable to create baked volume file " + path);
+
+		static const char padding[BAKED_VOLUME_SECTION_ALIGNMENT] = { 0 };
+		uint64_t written = 0;
+		auto writeSection = [&file, &written](uint64_t offset, const void* data, uint64_t byteSize) {
+			// We pad up to the section start
+			file.write(padding, offset - written);
+			file.write(reinterpret_cast<const char*>(data), byteSize);
+			written = offset + byteSize;
+		};
+
+		writeSection(0, &header, sizeof(BakedVolumeHeader));
+		writeSection(header.SubGridsOffset, subGrids, header.SubGridsLength * sizeof(int32_t));
+		writeSection(header.CellsMapOffset, cellsMap, header.CellsMapLength * sizeof(int32_t));
+		writeSection(header.IrradianceOffset, irradiance, header.IrradianceLength * sizeof(glm::vec4));
+
+		if (!file) throw std::runtime_error("Unable to write baked volume file " + path);
+	}
+};
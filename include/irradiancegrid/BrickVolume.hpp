@@ -0,0 +1,294 @@
+#pragma once
+
+#include <std_include.h>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <zlib.h>
+#include <irradiancegrid/BakedVolume.hpp>
+#include <profiling/Profiler.hpp>
+
+/// <summary>
+/// Current version of the bricks file format
+/// </summary>
+const uint32_t BRICK_VOLUME_VERSION = 1;
+/// <summary>
+/// The bricks are stored with the bytes of the floats split in planes before the compression
+/// </summary>
+const uint32_t BRICK_VOLUME_FLAG_SHUFFLE = 1;
+
+/// <summary>
+/// Header of a bricks file: a baked volume split in compressed bricks that can be streamed (see StreamedVolume)
+/// </summary>
+/// <remarks>
+/// [Header][SubGrids tree][Bricks table][Bricks data]
+///
+/// Each subgrid is a brick: the irradiance of the probes on the vertices of its lattice, (CellsX + 1) x (CellsY + 1) x (CellsZ + 1)
+/// probes in the cells map order. All the bricks have the same size, so a brick can be uploaded in any slot of the GPU pool
+/// and the shader finds a probe from the slot and the lattice vertex, without the cells map.
+/// The probes shared by adjacent subgrids are stored in each brick.
+///
+/// Each brick is deflated on its own, so it can be read and inflated without the others
+/// </remarks>
+struct BrickVolumeHeader {
+	char Magic[4];
+	uint32_t Version;
+	uint32_t HeaderSize;
+	uint32_t Flags;
+
+	/// <summary>
+	/// Non transformed grid bounds
+	/// </summary>
+	glm::vec3 GridMin;
+	int32_t MaxSubGridLevel;
+	glm::vec3 GridMax;
+	/// <summary>
+	/// Number of irradiance samples stored for each probe
+	/// </summary>
+	int32_t SamplesCount;
+	glm::ivec3 NumCellsPerDimension;
+	/// <summary>
+	/// Sampler resolution used during the bake (informative)
+	/// </summary>
+	int32_t SamplesResolution;
+
+	/// <summary>
+	/// Number of subgrids, and so of bricks
+	/// </summary>
+	int32_t SubGridCount;
+	/// <summary>
+	/// Probes in each brick
+	/// </summary>
+	int32_t BrickProbes;
+	int32_t DirectionSet;
+	int32_t Reserved;
+
+	/// <summary>
+	/// SubGrids tree section (int), as in the baked volume
+	/// </summary>
+	uint64_t SubGridsOffset;
+	/// <summary>
+	/// Bricks table section (BrickEntry), one entry for each subgrid
+	/// </summary>
+	uint64_t BricksTableOffset;
+	/// <summary>
+	/// Uncompressed size of the bricks (informative)
+	/// </summary>
+	uint64_t UncompressedBytes;
+	uint64_t CompressedBytes;
+
+	static constexpr char ExpectedMagic[4] = { 'I', 'R', 'B', 'K' };
+};
+
+/// <summary>
+/// Position of a compressed brick in the file
+/// </summary>
+struct BrickEntry {
+	uint64_t Offset;
+	uint64_t CompressedSize;
+};
+
+static_assert(sizeof(BrickVolumeHeader) == 112, "Bricks header must have a fixed size");
+
+/// <summary>
+/// Bricks file opened for the streaming
+/// </summary>
+/// <remarks>
+/// Only the header, the subgrids tree and the bricks table are kept in memory. The bricks are read on demand with
+/// ReadBrick(), that is meant to be called by a single I/O thread: each reader has its own file stream
+/// </remarks>
+class BrickVolume {
+private:
+	std::string _path;
+	BrickVolumeHeader _header;
+	std::vector<int> _subGrids;
+	std::vector<BrickEntry> _bricks;
+
+	/// <summary>
+	/// Splits the bytes of the floats in four planes: the exponents and the high mantissa bytes of near
+	/// values are the same, so the deflate finds longer matches
+	/// </summary>
+	static void Shuffle(const uint8_t* source, uint8_t* destination, size_t floatsCount) {
+		for (size_t i = 0; i < floatsCount; i++)
+		{
+			for (size_t b = 0; b < sizeof(float); b++) destination[b * floatsCount + i] = source[i * sizeof(float) + b];
+		}
+	}
+
+	static void Unshuffle(const uint8_t* source, uint8_t* destination, size_t floatsCount) {
+		for (size_t i = 0; i < floatsCount; i++)
+		{
+			for (size_t b = 0; b < sizeof(float); b++) destination[i * sizeof(float) + b] = source[b * floatsCount + i];
+		}
+	}
+
+	template<typename T>
+	static void ReadSection(std::ifstream& file, uint64_t offset, T* data, size_t count) {
+		file.seekg(offset);
+		if (!file.read(reinterpret_cast<char*>(data), sizeof(T) * count)) throw std::runtime_error("Bricks file section exceeds the file size");
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(BrickVolume);
+
+	/// <summary>
+	/// Opens and validates a bricks file
+	/// </summary>
+	explicit BrickVolume(const std::string& path) : _path(path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file) throw std::runtime_error("Unable to open bricks file " + path);
+
+		if (!file.read(reinterpret_cast<char*>(&_header), sizeof(BrickVolumeHeader))) throw std::runtime_error("Bricks file is too small");
+		if (memcmp(_header.Magic, BrickVolumeHeader::ExpectedMagic, sizeof(_header.Magic)) != 0) throw std::runtime_error("Invalid bricks file");
+		if (_header.Version != BRICK_VOLUME_VERSION) throw std::runtime_error("Unsupported bricks file version");
+		if (_header.HeaderSize != sizeof(BrickVolumeHeader)) throw std::runtime_error("Invalid bricks file header size");
+		if (glm::any(glm::lessThanEqual(_header.NumCellsPerDimension, glm::ivec3(0)))) throw std::runtime_error("Invalid bricks file division");
+		if (_header.SubGridCount <= 0 || _header.SamplesCount <= 0) throw std::runtime_error("Invalid bricks file");
+
+		const glm::ivec3 lattice = _header.NumCellsPerDimension + 1;
+		if (_header.BrickProbes != lattice.x * lattice.y * lattice.z) throw std::runtime_error("Invalid bricks file brick size");
+
+		_subGrids.resize(_header.SubGridCount);
+		ReadSection(file, _header.SubGridsOffset, _subGrids.data(), _subGrids.size());
+		_bricks.resize(_header.SubGridCount);
+		ReadSection(file, _header.BricksTableOffset, _bricks.data(), _bricks.size());
+	}
+
+	const std::string& GetPath() const { return _path; }
+	const BrickVolumeHeader& GetHeader() const { return _header; }
+	/// <summary>
+	/// SubGrids tree. Entry X contains the cell index in witch the subgrid X + 1 lives, -1 terminated
+	/// </summary>
+	const std::vector<int>& GetSubGrids() const { return _subGrids; }
+	int GetBricksCount() const { return (int)_bricks.size(); }
+	const BrickEntry& GetBrick(int index) const { return _bricks[index]; }
+	/// <summary>
+	/// Irradiance entries of a brick
+	/// </summary>
+	size_t GetBrickLength() const { return (size_t)_header.BrickProbes * _header.SamplesCount; }
+
+	/// <summary>
+	/// Reads and inflates a brick
+	/// </summary>
+	/// <param name="file">Stream of the calling thread, opened on GetPath()</param>
+	/// <param name="compressed">Scratch buffer for the compressed data</param>
+	/// <param name="irradiance">Brick irradiance, GetBrickLength() entries</param>
+	void ReadBrick(std::ifstream& file, int index, std::vector<uint8_t>& compressed, glm::vec4* irradiance) const {
+		const BrickEntry& entry = _bricks[index];
+		compressed.resize(entry.CompressedSize);
+		{
+			PROFILE_SCOPE("BrickVolume::Read");
+			ReadSection(file, entry.Offset, compressed.data(), compressed.size());
+		}
+		Inflate(compressed.data(), compressed.size(), irradiance, GetBrickLength(), (_header.Flags & BRICK_VOLUME_FLAG_SHUFFLE) != 0);
+	}
+
+	/// <summary>
+	/// Compresses the irradiance of a brick
+	/// </summary>
+	static void Deflate(const glm::vec4* irradiance, size_t length, int level, bool shuffle, std::vector<uint8_t>& compressed) {
+		const size_t byteSize = length * sizeof(glm::vec4);
+		std::vector<uint8_t> shuffled;
+		const uint8_t* source = reinterpret_cast<const uint8_t*>(irradiance);
+		if (shuffle) {
+			shuffled.resize(byteSize);
+			Shuffle(source, shuffled.data(), length * 4);
+			source = shuffled.data();
+		}
+
+		uLongf compressedSize = compressBound((uLong)byteSize);
+		compressed.resize(compressedSize);
+		if (compress2(compressed.data(), &compressedSize, source, (uLong)byteSize, level) != Z_OK) throw std::runtime_error("Unable to compress a brick");
+		compressed.resize(compressedSize);
+	}
+
+	/// <summary>
+	/// Decompresses the irradiance of a brick
+	/// </summary>
+	static void Inflate(const uint8_t* compressed, size_t compressedSize, glm::vec4* irradiance, size_t length, bool shuffle) {
+		PROFILE_SCOPE("BrickVolume::Inflate");
+
+		const size_t byteSize = length * sizeof(glm::vec4);
+		// Without the shuffle we inflate directly in the destination
+		std::vector<uint8_t> shuffled(shuffle ? byteSize : 0);
+		uint8_t* destination = shuffle ? shuffled.data() : reinterpret_cast<uint8_t*>(irradiance);
+
+		uLongf inflatedSize = (uLongf)byteSize;
+		if (uncompress(destination, &inflatedSize, compressed, (uLong)compressedSize) != Z_OK || inflatedSize != byteSize) {
+			throw std::runtime_error("Corrupted brick");
+		}
+		if (shuffle) Unshuffle(shuffled.data(), reinterpret_cast<uint8_t*>(irradiance), length * 4);
+	}
+
+	/// <summary>
+	/// Splits a baked volume in bricks
+	/// </summary>
+	/// <returns>Header of the written file</returns>
+	static BrickVolumeHeader Write(const std::string& path, const BakedVolume& bakedVolume, int level = Z_DEFAULT_COMPRESSION);
+};
+
+inline BrickVolumeHeader BrickVolume::Write(const std::string& path, const BakedVolume& bakedVolume, int level) {
+	const BakedVolumeHeader& bakedHeader = bakedVolume.GetHeader();
+
+	BrickVolumeHeader header = {};
+	memcpy(header.Magic, BrickVolumeHeader::ExpectedMagic, sizeof(header.Magic));
+	header.Version = BRICK_VOLUME_VERSION;
+	header.HeaderSize = sizeof(BrickVolumeHeader);
+	header.Flags = BRICK_VOLUME_FLAG_SHUFFLE;
+	header.GridMin = bakedHeader.GridMin;
+	header.GridMax = bakedHeader.GridMax;
+	header.MaxSubGridLevel = bakedHeader.MaxSubGridLevel;
+	header.SamplesCount = bakedHeader.SamplesCount;
+	header.NumCellsPerDimension = bakedHeader.NumCellsPerDimension;
+	header.SamplesResolution = bakedHeader.SamplesResolution;
+	header.SubGridCount = bakedHeader.SubGridCount;
+	header.DirectionSet = bakedHeader.DirectionSet;
+
+	const glm::ivec3 lattice = header.NumCellsPerDimension + 1;
+	header.BrickProbes = lattice.x * lattice.y * lattice.z;
+	if (bakedHeader.CellsMapLength < (uint64_t)header.BrickProbes * header.SubGridCount) throw std::runtime_error("Invalid baked volume cells map");
+
+	header.SubGridsOffset = sizeof(BrickVolumeHeader);
+	header.BricksTableOffset = header.SubGridsOffset + sizeof(int32_t) * header.SubGridCount;
+	uint64_t dataOffset = header.BricksTableOffset + sizeof(BrickEntry) * header.SubGridCount;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file) throw std::runtime_error("Unable to create bricks file " + path);
+
+	// The sections before the bricks are written at the end, when the bricks table is complete
+	file.seekp(dataOffset);
+
+	const int* cellsMap = bakedVolume.GetCellsMap();
+	const glm::vec4* irradiance = bakedVolume.GetIrradiance();
+	const size_t samplesCount = header.SamplesCount;
+	std::vector<glm::vec4> brick((size_t)header.BrickProbes * samplesCount);
+	std::vector<uint8_t> compressed;
+	std::vector<BrickEntry> entries(header.SubGridCount);
+	for (int subGrid = 0; subGrid < header.SubGridCount; subGrid++)
+	{
+		for (int vertex = 0; vertex < header.BrickProbes; vertex++)
+		{
+			int probe = cellsMap[(size_t)subGrid * header.BrickProbes + vertex];
+			glm::vec4* destination = brick.data() + vertex * samplesCount;
+			if (probe < 0 || probe >= bakedHeader.ProbeCount) throw std::runtime_error("Invalid baked volume probe index");
+			memcpy(destination, irradiance + probe * samplesCount, sizeof(glm::vec4) * samplesCount);
+		}
+
+		Deflate(brick.data(), brick.size(), level, true, compressed);
+		entries[subGrid] = { dataOffset, compressed.size() };
+		file.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+		dataOffset += compressed.size();
+		header.UncompressedBytes += brick.size() * sizeof(glm::vec4);
+		header.CompressedBytes += compressed.size();
+	}
+
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(BrickVolumeHeader));
+	file.write(reinterpret_cast<const char*>(bakedVolume.GetSubGrids()), sizeof(int32_t) * header.SubGridCount);
+	file.write(reinterpret_cast<const char*>(entries.data()), sizeof(BrickEntry) * entries.size());
+	if (!file) throw std::runtime_error("Unable to write bricks file " + path);
+	return header;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#if WITH_BULLET
+
+#include <std_include.h>
+#include <unordered_map>
+#include <bullet/btBulletCollisionCommon.h>
+#include <BCube.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
+
+/// <summary>
+/// Subgrid demand of the grid cells, tracked by a Bullet broadphase
+/// </summary>
+/// <remarks>
+/// The cells of every level are static proxies and the scene objects are the dynamic ones. The collision groups
+/// allow only the cell-object pairs. The pair cache notifies only the pairs that start or stop overlapping, so each
+/// cell keeps the count of the objects that intersect it and the structure update does not test every object
+/// against every cell: the work is proportional to the objects that moved.
+///
+/// A moved proxy is removed and inserted again instead of using setAabb(): the btDbvtBroadphase enlarges the
+/// moved leaves by a margin and removes the stale pairs lazily, while a new leaf has the exact bounds and the
+/// pairs of a removed proxy are released immediately. In this way the demand is exactly the one of the brute-force
+/// test (the bounds touching is an overlap in both).
+///
+/// The broadphase is not shared with the Physics world: the dispatcher would run the narrowphase on the cells pairs
+/// </remarks>
+class BroadphaseRefinement : public btOverlappingPairCallback {
+private:
+	static const int CellGroup = btBroadphaseProxy::StaticFilter;
+	static const int ObjectGroup = btBroadphaseProxy::DefaultFilter;
+
+	struct ObjectProxy {
+		btBroadphaseProxy* Proxy;
+		BCube Bounds;
+		/// <summary>
+		/// Last update that has seen the object
+		/// </summary>
+		unsigned int Stamp;
+	};
+
+	btOverlappingPairCache* _pairCache;
+	btDbvtBroadphase* _broadphase;
+	std::unordered_map<const void*, ObjectProxy> _objects;
+	unsigned int _stamp = 0;
+	int _movedObjectsCount = 0;
+
+	btBroadphaseProxy* CreateProxy(const BCube& bounds, void* clientObject, int group, int mask) {
+		const btVector3 min(bounds.Min.x, bounds.Min.y, bounds.Min.z);
+		const btVector3 max(bounds.Max.x, bounds.Max.y, bounds.Max.z);
+		// The shape type is only used by the dispatcher, that we never run
+		return _broadphase->createProxy(min, max, BOX_SHAPE_PROXYTYPE, clientObject, group, mask, nullptr);
+	}
+
+	/// <summary>
+	/// Demand counter of the cell in a cell-object pair
+	/// </summary>
+	static int* GetCellDemand(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) {
+		btBroadphaseProxy* cellProxy = (proxy0->m_collisionFilterGroup & CellGroup) ? proxy0 : proxy1;
+		assert(cellProxy->m_collisionFilterGroup & CellGroup);
+		return static_cast<int*>(cellProxy->m_clientObject);
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(BroadphaseRefinement);
+
+	BroadphaseRefinement() {
+		_pairCache = new btHashedOverlappingPairCache();
+		_broadphase = new btDbvtBroadphase(_pairCache);
+		// The ghost callback is notified by the pair cache for every added and removed pair
+		_pairCache->setInternalGhostPairCallback(this);
+	}
+
+	/// <summary>
+	/// Registers a cell. The counter is incremented for each object that overlaps the cell
+	/// </summary>
+	/// <remarks>
+	/// The overlapping objects are counted immediately, so the cells of a new subgrid have their demand before
+	/// the subgrid structure is updated
+	/// </remarks>
+	btBroadphaseProxy* AddCell(const BCube& transformedBounds, int* demand) {
+		return CreateProxy(transformedBounds, demand, CellGroup, ObjectGroup);
+	}
+
+	/// <summary>
+	/// Updates the bounds of a cell (for example after a grid transform change)
+	/// </summary>
+	btBroadphaseProxy* MoveCell(btBroadphaseProxy* proxy, const BCube& transformedBounds) {
+		int* demand = static_cast<int*>(proxy->m_clientObject);
+		RemoveCell(proxy);
+		return AddCell(transformedBounds, demand);
+	}
+
+	void RemoveCell(btBroadphaseProxy* proxy) {
+		// The pairs are removed (and the overlapping objects demand released) with the proxy
+		_broadphase->destroyProxy(proxy, nullptr);
+	}
+
+	/// <summary>
+	/// Synchronizes the objects proxies with the scene. Only the objects that moved, appeared or disappeared
+	/// change the cells demand
+	/// </summary>
+	template<class Iterator>
+	void UpdateObjects(const Iterator& begin, const Iterator& end);
+
+	/// <summary>
+	/// Objects whose proxy was created, moved or removed by the last UpdateObjects()
+	/// </summary>
+	int GetMovedObjectsCount() const { return _movedObjectsCount; }
+
+	/* btOverlappingPairCallback */
+
+	btBroadphasePair* addOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) override {
+		++*GetCellDemand(proxy0, proxy1);
+		return nullptr;
+	}
+
+	void* removeOverlappingPair(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1, btDispatcher* dispatcher) override {
+		int* demand = GetCellDemand(proxy0, proxy1);
+		--*demand;
+		assert(*demand >= 0);
+		return nullptr;
+	}
+
+	void removeOverlappingPairsContainingProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher) override {
+		// The pair cache already notifies each removed pair
+	}
+
+	~BroadphaseRefinement() {
+		// The cells proxies are removed by the cells, that must be destroyed before
+		for (auto& object : _objects)
+		{
+			_broadphase->destroyProxy(object.second.Proxy, nullptr);
+		}
+		delete _broadphase;
+		delete _pairCache;
+	}
+};
+
+template<class Iterator>
+void BroadphaseRefinement::UpdateObjects(const Iterator& begin, const Iterator& end)
+{
+	PROFILE_SCOPE("BroadphaseRefinement::UpdateObjects");
+
+	++_stamp;
+	_movedObjectsCount = 0;
+	for (Iterator it = begin; it != end; ++it)
+	{
+		const auto object = *it;
+		const BCube& bounds = object->GetTransformedBoundingCube();
+
+		auto found = _objects.find(object);
+		if (found == _objects.end()) {
+			_objects.insert({ object, { CreateProxy(bounds, nullptr, ObjectGroup, CellGroup), bounds, _stamp } });
+			_movedObjectsCount++;
+			continue;
+		}
+
+		ObjectProxy& objectProxy = found->second;
+		objectProxy.Stamp = _stamp;
+		if (objectProxy.Bounds.Min == bounds.Min && objectProxy.Bounds.Max == bounds.Max) continue;
+
+		_broadphase->destroyProxy(objectProxy.Proxy, nullptr);
+		objectProxy.Proxy = CreateProxy(bounds, nullptr, ObjectGroup, CellGroup);
+		objectProxy.Bounds = bounds;
+		_movedObjectsCount++;
+	}
+
+	// The objects not seen in this update left the scene
+	for (auto it = _objects.begin(); it != _objects.end();)
+	{
+		if (it->second.Stamp == _stamp) {
+			++it;
+			continue;
+		}
+		_broadphase->destroyProxy(it->second.Proxy, nullptr);
+		it = _objects.erase(it);
+		_movedObjectsCount++;
+	}
+
+	// The pairs are already up to date: this only rebalances the trees incrementally
+	_broadphase->calculateOverlappingPairs(nullptr);
+	Metrics::Instance.Add(MetricCounter::BroadphaseObjectsMoved, _movedObjectsCount);
+}
+
+#endif
@@ -67,6 +67,11 @@ GridCell::GridCell(SubGrid* parentGrid, const BCube& cellBoundingCube, glm::ivec
 		++i;
 	}
 	_transformedBoundingCube = _boundingCube >> transform;
+#if WITH_BULLET
+	if (BroadphaseRefinement* broadphase = gridData->GetBroadphase()) {
+		_broadphaseProxy = broadphase->AddCell(_transformedBoundingCube, &_broadphaseDemand);
+	}
+#endif
 	_registration = parentGrid->GetGridData()->RegisterTransformChanged(std::bind(&GridCell::OnTranformParamsChanged, this, std::placeholders::_1));
 }
 
@@ -78,6 +83,11 @@ void GridCell::OnTranformParamsChanged(const TransformParams& p)
 	{
 		_cellSamples[i]->SetTransform(p);
 	}
+#if WITH_BULLET
+	if (_broadphaseProxy) {
+		_broadphaseProxy = _parent->GetGridData()->GetBroadphase()->MoveCell(_broadphaseProxy, _transformedBoundingCube);
+	}
+#endif
 }
 
 void GridCell::CreateSubGrid()
@@ -118,5 +128,8 @@ void GridCell::SetIrradianceOffset()
 GridCell::~GridCell()
 {
 	_parent->GetGridData()->UnregisterTransformChanged(_registration);
+#if WITH_BULLET
+	if (_broadphaseProxy) _parent->GetGridData()->GetBroadphase()->RemoveCell(_broadphaseProxy);
+#endif
 	delete _subGrid;
 }
\ No newline at end of file
@@ -14,6 +14,42 @@
 //#define DEBUGRANDOMCOLOR
 #endif // DEBUG
 
+/// <summary>
+/// Span of a probe in the irradiance buffer (std430 layout of the ProbeLayout struct in irradiance.frag)
+/// </summary>
+/// <remarks>
+/// The probes can be sampled with different resolutions, so the irradiance buffer is not indexed with a fixed stride
+/// </remarks>
+struct ProbeLayout {
+	/// <summary>
+	/// First irradiance entry of the probe
+	/// </summary>
+	int Offset;
+	int SamplesCount;
+	/// <summary>
+	/// SamplingTier of the probe, to select the direction lookup table
+	/// </summary>
+	int Tier;
+};
+
+static_assert(sizeof(ProbeLayout) == 12, "Probe layout must match the std430 layout");
+
+/// <summary>
+/// Irradiance arrays of the grid where a progressive pass can find the irradiance of the last pass of its probe
+/// </summary>
+/// <remarks>
+/// The generation of an array changes when it' s reallocated or swapped, so a span is trusted only in the generation it was written in
+/// </remarks>
+struct PreviousIrradiance {
+	int BufferGeneration;
+	/// <summary>
+	/// Array swapped out by the bounce snapshot, null without the bounce
+	/// </summary>
+	const glm::vec4* Snapshot;
+	GLsizeiptr SnapshotLength;
+	int SnapshotGeneration;
+};
+
 /// <summary>
 /// Represents a sampling point in the space
 /// </summary>
@@ -24,6 +60,19 @@ private:
 	/// </summary>
 	int _gridSampleIndex;
 	/// <summary>
+	/// Irradiance span and sampling tier of the probe, assigned by the grid before the update
+	/// </summary>
+	ProbeLayout _layout = { 0, 0, (int)SamplingTier::High };
+	/// <summary>
+	/// Radiance accumulated by the temporal sampling
+	/// </summary>
+	RadianceHistory _history;
+	/// <summary>
+	/// Span written by the last update and generation of the irradiance array it was written in (-1 if not reusable)
+	/// </summary>
+	ProbeLayout _writtenLayout = { 0, 0, (int)SamplingTier::High };
+	int _writtenGeneration = -1;
+	/// <summary>
 	/// Associated sampling point
 	/// </summary>
 	glm::vec4 _samplingPoint;
@@ -32,14 +81,6 @@ private:
 	/// Sampling point with transformed coordinates after an Update call
 	/// </summary>
 	glm::vec3 _transformedSamplingPoint;
-	/// <summary>
-	/// Number of samples taken in the point
-	/// </summary>
-	/// <remarks>
-	/// This is usefull for the Draw() call
-	/// </remarks>
-	int _samplesCount = 0;
-
 	/// <summary>
 	/// Debug random color that is enabled via an application flag
 	/// </summary>
@@ -76,59 +117,126 @@ public:
 		// ABSOLUTE WARN: On Linux :<( the trick with the vec4 doesn't work so we MUST return a valid glm::vec3 reference
 		return _vec3SamplingPoint;
 	}
+
+	/// <summary>
+	/// Return the sampling point in world coordinates
+	/// </summary>
+	const glm::vec3& GetTransformedSamplingPoint() const { return _transformedSamplingPoint; }
 	/// <summary>
 	/// Updates the sample data relative to the sampling point
 	/// </summary>
 	/// <param name="sampler">Radiance sampler instance</param>
 	/// <param name="irradianceBuffer">Buffer to update</param>
-	void Update(RadianceSampler* sampler, VariableShaderBuffer<glm::vec4>& irradianceBuffer);
+	/// <param name="temporal">Progressive sampling settings, or null to trace all the directions</param>
+	/// <param name="previous">Arrays holding the irradiance of the last update, or null if unknown</param>
+	void Update(RadianceSampler* sampler, VariableShaderBuffer<glm::vec4>& irradianceBuffer, const TemporalSampling* temporal = nullptr,
+		const PreviousIrradiance* previous = nullptr);
+#ifndef HEADLESS
 	/// <summary>
 	/// Draw a radiance sphere in the transformed sampling point position 
 	/// </summary>
-	void Draw(RadianceSphere* radianceSphere);
+	/// <param name="probesBase">First entry of the volume in the packed probes layout buffer</param>
+	/// <param name="irradianceBase">First entry of the volume in the packed irradiance buffer</param>
+	/// <param name="lookupBase">Direction lookup section of the volume in the packed lookup buffer</param>
+	void Draw(RenderQueue& queue, RadianceSphere* radianceSphere, int probesBase, int irradianceBase, int lookupBase);
+	/// <summary>
+	/// Returns the instance data of the radiance sphere, for the instanced draw of the whole grid
+	/// </summary>
+	ProbeInstance GetDrawInstance(int probesBase, int irradianceBase, int lookupBase) const;
+#endif
 	/// <summary>
 	/// Returns the sample index associated with the grid structure
 	/// </summary>
 	int GetSampleGridIndex() const { return _gridSampleIndex; }
 	void SetSampleGridIndex(int index) { _gridSampleIndex = index; }
 
+	const ProbeLayout& GetLayout() const { return _layout; }
+	void SetLayout(const ProbeLayout& layout) { _layout = layout; }
+
 	void UseRandomColor(bool active) { _useRandomColor = active; }
 
+	/// <summary>
+	/// Discards the accumulated radiance: the next temporal update traces all the directions
+	/// </summary>
+	void ResetHistory() { _history.Reset(); }
+	/// <summary>
+	/// Releases the accumulated radiance memory
+	/// </summary>
+	void ReleaseHistory() { _history.Release(); }
+
 	void SetTransform(const TransformParams& t) {
 		// To avoid to calculate the transformed sampling point each time, 
 		// we do de calculation only one time
 		_transformedSamplingPoint = _samplingPoint >> t;
+		// The probe has moved, so the radiance seen from the old position is not valid anymore
+		_history.Reset();
 	}
 };
 
-void GridCellSample::Update(RadianceSampler* sampler, VariableShaderBuffer<glm::vec4>& irradianceBuffer) {
+void GridCellSample::Update(RadianceSampler* sampler, VariableShaderBuffer<glm::vec4>& irradianceBuffer, const TemporalSampling* temporal,
+	const PreviousIrradiance* previous) {
 	// The update must be performed on the irradiance buffer provided
 	// So we have to ensure that the grid-sample index is correctly set
 	// and doesn' t exceed the buffer length
 	if (_gridSampleIndex < 0) throw std::runtime_error("Sample index must be set before update");
 
+	// The span must match the tier resolution, otherwise the grid has not refreshed the layout
+	const SamplingTier tier = (SamplingTier)_layout.Tier;
+	if (_layout.SamplesCount != sampler->SamplesCount(tier)) throw std::runtime_error("Probe layout does not match the sampler");
+
 	int bufferLength = irradianceBuffer.GetVectorLength();
-	if (bufferLength <= _gridSampleIndex) throw std::runtime_error("Invalid irradiance buffer size");
+	if (bufferLength < _layout.Offset + _layout.SamplesCount) throw std::runtime_error("Invalid irradiance buffer size");
 
-	// We have to seek our irradiance buffer span remembering that each grid sample is storing "_samplesCount" samples
-	_samplesCount = sampler->SamplesCount();
+	// We have to seek our irradiance buffer span
 	glm::vec4* basePtr = irradianceBuffer.GetVectorPtr();
-	glm::vec4* dataPointer = basePtr + (_gridSampleIndex * _samplesCount);
+	glm::vec4* dataPointer = basePtr + _layout.Offset;
 
 	if (_useRandomColor) {
-		for (size_t i = 0; i < sampler->SamplesCount(); i++)
+		for (int i = 0; i < _layout.SamplesCount; i++)
 		{
 			dataPointer[i] = glm::vec4(_randomColor, 0.0f);
 		}
 	}
+	else if (temporal) {
+		// The last irradiance is still in place if the span didn' t move, otherwise it' s in the array swapped out by the snapshot
+		const glm::vec4* previousIrradiance = nullptr;
+		if (previous && _writtenLayout.SamplesCount == _layout.SamplesCount && _writtenLayout.Tier == _layout.Tier) {
+			if (_writtenGeneration == previous->BufferGeneration && _writtenLayout.Offset == _layout.Offset) {
+				previousIrradiance = dataPointer;
+			}
+			else if (previous->Snapshot && _writtenGeneration == previous->SnapshotGeneration &&
+				_writtenLayout.Offset + _writtenLayout.SamplesCount <= previous->SnapshotLength) {
+				previousIrradiance = previous->Snapshot + _writtenLayout.Offset;
+			}
+		}
+		sampler->SampleProgressive(_transformedSamplingPoint, dataPointer, tier, *temporal, _history, previousIrradiance);
+	}
 	else {
 		// Finally we sample the irradiance in the transformed sampling point
-		sampler->Sample(_transformedSamplingPoint, dataPointer);
+		sampler->Sample(_transformedSamplingPoint, dataPointer, tier);
 	}
+
+	_writtenLayout = _layout;
+	_writtenGeneration = !_useRandomColor && previous ? previous->BufferGeneration : -1;
 }
 
-void GridCellSample::Draw(RadianceSphere* radianceSphere)
+#ifndef HEADLESS
+/// <summary>
+/// Scale of the debug radiance spheres
+/// </summary>
+const float GRID_SAMPLE_SPHERE_SCALE = 0.30f;
+
+void GridCellSample::Draw(RenderQueue& queue, RadianceSphere* radianceSphere, int probesBase, int irradianceBase, int lookupBase)
 {
 	// The draw call in this case is usefull only for debug visualization of sampled irradiance in a point
-	radianceSphere->Draw(_transformedSamplingPoint, 0.30f, GetSampleGridIndex(), _samplesCount);
-}
\ No newline at end of file
+	radianceSphere->Draw(queue, _transformedSamplingPoint, GRID_SAMPLE_SPHERE_SCALE, GetSampleGridIndex(), probesBase, irradianceBase, lookupBase);
+}
+
+ProbeInstance GridCellSample::GetDrawInstance(int probesBase, int irradianceBase, int lookupBase) const
+{
+	ProbeInstance instance;
+	instance.TranslationScale = glm::vec4(_transformedSamplingPoint, GRID_SAMPLE_SPHERE_SCALE);
+	instance.Samples = glm::ivec4(GetSampleGridIndex(), probesBase, irradianceBase, lookupBase);
+	return instance;
+}
+#endif
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <cassert>
 #include <functional>
 #include <irradiancegrid/CellSample.hpp>
+#include <profiling/Metrics.hpp>
 
 /// <summary>
 /// Container for a collection of Cell Samples
@@ -218,6 +219,8 @@ void CellSamplesContainer::Trim()
 		}
 	}
 
+	Metrics::Instance.Add(MetricCounter::TrimRemovals, _keyToBeRemoveCached.size());
+
 	for (size_t i = 0; i < _keyToBeRemoveCached.size(); i++)
 	{
 		// We first reset out shared ptr in the vector so the following erase in the map will
@@ -9,29 +9,201 @@
 #include <irradiancegrid/Cell.hpp>
 #include <irradiancegrid/GridData.hpp>
 
-inline void Grid::Draw(RadianceSphere* radianceSphere) const {
+#ifndef HEADLESS
+inline void Grid::Draw(RenderQueue& queue, RadianceSphere* radianceSphere, const Frustum& frustum) const {
+	// Baked data does not have the samples on the CPU side
+	if (_bakedVolume) return;
+
+	PROFILE_SCOPE("Grid::Draw");
 	const CellSamplesContainer::SamplesVector& samplesMap = _gridData->GetCellSamples().GetVector();
-	for (const auto& it : samplesMap)
+
+	// Coarse pass on the subgrids hierarchy: the cells are expanded by the sphere radius (the sphere model has unit radius)
+	_visibleSamples.assign(samplesMap.size(), 0);
+	_mainSubgrid->MarkVisibleSamples(frustum, GRID_SAMPLE_SPHERE_SCALE, _cellsCulling, _visibleSamples);
+
+	// Fine pass on the bounds of the spheres that survived
+	_candidateProbes.clear();
+	_probesCulling.Boxes.Clear();
+	const glm::vec3 sphereExtent(GRID_SAMPLE_SPHERE_SCALE);
+	for (size_t i = 0; i < samplesMap.size(); i++)
+	{
+		if (!_visibleSamples[i]) continue;
+
+		const glm::vec3& center = samplesMap[i]->GetTransformedSamplingPoint();
+		_probesCulling.Boxes.Add(center - sphereExtent, center + sphereExtent);
+		_candidateProbes.push_back((int)i);
+	}
+	int visibleCount = frustum.Cull(_probesCulling.Boxes, _probesCulling.Visible);
+	Metrics::Instance.Add(MetricCounter::CulledProbes, (int64_t)samplesMap.size() - visibleCount);
+
+	if (!_instancedDraw) {
+		for (size_t i = 0; i < _candidateProbes.size(); i++)
+		{
+			if (_probesCulling.Visible[i]) samplesMap[_candidateProbes[i]]->Draw(queue, radianceSphere, _probesBase, _irradianceBase, _directionLookupBase);
+		}
+		return;
+	}
+
+	// One instance for each sample: the spheres share the mesh and the shader, only the position and the
+	// irradiance span change. So we upload them in a single buffer and we issue only one draw call
+	ProbeInstance* instances = radianceSphere->AddInstances(visibleCount);
+	for (size_t i = 0; i < _candidateProbes.size(); i++)
 	{
-		it->Draw(radianceSphere);
+		if (_probesCulling.Visible[i]) *instances++ = samplesMap[_candidateProbes[i]]->GetDrawInstance(_probesBase, _irradianceBase, _directionLookupBase);
+	}
+}
+#endif
+
+inline void Grid::SaveBaked(const std::string& path) const {
+	BakedVolumeHeader header = {};
+	header.GridMin = _boundingCube.Min;
+	header.GridMax = _boundingCube.Max;
+	header.NumCellsPerDimension = _cellsPerCoordinate;
+	header.MaxSubGridLevel = _gridData->GetMaxSubGridLevel();
+
+	if (_bakedVolume) {
+		// We are frozen so the live data is not available. We re-write the mapped sections
+		const BakedVolumeHeader& bakedHeader = _bakedVolume->GetHeader();
+		header.SamplesCount = bakedHeader.SamplesCount;
+		header.SamplesResolution = bakedHeader.SamplesResolution;
+		header.SubGridCount = bakedHeader.SubGridCount;
+		header.ProbeCount = bakedHeader.ProbeCount;
+		header.CellsMapLength = bakedHeader.CellsMapLength;
+		header.DirectionSet = bakedHeader.DirectionSet;
+
+		BakedVolume::Write(path, header, _bakedVolume->GetSubGrids(), _bakedVolume->GetCellsMap(), _bakedVolume->GetIrradiance());
+		return;
+	}
+
+	const IrradianceGridData& infos = _gridData->GetInfos().GetData();
+	header.SamplesCount = infos.SamplesResolution;
+	header.SamplesResolution = _gridData->GetDirectionSetResolution();
+	header.SubGridCount = _gridData->GetSubGridCount();
+	header.ProbeCount = (int)_gridData->GetCellSamples().GetVector().size();
+	header.CellsMapLength = _gridData->GetInfos().GetCellsMapLength(header.SubGridCount);
+	header.DirectionSet = (int32_t)_gridData->GetDirectionSetType();
+
+	// The file stores a single resolution, with the fixed stride layout
+	if (_lowTierProbeCount > 0) throw std::logic_error("Adaptive sampling must be disabled (and the grid updated) before baking");
+
+	// The irradiance must have been sampled at least once with the current structure
+	const VariableShaderBuffer<glm::vec4>& irradianceBuffer = _gridData->GetIrradianceBuffer();
+	if (header.SamplesCount <= 0 || irradianceBuffer.GetVectorLength() < (GLsizeiptr)header.ProbeCount * header.SamplesCount) {
+		throw std::logic_error("Grid must be updated before being baked");
 	}
+
+	BakedVolume::Write(path, header, _gridData->_subGridsInfoBuffer.GetVectorPtr(), infos.CellsVerticesToSamplesMap, irradianceBuffer.GetVectorPtr());
+}
+
+inline void Grid::LoadBaked(const std::string& path) {
+	std::unique_ptr<BakedVolume> bakedVolume = std::make_unique<BakedVolume>(path);
+	const BakedVolumeHeader& header = bakedVolume->GetHeader();
+
+	// A baked volume is valid only for the same bounds it was generated from
+	const float epsilon = 1e-4f;
+	if (glm::any(glm::greaterThan(glm::abs(header.GridMin - _boundingCube.Min), glm::vec3(epsilon))) ||
+		glm::any(glm::greaterThan(glm::abs(header.GridMax - _boundingCube.Max), glm::vec3(epsilon)))) {
+		throw std::runtime_error("Baked volume bounds do not match the grid bounds");
+	}
+	if (glm::any(glm::lessThanEqual(header.NumCellsPerDimension, glm::ivec3(0)))) throw std::runtime_error("Invalid baked volume division");
+
+	// The whole header is validated before touching the grid, so a rejected file leaves the live grid untouched
+	const glm::ivec3 lattice = header.NumCellsPerDimension + 1;
+	if (header.CellsMapLength < (uint64_t)lattice.x * lattice.y * lattice.z * header.SubGridCount) {
+		throw std::runtime_error("Invalid baked volume cells map");
+	}
+	if (header.DirectionSet < 0 || header.DirectionSet >= (int32_t)DirectionSetType::Count) {
+		throw std::runtime_error("Invalid baked volume direction set");
+	}
+
+	// The directions are not stored: we regenerate them to rebuild the shader lookup table
+	DirectionSetType directionSetType = (DirectionSetType)header.DirectionSet;
+	std::unique_ptr<DirectionSet> directionSet = DirectionSet::Create(directionSetType);
+	if (header.SamplesCount != directionSet->GetSamplesCount(header.SamplesResolution)) {
+		throw std::runtime_error("Invalid baked volume samples count");
+	}
+
+	// We rebuild the grid with the baked settings. The root subgrid is needed only to keep
+	// the grid in a consistent state when the baked volume will be discarded
+	SetGridDivision(header.NumCellsPerDimension);
+	_gridData->SetMaxSubGridLevel(header.MaxSubGridLevel);
+	assert(header.CellsMapLength >= (uint64_t)_gridData->GetInfos().GetCellsMapLength(header.SubGridCount));
+
+	std::vector<glm::vec3> directions;
+	std::vector<float> weights;
+	directionSet->Generate(header.SamplesResolution, directions, weights);
+	_gridData->WriteDirectionLookup(directionSetType, header.SamplesResolution, BuildDirectionLookup(*directionSet, directions));
+
+	// We can now upload the mapped sections directly
+	_gridData->GetInfos().WriteSamplesCount(header.SamplesCount);
+	_gridData->GetInfos().WriteSampleIndexes(bakedVolume->GetCellsMap(), (int)header.CellsMapLength);
+	_gridData->_subGridsInfoBuffer.WriteFrom(bakedVolume->GetSubGrids(), header.SubGridsLength);
+	_gridData->GetIrradianceBuffer().WriteFrom(bakedVolume->GetIrradiance(), header.IrradianceLength);
+
+	// All the baked probes have the same resolution
+	std::vector<ProbeLayout> layouts(std::max(header.ProbeCount, 1));
+	for (int i = 0; i < (int)layouts.size(); i++)
+	{
+		layouts[i] = { i * header.SamplesCount, header.SamplesCount, (int)SamplingTier::High };
+	}
+	_gridData->GetProbesLayoutBuffer().WriteFrom(layouts.data(), (GLsizeiptr)layouts.size());
+	_lowTierProbeCount = 0;
+	_buffersVersion++;
+
+	_bakedVolume = std::move(bakedVolume);
 }
 
 template<class Iterator>
 void Grid::Update(const Iterator& begin, const Iterator& end, RadianceSampler* sampler)
 {
+	// A baked grid is frozen: the data is already on the GPU
+	if (_bakedVolume) return;
+
+	PROFILE_SCOPE("Grid::Update");
+	// The irradiance of the last update is reflected by this one only with the secondary bounce
+	if (sampler->GetBounceSource()) TakeSnapshot();
+	else _snapshot = IrradianceSnapshot();
+
+	_sampling = true;
+	UpdateStructure(begin, end, sampler);
+	SampleProbes(sampler, 0, GetProbeCount());
+	WriteIrradiance();
+	_sampling = false;
+	_temporalFrame++;
+
+	_irradianceSampled = true;
+	_sampledWith = sampler;
+	_sampledDirectionsVersion = sampler->GetDirectionsVersion();
+}
+
+template<class Iterator>
+void Grid::UpdateStructure(const Iterator& begin, const Iterator& end, RadianceSampler* sampler)
+{
+	PROFILE_SCOPE("Grid::UpdateStructure");
 
 	// We need to update only the samples count which may be have changed.
 	// The transform change is handled by the listener
 	_gridData->GetInfos().WriteSamplesCount(sampler->SamplesCount());
+	_gridData->WriteDirectionLookup(sampler->GetDirectionSetType(), sampler->GetResolution(), sampler->GetDirectionLookup());
+	// The objects may have been moved since the last update
+	sampler->UpdateRayQuery();
 
 	// We first gave to update our subgrids structure and then we have to trim the sample indexes to respect the size of the irradiance buffer
 	// This is necessary when for example, in the frame "X" there are two active subgrids
 	// and then at frame "X + 1" the first subgrid is removed, leaving some unused space in the buffer
 	// Optimization: for the most frames the subgrid structures may not change so we can avoid to 
 	// to this control every update call
+#if WITH_BULLET
+	// With the broadphase only the objects that moved change the cells demand
+	if (_broadphase) _broadphase->UpdateObjects(begin, end);
+#endif
 	if (_mainSubgrid->UpdateSubGridStructure(begin, end)) {
-		_gridData->GetCellSamples().Trim();
+		// The sample indexes are going to change
+		_snapshot.Valid = false;
+		{
+			PROFILE_SCOPE("CellSamplesContainer::Trim");
+			_gridData->GetCellSamples().Trim();
+		}
 
 		UpdateSubGridsInfos();
 	}
@@ -41,25 +213,195 @@ void Grid::Update(const Iterator& begin, const Iterator& end, RadianceSampler* s
 	_gridData->AssertSubGrid();
 #endif
 
-	// We can now sample our radiance
+	// We have to be ready to sample our radiance
+	UpdateProbesLayout(sampler);
+	_buffersVersion++;
+}
+
+inline void Grid::UpdateProbesLayout(RadianceSampler* sampler)
+{
+	PROFILE_SCOPE("Grid::UpdateProbesLayout");
+
+	const CellSamplesContainer::SamplesVector& samplesMap = _gridData->GetCellSamples().GetVector();
+	VariableShaderBuffer<ProbeLayout>& layoutBuffer = _gridData->GetProbesLayoutBuffer();
+	// The buffer is reallocated only when the probes count changes
+	layoutBuffer.SetVectorLength(std::max<GLsizeiptr>(samplesMap.size(), 1));
+	ProbeLayout* layouts = layoutBuffer.GetVectorPtr();
+
+	const int highSamplesCount = sampler->SamplesCount(SamplingTier::High);
+	const int lowSamplesCount = sampler->SamplesCount(SamplingTier::Low);
+	const float highResolutionDistance2 = _highResolutionDistance * _highResolutionDistance;
+
+	// The spans are packed in the sample index order, so the tiers changes only move the following probes
+	int offset = 0;
+	_lowTierProbeCount = 0;
+	for (size_t i = 0; i < samplesMap.size(); i++)
+	{
+		GridCellSample* sample = samplesMap[i].get();
+		const glm::vec3 viewerOffset = sample->GetTransformedSamplingPoint() - _viewerPosition;
+		const bool lowTier = _adaptiveSampling && glm::dot(viewerOffset, viewerOffset) > highResolutionDistance2;
+
+		ProbeLayout layout;
+		layout.Offset = offset;
+		layout.SamplesCount = lowTier ? lowSamplesCount : highSamplesCount;
+		layout.Tier = (int)(lowTier ? SamplingTier::Low : SamplingTier::High);
+		sample->SetLayout(layout);
+		layouts[i] = layout;
+
+		offset += layout.SamplesCount;
+		_lowTierProbeCount += (int)lowTier;
+	}
+	layoutBuffer.Write();
+
+	EnsureBuffersCapacity(offset, _gridData->GetIrradianceBuffer());
+}
+
+inline void Grid::SetTemporalAccumulation(bool enabled)
+{
+	if (enabled == _temporalAccumulation) return;
+	_temporalAccumulation = enabled;
+
+	// The history is not accumulated while the mode is disabled, so it' s never reused
+	for (const std::shared_ptr<GridCellSample>& sample : _gridData->GetCellSamples().GetVector())
+	{
+		if (enabled) sample->ResetHistory();
+		else sample->ReleaseHistory();
+	}
+}
+
+inline void Grid::ResetTemporalHistory()
+{
+	for (const std::shared_ptr<GridCellSample>& sample : _gridData->GetCellSamples().GetVector())
+	{
+		sample->ResetHistory();
+	}
+}
+
+inline int Grid::GetTemporalLatency() const
+{
+	if (!_temporalAccumulation) return 1;
+	// Passes needed by the moving average to reach 90% of a radiance change
+	int passes = _temporalBlend >= 1.0f ? 1 : (int)ceil(log(0.1f) / log(1.0f - _temporalBlend));
+	return passes * _temporalPeriod;
+}
+
+inline void Grid::TakeSnapshot()
+{
+	PROFILE_SCOPE("Grid::TakeSnapshot");
+
 	VariableShaderBuffer<glm::vec4>& irradianceBuffer = _gridData->GetIrradianceBuffer();
-	EnsureBuffersCapacity(sampler, irradianceBuffer);
+	_snapshot.Valid = false;
+	if (!_irradianceSampled || !irradianceBuffer.GetVectorPtr()) return;
+
+	// The arrays are swapped: the buffer gets the older irradiance, that is overwritten by the update.
+	// A new array is allocated only when the buffer length has changed
+	const GLsizeiptr length = irradianceBuffer.GetVectorLength();
+	if (!_snapshot.Irradiance || _snapshot.IrradianceLength != length) {
+		_snapshot.Irradiance.reset(new glm::vec4[length]);
+		std::fill(_snapshot.Irradiance.get(), _snapshot.Irradiance.get() + length, glm::vec4(0.0f));
+		_snapshot.IrradianceLength = length;
+	}
+	irradianceBuffer.SwapVector(_snapshot.Irradiance);
+	_snapshot.Generation = _irradianceGeneration++;
 
 	const CellSamplesContainer::SamplesVector& samplesMap = _gridData->GetCellSamples().GetVector();
+	_snapshot.Layouts.resize(samplesMap.size());
+	for (size_t i = 0; i < samplesMap.size(); i++)
+	{
+		_snapshot.Layouts[i] = samplesMap[i]->GetLayout();
+	}
+	_snapshot.Sampler = _sampledWith;
+	_snapshot.DirectionsVersion = _sampledDirectionsVersion;
+	_snapshot.Valid = true;
+}
+
+inline bool Grid::QueryIrradiance(const glm::vec3& point, const glm::vec3& normal, glm::vec3& irradiance) const
+{
+	// While the grid is sampled its buffer is overwritten: the irradiance of the last update is in the snapshot
+	const bool fromSnapshot = _sampling;
+	if (fromSnapshot ? !_snapshot.Valid : !_irradianceSampled) return false;
+	const RadianceSampler* sampler = fromSnapshot ? _snapshot.Sampler : _sampledWith;
+	const glm::vec4* storedIrradiance = fromSnapshot ? _snapshot.Irradiance.get() : _gridData->GetIrradianceBuffer().GetVectorPtr();
+	const GLsizeiptr storedLength = fromSnapshot ? _snapshot.IrradianceLength : _gridData->GetIrradianceBuffer().GetVectorLength();
+	// The directions of the stored irradiance must still be the sampler ones to find the stored samples
+	if (!storedIrradiance || sampler->GetDirectionsVersion() != (fromSnapshot ? _snapshot.DirectionsVersion : _sampledDirectionsVersion)) return false;
+
+	glm::vec3 offset;
+	const GridCell* cell = _mainSubgrid->FindCell(point, offset);
+	if (!cell) return false;
+
+	int storageIndexes[(int)SamplingTier::Count];
+	for (int tier = 0; tier < (int)SamplingTier::Count; tier++)
+	{
+		storageIndexes[tier] = sampler->GetDirections((SamplingTier)tier).GetStorageIndex(normal);
+	}
+
+	glm::vec3 eightColors[8];
+	for (int i = 0; i < 8; i++)
+	{
+		const GridCellSample* sample = cell->GetSample(i);
+		int sampleIndex = sample->GetSampleGridIndex();
+		if (fromSnapshot && (sampleIndex < 0 || sampleIndex >= (int)_snapshot.Layouts.size())) return false;
+
+		const ProbeLayout& layout = fromSnapshot ? _snapshot.Layouts[sampleIndex] : sample->GetLayout();
+		int storageIndex = layout.Offset + storageIndexes[layout.Tier];
+		if (storageIndex >= storedLength) return false;
+		eightColors[i] = glm::vec3(storedIrradiance[storageIndex]);
+	}
+
+	// Trilinear interpolation (same sample order of the shaders)
+	glm::vec3 c00 = glm::mix(eightColors[0], eightColors[4], offset.x);
+	glm::vec3 c01 = glm::mix(eightColors[1], eightColors[5], offset.x);
+	glm::vec3 c10 = glm::mix(eightColors[2], eightColors[6], offset.x);
+	glm::vec3 c11 = glm::mix(eightColors[3], eightColors[7], offset.x);
+	glm::vec3 c0 = glm::mix(c00, c10, offset.y);
+	glm::vec3 c1 = glm::mix(c01, c11, offset.y);
+	irradiance = glm::mix(c0, c1, offset.z);
+	return true;
+}
+
+inline int Grid::GetProbeCount() const {
+	return (int)_gridData->GetCellSamples().GetVector().size();
+}
+
+inline void Grid::SampleProbes(RadianceSampler* sampler, int first, int count)
+{
+	PROFILE_SCOPE("Grid::SampleProbes");
+
+	VariableShaderBuffer<glm::vec4>& irradianceBuffer = _gridData->GetIrradianceBuffer();
+	const CellSamplesContainer::SamplesVector& samplesMap = _gridData->GetCellSamples().GetVector();
+	if (first < 0 || count < 0 || first + count > (int)samplesMap.size()) throw std::out_of_range("Invalid probes range");
+
+	Metrics::Instance.Add(MetricCounter::ProbesUpdated, count);
+
+	// All the probes of the pass trace the same subset of the directions
+	const TemporalSampling temporalSampling = { _temporalPeriod, _temporalFrame, _temporalBlend, _temporalJitter };
+	const TemporalSampling* temporal = _temporalAccumulation ? &temporalSampling : nullptr;
+	const PreviousIrradiance previous = { _irradianceGeneration, _snapshot.Irradiance.get(), _snapshot.IrradianceLength, _snapshot.Generation };
+
+	auto rangeBegin = samplesMap.cbegin() + first;
+	auto rangeEnd = rangeBegin + count;
 	if (_parallelUpdate) {
-		std::for_each(std::execution::par_unseq, samplesMap.cbegin(), samplesMap.cend(),
-			[sampler, &irradianceBuffer](const std::shared_ptr<GridCellSample>& it) {
-			it->Update(sampler, irradianceBuffer);
+		std::for_each(std::execution::par_unseq, rangeBegin, rangeEnd,
+			[sampler, &irradianceBuffer, temporal, &previous](const std::shared_ptr<GridCellSample>& it) {
+			it->Update(sampler, irradianceBuffer, temporal, &previous);
 		}
 		);
 	}
 	else
 	{
-		for (const auto& it : samplesMap)
+		for (auto it = rangeBegin; it != rangeEnd; ++it)
 		{
-			it->Update(sampler, irradianceBuffer);
+			(*it)->Update(sampler, irradianceBuffer, temporal, &previous);
 		}
 	}
+}
+
+inline void Grid::WriteIrradiance()
+{
+	PROFILE_SCOPE("Grid::WriteIrradiance");
+
+	VariableShaderBuffer<glm::vec4>& irradianceBuffer = _gridData->GetIrradianceBuffer();
 
 #if DEBUG
 	// Just in case of debug let's check that out entire irradiance buffer has some "valid" values
@@ -75,4 +417,5 @@ void Grid::Update(const Iterator& begin, const Iterator& end, RadianceSampler* s
 
 	// We finally store the irradiance and the transform matrix in the gpu buffers
 	irradianceBuffer.Write();
+	_buffersVersion++;
 }
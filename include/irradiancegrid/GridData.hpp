@@ -12,6 +12,7 @@
 #include <irradiancegrid/fwd.h>
 #include <irradiancegrid/CellSample.hpp>
 #include <buffers/VariableShaderBuffer.hpp>
+#include <irradiancegrid/BroadphaseRefinement.hpp>
 
 typedef std::function<void(const TransformParams&)> TransformCallback;
 
@@ -35,6 +36,10 @@ private:
 	/// Buffer for the sampled irradiance
 	/// </summary>
 	VariableShaderBuffer<glm::vec4> _irradianceBuffer;
+	/// <summary>
+	/// Span of each probe in the irradiance buffer, indexed by the sample grid index
+	/// </summary>
+	VariableShaderBuffer<ProbeLayout> _probesLayoutBuffer;
 
 	/// <summary>
 	/// Transform associated with the grid
@@ -60,13 +65,37 @@ private:
 	int _subGridCount;
 	std::priority_queue<int, std::vector<int>, std::greater<int>> _subgridFreeIndeces;
 
+	/// <summary>
+	/// Samples layout and direction lookup table of the probes (see BuildDirectionLookup())
+	/// </summary>
+	VariableShaderBuffer<int> _directionLookupBuffer;
+	/// <summary>
+	/// Direction set and resolution of the uploaded lookup table
+	/// </summary>
+	DirectionSetType _directionSetType;
+	int _directionSetResolution;
+
+#if WITH_BULLET
+	/// <summary>
+	/// Broadphase that tracks the cells demand. Owned by the grid, null with the brute-force refinement
+	/// </summary>
+	BroadphaseRefinement* _broadphase = nullptr;
+#endif
+
 public:
 	VariableShaderBuffer<int> _subGridsInfoBuffer;
 
 	GridData(const glm::vec3& gridMin, const glm::vec3& gridMax) :
-		_gridInfo(gridMin, gridMax), _irradianceBuffer(2), _progressiveCallbackId(0),
-		_maxSubGridLevel(0), _subGridCount(0),
+		_gridInfo(gridMin, gridMax), _irradianceBuffer(2), _probesLayoutBuffer(7), _progressiveCallbackId(0),
+		_maxSubGridLevel(0), _subGridCount(0), _directionLookupBuffer(5),
+		_directionSetType(DirectionSetType::Concentric), _directionSetResolution(0),
 		_subGridsInfoBuffer(3) {
+		_irradianceBuffer.SetMetricsBuffer(MetricBuffer::Irradiance);
+		_subGridsInfoBuffer.SetMetricsBuffer(MetricBuffer::SubGridsInfo);
+
+		// The shaders always read the samples layout
+		const int concentricLayout[] = { (int)DirectionLayout::Concentric, 0 };
+		_directionLookupBuffer.WriteFrom(concentricLayout, 2);
 	}
 
 	/* Grid index */
@@ -131,9 +160,30 @@ public:
 
 	GridInfoUniform& GetInfos() { return _gridInfo; }
 
+	/* Direction lookup */
+
+	DirectionSetType GetDirectionSetType() const { return _directionSetType; }
+	/// <summary>
+	/// Sampler resolution of the uploaded lookup table
+	/// </summary>
+	int GetDirectionSetResolution() const { return _directionSetResolution; }
+	VariableShaderBuffer<int>& GetDirectionLookupBuffer() { return _directionLookupBuffer; }
+
+	/// <summary>
+	/// Uploads the direction lookup table of a direction set, if it' s not the one already uploaded
+	/// </summary>
+	void WriteDirectionLookup(DirectionSetType type, int resolution, const std::vector<int>& lookup) {
+		if (type == _directionSetType && resolution == _directionSetResolution) return;
+
+		_directionSetType = type;
+		_directionSetResolution = resolution;
+		_directionLookupBuffer.WriteFrom(lookup.data(), (GLsizeiptr)lookup.size());
+	}
+
 	/* IrradianceBuffer */
 
 	VariableShaderBuffer<glm::vec4>& GetIrradianceBuffer() { return _irradianceBuffer; }
+	VariableShaderBuffer<ProbeLayout>& GetProbesLayoutBuffer() { return _probesLayoutBuffer; }
 
 	/* Cell samples related */
 	CellSamplesContainer& GetCellSamples() { return _cellsSamples; }
@@ -193,6 +243,16 @@ public:
 		_gridInfo.WriteGridTransform(p.Matrix());
 	}
 
+#if WITH_BULLET
+	/* Broadphase refinement */
+
+	BroadphaseRefinement* GetBroadphase() const { return _broadphase; }
+	/// <summary>
+	/// Sets the broadphase used by the cells created from now on
+	/// </summary>
+	void SetBroadphase(BroadphaseRefinement* broadphase) { _broadphase = broadphase; }
+#endif
+
 	/* Subgrid level related Api */
 
 	int GetMaxSubGridLevel() const { return _maxSubGridLevel; }
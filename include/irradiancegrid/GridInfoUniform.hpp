@@ -43,16 +43,15 @@ public:
 	int SamplesResolution;
 
 	/// <summary>
-	/// Map for the eight vertices of a cell to the corresponding irradiance offset
+	/// Map for the vertices of the cells to the corresponding probe index
 	/// 
-	/// The array is indexed with: SubGridOffset x CellX x CellY x CellZ x VertexIndex [0*8]
+	/// The array is indexed with: SubGridOffset x VertexX x VertexY x VertexZ
 	/// The SubGridOffset is relative to the subgrid in witch the irradiance offset are calculated (SubgridOffset 0 is the root grid)
-	/// CellX, Y, Z identify a cell in the indexed subgrid
-	/// Vertex index represents a vertex in the cell
+	/// VertexX, Y, Z identify a vertex of the subgrid lattice, so each subgrid has (CellsX + 1) x (CellsY + 1) x (CellsZ + 1) entries.
+	/// The eight vertices of the cell X, Y, Z are the lattice vertices from X, Y, Z to X + 1, Y + 1, Z + 1
 	///
-	/// The entry in the array correspond to the offset of the irradiance calculate. For example, the first vertex sample (in the entire grid) will have a offset 0 * numSamples in the irradiance buffer, the second calculated vertex
-	/// will have a offset of 1 * numSamples. So for example, the first grid in the cell [0:subgrid, 0:cellx, 0:celly, 0:celly] will index the vertex 0 to 8 with offset 0 to 8.
-	/// Another grid in the cell will index the vertex it' s own vertexes along with vertexes shared with adjacent cells
+	/// The entry in the array correspond to the probe index. The vertices shared by the adjacent cells are stored once,
+	/// so the map is smaller than a table with the eight vertices of each cell
 	/// </summary>
 	int* CellsVerticesToSamplesMap = nullptr;
 
@@ -120,12 +119,17 @@ public:
 		assert(offsetof(IrradianceGridData, GridMax) % 16 == 0);
 		assert(offsetof(IrradianceGridData, NumCellsPerDimension) % 16 == 0);
 
+		SetMetricsBuffer(MetricBuffer::GridInfo);
 		WriteBaseFields();
 	}
 
 	/// <summary>
 	/// Ensure that the cells vertices to samples mapping array is big enought
 	/// </summary>
+	/// <remarks>
+	/// The buffer is not limited by the shader block size: the shaders read the map from the paged copy
+	/// of the VolumeManager
+	/// </remarks>
 	void EnsureCellVerticesMappingSpace(int subGridsCount)
 	{
 		// To avoid too many allocation/deallocation, let' s resize the buffer only
@@ -133,8 +137,7 @@ public:
 		int irrOffsetArrayRequiredSize = subGridsCount * subGridOffsetCache;
 		if (irrOffsetArrayRequiredSize <= _lastCellsMapBufferSize) return;
 
-		int totalShaderBufferByteSize = offsetof(IrradianceGridData, CellsVerticesToSamplesMap) + (sizeof(int) * irrOffsetArrayRequiredSize);
-		if (totalShaderBufferByteSize >= GetMaxSize()) throw std::out_of_range("Buffer max size exceeded");
+		GLsizeiptr totalShaderBufferByteSize = offsetof(IrradianceGridData, CellsVerticesToSamplesMap) + (sizeof(int) * (GLsizeiptr)irrOffsetArrayRequiredSize);
 
 		_lastCellsMapBufferSize = irrOffsetArrayRequiredSize;
 		// We have to update our buffer map
@@ -146,7 +149,9 @@ public:
 	}
 
 	void SetCellIrradianceOffset(int subGridIndex, const glm::ivec3& cellPosition, int sampleIndexInCell, int irradianceOffset) {
-		const int sampleIndexIn1d = (subGridIndex * subGridOffsetCache) + (cellPosition.x * xOffsetCache) + (cellPosition.y * yOffsetCache) + (cellPosition.z * 8) + sampleIndexInCell;
+		// The sample index bits are the vertex offsets from the cell min (see GetSpatialSamples())
+		const glm::ivec3 vertex = cellPosition + glm::ivec3((sampleIndexInCell >> 2) & 1, (sampleIndexInCell >> 1) & 1, sampleIndexInCell & 1);
+		const int sampleIndexIn1d = (subGridIndex * subGridOffsetCache) + (vertex.x * xOffsetCache) + (vertex.y * yOffsetCache) + vertex.z;
 		_gridData.CellsVerticesToSamplesMap[sampleIndexIn1d] = irradianceOffset;
 
 		// std::cout << "Writing subgrid " << subGridIndex << "[ " << cellPosition << "] (" << sampleIndexIn1d << ") irradiance offset: " << irradianceOffset << std::endl;
@@ -164,9 +169,10 @@ public:
 	void WriteCellsPerDimension(const glm::ivec3& cellsPerDimension)
 	{
 		_gridData.NumCellsPerDimension = cellsPerDimension;
-		yOffsetCache = cellsPerDimension.z * 8;
-		xOffsetCache = cellsPerDimension.y * yOffsetCache;
-		subGridOffsetCache = cellsPerDimension.x * xOffsetCache;
+		// Strides of the vertices lattice
+		yOffsetCache = cellsPerDimension.z + 1;
+		xOffsetCache = (cellsPerDimension.y + 1) * yOffsetCache;
+		subGridOffsetCache = (cellsPerDimension.x + 1) * xOffsetCache;
 		UpdateFieldData(_gridData, &IrradianceGridData::NumCellsPerDimension);
 	}
 
@@ -187,5 +193,32 @@ public:
 		UpdatePointerFieldData<int*>(_gridData, &IrradianceGridData::CellsVerticesToSamplesMap, sizeof(int) * _lastCellsMapBufferSize);
 	}
 
+	/// <summary>
+	/// Writes an external cells vertices to samples map directly to the GPU
+	/// </summary>
+	/// <remarks>
+	/// The local map is left untouched. Used to upload baked data without an intermediate copy
+	/// </remarks>
+	void WriteSampleIndexes(const int* cellsMap, int length) {
+		GLsizeiptr totalShaderBufferByteSize = offsetof(IrradianceGridData, CellsVerticesToSamplesMap) + (sizeof(int) * (GLsizeiptr)length);
+
+		RebindBuffer(totalShaderBufferByteSize);
+		WriteBaseFields();
+		UpdateRangeData(offsetof(IrradianceGridData, CellsVerticesToSamplesMap), cellsMap, sizeof(int) * length);
+	}
+
+	/// <summary>
+	/// Returns the number of entries of the cells vertices to samples map used by the specified number of subgrids
+	/// </summary>
+	int GetCellsMapLength(int subGridsCount) const { return subGridsCount * subGridOffsetCache; }
+
 	const IrradianceGridData& GetData() const { return _gridData; }
+
+	using ShaderStorageBuffer::GetBufferId;
+	using ShaderStorageBuffer::GetByteSize;
+
+	/// <summary>
+	/// Byte offset of the cells vertices to samples map in the buffer (the map follows the base fields)
+	/// </summary>
+	static GLsizeiptr GetCellsMapByteOffset() { return offsetof(IrradianceGridData, CellsVerticesToSamplesMap); }
 };
\ No newline at end of file
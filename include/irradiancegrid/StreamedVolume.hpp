@@ -0,0 +1,487 @@
+#pragma once
+
+#include <std_include.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <BCube.hpp>
+#include <Transform.hpp>
+#include <buffers/ShaderStorageBuffer.hpp>
+#include <buffers/VariableShaderBuffer.hpp>
+#include <irradiancegrid/BrickVolume.hpp>
+#include <irradiancegrid/CellSample.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
+
+/// <summary>
+/// Baked irradiance volume streamed from a bricks file (see BrickVolume), for the volumes that do not fit in the GPU memory
+/// </summary>
+/// <remarks>
+/// The GPU keeps a pool of brick slots, sized by the memory budget, and the bricks table (the slot of each subgrid, -1 if the
+/// brick is not resident). The shader descends only in the resident subgrids (GetFinalCellIndex), so a missing brick falls
+/// back to the coarser level. The root brick is read when the volume is opened and it' s never evicted.
+///
+/// At each Update() the bricks are ordered by their distance from the camera (the coarser level first at the same distance,
+/// so the parents always precede their subgrids) and the first ones that fit in the pool are the wanted ones. The missing
+/// wanted bricks are queued, nearest first, to a background I/O thread that reads and inflates them. The inflated bricks are
+/// uploaded by the next updates, within an upload budget, and they take a free slot or the slot of the farthest resident
+/// brick that is farther than them.
+///
+/// The bricks are read with the direction layout of the sampler, so the bricks file must be baked with the same direction set
+/// </remarks>
+class StreamedVolume {
+private:
+	using Clock = std::chrono::steady_clock;
+
+	/// <summary>
+	/// Max bricks queued to the I/O thread or waiting for the upload. The queue is refilled at every update, so it
+	/// follows the camera
+	/// </summary>
+	static const int MaxPendingBricks = 8;
+
+	struct Brick {
+		/// <summary>
+		/// Transformed subgrid bounds
+		/// </summary>
+		BCube Bounds;
+		int Level = 0;
+		int Slot = -1;
+		bool Pending = false;
+		bool Failed = false;
+		float Distance = 0.0f;
+		/// <summary>
+		/// Position in the priority order of the last update
+		/// </summary>
+		int Rank = 0;
+	};
+
+	struct PageIn {
+		int Brick;
+		Clock::time_point RequestTime;
+		/// <summary>
+		/// Inflated brick, empty if the read has failed
+		/// </summary>
+		std::vector<glm::vec4> Irradiance;
+	};
+
+	BrickVolume _file;
+	TransformParams _transform;
+	std::vector<BCube> _localBounds;
+	std::vector<Brick> _bricks;
+	std::vector<int> _priorityOrder;
+	/// <summary>
+	/// Brick in each slot, -1 for the free slots
+	/// </summary>
+	std::vector<int> _slots;
+	int _residentCount = 0;
+	int _pendingCount = 0;
+	GLsizeiptr _brickByteSize;
+	GLsizeiptr _uploadBudget = 8 * 1024 * 1024;
+	double _lastPageInMilliseconds = 0.0;
+	double _maxPageInMilliseconds = 0.0;
+
+	ShaderStorageBuffer<glm::vec4> _poolBuffer;
+	VariableShaderBuffer<int> _bricksTableBuffer;
+	VariableShaderBuffer<int> _subGridsBuffer;
+	VariableShaderBuffer<ProbeLayout> _probesLayoutBuffer;
+	/// <summary>
+	/// Samples layout of the file direction set, that may differ from the one of the sampler
+	/// </summary>
+	VariableShaderBuffer<int> _directionLookupBuffer;
+	bool _bricksTableChanged = true;
+	int _bricksTableVersion = 0;
+	/// <summary>
+	/// Slots uploaded since the last CopyIrradiance()
+	/// </summary>
+	std::vector<int> _changedSlots;
+	GLuint _packedBuffer = 0;
+	GLsizeiptr _packedOffset = -1;
+	GLsizeiptr _packedSize = -1;
+
+	// Owned by the main thread
+	std::deque<PageIn> _readyBricks;
+
+	// Shared with the I/O thread
+	std::mutex _ioMutex;
+	std::condition_variable _ioCondition;
+	std::deque<std::pair<int, Clock::time_point>> _readQueue;
+	std::deque<PageIn> _completedBricks;
+	bool _stopping = false;
+	std::thread _ioThread;
+
+	static float DistanceToBox(const glm::vec3& point, const BCube& box) {
+		glm::vec3 outside = glm::max(glm::max(box.Min - point, point - box.Max), glm::vec3(0.0f));
+		return glm::length(outside);
+	}
+
+	/// <summary>
+	/// Finds the subgrids bounds from the subgrids tree
+	/// </summary>
+	void BuildBounds(int subGrid, std::vector<bool>& visited);
+
+	void IoThread();
+
+	void Upload(int brickIndex, int slot, const glm::vec4* irradiance);
+
+	/// <summary>
+	/// Free slot, or the slot of the farthest resident brick that is farther than the specified rank. -1 if there are no slots
+	/// </summary>
+	int AcquireSlot(int rank);
+
+	void UploadReadyBricks();
+
+	void RequestBricks();
+
+public:
+	NO_COPY_AND_ASSIGN(StreamedVolume);
+
+	/// <summary>
+	/// Opens a bricks file
+	/// </summary>
+	/// <param name="budgetBytes">GPU memory for the bricks pool. The pool has at least the root brick</param>
+	StreamedVolume(const std::string& path, const TransformParams& transform, GLsizeiptr budgetBytes);
+
+	~StreamedVolume() {
+		{
+			std::lock_guard<std::mutex> lock(_ioMutex);
+			_stopping = true;
+		}
+		_ioCondition.notify_all();
+		_ioThread.join();
+	}
+
+	const BrickVolumeHeader& GetHeader() const { return _file.GetHeader(); }
+	const TransformParams& GetTransform() const { return _transform; }
+	void SetTransform(const TransformParams& transform);
+	BCube GetTransformedBoundingCube() const { return BCube::FromMinMax(GetHeader().GridMin, GetHeader().GridMax) >> _transform; }
+
+	/// <summary>
+	/// Max bytes uploaded by an Update(). At least one brick is uploaded
+	/// </summary>
+	GLsizeiptr GetUploadBudget() const { return _uploadBudget; }
+	void SetUploadBudget(GLsizeiptr value) { _uploadBudget = value; }
+
+	int GetBricksCount() const { return (int)_bricks.size(); }
+	int GetSlotsCount() const { return (int)_slots.size(); }
+	int GetResidentCount() const { return _residentCount; }
+	/// <summary>
+	/// Bricks requested and not uploaded yet
+	/// </summary>
+	int GetPendingCount() const { return _pendingCount; }
+	/// <summary>
+	/// Slot of a brick, -1 if it' s not resident
+	/// </summary>
+	int GetBrickSlot(int brick) const { return _bricks[brick].Slot; }
+	/// <summary>
+	/// Time from the request to the upload of the last brick paged in, and the max since the volume has been opened
+	/// </summary>
+	double GetLastPageInMilliseconds() const { return _lastPageInMilliseconds; }
+	double GetMaxPageInMilliseconds() const { return _maxPageInMilliseconds; }
+
+	/// <summary>
+	/// Uploads the bricks read by the I/O thread and requests the bricks around the camera
+	/// </summary>
+	void Update(const glm::vec3& cameraPosition);
+
+	/* Buffers packed by the VolumeManager */
+
+	VariableShaderBuffer<int>& GetBricksTableBuffer() { return _bricksTableBuffer; }
+	/// <summary>
+	/// Changes each time the bricks table is uploaded. The subgrids and the probes layout never change
+	/// </summary>
+	int GetBricksTableVersion() const { return _bricksTableVersion; }
+	VariableShaderBuffer<int>& GetSubGridsBuffer() { return _subGridsBuffer; }
+	VariableShaderBuffer<ProbeLayout>& GetProbesLayoutBuffer() { return _probesLayoutBuffer; }
+	VariableShaderBuffer<int>& GetDirectionLookupBuffer() { return _directionLookupBuffer; }
+	GLsizeiptr GetPoolByteSize() const { return _poolBuffer.GetByteSize(); }
+
+	/// <summary>
+	/// Copies the pool in the packed irradiance buffer
+	/// </summary>
+	/// <remarks>
+	/// Only the slots uploaded since the last copy are copied, unless the packed buffer or the offset have changed
+	/// </remarks>
+	void CopyIrradiance(GLuint destination, GLsizeiptr destinationOffset, GLsizeiptr destinationSize);
+};
+
+inline StreamedVolume::StreamedVolume(const std::string& path, const TransformParams& transform, GLsizeiptr budgetBytes)
+	: _file(path), _poolBuffer(2), _bricksTableBuffer(1), _subGridsBuffer(3), _probesLayoutBuffer(7), _directionLookupBuffer(5)
+{
+	const BrickVolumeHeader& header = _file.GetHeader();
+	if (header.DirectionSet < 0 || header.DirectionSet >= (int32_t)DirectionSetType::Count) throw std::runtime_error("Invalid bricks file direction set");
+
+	// The directions are not stored: we regenerate them to rebuild the shader lookup table
+	const DirectionSetType directionSetType = (DirectionSetType)header.DirectionSet;
+	std::unique_ptr<DirectionSet> directionSet = DirectionSet::Create(directionSetType);
+	if (header.SamplesCount != directionSet->GetSamplesCount(header.SamplesResolution)) throw std::runtime_error("Invalid bricks file samples count");
+	std::vector<glm::vec3> directions;
+	std::vector<float> weights;
+	directionSet->Generate(header.SamplesResolution, directions, weights);
+	const std::vector<int> lookup = BuildDirectionLookup(*directionSet, directions);
+	_directionLookupBuffer.WriteFrom(lookup.data(), (GLsizeiptr)lookup.size());
+
+	_brickByteSize = (GLsizeiptr)(_file.GetBrickLength() * sizeof(glm::vec4));
+	const int slotsCount = (int)std::max((GLsizeiptr)1, std::min(budgetBytes / _brickByteSize, (GLsizeiptr)_file.GetBricksCount()));
+	_slots.assign(slotsCount, -1);
+
+	// The bricks bounds, from the root down
+	_bricks.resize(_file.GetBricksCount());
+	_localBounds.resize(_file.GetBricksCount());
+	std::vector<bool> visited(_bricks.size(), false);
+	for (int i = 0; i < (int)_bricks.size(); i++) BuildBounds(i, visited);
+	SetTransform(transform);
+	_priorityOrder.resize(_bricks.size());
+	for (int i = 0; i < (int)_priorityOrder.size(); i++) _priorityOrder[i] = i;
+
+	// The pool probes have all the same span: the layout table never changes
+	_poolBuffer.RebindBuffer(_brickByteSize * slotsCount);
+	_probesLayoutBuffer.SetVectorLength((GLsizeiptr)slotsCount * header.BrickProbes);
+	for (int i = 0; i < slotsCount * header.BrickProbes; i++)
+	{
+		_probesLayoutBuffer.GetVectorPtr()[i] = { i * header.SamplesCount, header.SamplesCount, (int)SamplingTier::High };
+	}
+	_probesLayoutBuffer.Write();
+	_subGridsBuffer.WriteFrom(_file.GetSubGrids().data(), (GLsizeiptr)_file.GetSubGrids().size());
+	_bricksTableBuffer.SetVectorLength((GLsizeiptr)_bricks.size());
+	std::fill(_bricksTableBuffer.GetVectorPtr(), _bricksTableBuffer.GetVectorPtr() + _bricks.size(), -1);
+
+	// The root brick is always resident, so the volume is never empty
+	std::ifstream file(path, std::ios::binary);
+	std::vector<uint8_t> compressed;
+	std::vector<glm::vec4> irradiance(_file.GetBrickLength());
+	_file.ReadBrick(file, 0, compressed, irradiance.data());
+	Metrics::Instance.Add(MetricCounter::BricksReadBytes, (int64_t)compressed.size());
+	Upload(0, 0, irradiance.data());
+
+	_ioThread = std::thread(&StreamedVolume::IoThread, this);
+}
+
+inline void StreamedVolume::BuildBounds(int subGrid, std::vector<bool>& visited) {
+	if (visited[subGrid]) return;
+	visited[subGrid] = true;
+
+	const BrickVolumeHeader& header = _file.GetHeader();
+	if (subGrid == 0) {
+		_localBounds[0] = BCube::FromMinMax(header.GridMin, header.GridMax);
+		_bricks[0].Level = 0;
+		return;
+	}
+
+	// The subgrid lives in a cell of its parent (see SubGrid::CorrectIndexes())
+	const glm::ivec3 cells = header.NumCellsPerDimension;
+	const int cellsCount = cells.x * cells.y * cells.z;
+	const int cellFinalIndex = _file.GetSubGrids()[subGrid - 1];
+	const int parent = cellFinalIndex / cellsCount;
+	if (cellFinalIndex < 0 || parent >= (int)_bricks.size() || parent == subGrid) throw std::runtime_error("Invalid bricks file subgrids tree");
+	BuildBounds(parent, visited);
+
+	const int cellIndex = cellFinalIndex % cellsCount;
+	const glm::ivec3 cell(cellIndex / (cells.y * cells.z), (cellIndex / cells.z) % cells.y, cellIndex % cells.z);
+	const BCube& parentBounds = _localBounds[parent];
+	const glm::vec3 step = (parentBounds.Max - parentBounds.Min) / glm::vec3(cells);
+	const glm::vec3 min = parentBounds.Min + step * glm::vec3(cell);
+	_localBounds[subGrid] = BCube::FromMinMax(min, min + step);
+	_bricks[subGrid].Level = _bricks[parent].Level + 1;
+}
+
+inline void StreamedVolume::SetTransform(const TransformParams& transform) {
+	_transform = transform;
+	for (int i = 0; i < (int)_bricks.size(); i++) _bricks[i].Bounds = _localBounds[i] >> _transform;
+}
+
+inline void StreamedVolume::IoThread() {
+	Profiler::Instance.SetThreadName("Bricks I/O");
+
+	std::ifstream file(_file.GetPath(), std::ios::binary);
+	std::vector<uint8_t> compressed;
+	while (true)
+	{
+		PageIn pageIn;
+		{
+			std::unique_lock<std::mutex> lock(_ioMutex);
+			_ioCondition.wait(lock, [this]() { return _stopping || !_readQueue.empty(); });
+			if (_stopping) return;
+			pageIn.Brick = _readQueue.front().first;
+			pageIn.RequestTime = _readQueue.front().second;
+			_readQueue.pop_front();
+		}
+
+		try {
+			PROFILE_SCOPE("StreamedVolume::PageIn");
+			if (!file) throw std::runtime_error("Unable to read bricks file " + _file.GetPath());
+			pageIn.Irradiance.resize(_file.GetBrickLength());
+			_file.ReadBrick(file, pageIn.Brick, compressed, pageIn.Irradiance.data());
+			Metrics::Instance.Add(MetricCounter::BricksReadBytes, (int64_t)compressed.size());
+		}
+		catch (const std::exception& e) {
+			std::cout << "ERROR::STREAMEDVOLUME: brick " << pageIn.Brick << ": " << e.what() << std::endl;
+			pageIn.Irradiance.clear();
+			// The stream may be in a failed state
+			file.clear();
+		}
+
+		std::lock_guard<std::mutex> lock(_ioMutex);
+		_completedBricks.push_back(std::move(pageIn));
+	}
+}
+
+inline void StreamedVolume::Upload(int brickIndex, int slot, const glm::vec4* irradiance) {
+	_poolBuffer.UpdateRangeData(slot * _brickByteSize, irradiance, _brickByteSize);
+	Metrics::Instance.AddBufferUpload(MetricBuffer::Bricks, _brickByteSize);
+	Metrics::Instance.AddBufferMemory(MetricBuffer::Bricks, _brickByteSize);
+
+	_slots[slot] = brickIndex;
+	_bricks[brickIndex].Slot = slot;
+	_bricksTableBuffer.GetVectorPtr()[brickIndex] = slot;
+	_bricksTableChanged = true;
+	_changedSlots.push_back(slot);
+	_residentCount++;
+}
+
+inline int StreamedVolume::AcquireSlot(int rank) {
+	int evictedSlot = -1, evictedRank = rank;
+	for (int slot = 0; slot < (int)_slots.size(); slot++)
+	{
+		if (_slots[slot] < 0) return slot;
+		// The root is always the first, so it' s never evicted
+		const Brick& brick = _bricks[_slots[slot]];
+		if (brick.Rank > evictedRank) {
+			evictedSlot = slot;
+			evictedRank = brick.Rank;
+		}
+	}
+	if (evictedSlot < 0) return -1;
+
+	const int evicted = _slots[evictedSlot];
+	_bricks[evicted].Slot = -1;
+	_bricksTableBuffer.GetVectorPtr()[evicted] = -1;
+	_slots[evictedSlot] = -1;
+	_residentCount--;
+	Metrics::Instance.Add(MetricCounter::BricksEvicted, 1);
+	Metrics::Instance.AddBufferMemory(MetricBuffer::Bricks, -_brickByteSize);
+	return evictedSlot;
+}
+
+inline void StreamedVolume::UploadReadyBricks() {
+	{
+		std::lock_guard<std::mutex> lock(_ioMutex);
+		for (PageIn& pageIn : _completedBricks) _readyBricks.push_back(std::move(pageIn));
+		_completedBricks.clear();
+	}
+
+	GLsizeiptr uploadedBytes = 0;
+	while (!_readyBricks.empty() && (uploadedBytes == 0 || uploadedBytes + _brickByteSize <= _uploadBudget))
+	{
+		PageIn pageIn = std::move(_readyBricks.front());
+		_readyBricks.pop_front();
+		Brick& brick = _bricks[pageIn.Brick];
+		brick.Pending = false;
+		_pendingCount--;
+
+		if (pageIn.Irradiance.empty()) {
+			// A brick that can' t be read is not requested again: the shader keeps using the coarser level
+			brick.Failed = true;
+			continue;
+		}
+		// The camera may have moved away during the read
+		if (brick.Rank >= (int)_slots.size()) continue;
+		int slot = AcquireSlot(brick.Rank);
+		if (slot < 0) continue;
+
+		Upload(pageIn.Brick, slot, pageIn.Irradiance.data());
+		uploadedBytes += _brickByteSize;
+
+		_lastPageInMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - pageIn.RequestTime).count();
+		_maxPageInMilliseconds = std::max(_maxPageInMilliseconds, _lastPageInMilliseconds);
+		Metrics::Instance.Add(MetricCounter::BricksPagedIn, 1);
+		Metrics::Instance.Add(MetricCounter::BricksPageInMicroseconds, (int64_t)(_lastPageInMilliseconds * 1000.0));
+	}
+}
+
+inline void StreamedVolume::RequestBricks() {
+	const int wantedCount = (int)_slots.size();
+	const Clock::time_point now = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(_ioMutex);
+		// The queued reads that are no longer wanted are dropped, so the queue follows the camera
+		for (auto it = _readQueue.begin(); it != _readQueue.end();)
+		{
+			Brick& brick = _bricks[it->first];
+			if (brick.Rank < wantedCount) {
+				++it;
+				continue;
+			}
+			brick.Pending = false;
+			_pendingCount--;
+			it = _readQueue.erase(it);
+		}
+
+		for (int rank = 0; rank < wantedCount && _pendingCount < MaxPendingBricks; rank++)
+		{
+			const int brickIndex = _priorityOrder[rank];
+			Brick& brick = _bricks[brickIndex];
+			if (brick.Slot >= 0 || brick.Pending || brick.Failed) continue;
+
+			brick.Pending = true;
+			_pendingCount++;
+			_readQueue.push_back({ brickIndex, now });
+		}
+	}
+	_ioCondition.notify_one();
+}
+
+inline void StreamedVolume::Update(const glm::vec3& cameraPosition) {
+	PROFILE_SCOPE("StreamedVolume::Update");
+
+	// The parent bounds contain the subgrids ones, so at the same distance the coarser level wins
+	for (Brick& brick : _bricks) brick.Distance = DistanceToBox(cameraPosition, brick.Bounds);
+	std::sort(_priorityOrder.begin(), _priorityOrder.end(), [this](int a, int b) {
+		const Brick& brickA = _bricks[a];
+		const Brick& brickB = _bricks[b];
+		if (brickA.Distance != brickB.Distance) return brickA.Distance < brickB.Distance;
+		if (brickA.Level != brickB.Level) return brickA.Level < brickB.Level;
+		return a < b;
+	});
+	for (int rank = 0; rank < (int)_priorityOrder.size(); rank++) _bricks[_priorityOrder[rank]].Rank = rank;
+	// The root must stay resident even when the camera is inside a subgrid
+	_bricks[0].Rank = -1;
+
+	UploadReadyBricks();
+	RequestBricks();
+
+	if (_bricksTableChanged) {
+		_bricksTableBuffer.Write();
+		_bricksTableChanged = false;
+		_bricksTableVersion++;
+	}
+}
+
+inline void StreamedVolume::CopyIrradiance(GLuint destination, GLsizeiptr destinationOffset, GLsizeiptr destinationSize) {
+	const bool fullCopy = destination != _packedBuffer || destinationOffset != _packedOffset || destinationSize != _packedSize;
+	_packedBuffer = destination;
+	_packedOffset = destinationOffset;
+	_packedSize = destinationSize;
+
+#ifndef HEADLESS
+	glBindBuffer(GL_COPY_READ_BUFFER, _poolBuffer.GetBufferId());
+	glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+	if (fullCopy) {
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, destinationOffset, _poolBuffer.GetByteSize());
+	}
+	else {
+		for (int slot : _changedSlots)
+		{
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, slot * _brickByteSize, destinationOffset + slot * _brickByteSize, _brickByteSize);
+		}
+	}
+#endif
+	_changedSlots.clear();
+}
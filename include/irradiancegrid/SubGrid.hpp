@@ -18,6 +18,8 @@ SubGrid::SubGrid(const BCube& cube, int level, GridData* gridData) : _level(leve
 	_cellsThatNeedSubGrid = new bool[_cachedGridSize];
 	_cellsThatHaveSubGrid = new bool[_cachedGridSize];
 	BuildGridCells(cube);
+
+	Metrics::Instance.Add(MetricCounter::SubGridsCreated, 1);
 }
 
 void SubGrid::BuildGridCells(const BCube& gridCube)
@@ -80,6 +82,8 @@ void SubGrid::BuildGridCells(const BCube& gridCube)
 template<class Iterator>
 void SubGrid::CalculateSubGridsState(const Iterator& begin, const Iterator& end)
 {
+	PROFILE_SCOPE("SubGrid::CalculateSubGridsState");
+
 	// First we iterate one time to check if a subgrid already exists
 	for (int i = 0; i < _cachedGridSize; i++)
 	{
@@ -87,6 +91,17 @@ void SubGrid::CalculateSubGridsState(const Iterator& begin, const Iterator& end)
 		_cellsThatHaveSubGrid[i] = cellPtr->AssociatedSubGrid();
 	}
 
+#if WITH_BULLET
+	if (_gridData->GetBroadphase()) {
+		// The objects overlapping each cell are already counted by the broadphase pairs
+		for (int i = 0; i < _cachedGridSize; i++)
+		{
+			_cellsThatNeedSubGrid[i] = _cells[i]->GetBroadphaseDemand() > 0;
+		}
+		return;
+	}
+#endif
+
 	/* FOR THE FUTURE: Here the code is absolutely not optimized since it searches in all the objects
 	* proided in the iterator.
 	*
@@ -121,6 +136,8 @@ void SubGrid::CalculateSubGridsState(const Iterator& begin, const Iterator& end)
 
 bool SubGrid::UpdateSubGrids()
 {
+	PROFILE_SCOPE("SubGrid::UpdateSubGrids");
+
 	bool somethingChanged = false;
 	for (int i = 0; i < _cachedGridSize; i++)
 	{
@@ -166,9 +183,71 @@ bool SubGrid::UpdateSubGridStructure(const Iterator& begin, const Iterator& end)
 	return result || subResult;
 }
 
+const GridCell* SubGrid::FindCell(const glm::vec3& point, glm::vec3& offset) const
+{
+	// The points just outside the root grid (for example on the walls hit by the sampling rays) are clamped
+	// to the border cells, up to half a cell. The points in a subgrid are already inside the parent cell
+	const float tolerance = _level == 0 ? 0.5f : std::numeric_limits<float>::max();
+	const glm::ivec3 cellsPerCoordinate = _gridData->GetInfos().GetData().NumCellsPerDimension;
+	const glm::vec3 subGridMin = _cells[0]->GetTransformedBoundingCube().Min;
+	const glm::vec3 subGridMax = _cells[_cachedGridSize - 1]->GetTransformedBoundingCube().Max;
+
+	// Same normalization of the shaders (GetCellIndex)
+	glm::vec3 qd = (point - subGridMin) / (subGridMax - subGridMin) * glm::vec3(cellsPerCoordinate);
+	if (glm::any(glm::lessThan(qd, glm::vec3(-tolerance))) || glm::any(glm::greaterThan(qd, glm::vec3(cellsPerCoordinate) + tolerance))) return nullptr;
+
+	glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor(qd)), glm::ivec3(0), cellsPerCoordinate - 1);
+	int cellIndex = (cell.x * cellsPerCoordinate.y * cellsPerCoordinate.z) + (cell.y * cellsPerCoordinate.z) + cell.z;
+	const GridCell* gridCell = _cells[cellIndex].get();
+
+	// The data is stored in the deepest level
+	const SubGrid* subGrid = gridCell->AssociatedSubGrid();
+	if (subGrid) return subGrid->FindCell(point, offset);
+
+	offset = glm::clamp(qd - glm::vec3(cell), glm::vec3(0.0f), glm::vec3(1.0f));
+	return gridCell;
+}
+
+#ifndef HEADLESS
+void SubGrid::MarkVisibleSamples(const Frustum& frustum, float margin, std::vector<CullingBuffers>& levelBuffers, std::vector<uint8_t>& visibleSamples) const
+{
+	// The buffers are indexed again after each recursion: a deeper level may reallocate the vector
+	if ((int)levelBuffers.size() <= _level) levelBuffers.resize(_level + 1);
+
+	BoxBatch& boxes = levelBuffers[_level].Boxes;
+	boxes.Clear();
+	const glm::vec3 marginVector(margin);
+	for (int i = 0; i < _cachedGridSize; i++)
+	{
+		const BCube& cellCube = _cells[i]->GetTransformedBoundingCube();
+		boxes.Add(cellCube.Min - marginVector, cellCube.Max + marginVector);
+	}
+	frustum.Cull(boxes, levelBuffers[_level].Visible);
+
+	for (int i = 0; i < _cachedGridSize; i++)
+	{
+		if (!levelBuffers[_level].Visible[i]) continue;
+
+		GridCell* cell = _cells[i].get();
+		for (int s = 0; s < 8; s++)
+		{
+			int sampleIndex = cell->GetSample(s)->GetSampleGridIndex();
+			assert(sampleIndex >= 0 && sampleIndex < (int)visibleSamples.size());
+			visibleSamples[sampleIndex] = 1;
+		}
+
+		// A culled cell skips all its subgrids
+		SubGrid* cellSubGrid = cell->AssociatedSubGrid();
+		if (cellSubGrid) cellSubGrid->MarkVisibleSamples(frustum, margin, levelBuffers, visibleSamples);
+	}
+}
+#endif
+
 void SubGrid::CorrectIndexes() {
 
-	_gridData->CorrectSubGridIndex(_subGridIndex);
+	if (_gridData->CorrectSubGridIndex(_subGridIndex)) {
+		Metrics::Instance.Add(MetricCounter::IndexCorrections, 1);
+	}
 
 	for (int cellIndex = 0; cellIndex < _cachedGridSize; cellIndex++)
 	{
@@ -0,0 +1,500 @@
+#pragma once
+
+#include <std_include.h>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <irradiancegrid/Grid.hpp>
+#include <irradiancegrid/StreamedVolume.hpp>
+#include <render/Frustum.hpp>
+#include <render/RenderQueue.hpp>
+#include <buffers/ShaderStorageBuffer.hpp>
+#include <buffers/PagedStorageBuffer.hpp>
+
+/// <summary>
+/// Max number of volumes in the volume table (MAX_VOLUMES in irradiance.frag)
+/// </summary>
+const int MAX_IRRADIANCE_VOLUMES = 16;
+/// <summary>
+/// Number of pages of the packed cells maps (MAX_CELLS_MAP_PAGES in irradiance.frag)
+/// </summary>
+const int MAX_CELLS_MAP_PAGES = 4;
+/// <summary>
+/// Binding port of the first cells map page. The pages take the following ports
+/// </summary>
+const int CELLS_MAP_FIRST_BINDING = 8;
+
+/// <summary>
+/// Entry of a volume in the volume table (std430 layout of the VolumeInfo struct in irradiance.frag)
+/// </summary>
+/// <remarks>
+/// The bases are the first entries of the volume in the packed buffers, so the shader indexes all the volumes
+/// from the same buffers
+/// </remarks>
+struct VolumeInfo {
+	glm::vec3 GridMin;
+	/// <summary>
+	/// Distance from the volume faces where the volume weight fades to zero
+	/// </summary>
+	float BlendDistance;
+	glm::vec3 GridMax;
+	int CellsMapBase;
+	glm::ivec3 NumCellsPerDimension;
+	int SubGridsBase;
+	glm::mat4 GridTransform;
+	int IrradianceBase;
+	int ProbesBase;
+	/// <summary>
+	/// 1 for a StreamedVolume: the cells map section is the bricks table and the probes are found from the brick slot
+	/// </summary>
+	int Streamed;
+	/// <summary>
+	/// Samples layout section of the volume: the volumes can be sampled (or baked) with different direction sets
+	/// </summary>
+	int DirectionLookupBase;
+};
+
+/// <summary>
+/// Volumes buffer
+/// </summary>
+struct VolumeTable {
+	int VolumesCount;
+	/// <summary>
+	/// Entries in each page of the packed cells maps
+	/// </summary>
+	int CellsMapPageLength;
+	int __aligment__[2];
+	VolumeInfo Volumes[MAX_IRRADIANCE_VOLUMES];
+};
+
+static_assert(sizeof(VolumeInfo) == 128, "Volume info must match the std430 layout");
+static_assert(sizeof(VolumeTable) == 16 + 128 * MAX_IRRADIANCE_VOLUMES, "Volume table must match the std430 layout");
+
+/// <summary>
+/// Owns many irradiance volumes and exposes them to the shaders as a single set of packed buffers
+/// </summary>
+/// <remarks>
+/// Each grid keeps its own buffers, as in the single volume case. At the end of the Update() their content is copied
+/// (GPU to GPU) in the packed buffers, only for the volumes changed or moved since the last copy. The packed buffers
+/// take the grid bindings (1: volume table, 2: irradiance, 3: subgrids, 5: direction lookup, 7: probes layout).
+/// The packed cells maps can be bigger than a shader storage block, so they are split in pages (bindings 8 to 11)
+///
+/// The sampling work is limited by a probes budget: the volumes are updated in priority order (the volume that
+/// contains the camera, then the visible ones by distance, then the others) until the budget is spent. A volume
+/// skipped for too many frames is promoted to the top, so the far volumes are still refreshed
+///
+/// The streamed volumes (see StreamedVolume) are not sampled: they only page their bricks around the camera.
+///
+/// As an IrradianceSource the manager blends the CPU queries of the volumes like the shaders, so it can be
+/// the bounce source of the sampler. The streamed volumes keep their bricks only on the GPU, so they are not queried
+/// </remarks>
+class VolumeManager : public IrradianceSource {
+private:
+	/// <summary>
+	/// Frames after which a skipped volume is updated regardless of its priority
+	/// </summary>
+	static const int MaxStaleFrames = 30;
+	/// <summary>
+	/// Priority offset of the volumes outside the frustum: they always follow the visible ones
+	/// </summary>
+	static constexpr float HiddenPriorityOffset = 1e6f;
+
+	/// <summary>
+	/// Bases of a volume sections in the packed buffers (cells map, irradiance, subgrids, probes layout, direction lookup)
+	/// </summary>
+	typedef std::array<int, 5> PackedBases;
+
+	struct Volume {
+		std::unique_ptr<Grid> VolumeGrid;
+		float BlendDistance;
+		int FramesSinceUpdate;
+		float Priority;
+		/// <summary>
+		/// Grid buffers version and bases of the last copy in the packed buffers
+		/// </summary>
+		int PackedVersion;
+		PackedBases Bases;
+	};
+
+	struct StreamedEntry {
+		std::unique_ptr<StreamedVolume> Volume;
+		float BlendDistance;
+		/// <summary>
+		/// Bricks table version and bases of the last copy in the packed buffers
+		/// </summary>
+		int PackedVersion;
+		PackedBases Bases;
+	};
+
+	std::vector<Volume> _volumes;
+	std::vector<StreamedEntry> _streamedVolumes;
+	std::vector<int> _updateOrder;
+	int _probesBudget = 4096;
+	int _lastUpdatedCount = 0;
+
+	VolumeTable _table = {};
+	// The block types only set the initial sizes: the buffers are resized by Pack()
+	ShaderStorageBuffer<VolumeTable> _tableBuffer;
+	PagedStorageBuffer _cellsMapBuffer;
+	ShaderStorageBuffer<glm::vec4> _irradianceBuffer;
+	ShaderStorageBuffer<glm::ivec4> _subGridsBuffer;
+	ShaderStorageBuffer<glm::ivec4> _probesLayoutBuffer;
+	ShaderStorageBuffer<glm::ivec4> _directionLookupBuffer;
+
+	static GLsizeiptr AlignSize(GLsizeiptr size, GLsizeiptr alignment) {
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	/// <summary>
+	/// Grows the buffer if it' s smaller than the required size. The content is not preserved
+	/// </summary>
+	/// <returns>True if the buffer has been reallocated</returns>
+	template<typename T>
+	static bool EnsureSize(ShaderStorageBuffer<T>& buffer, GLsizeiptr byteSize) {
+		if (byteSize > buffer.GetMaxSize()) throw std::out_of_range("Buffer max size exceeded");
+		if (buffer.GetByteSize() >= byteSize) return false;
+		buffer.RebindBuffer(byteSize);
+		return true;
+	}
+
+	static PackedBases GetBases(const VolumeInfo& volumeInfo) {
+		return { volumeInfo.CellsMapBase, volumeInfo.IrradianceBase, volumeInfo.SubGridsBase, volumeInfo.ProbesBase, volumeInfo.DirectionLookupBase };
+	}
+
+	static void CopyBuffer(GLuint source, GLuint destination, GLsizeiptr destinationOffset, GLsizeiptr sourceOffset, GLsizeiptr byteSize) {
+		if (byteSize <= 0) return;
+		glBindBuffer(GL_COPY_READ_BUFFER, source);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, destinationOffset, byteSize);
+	}
+
+	/// <summary>
+	/// Distance between a point and a box (zero inside)
+	/// </summary>
+	static float DistanceToBox(const glm::vec3& point, const BCube& box) {
+		glm::vec3 lower = glm::min(box.Min, box.Max), upper = glm::max(box.Min, box.Max);
+		glm::vec3 outside = glm::max(glm::max(lower - point, point - upper), glm::vec3(0.0f));
+		return glm::length(outside);
+	}
+
+	/// <summary>
+	/// Rebuilds the volume table and copies the buffers of the changed volumes in the packed ones
+	/// </summary>
+	void Pack();
+
+public:
+	NO_COPY_AND_ASSIGN(VolumeManager);
+
+	VolumeManager() : _tableBuffer(1), _cellsMapBuffer(CELLS_MAP_FIRST_BINDING, MAX_CELLS_MAP_PAGES), _irradianceBuffer(2), _subGridsBuffer(3), _probesLayoutBuffer(7),
+		_directionLookupBuffer(5) {
+	}
+
+	/// <summary>
+	/// Creates a new volume
+	/// </summary>
+	/// <param name="blendDistance">Distance from the volume faces where it blends with the overlapping volumes</param>
+	Grid* AddVolume(const BCube& boundingCube, const TransformParams& transform, float blendDistance) {
+		if ((int)(_volumes.size() + _streamedVolumes.size()) >= MAX_IRRADIANCE_VOLUMES) throw std::out_of_range("Too many irradiance volumes");
+
+		Volume volume;
+		volume.VolumeGrid = std::make_unique<Grid>(boundingCube);
+		volume.VolumeGrid->SetTransform(transform);
+		volume.BlendDistance = blendDistance;
+		// A new volume is sampled as soon as possible
+		volume.FramesSinceUpdate = MaxStaleFrames;
+		volume.Priority = 0.0f;
+		volume.PackedVersion = -1;
+		volume.Bases.fill(-1);
+		_volumes.push_back(std::move(volume));
+		return _volumes.back().VolumeGrid.get();
+	}
+
+	int GetVolumesCount() const { return (int)_volumes.size(); }
+	Grid* GetVolume(int index) const { return _volumes[index].VolumeGrid.get(); }
+
+	/// <summary>
+	/// Opens a bricks file as a streamed volume
+	/// </summary>
+	/// <param name="budgetBytes">GPU memory for the resident bricks</param>
+	StreamedVolume* AddStreamedVolume(const std::string& path, const TransformParams& transform, float blendDistance, GLsizeiptr budgetBytes) {
+		if ((int)(_volumes.size() + _streamedVolumes.size()) >= MAX_IRRADIANCE_VOLUMES) throw std::out_of_range("Too many irradiance volumes");
+
+		_streamedVolumes.push_back({ std::make_unique<StreamedVolume>(path, transform, budgetBytes), blendDistance, -1, { -1, -1, -1, -1, -1 } });
+		return _streamedVolumes.back().Volume.get();
+	}
+
+	int GetStreamedVolumesCount() const { return (int)_streamedVolumes.size(); }
+	StreamedVolume* GetStreamedVolume(int index) const { return _streamedVolumes[index].Volume.get(); }
+
+	/// <summary>
+	/// Max number of probes sampled in a frame. At least one volume is updated in each frame, even if it exceeds the budget
+	/// </summary>
+	int GetProbesBudget() const { return _probesBudget; }
+	void SetProbesBudget(int value) { _probesBudget = max(value, 0); }
+	/// <summary>
+	/// Number of volumes updated by the last Update()
+	/// </summary>
+	int GetLastUpdatedCount() const { return _lastUpdatedCount; }
+
+	/// <summary>
+	/// Updates the volumes with the highest priority for the camera and packs all the volumes for the shaders
+	/// </summary>
+	template<class Iterator>
+	void Update(const Iterator& begin, const Iterator& end, RadianceSampler* sampler, const glm::vec3& cameraPosition, const Frustum& frustum);
+
+	/// <summary>
+	/// Submits the debug spheres of the visible volumes
+	/// </summary>
+	void Draw(RenderQueue& queue, RadianceSphere* radianceSphere, const Frustum& frustum) const;
+
+	/// <summary>
+	/// Irradiance of the previous updates of the volumes, weighted like the shaders (GetIrradiance)
+	/// </summary>
+	virtual bool QueryIrradiance(const glm::vec3& point, const glm::vec3& normal, glm::vec3& irradiance) const override;
+};
+
+template<class Iterator>
+void VolumeManager::Update(const Iterator& begin, const Iterator& end, RadianceSampler* sampler, const glm::vec3& cameraPosition, const Frustum& frustum)
+{
+	PROFILE_SCOPE("VolumeManager::Update");
+
+	_updateOrder.clear();
+	for (int i = 0; i < (int)_volumes.size(); i++)
+	{
+		Volume& volume = _volumes[i];
+		const BCube& volumeCube = volume.VolumeGrid->GetTransformedBoundingCube();
+		// The distance is zero for the volume that contains the camera, so it' s always the first
+		volume.Priority = DistanceToBox(cameraPosition, volumeCube);
+		if (!frustum.IsVisible(volumeCube)) volume.Priority += HiddenPriorityOffset;
+		// Stale volumes go before all the others, the oldest first
+		if (volume.FramesSinceUpdate >= MaxStaleFrames) volume.Priority = -(float)volume.FramesSinceUpdate;
+		_updateOrder.push_back(i);
+	}
+	std::sort(_updateOrder.begin(), _updateOrder.end(), [this](int a, int b) {
+		return _volumes[a].Priority < _volumes[b].Priority;
+	});
+
+	int remainingBudget = _probesBudget;
+	_lastUpdatedCount = 0;
+	for (int index : _updateOrder)
+	{
+		Volume& volume = _volumes[index];
+		if (_lastUpdatedCount > 0 && remainingBudget <= 0) {
+			volume.FramesSinceUpdate++;
+			continue;
+		}
+
+		volume.VolumeGrid->SetViewerPosition(cameraPosition);
+		volume.VolumeGrid->Update(begin, end, sampler);
+		remainingBudget -= volume.VolumeGrid->GetProbeCount();
+		volume.FramesSinceUpdate = 0;
+		_lastUpdatedCount++;
+	}
+	Metrics::Instance.Add(MetricCounter::VolumesUpdated, _lastUpdatedCount);
+	Metrics::Instance.Add(MetricCounter::VolumesDeferred, (int64_t)_volumes.size() - _lastUpdatedCount);
+
+	for (StreamedEntry& streamed : _streamedVolumes) streamed.Volume->Update(cameraPosition);
+
+	Pack();
+}
+
+inline void VolumeManager::Pack()
+{
+	PROFILE_SCOPE("VolumeManager::Pack");
+
+	// First we lay out the volumes in the packed buffers. The sections are aligned to their element type,
+	// since the bases are element indexes
+	GLsizeiptr cellsMapBytes = 0, irradianceBytes = 0, subGridsBytes = 0, probesLayoutBytes = 0, directionLookupBytes = 0;
+	_table.VolumesCount = (int)(_volumes.size() + _streamedVolumes.size());
+	_table.CellsMapPageLength = _cellsMapBuffer.GetPageLength();
+
+	// The streamed volumes follow the grids in the table, but they go first in the packed buffers: their pools
+	// have a fixed size, so the bases do not change and only the uploaded bricks are copied
+	for (int i = 0; i < (int)_streamedVolumes.size(); i++)
+	{
+		StreamedVolume& streamed = *_streamedVolumes[i].Volume;
+		const BrickVolumeHeader& header = streamed.GetHeader();
+
+		VolumeInfo& volumeInfo = _table.Volumes[_volumes.size() + i];
+		volumeInfo.GridMin = header.GridMin;
+		volumeInfo.GridMax = header.GridMax;
+		volumeInfo.NumCellsPerDimension = header.NumCellsPerDimension;
+		volumeInfo.GridTransform = streamed.GetTransform().Matrix();
+		volumeInfo.BlendDistance = _streamedVolumes[i].BlendDistance;
+		volumeInfo.Streamed = 1;
+
+		volumeInfo.CellsMapBase = (int)(cellsMapBytes / sizeof(int));
+		cellsMapBytes += AlignSize(streamed.GetBricksTableBuffer().GetByteSize(), sizeof(int));
+		volumeInfo.IrradianceBase = (int)(irradianceBytes / sizeof(glm::vec4));
+		irradianceBytes += AlignSize(streamed.GetPoolByteSize(), sizeof(glm::vec4));
+		volumeInfo.SubGridsBase = (int)(subGridsBytes / sizeof(int));
+		subGridsBytes += AlignSize(streamed.GetSubGridsBuffer().GetByteSize(), sizeof(int));
+		volumeInfo.ProbesBase = (int)(probesLayoutBytes / sizeof(ProbeLayout));
+		probesLayoutBytes += AlignSize(streamed.GetProbesLayoutBuffer().GetByteSize(), sizeof(ProbeLayout));
+		volumeInfo.DirectionLookupBase = (int)(directionLookupBytes / sizeof(int));
+		directionLookupBytes += AlignSize(streamed.GetDirectionLookupBuffer().GetByteSize(), sizeof(int));
+	}
+
+	for (int i = 0; i < (int)_volumes.size(); i++)
+	{
+		Grid& grid = *_volumes[i].VolumeGrid;
+		GridData* gridData = grid.GetGridData();
+		const IrradianceGridData& gridInfo = gridData->GetInfos().GetData();
+
+		VolumeInfo& volumeInfo = _table.Volumes[i];
+		volumeInfo.GridMin = gridInfo.GridMin;
+		volumeInfo.GridMax = gridInfo.GridMax;
+		volumeInfo.NumCellsPerDimension = gridInfo.NumCellsPerDimension;
+		volumeInfo.GridTransform = gridInfo.GridTransform;
+		volumeInfo.BlendDistance = _volumes[i].BlendDistance;
+		volumeInfo.Streamed = 0;
+
+		volumeInfo.CellsMapBase = (int)(cellsMapBytes / sizeof(int));
+		cellsMapBytes += AlignSize(gridData->GetInfos().GetByteSize() - GridInfoUniform::GetCellsMapByteOffset(), sizeof(int));
+		volumeInfo.IrradianceBase = (int)(irradianceBytes / sizeof(glm::vec4));
+		irradianceBytes += AlignSize(gridData->GetIrradianceBuffer().GetByteSize(), sizeof(glm::vec4));
+		volumeInfo.SubGridsBase = (int)(subGridsBytes / sizeof(int));
+		subGridsBytes += AlignSize(gridData->_subGridsInfoBuffer.GetByteSize(), sizeof(int));
+		volumeInfo.ProbesBase = (int)(probesLayoutBytes / sizeof(ProbeLayout));
+		probesLayoutBytes += AlignSize(gridData->GetProbesLayoutBuffer().GetByteSize(), sizeof(ProbeLayout));
+		volumeInfo.DirectionLookupBase = (int)(directionLookupBytes / sizeof(int));
+		directionLookupBytes += AlignSize(gridData->GetDirectionLookupBuffer().GetByteSize(), sizeof(int));
+
+		// The debug spheres of the volume read the irradiance from the packed buffers
+		grid.SetIrradianceBase(volumeInfo.IrradianceBase);
+		grid.SetProbesBase(volumeInfo.ProbesBase);
+		grid.SetDirectionLookupBase(volumeInfo.DirectionLookupBase);
+	}
+
+	// The packed buffers only grow: after the first frames the volumes sizes are almost stable.
+	// A reallocated buffer loses its content, so all the volumes are copied again
+	EnsureSize(_tableBuffer, sizeof(VolumeTable));
+	const GLsizeiptr cellsMapByteSize = _cellsMapBuffer.GetByteSize();
+	_cellsMapBuffer.EnsureSize(cellsMapBytes);
+	bool reallocated = _cellsMapBuffer.GetByteSize() != cellsMapByteSize;
+	reallocated |= EnsureSize(_irradianceBuffer, irradianceBytes);
+	reallocated |= EnsureSize(_subGridsBuffer, subGridsBytes);
+	reallocated |= EnsureSize(_probesLayoutBuffer, probesLayoutBytes);
+	reallocated |= EnsureSize(_directionLookupBuffer, directionLookupBytes);
+
+	_tableBuffer.UpdateRangeData(0, &_table, sizeof(VolumeTable));
+	for (int i = 0; i < (int)_volumes.size(); i++)
+	{
+		Volume& volume = _volumes[i];
+		const VolumeInfo& volumeInfo = _table.Volumes[i];
+
+		// Only the grids written since the last copy (or moved by the resize of the previous ones) are copied
+		const int buffersVersion = volume.VolumeGrid->GetBuffersVersion();
+		const PackedBases bases = GetBases(volumeInfo);
+		if (!reallocated && volume.PackedVersion == buffersVersion && volume.Bases == bases) continue;
+		volume.PackedVersion = buffersVersion;
+		volume.Bases = bases;
+
+		GridData* gridData = volume.VolumeGrid->GetGridData();
+
+		GridInfoUniform& gridInfo = gridData->GetInfos();
+		CopyBuffer(gridInfo.GetBufferId(), _cellsMapBuffer.GetBufferId(), volumeInfo.CellsMapBase * sizeof(int),
+			GridInfoUniform::GetCellsMapByteOffset(), gridInfo.GetByteSize() - GridInfoUniform::GetCellsMapByteOffset());
+
+		VariableShaderBuffer<glm::vec4>& irradianceBuffer = gridData->GetIrradianceBuffer();
+		CopyBuffer(irradianceBuffer.GetBufferId(), _irradianceBuffer.GetBufferId(), volumeInfo.IrradianceBase * sizeof(glm::vec4),
+			0, irradianceBuffer.GetByteSize());
+
+		VariableShaderBuffer<int>& subGridsBuffer = gridData->_subGridsInfoBuffer;
+		CopyBuffer(subGridsBuffer.GetBufferId(), _subGridsBuffer.GetBufferId(), volumeInfo.SubGridsBase * sizeof(int),
+			0, subGridsBuffer.GetByteSize());
+
+		VariableShaderBuffer<ProbeLayout>& probesLayoutBuffer = gridData->GetProbesLayoutBuffer();
+		CopyBuffer(probesLayoutBuffer.GetBufferId(), _probesLayoutBuffer.GetBufferId(), volumeInfo.ProbesBase * sizeof(ProbeLayout),
+			0, probesLayoutBuffer.GetByteSize());
+
+		VariableShaderBuffer<int>& directionLookupBuffer = gridData->GetDirectionLookupBuffer();
+		CopyBuffer(directionLookupBuffer.GetBufferId(), _directionLookupBuffer.GetBufferId(), volumeInfo.DirectionLookupBase * sizeof(int),
+			0, directionLookupBuffer.GetByteSize());
+	}
+	for (int i = 0; i < (int)_streamedVolumes.size(); i++)
+	{
+		StreamedEntry& entry = _streamedVolumes[i];
+		StreamedVolume& streamed = *entry.Volume;
+		const VolumeInfo& volumeInfo = _table.Volumes[_volumes.size() + i];
+
+		// The irradiance copy tracks the uploaded bricks by itself
+		streamed.CopyIrradiance(_irradianceBuffer.GetBufferId(), volumeInfo.IrradianceBase * sizeof(glm::vec4), _irradianceBuffer.GetByteSize());
+
+		const PackedBases bases = GetBases(volumeInfo);
+		const bool moved = reallocated || entry.Bases != bases;
+		const bool tableChanged = entry.PackedVersion != streamed.GetBricksTableVersion();
+		entry.PackedVersion = streamed.GetBricksTableVersion();
+		entry.Bases = bases;
+
+		if (moved || tableChanged) {
+			VariableShaderBuffer<int>& bricksTableBuffer = streamed.GetBricksTableBuffer();
+			CopyBuffer(bricksTableBuffer.GetBufferId(), _cellsMapBuffer.GetBufferId(), volumeInfo.CellsMapBase * sizeof(int),
+				0, bricksTableBuffer.GetByteSize());
+		}
+		// The subgrids, the probes layout and the direction lookup are fixed
+		if (!moved) continue;
+
+		VariableShaderBuffer<int>& subGridsBuffer = streamed.GetSubGridsBuffer();
+		CopyBuffer(subGridsBuffer.GetBufferId(), _subGridsBuffer.GetBufferId(), volumeInfo.SubGridsBase * sizeof(int),
+			0, subGridsBuffer.GetByteSize());
+
+		VariableShaderBuffer<ProbeLayout>& probesLayoutBuffer = streamed.GetProbesLayoutBuffer();
+		CopyBuffer(probesLayoutBuffer.GetBufferId(), _probesLayoutBuffer.GetBufferId(), volumeInfo.ProbesBase * sizeof(ProbeLayout),
+			0, probesLayoutBuffer.GetByteSize());
+
+		VariableShaderBuffer<int>& directionLookupBuffer = streamed.GetDirectionLookupBuffer();
+		CopyBuffer(directionLookupBuffer.GetBufferId(), _directionLookupBuffer.GetBufferId(), volumeInfo.DirectionLookupBase * sizeof(int),
+			0, directionLookupBuffer.GetByteSize());
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// The grids (and the streamed volumes) bind their own buffers on each resize, so we take back the ports
+	_tableBuffer.BindBase();
+	_cellsMapBuffer.BindPages();
+	_irradianceBuffer.BindBase();
+	_subGridsBuffer.BindBase();
+	_probesLayoutBuffer.BindBase();
+	_directionLookupBuffer.BindBase();
+}
+
+inline bool VolumeManager::QueryIrradiance(const glm::vec3& point, const glm::vec3& normal, glm::vec3& irradiance) const
+{
+	glm::vec3 totalIrradiance(0.0f);
+	float totalWeight = 0.0f;
+	for (const Volume& volume : _volumes)
+	{
+		const BCube& volumeCube = volume.VolumeGrid->GetTransformedBoundingCube();
+		glm::vec3 lower = glm::min(volumeCube.Min, volumeCube.Max), upper = glm::max(volumeCube.Min, volumeCube.Max);
+		glm::vec3 faceDistance = glm::min(point - lower, upper - point);
+		float distance = std::min(faceDistance.x, std::min(faceDistance.y, faceDistance.z));
+
+		// The grid also answers just outside its faces (see SubGrid::FindCell()), where it has the lowest weight
+		glm::vec3 volumeIrradiance;
+		if (!volume.VolumeGrid->QueryIrradiance(point, normal, volumeIrradiance)) continue;
+
+		// Same fading of the shaders (GetVolumeWeight)
+		float weight = volume.BlendDistance <= 0.0f ? 1.0f : std::max(glm::clamp(distance / volume.BlendDistance, 0.0f, 1.0f), 1e-4f);
+		totalIrradiance += weight * volumeIrradiance;
+		totalWeight += weight;
+	}
+
+	if (totalWeight <= 0.0f) return false;
+	irradiance = totalIrradiance / totalWeight;
+	return true;
+}
+
+inline void VolumeManager::Draw(RenderQueue& queue, RadianceSphere* radianceSphere, const Frustum& frustum) const
+{
+	PROFILE_SCOPE("VolumeManager::Draw");
+	for (const Volume& volume : _volumes)
+	{
+		if (!frustum.IsVisible(volume.VolumeGrid->GetTransformedBoundingCube())) continue;
+		volume.VolumeGrid->Draw(queue, radianceSphere, frustum);
+	}
+	// The instances of all the volumes are drawn together
+	radianceSphere->DrawInstances(queue);
+}
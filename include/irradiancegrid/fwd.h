@@ -5,20 +5,29 @@
 #include <memory>
 #include <queue>
 #include <cassert>
+#ifndef HEADLESS
 #include "../../RadianceSphere.hpp"
+#endif
 #include <RadianceSampler.hpp>
 #include <irradiancegrid/GridInfoUniform.hpp>
 #include <irradiancegrid/CellSample.hpp>
 #include <irradiancegrid/CellsSamplesContainer.hpp>
 #include <irradiancegrid/GridData.hpp>
+#include <irradiancegrid/BakedVolume.hpp>
 #include <BCube.hpp>
 #include <Transform.hpp>
+#include <render/Frustum.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
 
 /* Forwar declaration header to solve classes circular dependencies */
 
 class GridCell;
 class Grid;
 class SubGrid;
+#if WITH_BULLET
+struct btBroadphaseProxy;
+#endif
 
 /// <summary>
 /// Represents a grid volume cell
@@ -44,6 +53,13 @@ private:
 	/// </summary>
 	glm::ivec3 _gridCellPosition;
 	SubGrid* _subGrid = nullptr;
+#if WITH_BULLET
+	/// <summary>
+	/// Proxy of the cell in the grid broadphase and number of scene objects that overlap it (see BroadphaseRefinement)
+	/// </summary>
+	btBroadphaseProxy* _broadphaseProxy = nullptr;
+	int _broadphaseDemand = 0;
+#endif
 	void OnTranformParamsChanged(const TransformParams& p);
 public:
 	GridCell(SubGrid* parentGrid, const BCube& cellBoundingCube, glm::ivec3 gridPosition);
@@ -55,9 +71,20 @@ public:
 	int GetCellIndex();
 
 	SubGrid* AssociatedSubGrid() { return _subGrid; }
+	const SubGrid* AssociatedSubGrid() const { return _subGrid; }
+	/// <summary>
+	/// Returns one of the 8 cell vertices samples
+	/// </summary>
+	GridCellSample* GetSample(int index) const { return _cellSamples[index].get(); }
 	const BCube& GetBoundingCube() const { return _boundingCube; }
 
 	const BCube& GetTransformedBoundingCube() const { return _transformedBoundingCube; }
+#if WITH_BULLET
+	/// <summary>
+	/// Number of scene objects that overlap the cell, when the grid uses the broadphase refinement
+	/// </summary>
+	int GetBroadphaseDemand() const { return _broadphaseDemand; }
+#endif
 
 	~GridCell();
 };
@@ -92,6 +119,23 @@ public:
 	template<class Iterator>
 	bool UpdateSubGridStructure(const Iterator& begin, const Iterator& end);
 	void CorrectIndexes();
+#ifndef HEADLESS
+	/// <summary>
+	/// Flags the samples of the cells that intersect the frustum. The subgrids of the culled cells are skipped
+	/// </summary>
+	/// <param name="margin">Cells bounds expansion, so the samples drawn bigger than a point are not culled</param>
+	/// <param name="levelBuffers">Culling buffers of each subgrid level</param>
+	/// <param name="visibleSamples">Flags indexed by the sample grid index</param>
+	void MarkVisibleSamples(const Frustum& frustum, float margin, std::vector<CullingBuffers>& levelBuffers, std::vector<uint8_t>& visibleSamples) const;
+#endif
+
+	/// <summary>
+	/// Finds the deepest cell that contains a world point. The points up to half a cell outside the grid
+	/// are clamped to the border cells
+	/// </summary>
+	/// <param name="offset">Point offset in the cell [0 - 1]</param>
+	/// <returns>Null if the point is outside the subgrid</returns>
+	const GridCell* FindCell(const glm::vec3& point, glm::vec3& offset) const;
 
 	int GetLevel() const { return _level; }
 	GridData* GetGridData() const { return _gridData; }
@@ -99,6 +143,7 @@ public:
 	void SetIndex(int index) { _subGridIndex = index; }
 
 	~SubGrid() {
+		Metrics::Instance.Add(MetricCounter::SubGridsDestroyed, 1);
 		_gridData->ReturnSubgridIndex(_subGridIndex);
 		delete[] _cells;
 		delete[] _cellsThatNeedSubGrid;
@@ -126,24 +171,143 @@ private:
 	SubGrid* _mainSubgrid;
 
 	bool _parallelUpdate = false;
+	/// <summary>
+	/// Draws all the debug spheres with a single instanced call instead of one call for each sample
+	/// </summary>
+	bool _instancedDraw = true;
+	/// <summary>
+	/// First entries of the grid irradiance, probes layout and direction lookup when they are packed with other volumes (see VolumeManager)
+	/// </summary>
+	int _irradianceBase = 0;
+	int _probesBase = 0;
+	int _directionLookupBase = 0;
+
+	/// <summary>
+	/// Samples the probes far from the viewer with the low sampling tier
+	/// </summary>
+	bool _adaptiveSampling = false;
+	/// <summary>
+	/// Probes within this distance from the viewer are always sampled with the sampler resolution
+	/// </summary>
+	float _highResolutionDistance = 4.0f;
+	glm::vec3 _viewerPosition = glm::vec3(0.0f);
+	int _lowTierProbeCount = 0;
+
+	/// <summary>
+	/// Traces only a subset of the directions at each update and accumulates the radiance over the updates
+	/// </summary>
+	bool _temporalAccumulation = false;
+	/// <summary>
+	/// Updates needed to trace all the directions once
+	/// </summary>
+	int _temporalPeriod = 8;
+	/// <summary>
+	/// Weight of the traced radiance in the moving average
+	/// </summary>
+	float _temporalBlend = 0.5f;
+	bool _temporalJitter = true;
+	int _temporalFrame = 0;
+
+	/// <summary>
+	/// Irradiance of the last update, read by the secondary bounce while the grid is sampled again
+	/// </summary>
+	/// <remarks>
+	/// The snapshot is indexed with the sample indexes of the structure it was taken with, so it' s
+	/// invalidated by every structure change.
+	/// The array is swapped with the irradiance buffer one at the start of the update (see TakeSnapshot()), so the
+	/// irradiance is never copied: the update writes all the probes spans in the other array
+	/// </remarks>
+	struct IrradianceSnapshot {
+		std::unique_ptr<glm::vec4[]> Irradiance;
+		GLsizeiptr IrradianceLength = 0;
+		std::vector<ProbeLayout> Layouts;
+		/// <summary>
+		/// Sampler (and its directions version) the irradiance was sampled with
+		/// </summary>
+		const RadianceSampler* Sampler = nullptr;
+		int DirectionsVersion = -1;
+		/// <summary>
+		/// Generation the array had as the irradiance buffer (see PreviousIrradiance)
+		/// </summary>
+		int Generation = -1;
+		bool Valid = false;
+	} _snapshot;
+	/// <summary>
+	/// Generation of the irradiance buffer array, changed when it' s reallocated or swapped
+	/// </summary>
+	int _irradianceGeneration = 0;
+	/// <summary>
+	/// Changed each time the GPU buffers are written (see GetBuffersVersion())
+	/// </summary>
+	int _buffersVersion = 0;
+	/// <summary>
+	/// The CPU irradiance buffer holds a whole update, sampled with the current structure and probes positions
+	/// </summary>
+	bool _irradianceSampled = false;
+	/// <summary>
+	/// Sampler (and its directions version) of the last update
+	/// </summary>
+	const RadianceSampler* _sampledWith = nullptr;
+	int _sampledDirectionsVersion = -1;
+	/// <summary>
+	/// The grid is being sampled: the queries read the snapshot
+	/// </summary>
+	bool _sampling = false;
+
 	CallbackRegistration _transformCallback;
 
-	void EnsureBuffersCapacity(RadianceSampler* sampler, VariableShaderBuffer<glm::vec4>& irradianceBuffer) {
+#if WITH_BULLET
+	/// <summary>
+	/// Broadphase of the incremental subgrid refinement. Null with the brute-force refinement
+	/// </summary>
+	std::unique_ptr<BroadphaseRefinement> _broadphase;
+#endif
+
+	/// <summary>
+	/// Baked volume currently uploaded to the GPU. While present, the grid is frozen and it' s not sampled anymore
+	/// </summary>
+	std::unique_ptr<BakedVolume> _bakedVolume;
+
+#ifndef HEADLESS
+	/// <summary>
+	/// Culling state reused between the frames
+	/// </summary>
+	mutable std::vector<CullingBuffers> _cellsCulling;
+	mutable std::vector<uint8_t> _visibleSamples;
+	mutable CullingBuffers _probesCulling;
+	mutable std::vector<int> _candidateProbes;
+#endif
+
+	void EnsureBuffersCapacity(GLsizeiptr requiredVectorSize, VariableShaderBuffer<glm::vec4>& irradianceBuffer) {
 		// We have to ensure that the irradiance buffer is big enough.
 		// We have to store the data for each sample point we have saved in our map
-		int samplesCount = sampler->SamplesCount();
-		GLsizeiptr requiredVectorSize = samplesCount * _gridData->GetCellSamples().GetVector().size();
-
 		// If buffer is already big enough, exit
 		if (irradianceBuffer.GetVectorLength() >= requiredVectorSize) return;
 		irradianceBuffer.SetVectorLength(requiredVectorSize);
+		// The irradiance of the last update is lost
+		_irradianceGeneration++;
 	}
 
+	/// <summary>
+	/// Assigns the sampling tier and the irradiance span of each probe and uploads the probes layout
+	/// </summary>
+	void UpdateProbesLayout(RadianceSampler* sampler);
+
 	void OnTranformChanged(const TransformParams& p) {
 		_transformedBoundingCube = _boundingCube >> p;
+		// The stored irradiance was sampled in the old positions
+		_snapshot.Valid = false;
+		_irradianceSampled = false;
 	}
 
+	/// <summary>
+	/// Moves the irradiance of the last update in the snapshot, for the secondary bounce of the next sampling
+	/// </summary>
+	void TakeSnapshot();
+
 	void UpdateSubGridsInfos() {
+		PROFILE_SCOPE("Grid::UpdateSubGridsInfos");
+
 		// We have to update the information about the sample indexes for each cell in each subgrid
 		_gridData->GetInfos().EnsureCellVerticesMappingSpace(_gridData->GetSubGridCount());
 		// We have to ensure that our subgrid buffer info is big enougth
@@ -179,15 +343,130 @@ public:
 	}
 
 	const glm::ivec3& GetGridDivision() const { return _cellsPerCoordinate; }
+	GridData* GetGridData() const { return _gridData; }
+	const BCube& GetTransformedBoundingCube() const { return _transformedBoundingCube; }
+	int GetIrradianceBase() const { return _irradianceBase; }
+	void SetIrradianceBase(int value) { _irradianceBase = value; }
+	int GetProbesBase() const { return _probesBase; }
+	void SetProbesBase(int value) { _probesBase = value; }
+	int GetDirectionLookupBase() const { return _directionLookupBase; }
+	void SetDirectionLookupBase(int value) { _directionLookupBase = value; }
+
+	/// <summary>
+	/// With the adaptive sampling the probes farther than GetHighResolutionDistance() from the viewer
+	/// are sampled with the low sampling tier
+	/// </summary>
+	bool IsAdaptiveSamplingEnabled() const { return _adaptiveSampling; }
+	void SetAdaptiveSampling(bool enabled) { _adaptiveSampling = enabled; }
+	float GetHighResolutionDistance() const { return _highResolutionDistance; }
+	void SetHighResolutionDistance(float value) { _highResolutionDistance = value; }
+	/// <summary>
+	/// Sets the point used to select the sampling tier of the probes in the next update
+	/// </summary>
+	void SetViewerPosition(const glm::vec3& position) { _viewerPosition = position; }
+	/// <summary>
+	/// Number of probes sampled with the low tier in the last update
+	/// </summary>
+	int GetLowTierProbeCount() const { return _lowTierProbeCount; }
+
+	/// <summary>
+	/// With the temporal accumulation each update traces one direction every GetTemporalPeriod() for each probe,
+	/// and blends the traced radiance in the probe history. The probes without a valid history (new, moved
+	/// or resampled with other directions) are fully traced
+	/// </summary>
+	bool IsTemporalAccumulationEnabled() const { return _temporalAccumulation; }
+	void SetTemporalAccumulation(bool enabled);
+	int GetTemporalPeriod() const { return _temporalPeriod; }
+	void SetTemporalPeriod(int value) { _temporalPeriod = glm::clamp(value, 1, 64); }
+	float GetTemporalBlend() const { return _temporalBlend; }
+	void SetTemporalBlend(float value) { _temporalBlend = glm::clamp(value, 0.01f, 1.0f); }
+	bool IsTemporalJitterEnabled() const { return _temporalJitter; }
+	void SetTemporalJitter(bool enabled) { _temporalJitter = enabled; }
+	/// <summary>
+	/// Fast reset of all the probes, for example after a scene change: the next update traces all the directions
+	/// </summary>
+	/// <remarks>
+	/// Called when the secondary bounce is toggled. The moved probes are reset by GridCellSample::SetTransform()
+	/// </remarks>
+	void ResetTemporalHistory();
+	/// <summary>
+	/// Updates needed to reflect a radiance change (at 90%), given the period and the blend weight
+	/// </summary>
+	int GetTemporalLatency() const;
+
+	/// <summary>
+	/// CPU query of the irradiance sampled by the previous update, with the same interpolation of the shaders
+	/// </summary>
+	/// <remarks>
+	/// Between the updates the irradiance buffer is read. While the grid is sampled the irradiance of the previous
+	/// update is in the snapshot, that is taken only when the sampler has a bounce source (see RadianceSampler::SetBounceSource())
+	/// </remarks>
+	/// <returns>False if the point is outside the grid or there is no valid irradiance</returns>
+	bool QueryIrradiance(const glm::vec3& point, const glm::vec3& normal, glm::vec3& irradiance) const;
+#if WITH_BULLET
+	/// <summary>
+	/// With the broadphase refinement the cells of all the levels are registered in a Bullet broadphase, and only
+	/// the scene objects that moved update the subgrids demand (see BroadphaseRefinement). The structure is rebuilt
+	/// when the mode changes
+	/// </summary>
+	bool IsBroadphaseRefinementEnabled() const { return _broadphase != nullptr; }
+	void SetBroadphaseRefinement(bool enabled) {
+		if (enabled == IsBroadphaseRefinementEnabled()) return;
+
+		// The old broadphase is released after the cells that are registered in it
+		std::unique_ptr<BroadphaseRefinement> oldBroadphase = std::move(_broadphase);
+		if (enabled) _broadphase = std::make_unique<BroadphaseRefinement>();
+		SetGridDivision(_cellsPerCoordinate);
+	}
+#endif
 	bool IsParallelUpdateEnabled() const { return _parallelUpdate; }
 	void SetParallelUpdate(bool enabled) { _parallelUpdate = enabled; }
+	bool IsInstancedDrawEnabled() const { return _instancedDraw; }
+	void SetInstancedDraw(bool enabled) { _instancedDraw = enabled; }
 	bool IsDebugColorEnabled() const { return _gridData->GetCellSamples().IsDebugColorEnabled(); }
 	void SetDebugColorEnabled(bool value) { _gridData->GetCellSamples().SetDebugColorEnabled(value); }
 
-	void Draw(RadianceSphere* radianceSphere) const;
+#ifndef HEADLESS
+	/// <summary>
+	/// Submits the debug spheres of the samples inside the frustum
+	/// </summary>
+	/// <remarks>
+	/// With the instanced draw the spheres are only added to the radiance sphere instances: the caller submits them
+	/// with RadianceSphere::DrawInstances(), once for all the volumes
+	/// </remarks>
+	void Draw(RenderQueue& queue, RadianceSphere* radianceSphere, const Frustum& frustum) const;
+#endif
+
+	/// <summary>
+	/// Saves the current grid structure and irradiance into a baked volume file
+	/// </summary>
+	void SaveBaked(const std::string& path) const;
+	/// <summary>
+	/// Loads a baked volume file and uploads it directly to the GPU. The grid is frozen until DiscardBaked() is called
+	/// or the grid settings are changed
+	/// </summary>
+	void LoadBaked(const std::string& path);
+	/// <summary>
+	/// Discards the loaded baked volume and return to the live sampling
+	/// </summary>
+	void DiscardBaked() {
+		if (!_bakedVolume) return;
+		SetGridDivision(_cellsPerCoordinate);
+	}
+	bool IsBaked() const { return _bakedVolume != nullptr; }
+	/// <summary>
+	/// Version of the GPU buffers content: it changes when the grid writes them or recreates them, so the copies
+	/// of the buffers (see VolumeManager) are refreshed only when needed
+	/// </summary>
+	int GetBuffersVersion() const { return _buffersVersion; }
 
 	void SetGridDivision(const glm::ivec3& numCellsPerDimension)
 	{
+		// Every structural change brings back the grid to the live sampling
+		_bakedVolume.reset();
+		_snapshot.Valid = false;
+		_irradianceSampled = false;
+
 		TransformParams oldTransform;
 		int oldMaxGridLevel = 0;
 		bool oldIsDebug = false;
@@ -204,6 +483,9 @@ public:
 		// We have to rebuild our root grid data
 		_cellsPerCoordinate = numCellsPerDimension;
 		_gridData = new GridData(_boundingCube.Min, _boundingCube.Max);
+#if WITH_BULLET
+		_gridData->SetBroadphase(_broadphase.get());
+#endif
 		// We set the division info in the grid uniform
 		_gridData->GetInfos().WriteCellsPerDimension(numCellsPerDimension);
 
@@ -213,20 +495,41 @@ public:
 		_gridData->SetMaxSubGridLevel(oldMaxGridLevel);
 		_gridData->GetCellSamples().SetDebugColorEnabled(oldIsDebug);
 		UpdateSubGridsInfos();
+		_buffersVersion++;
 	}
 
 	template<class Iterator>
 	void Update(const Iterator& begin, const Iterator& end, RadianceSampler* sampler);
 
+	/* The Update() steps. They can be used directly to split the sampling work (for example to report the progress) */
+
+	/// <summary>
+	/// Updates the subgrids structure and prepares the irradiance buffer for the sampling
+	/// </summary>
+	template<class Iterator>
+	void UpdateStructure(const Iterator& begin, const Iterator& end, RadianceSampler* sampler);
+	/// <summary>
+	/// Returns the number of probes (shared cells samples) in the current structure
+	/// </summary>
+	int GetProbeCount() const;
+	/// <summary>
+	/// Samples the irradiance for the probes in the range [first, first + count)
+	/// </summary>
+	void SampleProbes(RadianceSampler* sampler, int first, int count);
+	/// <summary>
+	/// Writes the sampled irradiance to the GPU
+	/// </summary>
+	void WriteIrradiance();
+
 	int GetMaxSubGridLevel() const { return _gridData->GetMaxSubGridLevel(); }
 
 	void SetMaxSubGridLevel(int value) {
 		int oldValue = _gridData->GetMaxSubGridLevel();
 		_gridData->SetMaxSubGridLevel(value);
 
-		// We have to reset the division if the level is lowered
+		// We have to reset the division if the level is lowered (or if we are showing a baked volume)
 		int updateValue = _gridData->GetMaxSubGridLevel();
-		if (updateValue < oldValue) {
+		if (updateValue < oldValue || _bakedVolume) {
 			SetGridDivision(_cellsPerCoordinate);
 		}
 	}
@@ -1,26 +1,31 @@
 #pragma once
 
 #include <std_include.h>	
+#include <assets/AssetCache.hpp>
 #include <SceneObject.hpp>
+#include <BoundingHull.hpp>
 #include <dbg/DbgLine.hpp>
 class Bunny : public SceneObject
 {
 
 private:
-	Model _model;
+	std::shared_ptr<Model> _model;
 	BCube _boundingCube;
 	BCube _transformedBoundingCube;
+	/// <summary>
+	/// The bunny spins: its bounds are taken from the hull, that is tighter than the rotated AABB
+	/// </summary>
+	BoundingHull _boundingHull;
 	bool _debugColor = false;
 	DbgLine _line;
-	glm::mat3 _normalMatrix;
 protected:
 	virtual void OnTransformChanged() override {
-		_transformedBoundingCube = _boundingCube >> GetTransform();
-		_normalMatrix = glm::inverseTranspose(glm::mat3(GetTransform().Matrix()));
+		_transformedBoundingCube = _boundingHull.Transform(GetTransform());
 	}
 public:
-	Bunny() : SceneObject(Shader("shaders/trilinear.vert", "shaders/trilinear.frag")), _model("models/bunny_lp.obj"), _normalMatrix(glm::mat3(1.0f)) {
-		_boundingCube = BCube::FromMeshes(_model.meshes.cbegin(), _model.meshes.cend(), true);
+	Bunny() : SceneObject(Shader("shaders/trilinear.vert", "shaders/trilinear.frag")), _model(AssetCache::Instance.GetModel("models/bunny_lp.obj")) {
+		_boundingCube = BCube::FromMeshes(_model->meshes.cbegin(), _model->meshes.cend());
+		_boundingHull = BoundingHull::FromMeshes(_model->meshes.cbegin(), _model->meshes.cend());
 
 
 		SetPosition(glm::vec3(-0.75f));
@@ -42,14 +47,14 @@ public:
 
 	void SetDebugColor(bool value) { _debugColor = value; }
 
-	void Draw() override
+	void Draw(RenderQueue& queue) override
 	{
-		_shader.Use();
+		queue.Begin(_shader, 0);
 		const TransformParams& transform = GetTransform();
-		_shader.SetUniform("modelMatrix", transform.Matrix());
-		_shader.SetUniform("normalMatrix", _normalMatrix);
-		_shader.SetUniform("debugColor", (int)_debugColor);
-		_model.Draw();
+		queue.SetUniform("modelMatrix", transform.Matrix());
+		queue.SetUniform("normalMatrix", transform.NormalMatrix());
+		queue.SetUniform("debugColor", (int)_debugColor);
+		queue.DrawModel(*_model);
 
 		//BCube::Draw(_transformedBoundingCube, _line);		
 	}
@@ -6,6 +6,8 @@
 
 class CCube : public SceneObject {
 private:
+	static constexpr float WallAlbedo = 0.5f;
+
 	Wall* _leftWall;
 	Wall* _rightWall;
 	Wall* _backWall;
@@ -19,10 +21,26 @@ private:
 
 	virtual void OnTransformChanged() override {
 		_objTransformedBoudingCube = _objBoudingCube >> GetTransform();
+		// The walls are not in the scene objects: their scale is applied with the cube one
+		UpdateTransforms(std::begin(_walls), std::end(_walls));
 	};
+
+	Wall* CreateWall(glm::vec3 vertices[]) {
+#ifndef HEADLESS
+		// The walls share the cube shader
+		Wall* wall = new Wall(vertices, 4, _shader);
+#else
+		Wall* wall = new Wall(vertices, 4);
+#endif
+		// Same reflectance used by the shaders, for the secondary bounce of the sampling
+		wall->GetSurface()->SetAlbedo(glm::vec3(WallAlbedo));
+		return wall;
+	}
 public:
 	CCube() :
+#ifndef HEADLESS
 		SceneObject(Shader("shaders/simple.vert", "shaders/simple.frag")),
+#endif
 		_leftWall(nullptr), _rightWall(nullptr), _backWall(nullptr),
 		_frontWall(nullptr), _topWall(nullptr), _bottomWall(nullptr)
 	{
@@ -33,7 +51,7 @@ public:
 			glm::vec3(-0.5f, -0.5f, -0.5f),
 			glm::vec3(-0.5f,  0.5f, -0.5f) };
 
-		_leftWall = new Wall(leftWallVertices, 4, _shader);
+		_leftWall = CreateWall(leftWallVertices);
 		_leftWall->GetSurface()->SetRadiance(glm::vec3(0.4f, 0.0f, 0.0f));
 
 		glm::vec3 backVertices[] = {
@@ -42,7 +60,7 @@ public:
 			 glm::vec3(0.5f, -0.5f,  -0.5f),
 			 glm::vec3(0.5f,  0.5f,  -0.5f)
 		};
-		_backWall = new Wall(backVertices, 4, _shader);
+		_backWall = CreateWall(backVertices);
 		_backWall->GetSurface()->SetRadiance(grayWall);
 
 		glm::vec3 rightVertices[] = {
@@ -51,7 +69,7 @@ public:
 			 glm::vec3(0.5f, -0.5f,  0.5f),
 			 glm::vec3(0.5f,  0.5f,  0.5f)
 		};
-		_rightWall = new Wall(rightVertices, 4, _shader);
+		_rightWall = CreateWall(rightVertices);
 		_rightWall->GetSurface()->SetRadiance(glm::vec3(0.0f, 0.0f, .7f));
 
 		glm::vec3 frontVertices[] = {
@@ -60,7 +78,7 @@ public:
 			 glm::vec3(-0.5f,  0.5f, 0.5f),
 			 glm::vec3(0.5f,  0.5f,  0.5f)
 		};
-		_frontWall = new Wall(frontVertices, 4, _shader);
+		_frontWall = CreateWall(frontVertices);
 		_frontWall->GetSurface()->SetRadiance(grayWall);
 
 		glm::vec3 topVertices[] = {
@@ -69,7 +87,7 @@ public:
 			 glm::vec3(0.5f, 0.5f,  0.5f),
 			 glm::vec3(0.5f, 0.5f, -0.5f)
 		};
-		_topWall = new Wall(topVertices, 4, _shader);
+		_topWall = CreateWall(topVertices);
 		_topWall->GetSurface()->SetRadiance(grayWall);
 
 		glm::vec3 bottomVertices[] = {
@@ -78,7 +96,7 @@ public:
 			 glm::vec3(0.5f, -0.5f,  0.5f),
 			 glm::vec3(0.5f, -0.5f, -0.5f)
 		};
-		_bottomWall = new Wall(bottomVertices, 4, _shader);
+		_bottomWall = CreateWall(bottomVertices);
 		_bottomWall->GetSurface()->SetRadiance(grayWall);
 
 		_walls[0] = _leftWall;
@@ -105,14 +123,23 @@ public:
 	}
 
 	virtual RayHit IsHitByRay(const Ray& ray) const override {
-		static const RayHit empty;
+		// More than one wall may be hit (for example near the edges): we need the closest one
+		RayHit closestHit;
 		for (int i = 0; i < 6; i++)
 		{
 			RayHit hit = _walls[i]->IsHitByRay(ray);
-			if (hit.IsHit()) return hit;
+			if (hit.IsHit() && (!closestHit.IsHit() || hit.Distance() < closestHit.Distance())) closestHit = std::move(hit);
+		}
+		// Nothing has been hit if the closest hit is still empty
+		return closestHit;
+	}
+
+	virtual bool CompileTo(PrimitiveTable& table) const override {
+		for (int i = 0; i < 6; i++)
+		{
+			_walls[i]->CompileTo(table);
 		}
-		// Nothing has been hit
-		return empty;
+		return true;
 	}
 
 	virtual BCube& GetBoundingCube() override {
@@ -122,16 +149,18 @@ public:
 		return _objTransformedBoudingCube;
 	}
 
-	virtual void Draw() override {
-		_leftWall->Draw();
-		_rightWall->Draw();
-		_backWall->Draw();
-		_topWall->Draw();
-		_bottomWall->Draw();
+#ifndef HEADLESS
+	virtual void Draw(RenderQueue& queue) override {
+		_leftWall->Draw(queue);
+		_rightWall->Draw(queue);
+		_backWall->Draw(queue);
+		_topWall->Draw(queue);
+		_bottomWall->Draw(queue);
 
 		// ~ Cube is open ~
-		//_frontWall->Draw();
+		//_frontWall->Draw(queue);
 	}
+#endif
 
 	virtual ~CCube() override {
 		delete _leftWall;
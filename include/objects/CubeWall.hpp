@@ -5,10 +5,12 @@
 #include <cmath>
 
 #include <SceneObject.hpp>
+#ifndef HEADLESS
 #include <GpuResource.hpp>
 #include <buffers/GpuBuffer.hpp>
 #include <buffers/VertexArray.hpp>
 #include <dbg/DbgLine.hpp>
+#endif
 
 class Wall : public SceneObject {
 private:
@@ -16,9 +18,11 @@ private:
 
 	Surface* _wallSurface;
 
+#ifndef HEADLESS
 	VertexArray _vao;
 	GpuBufferT<GL_ARRAY_BUFFER> _vbo;
 	GpuBufferT<GL_ELEMENT_ARRAY_BUFFER> _ebo;
+#endif
 
 	glm::vec3 _minCoords;
 	glm::vec3 _maxCoords;
@@ -28,14 +32,19 @@ private:
 
 	glm::vec3 _planeP0;
 	glm::vec3 _normal;
+	glm::vec3 _edge1;
+	glm::vec3 _edge2;
 
 	glm::vec3 _planeP0T;
 	glm::vec3 _planeNormalT;
 	GLfloat _planeNormalTLength;
 	GLfloat _planeDistance;
+#ifndef HEADLESS
 	DbgLine _dbgLine;
+#endif
 
 	BCube _emptyBCube;
+	BCube _transformedBoundingCube;
 
 	void SetupVAO(const glm::vec3 vertices[], int size) {
 		_minCoords = _maxCoords = vertices[0];
@@ -51,6 +60,7 @@ private:
 			_maxCoords.z = max(_maxCoords.z, vertex.z);
 		}
 
+#ifndef HEADLESS
 		GLushort elements[] = {
 			 0, 1, 2, 1, 2, 3
 		};
@@ -64,6 +74,7 @@ private:
 		_ebo.Bind();
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements), elements, GL_STATIC_DRAW);
 		_vao.Unbind();
+#endif
 	}
 
 	void GenerateNormals(const glm::vec3 vertices[], int size) {
@@ -71,29 +82,37 @@ private:
 		const glm::vec3& point1 = vertices[1];
 		const glm::vec3& point2 = vertices[2];
 
-		glm::vec3 vector1 = point1 - _planeP0;
-		glm::vec3 vector2 = point2 - _planeP0;
+		_edge1 = point1 - _planeP0;
+		_edge2 = point2 - _planeP0;
 
-		_normal = glm::normalize(glm::cross(vector1, vector2));
+		_normal = glm::normalize(glm::cross(_edge1, _edge2));
 	}
 protected:
 	virtual void OnTransformChanged() override {
 		const TransformParams& transform = GetTransform();
 		_planeP0T = _planeP0 >> transform;
-		_planeNormalT = _normal >> transform;
+		// The normal is a direction: the translation must not be applied
+		_planeNormalT = ((_planeP0 + _normal) >> transform) - _planeP0T;
 		_minCoordsT = _minCoords >> transform;
 		_maxCoordsT = _maxCoords >> transform;
+		// The ray query backends cull the walls with their bounds
+		_transformedBoundingCube = BCube::FromMinMax(glm::min(_minCoordsT, _maxCoordsT), glm::max(_minCoordsT, _maxCoordsT));
 
-		_planeDistance = abs(glm::dot(_planeP0T, _planeNormalT));
+		_planeDistance = glm::dot(_planeP0T, _planeNormalT);
 		// after the plane distance calculation, we can normalize the
 		// transformed normal ??
 		_planeNormalTLength = glm::length(_planeNormalT);
 	}
 
 public:
+#ifndef HEADLESS
 	explicit Wall(glm::vec3 vertices[], int verticesCount, Shader parentShader) :
 		SceneObject(parentShader),
 		_wallSurface(nullptr)
+#else
+	explicit Wall(glm::vec3 vertices[], int verticesCount) :
+		_wallSurface(nullptr)
+#endif
 	{
 		SetupVAO(vertices, verticesCount);
 		GenerateNormals(vertices, verticesCount);
@@ -114,20 +133,20 @@ public:
 	}
 
 
-	virtual void Draw() override {
-		_shader.Use();
-		_shader.SetUniform("modelMatrix", GetTransform().Matrix());
+#ifndef HEADLESS
+	virtual void Draw(RenderQueue& queue) override {
+		queue.Begin(_shader, _vao.Resource());
+		queue.SetUniform("modelMatrix", GetTransform().Matrix());
 		std::optional<RadianceP> radiance = _wallSurface->GetRadiance();
 		if (radiance.has_value()) {
-			_shader.SetUniform("color", radiance.value().Value);
+			queue.SetUniform("color", radiance.value().Value);
 		}
 
-		_vao.Bind();
-		glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, 0);
-		glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_SHORT, (GLvoid*)(3 * sizeof(GLushort)));
-		glDrawElements(GL_LINE_LOOP, 4, GL_UNSIGNED_SHORT, 0);
-		_vao.Unbind();
+		// The two triangles are contiguous in the element buffer
+		queue.Draw(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT);
+		queue.Draw(GL_LINE_LOOP, 4, GL_UNSIGNED_SHORT);
 	}
+#endif
 
 	virtual RayHit IsHitByRay(const Ray& ray) const override {
 		// Ray-Plane intersection consider the ray eq and the play eq
@@ -155,9 +174,11 @@ public:
 			assert(abs(dirNormalProduct - glm::dot(ray.Direction(), normalT)) < 0.0001);
 		}
 
-		float f = -(glm::dot(ray.Position(), normalT) + _planeDistance) / dirNormalProduct;
-		if (isinf(f)) {
-			// This check may be redundant
+		// The plane distance is signed with the original normal, so the flipped one needs its opposite
+		const float planeDistance = angleCos > 0.0f ? -_planeDistance : _planeDistance;
+		float f = (planeDistance - glm::dot(ray.Position(), normalT)) / dirNormalProduct;
+		if (isinf(f) || f < 0.0f) {
+			// The plane is behind the ray
 			return s_NoHit;
 		}
 
@@ -184,13 +205,21 @@ public:
 		}
 	}
 
+	virtual bool CompileTo(PrimitiveTable& table) const override {
+		// The vertices are in the (p0, p0 + edge1, p0 + edge2, p0 + edge1 + edge2) order
+		const glm::mat4& matrix = GetTransform().Matrix();
+		glm::vec3 p0 = _planeP0 >> matrix;
+		table.AddQuad(p0, ((_planeP0 + _edge1) >> matrix) - p0, ((_planeP0 + _edge2) >> matrix) - p0, _wallSurface);
+		return true;
+	}
+
 	virtual BCube& GetBoundingCube() override {
 		// Not used at the moment
 		return _emptyBCube;
 	}
 
 	virtual BCube& GetTransformedBoundingCube() override {
-		return _emptyBCube;
+		return _transformedBoundingCube;
 	}
 
 	Surface* GetSurface() const { return _wallSurface; }
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <core_include.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+/// <summary>
+/// Counters of the irradiance pipeline. They are reset at every frame
+/// </summary>
+enum class MetricCounter : int {
+	RaysCast,
+	RayHits,
+	ProbesUpdated,
+	SubGridsCreated,
+	SubGridsDestroyed,
+	/// <summary>
+	/// Cell samples removed by CellSamplesContainer::Trim()
+	/// </summary>
+	TrimRemovals,
+	/// <summary>
+	/// Subgrid indexes changed by SubGrid::CorrectIndexes()
+	/// </summary>
+	IndexCorrections,
+	IrradianceUploadBytes,
+	GridInfoUploadBytes,
+	SubGridsInfoUploadBytes,
+	BricksUploadBytes,
+	/// <summary>
+	/// Draw calls issued by the RenderQueue
+	/// </summary>
+	DrawCalls,
+	/// <summary>
+	/// Program and vertex array changes performed by the RenderQueue
+	/// </summary>
+	ProgramSwitches,
+	VertexArraySwitches,
+	/// <summary>
+	/// Scene objects and probe spheres skipped by the frustum culling
+	/// </summary>
+	CulledObjects,
+	CulledProbes,
+	/// <summary>
+	/// Irradiance volumes sampled in the frame and volumes postponed by the update budget
+	/// </summary>
+	VolumesUpdated,
+	VolumesDeferred,
+	/// <summary>
+	/// Probes whose temporal history was rebuilt with a full trace
+	/// </summary>
+	ProbesReset,
+	/// <summary>
+	/// Scene objects whose broadphase proxy was updated by the subgrid refinement (see BroadphaseRefinement)
+	/// </summary>
+	BroadphaseObjectsMoved,
+	/// <summary>
+	/// Scene objects whose transform was rebuilt by SceneObject::UpdateTransforms()
+	/// </summary>
+	TransformsUpdated,
+	/// <summary>
+	/// Bricks of the streamed volumes uploaded to and released from the GPU (see StreamedVolume)
+	/// </summary>
+	BricksPagedIn,
+	BricksEvicted,
+	/// <summary>
+	/// Compressed bytes read from the bricks files
+	/// </summary>
+	BricksReadBytes,
+	/// <summary>
+	/// Sum of the page-in latencies (from the request to the upload) of the bricks paged in, in microseconds
+	/// </summary>
+	BricksPageInMicroseconds,
+	Count
+};
+
+/// <summary>
+/// Buffers tracked by the metrics (uploaded bytes and allocated memory)
+/// </summary>
+/// <remarks>
+/// The CPU buffers follow the GPU ones and have no upload counter
+/// </remarks>
+enum class MetricBuffer : int {
+	None = -1,
+	Irradiance,
+	GridInfo,
+	SubGridsInfo,
+	/// <summary>
+	/// Bricks resident on the GPU. The bricks pool is allocated at the budget size, so only the resident bricks are counted
+	/// </summary>
+	Bricks,
+	/// <summary>
+	/// Radiance accumulated on the CPU by the progressive sampling of the probes
+	/// </summary>
+	RadianceHistory,
+	Count
+};
+
+const int MetricCountersCount = (int)MetricCounter::Count;
+const int MetricBuffersCount = (int)MetricBuffer::Count;
+const int MetricGpuBuffersCount = (int)MetricBuffer::Bricks + 1;
+// The upload counters follow the buffers order (see AddBufferUpload())
+static_assert((int)MetricCounter::BricksUploadBytes == (int)MetricCounter::IrradianceUploadBytes + (int)MetricBuffer::Bricks, "Upload counters must match the buffers");
+
+/// <summary>
+/// Metrics of a single frame
+/// </summary>
+struct MetricsFrame {
+	int Frame = 0;
+	int64_t Counters[MetricCountersCount] = {};
+	/// <summary>
+	/// Allocated bytes of each buffer at the end of the frame
+	/// </summary>
+	int64_t BufferBytes[MetricBuffersCount] = {};
+	/// <summary>
+	/// Max allocated bytes of each buffer since the application start
+	/// </summary>
+	int64_t BufferPeakBytes[MetricBuffersCount] = {};
+};
+
+/// <summary>
+/// Registry of the pipeline counters
+/// </summary>
+/// <remarks>
+/// Each thread increments its own counters (a plain load/store, no locked instruction). The counters are aggregated
+/// only once per frame by EndFrame(), that stores the frame in a bounded time series.
+///
+/// The buffers memory is the size of the GPU allocation (the CPU-side copies have the same size)
+/// </remarks>
+class Metrics
+{
+private:
+	/// <summary>
+	/// Frames kept in the time series (10 minutes at 60 FPS)
+	/// </summary>
+	static const std::size_t MaxHistoryFrames = 36000;
+
+	struct ThreadCounters {
+		// Written only by the owner thread, read by EndFrame()
+		std::atomic<int64_t> Values[MetricCountersCount];
+
+		ThreadCounters() {
+			for (std::atomic<int64_t>& value : Values) value.store(0, std::memory_order_relaxed);
+		}
+	};
+
+	std::mutex _threadsMutex;
+	std::vector<std::unique_ptr<ThreadCounters>> _threads;
+	int64_t _previousTotals[MetricCountersCount] = {};
+	int64_t _totals[MetricCountersCount] = {};
+
+	std::atomic<int64_t> _bufferBytes[MetricBuffersCount];
+	std::atomic<int64_t> _bufferPeakBytes[MetricBuffersCount];
+
+	std::deque<MetricsFrame> _history;
+	int _frameIndex = 0;
+
+	ThreadCounters* GetThreadCounters() {
+		thread_local ThreadCounters* threadCounters = nullptr;
+		if (!threadCounters) {
+			const std::lock_guard<std::mutex> lock(_threadsMutex);
+			// The counters are owned by the registry: the worker threads may terminate before the aggregation
+			_threads.push_back(std::make_unique<ThreadCounters>());
+			threadCounters = _threads.back().get();
+		}
+		return threadCounters;
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(Metrics);
+
+	static Metrics Instance;
+
+	Metrics() {
+		for (int i = 0; i < MetricBuffersCount; i++) {
+			_bufferBytes[i].store(0, std::memory_order_relaxed);
+			_bufferPeakBytes[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	static const char* GetCounterName(MetricCounter counter) {
+		static const char* names[MetricCountersCount] = {
+			"rays_cast", "ray_hits", "probes_updated", "subgrids_created", "subgrids_destroyed",
+			"trim_removals", "index_corrections", "irradiance_upload_bytes", "grid_info_upload_bytes", "subgrids_info_upload_bytes",
+			"bricks_upload_bytes", "draw_calls", "program_switches", "vertex_array_switches", "culled_objects", "culled_probes",
+			"volumes_updated", "volumes_deferred", "probes_reset", "broadphase_objects_moved", "transforms_updated",
+			"bricks_paged_in", "bricks_evicted", "bricks_read_bytes", "bricks_page_in_us"
+		};
+		return names[(int)counter];
+	}
+
+	static const char* GetBufferName(MetricBuffer buffer) {
+		static const char* names[MetricBuffersCount] = { "irradiance", "grid_info", "subgrids_info", "bricks", "radiance_history" };
+		return names[(int)buffer];
+	}
+
+	/// <summary>
+	/// Adds a value to a counter of the calling thread
+	/// </summary>
+	void Add(MetricCounter counter, int64_t value) {
+		std::atomic<int64_t>& threadValue = GetThreadCounters()->Values[(int)counter];
+		threadValue.store(threadValue.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Counts the bytes uploaded to a buffer
+	/// </summary>
+	void AddBufferUpload(MetricBuffer buffer, int64_t bytes) {
+		if (buffer == MetricBuffer::None || (int)buffer >= MetricGpuBuffersCount) return;
+		Add((MetricCounter)((int)MetricCounter::IrradianceUploadBytes + (int)buffer), bytes);
+	}
+
+	/// <summary>
+	/// Changes the allocated memory of a buffer. More instances of the same buffer sum their memory
+	/// </summary>
+	void AddBufferMemory(MetricBuffer buffer, int64_t deltaBytes) {
+		if (buffer == MetricBuffer::None || deltaBytes == 0) return;
+
+		int64_t bytes = _bufferBytes[(int)buffer].fetch_add(deltaBytes, std::memory_order_relaxed) + deltaBytes;
+		std::atomic<int64_t>& peak = _bufferPeakBytes[(int)buffer];
+		int64_t currentPeak = peak.load(std::memory_order_relaxed);
+		while (bytes > currentPeak && !peak.compare_exchange_weak(currentPeak, bytes, std::memory_order_relaxed)) {
+		}
+	}
+
+	/// <summary>
+	/// Aggregates the threads counters in a new frame of the time series
+	/// </summary>
+	void EndFrame() {
+		MetricsFrame frame;
+		frame.Frame = _frameIndex++;
+
+		int64_t totals[MetricCountersCount] = {};
+		{
+			const std::lock_guard<std::mutex> lock(_threadsMutex);
+			for (const std::unique_ptr<ThreadCounters>& threadCounters : _threads) {
+				for (int i = 0; i < MetricCountersCount; i++) totals[i] += threadCounters->Values[i].load(std::memory_order_relaxed);
+			}
+		}
+		// The thread counters are never reset (they have a single writer), we store the frame difference
+		for (int i = 0; i < MetricCountersCount; i++) {
+			frame.Counters[i] = totals[i] - _previousTotals[i];
+			_previousTotals[i] = totals[i];
+			_totals[i] = totals[i];
+		}
+		for (int i = 0; i < MetricBuffersCount; i++) {
+			frame.BufferBytes[i] = _bufferBytes[i].load(std::memory_order_relaxed);
+			frame.BufferPeakBytes[i] = _bufferPeakBytes[i].load(std::memory_order_relaxed);
+		}
+
+		_history.push_back(frame);
+		if (_history.size() > MaxHistoryFrames) _history.pop_front();
+	}
+
+	/// <summary>
+	/// Last aggregated frame (an empty frame if EndFrame() has never been called)
+	/// </summary>
+	MetricsFrame GetLastFrame() const { return _history.empty() ? MetricsFrame() : _history.back(); }
+
+	/// <summary>
+	/// Counters totals up to the last aggregated frame
+	/// </summary>
+	int64_t GetTotal(MetricCounter counter) const { return _totals[(int)counter]; }
+
+	/// <summary>
+	/// Writes the time series as CSV (one row per frame)
+	/// </summary>
+	void WriteCsv(std::ostream& stream) const {
+		stream << "frame";
+		for (int i = 0; i < MetricCountersCount; i++) stream << "," << GetCounterName((MetricCounter)i);
+		for (int i = 0; i < MetricBuffersCount; i++) {
+			stream << "," << GetBufferName((MetricBuffer)i) << "_bytes," << GetBufferName((MetricBuffer)i) << "_peak_bytes";
+		}
+		stream << "\n";
+
+		for (const MetricsFrame& frame : _history) {
+			stream << frame.Frame;
+			for (int i = 0; i < MetricCountersCount; i++) stream << "," << frame.Counters[i];
+			for (int i = 0; i < MetricBuffersCount; i++) stream << "," << frame.BufferBytes[i] << "," << frame.BufferPeakBytes[i];
+			stream << "\n";
+		}
+	}
+
+	/// <summary>
+	/// Writes the totals and the time series as JSON
+	/// </summary>
+	void WriteJson(std::ostream& stream) const {
+		stream << "{\n  \"totals\": {";
+		for (int i = 0; i < MetricCountersCount; i++) {
+			stream << (i > 0 ? ", " : " ") << "\"" << GetCounterName((MetricCounter)i) << "\": " << _totals[i];
+		}
+		stream << " },\n  \"frames\": [\n";
+		for (std::size_t f = 0; f < _history.size(); f++) {
+			const MetricsFrame& frame = _history[f];
+			stream << "    { \"frame\": " << frame.Frame;
+			for (int i = 0; i < MetricCountersCount; i++) stream << ", \"" << GetCounterName((MetricCounter)i) << "\": " << frame.Counters[i];
+			for (int i = 0; i < MetricBuffersCount; i++) {
+				stream << ", \"" << GetBufferName((MetricBuffer)i) << "_bytes\": " << frame.BufferBytes[i]
+					<< ", \"" << GetBufferName((MetricBuffer)i) << "_peak_bytes\": " << frame.BufferPeakBytes[i];
+			}
+			stream << " }" << (f + 1 < _history.size() ? "," : "") << "\n";
+		}
+		stream << "  ]\n}\n";
+	}
+
+	/// <summary>
+	/// Exports the time series to a CSV or JSON file (chosen by the extension)
+	/// </summary>
+	bool Write(const std::string& path) const {
+		std::ofstream file(path);
+		if (!file) {
+			std::cout << "ERROR::METRICS: unable to write " << path << std::endl;
+			return false;
+		}
+
+		bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		if (json) WriteJson(file);
+		else WriteCsv(file);
+		return true;
+	}
+};
+
+// Singleton definition
+Metrics Metrics::Instance;
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <core_include.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/// <summary>
+/// Single completed zone
+/// </summary>
+struct ProfileEvent {
+	const char* Name;
+	/// <summary>
+	/// Start time in nanoseconds from the profiler creation
+	/// </summary>
+	int64_t Start;
+	int64_t Duration;
+	int Depth;
+};
+
+/// <summary>
+/// Per-zone summary of a frame. Zones executed by more threads sum their time
+/// </summary>
+struct ProfileZoneSummary {
+	const char* Name;
+	int Depth;
+	int Calls;
+	double TotalMilliseconds;
+};
+
+/// <summary>
+/// Timeline of a single thread
+/// </summary>
+/// <remarks>
+/// The mutex is taken only by the owner thread and by the profiler when the frame ends or the trace is exported,
+/// so it' s almost never contended
+/// </remarks>
+struct ProfilerThreadData {
+	std::mutex Mutex;
+	int ThreadId = 0;
+	std::string Name;
+	int Depth = 0;
+	std::vector<ProfileEvent> Events;
+	std::unordered_map<const char*, ProfileZoneSummary> FrameZones;
+	int64_t DroppedEvents = 0;
+};
+
+/// <summary>
+/// Hierarchical scoped-zone profiler
+/// </summary>
+/// <remarks>
+/// Zones are opened with the PROFILE_SCOPE macro and they are closed at the end of the C++ scope, so the nesting
+/// follows the call stack. Each thread records on its own timeline.
+///
+/// When the profiler is disabled a zone costs only an atomic load. With NO_PROFILING defined the zones are
+/// entirely removed from the build.
+///
+/// The recorded events can be exported in the Chrome trace-event format (chrome://tracing or https://ui.perfetto.dev)
+/// </remarks>
+class Profiler
+{
+private:
+	/// <summary>
+	/// Events limit for each thread. Once reached, the events are only counted in the frame summary
+	/// </summary>
+	static const std::size_t MaxEventsPerThread = 1 << 20;
+
+	std::atomic<bool> _enabled;
+	const std::chrono::steady_clock::time_point _epoch;
+
+	std::mutex _threadsMutex;
+	std::vector<std::unique_ptr<ProfilerThreadData>> _threads;
+	std::vector<ProfileZoneSummary> _lastFrameSummary;
+
+	ProfilerThreadData* RegisterThread() {
+		const std::lock_guard<std::mutex> lock(_threadsMutex);
+		// The data is owned by the profiler: the worker threads may terminate before the export
+		_threads.push_back(std::make_unique<ProfilerThreadData>());
+		ProfilerThreadData* data = _threads.back().get();
+		data->ThreadId = (int)_threads.size();
+		data->Name = "Thread " + std::to_string(data->ThreadId);
+		return data;
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(Profiler);
+
+	static Profiler Instance;
+
+	Profiler() : _enabled(false), _epoch(std::chrono::steady_clock::now()) {
+	}
+
+	bool IsEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+	void SetEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+
+	int64_t Now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _epoch).count();
+	}
+
+	/// <summary>
+	/// Returns the timeline of the calling thread
+	/// </summary>
+	ProfilerThreadData* GetThreadData() {
+		thread_local ProfilerThreadData* threadData = nullptr;
+		if (!threadData) threadData = RegisterThread();
+		return threadData;
+	}
+
+	/// <summary>
+	/// Names the calling thread timeline in the exported trace
+	/// </summary>
+	void SetThreadName(const std::string& name) {
+		ProfilerThreadData* data = GetThreadData();
+		const std::lock_guard<std::mutex> lock(data->Mutex);
+		data->Name = name;
+	}
+
+	void RecordZone(ProfilerThreadData* data, const char* name, int64_t start, int depth) {
+		int64_t duration = Now() - start;
+
+		const std::lock_guard<std::mutex> lock(data->Mutex);
+		if (data->Events.size() < MaxEventsPerThread) data->Events.push_back({ name, start, duration, depth });
+		else ++data->DroppedEvents;
+
+		auto zoneIt = data->FrameZones.find(name);
+		if (zoneIt == data->FrameZones.end()) {
+			zoneIt = data->FrameZones.emplace(name, ProfileZoneSummary{ name, depth, 0, 0.0 }).first;
+		}
+		ProfileZoneSummary& zone = zoneIt->second;
+		zone.Depth = std::min(zone.Depth, depth);
+		zone.Calls++;
+		zone.TotalMilliseconds += duration / 1e6;
+	}
+
+	/// <summary>
+	/// Closes the current frame and builds its per-zone summary
+	/// </summary>
+	void EndFrame() {
+		std::unordered_map<const char*, ProfileZoneSummary> frameZones;
+		{
+			const std::lock_guard<std::mutex> lock(_threadsMutex);
+			for (const std::unique_ptr<ProfilerThreadData>& data : _threads) {
+				const std::lock_guard<std::mutex> threadLock(data->Mutex);
+				for (const auto& it : data->FrameZones) {
+					auto zoneIt = frameZones.emplace(it.first, it.second);
+					if (zoneIt.second) continue;
+
+					// Same zone on more threads
+					ProfileZoneSummary& zone = zoneIt.first->second;
+					zone.Depth = std::min(zone.Depth, it.second.Depth);
+					zone.Calls += it.second.Calls;
+					zone.TotalMilliseconds += it.second.TotalMilliseconds;
+				}
+				data->FrameZones.clear();
+			}
+		}
+
+		_lastFrameSummary.clear();
+		for (const auto& it : frameZones) _lastFrameSummary.push_back(it.second);
+		// Outer zones first, then the most expensive ones
+		std::sort(_lastFrameSummary.begin(), _lastFrameSummary.end(), [](const ProfileZoneSummary& a, const ProfileZoneSummary& b) {
+			if (a.Depth != b.Depth) return a.Depth < b.Depth;
+			return a.TotalMilliseconds > b.TotalMilliseconds;
+		});
+	}
+
+	/// <summary>
+	/// Summary of the last completed frame
+	/// </summary>
+	const std::vector<ProfileZoneSummary>& GetLastFrameSummary() const { return _lastFrameSummary; }
+
+	/// <summary>
+	/// Writes all the recorded events in the Chrome trace-event JSON format and clears them
+	/// </summary>
+	void WriteChromeTrace(std::ostream& stream) {
+		const std::lock_guard<std::mutex> lock(_threadsMutex);
+
+		stream << std::fixed << std::setprecision(3);
+		stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		for (const std::unique_ptr<ProfilerThreadData>& data : _threads) {
+			const std::lock_guard<std::mutex> threadLock(data->Mutex);
+
+			stream << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << data->ThreadId
+				<< ",\"args\":{\"name\":\"" << data->Name << "\"}}";
+			first = false;
+
+			// Complete events ("X") are nested by the viewer from their time ranges
+			for (const ProfileEvent& event : data->Events) {
+				stream << ",\n{\"name\":\"" << event.Name << "\",\"cat\":\"irradiance\",\"ph\":\"X\",\"pid\":1,\"tid\":" << data->ThreadId
+					<< ",\"ts\":" << event.Start / 1e3 << ",\"dur\":" << event.Duration / 1e3
+					<< ",\"args\":{\"depth\":" << event.Depth << "}}";
+			}
+
+			if (data->DroppedEvents > 0) {
+				std::cout << "WARNING::PROFILER: " << data->DroppedEvents << " events dropped on " << data->Name << std::endl;
+			}
+			data->Events.clear();
+			data->DroppedEvents = 0;
+		}
+		stream << "\n]}\n";
+	}
+
+	/// <summary>
+	/// Exports the recorded events to a Chrome trace file
+	/// </summary>
+	bool WriteChromeTrace(const std::string& path) {
+		std::ofstream file(path);
+		if (!file) {
+			std::cout << "ERROR::PROFILER: unable to write " << path << std::endl;
+			return false;
+		}
+		WriteChromeTrace(file);
+		return true;
+	}
+};
+
+// Singleton definition
+Profiler Profiler::Instance;
+
+/// <summary>
+/// RAII zone. Use it through the PROFILE_SCOPE macro
+/// </summary>
+class ProfileZone
+{
+private:
+	const char* _name;
+	ProfilerThreadData* _data = nullptr;
+	int64_t _start = 0;
+	int _depth = 0;
+
+public:
+	NO_COPY_AND_ASSIGN(ProfileZone);
+
+	/// <param name="name">Zone name. It must be a string literal (it' s also the zone identity)</param>
+	explicit ProfileZone(const char* name) : _name(name) {
+		if (!Profiler::Instance.IsEnabled()) return;
+
+		_data = Profiler::Instance.GetThreadData();
+		_depth = _data->Depth++;
+		_start = Profiler::Instance.Now();
+	}
+
+	~ProfileZone() {
+		if (!_data) return;
+
+		_data->Depth--;
+		Profiler::Instance.RecordZone(_data, _name, _start, _depth);
+	}
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef NO_PROFILING
+#define PROFILE_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#endif
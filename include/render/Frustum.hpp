@@ -0,0 +1,152 @@
+#pragma once
+
+#include <std_include.h>
+#include <cstdint>
+#include <vector>
+#include <immintrin.h>
+
+#include <BCube.hpp>
+
+/// <summary>
+/// Axis aligned boxes stored as separate coordinate columns, so they can be culled 4 at a time
+/// </summary>
+class BoxBatch {
+private:
+	std::vector<float> _minX, _minY, _minZ;
+	std::vector<float> _maxX, _maxY, _maxZ;
+
+	friend class Frustum;
+public:
+	void Clear() {
+		_minX.clear(); _minY.clear(); _minZ.clear();
+		_maxX.clear(); _maxY.clear(); _maxZ.clear();
+	}
+
+	void Add(const glm::vec3& minValue, const glm::vec3& maxValue) {
+		_minX.push_back(minValue.x); _minY.push_back(minValue.y); _minZ.push_back(minValue.z);
+		_maxX.push_back(maxValue.x); _maxY.push_back(maxValue.y); _maxZ.push_back(maxValue.z);
+	}
+
+	void Add(const BCube& cube) {
+		Add(cube.Min, cube.Max);
+	}
+
+	size_t Size() const { return _minX.size(); }
+};
+
+/// <summary>
+/// Reusable buffers of a culling pass, to avoid the allocations at each frame
+/// </summary>
+struct CullingBuffers {
+	BoxBatch Boxes;
+	std::vector<uint8_t> Visible;
+};
+
+/// <summary>
+/// View frustum planes, extracted from a view-projection matrix
+/// </summary>
+/// <remarks>
+/// The test is conservative: a box is culled only if it' s entirely behind one of the planes, so some boxes
+/// near the frustum corners are reported as visible
+/// </remarks>
+class Frustum {
+private:
+	static const int PlanesCount = 6;
+
+	/// <summary>
+	/// Planes in the a*x + b*y + c*z + d >= 0 form (inside). They are not normalized: only the sign is used
+	/// </summary>
+	glm::vec4 _planes[PlanesCount];
+
+public:
+	/// <summary>
+	/// Extracts the planes of the clip space volume (Gribb-Hartmann)
+	/// </summary>
+	static Frustum FromMatrix(const glm::mat4& viewProjection) {
+		const glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+		const glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+		const glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+		const glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+		Frustum frustum;
+		frustum._planes[0] = row3 + row0; // Left
+		frustum._planes[1] = row3 - row0; // Right
+		frustum._planes[2] = row3 + row1; // Bottom
+		frustum._planes[3] = row3 - row1; // Top
+		frustum._planes[4] = row3 + row2; // Near
+		frustum._planes[5] = row3 - row2; // Far
+		return frustum;
+	}
+
+	/// <summary>
+	/// Tests a single box
+	/// </summary>
+	bool IsVisible(const glm::vec3& minValue, const glm::vec3& maxValue) const {
+		for (int i = 0; i < PlanesCount; i++)
+		{
+			const glm::vec4& plane = _planes[i];
+			// The box corner farthest along the plane normal
+			glm::vec3 corner(plane.x >= 0.0f ? maxValue.x : minValue.x, plane.y >= 0.0f ? maxValue.y : minValue.y, plane.z >= 0.0f ? maxValue.z : minValue.z);
+			if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+		}
+		return true;
+	}
+
+	bool IsVisible(const BCube& cube) const {
+		return IsVisible(cube.Min, cube.Max);
+	}
+
+	/// <summary>
+	/// Tests all the boxes of the batch
+	/// </summary>
+	/// <param name="visible">Visibility flag of each box, in the batch order</param>
+	/// <returns>Number of visible boxes</returns>
+	int Cull(const BoxBatch& boxes, std::vector<uint8_t>& visible) const;
+};
+
+int Frustum::Cull(const BoxBatch& boxes, std::vector<uint8_t>& visible) const {
+	const size_t count = boxes.Size();
+	visible.resize(count);
+
+	int visibleCount = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 minX = _mm_loadu_ps(boxes._minX.data() + i), maxX = _mm_loadu_ps(boxes._maxX.data() + i);
+		const __m128 minY = _mm_loadu_ps(boxes._minY.data() + i), maxY = _mm_loadu_ps(boxes._maxY.data() + i);
+		const __m128 minZ = _mm_loadu_ps(boxes._minZ.data() + i), maxZ = _mm_loadu_ps(boxes._maxZ.data() + i);
+
+		// Lanes are cleared as soon as a box is outside a plane
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < PlanesCount; p++)
+		{
+			const glm::vec4& plane = _planes[p];
+			// The plane is the same for the 4 boxes, so the farthest corner is selected once per plane
+			const __m128 cornerX = plane.x >= 0.0f ? maxX : minX;
+			const __m128 cornerY = plane.y >= 0.0f ? maxY : minY;
+			const __m128 cornerZ = plane.z >= 0.0f ? maxZ : minZ;
+
+			__m128 distance = _mm_add_ps(_mm_mul_ps(cornerX, _mm_set1_ps(plane.x)), _mm_mul_ps(cornerY, _mm_set1_ps(plane.y)));
+			distance = _mm_add_ps(distance, _mm_mul_ps(cornerZ, _mm_set1_ps(plane.z)));
+			distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		visible[i] = (uint8_t)(mask & 1);
+		visible[i + 1] = (uint8_t)((mask >> 1) & 1);
+		visible[i + 2] = (uint8_t)((mask >> 2) & 1);
+		visible[i + 3] = (uint8_t)((mask >> 3) & 1);
+		visibleCount += visible[i] + visible[i + 1] + visible[i + 2] + visible[i + 3];
+	}
+
+	// Scalar tail
+	for (; i < count; i++)
+	{
+		const glm::vec3 minValue(boxes._minX[i], boxes._minY[i], boxes._minZ[i]);
+		const glm::vec3 maxValue(boxes._maxX[i], boxes._maxY[i], boxes._maxZ[i]);
+		visible[i] = (uint8_t)IsVisible(minValue, maxValue);
+		visibleCount += visible[i];
+	}
+	return visibleCount;
+}
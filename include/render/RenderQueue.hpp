@@ -0,0 +1,233 @@
+#pragma once
+
+#include <std_include.h>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <profiling/Metrics.hpp>
+
+/// <summary>
+/// Uniform value captured by a draw item
+/// </summary>
+struct RenderUniform {
+	enum class UniformType : uint8_t { Int, Vec3, Mat3, Mat4 };
+
+	GLint Location;
+	UniformType Type;
+	union {
+		GLint IntValue;
+		GLfloat FloatValues[16];
+	};
+};
+
+/// <summary>
+/// Single draw command of an item
+/// </summary>
+struct RenderCommand {
+	GLenum Mode;
+	GLsizei Count;
+	GLenum IndexType;
+	/// <summary>
+	/// Byte offset of the first index in the element buffer
+	/// </summary>
+	size_t IndexOffset;
+	GLsizei InstancesCount;
+};
+
+/// <summary>
+/// State of a set of draw commands: the program, the vertex array and the uniforms values
+/// </summary>
+struct RenderItem {
+	GLuint Program;
+	GLuint VertexArray;
+	uint32_t FirstUniform;
+	uint32_t UniformsCount;
+	uint32_t FirstCommand;
+	uint32_t CommandsCount;
+	/// <summary>
+	/// Submission order, to keep the sort stable for items with the same state
+	/// </summary>
+	uint32_t Order;
+};
+
+/// <summary>
+/// Collects the draw items of a frame and issues them sorted by program and vertex array
+/// </summary>
+/// <remarks>
+/// An item is opened by Begin() and the following SetUniform() and Draw() calls are attached to it. The uniforms
+/// are captured by value, so the objects can change their state before the Flush().
+/// The uniforms of an item are always applied: the program state is not tracked between the items.
+///
+/// Only the state that is part of the item is sorted: the objects must not rely on any other GL state changed
+/// between the submissions (for example the storage buffers must be written before the submission)
+/// </remarks>
+class RenderQueue {
+private:
+	std::vector<RenderItem> _items;
+	std::vector<RenderUniform> _uniforms;
+	std::vector<RenderCommand> _commands;
+
+	const Shader* _currentShader = nullptr;
+
+	RenderUniform& AddUniform(const GLchar* uniformName, RenderUniform::UniformType type) {
+#if DEBUG
+		if (!_currentShader) throw std::runtime_error("RenderQueue::SetUniform called without an open item");
+#endif
+		RenderItem& item = _items.back();
+		_uniforms.emplace_back();
+		item.UniformsCount++;
+
+		RenderUniform& uniform = _uniforms.back();
+		uniform.Location = _currentShader->GetUniformLocation(uniformName);
+		uniform.Type = type;
+		return uniform;
+	}
+
+	static void ApplyUniform(const RenderUniform& uniform) {
+		switch (uniform.Type)
+		{
+		case RenderUniform::UniformType::Int:
+			glUniform1i(uniform.Location, uniform.IntValue);
+			break;
+		case RenderUniform::UniformType::Vec3:
+			glUniform3fv(uniform.Location, 1, uniform.FloatValues);
+			break;
+		case RenderUniform::UniformType::Mat3:
+			glUniformMatrix3fv(uniform.Location, 1, GL_FALSE, uniform.FloatValues);
+			break;
+		case RenderUniform::UniformType::Mat4:
+			glUniformMatrix4fv(uniform.Location, 1, GL_FALSE, uniform.FloatValues);
+			break;
+		}
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(RenderQueue);
+
+	RenderQueue() {
+	}
+
+	/// <summary>
+	/// Opens a new item with the shader program and the vertex array
+	/// </summary>
+	void Begin(const Shader& shader, GLuint vertexArray) {
+		RenderItem item;
+		item.Program = shader.Program;
+		item.VertexArray = vertexArray;
+		item.FirstUniform = (uint32_t)_uniforms.size();
+		item.UniformsCount = 0;
+		item.FirstCommand = (uint32_t)_commands.size();
+		item.CommandsCount = 0;
+		item.Order = (uint32_t)_items.size();
+		_items.push_back(item);
+		_currentShader = &shader;
+	}
+
+	void SetUniform(const GLchar* uniformName, int value) {
+		AddUniform(uniformName, RenderUniform::UniformType::Int).IntValue = value;
+	}
+
+	void SetUniform(const GLchar* uniformName, const glm::vec3& value) {
+		memcpy(AddUniform(uniformName, RenderUniform::UniformType::Vec3).FloatValues, glm::value_ptr(value), sizeof(value));
+	}
+
+	void SetUniform(const GLchar* uniformName, const glm::mat3& value) {
+		memcpy(AddUniform(uniformName, RenderUniform::UniformType::Mat3).FloatValues, glm::value_ptr(value), sizeof(value));
+	}
+
+	void SetUniform(const GLchar* uniformName, const glm::mat4& value) {
+		memcpy(AddUniform(uniformName, RenderUniform::UniformType::Mat4).FloatValues, glm::value_ptr(value), sizeof(value));
+	}
+
+	/// <summary>
+	/// Adds an indexed draw to the open item
+	/// </summary>
+	void Draw(GLenum mode, GLsizei count, GLenum indexType, size_t indexOffset = 0, GLsizei instancesCount = 1) {
+#if DEBUG
+		if (!_currentShader) throw std::runtime_error("RenderQueue::Draw called without an open item");
+#endif
+		_commands.push_back({ mode, count, indexType, indexOffset, instancesCount });
+		_items.back().CommandsCount++;
+	}
+
+	/// <summary>
+	/// Adds the draw of all the meshes of a model. Each mesh has its own vertex array, so it' s a new item
+	/// with a copy of the uniforms of the open item
+	/// </summary>
+	void DrawModel(const Model& model, GLsizei instancesCount = 1) {
+		if (model.meshes.empty()) return;
+
+		const Shader* shader = _currentShader;
+		const RenderItem first = _items.back();
+		_items.back().VertexArray = model.meshes[0].VAO;
+		Draw(GL_TRIANGLES, (GLsizei)model.meshes[0].indices.size(), GL_UNSIGNED_INT, 0, instancesCount);
+
+		for (size_t i = 1; i < model.meshes.size(); i++)
+		{
+			Begin(*shader, model.meshes[i].VAO);
+			RenderItem& item = _items.back();
+			// The uniforms values are shared with the first mesh
+			item.FirstUniform = first.FirstUniform;
+			item.UniformsCount = first.UniformsCount;
+			Draw(GL_TRIANGLES, (GLsizei)model.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, instancesCount);
+		}
+	}
+
+	size_t GetItemsCount() const { return _items.size(); }
+
+	/// <summary>
+	/// Issues all the items sorted by program and vertex array, then clears the queue
+	/// </summary>
+	void Flush() {
+		std::sort(_items.begin(), _items.end(), [](const RenderItem& a, const RenderItem& b) {
+			if (a.Program != b.Program) return a.Program < b.Program;
+			if (a.VertexArray != b.VertexArray) return a.VertexArray < b.VertexArray;
+			return a.Order < b.Order;
+		});
+
+		int64_t drawCalls = 0, programSwitches = 0, vertexArraySwitches = 0;
+		GLuint currentProgram = 0, currentVertexArray = 0;
+		for (const RenderItem& item : _items)
+		{
+			if (item.Program != currentProgram) {
+				glUseProgram(item.Program);
+				currentProgram = item.Program;
+				programSwitches++;
+			}
+			if (item.VertexArray != currentVertexArray) {
+				glBindVertexArray(item.VertexArray);
+				currentVertexArray = item.VertexArray;
+				vertexArraySwitches++;
+			}
+
+			for (uint32_t i = 0; i < item.UniformsCount; i++)
+			{
+				ApplyUniform(_uniforms[item.FirstUniform + i]);
+			}
+			for (uint32_t i = 0; i < item.CommandsCount; i++)
+			{
+				const RenderCommand& command = _commands[item.FirstCommand + i];
+				const GLvoid* indices = (const GLvoid*)command.IndexOffset;
+				if (command.InstancesCount == 1) {
+					glDrawElements(command.Mode, command.Count, command.IndexType, indices);
+				}
+				else {
+					glDrawElementsInstanced(command.Mode, command.Count, command.IndexType, indices, command.InstancesCount);
+				}
+				drawCalls++;
+			}
+		}
+		glBindVertexArray(0);
+
+		Metrics::Instance.Add(MetricCounter::DrawCalls, drawCalls);
+		Metrics::Instance.Add(MetricCounter::ProgramSwitches, programSwitches);
+		Metrics::Instance.Add(MetricCounter::VertexArraySwitches, vertexArraySwitches);
+
+		_items.clear();
+		_uniforms.clear();
+		_commands.clear();
+		_currentShader = nullptr;
+	}
+};
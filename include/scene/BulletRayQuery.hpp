@@ -0,0 +1,133 @@
+#pragma once
+
+#if WITH_BULLET
+
+#include <std_include.h>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <unordered_set>
+#include <bullet/btBulletCollisionCommon.h>
+#include <scene/RayQuery.hpp>
+
+/// <summary>
+/// Forwards the ray queries to btCollisionWorld::rayTest, for the scenes already simulated in a Physics world
+/// </summary>
+/// <remarks>
+/// The objects are matched to their bodies with the body user pointer (see Register()). Bullet finds the candidate
+/// bodies along the ray and the hit surface is found with SceneObject::IsHitByRay, so the collision shapes must
+/// enclose the objects surfaces. The objects without a body are tested one by one. The rays that start inside a
+/// convex shape do not report it, so the objects that enclose the probes (the room) must not be registered.
+///
+/// The body bounds are updated by the world simulation step, that must not run during the sampling.
+/// The Bullet ray test is not reentrant (the default build has no BT_THREADSAFE), so the queries are serialized
+/// and the parallel update does not scale with this backend
+/// </remarks>
+class BulletRayQuery : public RayQueryBackend {
+private:
+	/// <summary>
+	/// Length of the rays without a max distance (the rayTest needs a segment)
+	/// </summary>
+	static constexpr float MaxRayLength = 1000.0f;
+
+	/// <summary>
+	/// Collects the sampling objects hit by the ray, with their fraction on the segment
+	/// </summary>
+	struct CandidatesCallback : public btCollisionWorld::RayResultCallback {
+		const std::unordered_set<const void*>& Objects;
+		std::vector<std::pair<btScalar, const SceneObject*>> Candidates;
+
+		explicit CandidatesCallback(const std::unordered_set<const void*>& objects) : Objects(objects) {
+		}
+
+		btScalar addSingleResult(btCollisionWorld::LocalRayResult& rayResult, bool normalInWorldSpace) override {
+			// The other bodies of the world (and the objects that are not sampled) are ignored
+			const void* object = rayResult.m_collisionObject->getUserPointer();
+			if (Objects.count(object)) Candidates.push_back({ rayResult.m_hitFraction, static_cast<const SceneObject*>(object) });
+			// We keep the closest fraction of Bullet untouched, so all the candidates are reported
+			return m_closestHitFraction;
+		}
+	};
+
+	btCollisionWorld* _world;
+	std::vector<const SceneObject*> _unregisteredObjects;
+	std::vector<const SceneObject*> _registeredObjects;
+	/// <summary>
+	/// Registered objects that are in the sampling objects
+	/// </summary>
+	std::unordered_set<const void*> _sampledObjects;
+	mutable std::mutex _queryMutex;
+
+	/// <summary>
+	/// Tests the candidates nearest first
+	/// </summary>
+	void Intersect(const Ray& ray, ObjectHit& hit, bool anyHit) const {
+		const float length = std::min(hit.Distance, MaxRayLength);
+		const glm::vec3 end = ray.Position() + ray.Direction() * length;
+
+		CandidatesCallback callback(_sampledObjects);
+		{
+			std::lock_guard<std::mutex> lock(_queryMutex);
+			_world->rayTest(btVector3(ray.Position().x, ray.Position().y, ray.Position().z), btVector3(end.x, end.y, end.z), callback);
+		}
+
+		// The candidates are sorted by the entry in the collision shape, the exact hit may be farther
+		std::sort(callback.Candidates.begin(), callback.Candidates.end(),
+			[](const std::pair<btScalar, const SceneObject*>& a, const std::pair<btScalar, const SceneObject*>& b) { return a.first < b.first; });
+		for (const auto& candidate : callback.Candidates)
+		{
+			if (candidate.first * length > hit.Distance) break;
+			if (TestObject(candidate.second, ray, hit) && anyHit) return;
+		}
+
+		for (const SceneObject* object : _unregisteredObjects)
+		{
+			if (TestObject(object, ray, hit) && anyHit) return;
+		}
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(BulletRayQuery);
+
+	explicit BulletRayQuery(btCollisionWorld* world) : _world(world) {
+	}
+
+	/// <summary>
+	/// Associates a sampling object with its body in the world
+	/// </summary>
+	void Register(const SceneObject* object, btCollisionObject* body) {
+		body->setUserPointer(const_cast<SceneObject*>(object));
+		_registeredObjects.push_back(object);
+	}
+
+	const char* GetName() const override { return "bullet"; }
+
+	void Update(const std::vector<const SceneObject*>& objects) override {
+		_unregisteredObjects.clear();
+		_sampledObjects.clear();
+		for (const SceneObject* object : objects)
+		{
+			if (std::find(_registeredObjects.cbegin(), _registeredObjects.cend(), object) == _registeredObjects.cend()) _unregisteredObjects.push_back(object);
+			else _sampledObjects.insert(object);
+		}
+	}
+
+	void IntersectClosest(const glm::vec3& origin, const glm::vec3* directions, int count, ObjectHit* hits) const override {
+		for (int i = 0; i < count; i++)
+		{
+			Intersect(Ray(origin, directions[i]), hits[i], false);
+		}
+	}
+
+	void IntersectAny(const glm::vec3& origin, const glm::vec3* directions, const float* maxDistances, int count, bool* occluded) const override {
+		for (int i = 0; i < count; i++)
+		{
+			ObjectHit hit;
+			hit.Distance = maxDistances[i];
+			Intersect(Ray(origin, directions[i]), hit, true);
+			occluded[i] = hit.IsHit();
+		}
+	}
+};
+
+#endif
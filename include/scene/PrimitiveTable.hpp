@@ -0,0 +1,333 @@
+#pragma once
+
+#include <std_include.h>
+#include <vector>
+#include <limits>
+#include <stdexcept>
+#include <immintrin.h>
+
+#include <Ray.hpp>
+#include <Surface.hpp>
+#include <BCube.hpp>
+
+/// <summary>
+/// Kind of a primitive stored in the PrimitiveTable
+/// </summary>
+enum class PrimitiveType : uint8_t {
+	/// <summary>
+	/// Double sided parallelogram (the cube walls and the scene quads)
+	/// </summary>
+	Quad = 0,
+	Sphere,
+	/// <summary>
+	/// Solid axis aligned box
+	/// </summary>
+	Box,
+	Count
+};
+
+/// <summary>
+/// Closest hit found in a PrimitiveTable
+/// </summary>
+struct PrimitiveHit {
+	/// <summary>
+	/// Index of the hit primitive, -1 if nothing has been hit
+	/// </summary>
+	int Index = -1;
+	/// <summary>
+	/// Hit distance. Only the primitives nearer than this value are considered
+	/// </summary>
+	float Distance = std::numeric_limits<float>::max();
+
+	bool IsHit() const { return Index >= 0; }
+};
+
+/// <summary>
+/// Flattened static geometry for the ray casting
+/// </summary>
+/// <remarks>
+/// The primitives are stored as structure of arrays grouped by type, so each type is intersected in bulk
+/// with a tight loop (the quads 4 at time with SSE) instead of a virtual call per object.
+/// The columns meaning depends on the primitive type:
+/// - Quad: plane = unit normal and offset (n.p + w = 0), U/V = edges dual vectors and offset (u = U.p + U.w). The point is inside when u and v are in [0, 1]
+/// - Sphere: plane = center and radius
+/// - Box: only the bounds
+/// The bounds are the world AABB of every primitive
+/// </remarks>
+class PrimitiveTable {
+private:
+	std::vector<PrimitiveType> _types;
+	std::vector<Surface*> _surfaces;
+
+	std::vector<float> _planeX, _planeY, _planeZ, _planeW;
+	std::vector<float> _uX, _uY, _uZ, _uW;
+	std::vector<float> _vX, _vY, _vZ, _vW;
+	std::vector<float> _minX, _minY, _minZ;
+	std::vector<float> _maxX, _maxY, _maxZ;
+
+	/// <summary>
+	/// First index of each type range. The last item is the primitives count
+	/// </summary>
+	int _typeStart[(int)PrimitiveType::Count + 1] = {};
+
+	int Insert(PrimitiveType type, Surface* surface, const glm::vec4& plane, const glm::vec4& u, const glm::vec4& v, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	bool IntersectQuad(int index, const Ray& ray, float& distance) const;
+	bool IntersectSphere(int index, const Ray& ray, float& distance) const;
+	bool IntersectBox(int index, const Ray& ray, float& distance) const;
+
+	void IntersectQuads(const Ray& ray, PrimitiveHit& hit) const;
+
+	template<class Intersector>
+	void IntersectRange(PrimitiveType type, const Ray& ray, PrimitiveHit& hit, Intersector intersector) const {
+		for (int i = _typeStart[(int)type]; i < _typeStart[(int)type + 1]; i++)
+		{
+			float distance;
+			if ((this->*intersector)(i, ray, distance) && distance < hit.Distance) {
+				hit.Index = i;
+				hit.Distance = distance;
+			}
+		}
+	}
+
+public:
+	/// <summary>
+	/// Minimum hit distance. Avoids the self intersections of the rays shot from a surface
+	/// </summary>
+	static constexpr float MinDistance = 1e-4f;
+	/// <summary>
+	/// Tolerance on the quads edges (in edge units). The rays through the edge between two walls must hit one of them
+	/// </summary>
+	static constexpr float EdgeEpsilon = 1e-5f;
+
+	/// <summary>
+	/// Adds the parallelogram p0, p0 + edge1, p0 + edge2, p0 + edge1 + edge2
+	/// </summary>
+	int AddQuad(const glm::vec3& p0, const glm::vec3& edge1, const glm::vec3& edge2, Surface* surface);
+	int AddSphere(const glm::vec3& center, float radius, Surface* surface);
+	int AddBox(const glm::vec3& boxMin, const glm::vec3& boxMax, Surface* surface);
+
+	void Clear();
+
+	int Size() const { return (int)_types.size(); }
+	int Count(PrimitiveType type) const { return _typeStart[(int)type + 1] - _typeStart[(int)type]; }
+	PrimitiveType GetType(int index) const { return _types[index]; }
+	Surface* GetSurface(int index) const { return _surfaces[index]; }
+	BCube GetBounds(int index) const {
+		return BCube::FromMinMax(glm::vec3(_minX[index], _minY[index], _minZ[index]), glm::vec3(_maxX[index], _maxY[index], _maxZ[index]));
+	}
+
+	/// <summary>
+	/// Returns the unit normal of a primitive in a point of its surface. The quads normal is not oriented
+	/// </summary>
+	glm::vec3 GetNormal(int index, const glm::vec3& point) const;
+
+	/// <summary>
+	/// Finds the closest primitive hit by the ray nearer than hit.Distance
+	/// </summary>
+	/// <returns>True if hit has been updated</returns>
+	bool IntersectClosest(const Ray& ray, PrimitiveHit& hit) const;
+};
+
+int PrimitiveTable::Insert(PrimitiveType type, Surface* surface, const glm::vec4& plane, const glm::vec4& u, const glm::vec4& v, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	// The primitive is placed at the end of its type range (the table is built once, so the
+	// insertion cost is not a problem)
+	const int index = _typeStart[(int)type + 1];
+	auto insert = [index](auto& column, auto value) { column.insert(column.begin() + index, value); };
+
+	insert(_types, type);
+	insert(_surfaces, surface);
+	insert(_planeX, plane.x); insert(_planeY, plane.y); insert(_planeZ, plane.z); insert(_planeW, plane.w);
+	insert(_uX, u.x); insert(_uY, u.y); insert(_uZ, u.z); insert(_uW, u.w);
+	insert(_vX, v.x); insert(_vY, v.y); insert(_vZ, v.z); insert(_vW, v.w);
+	insert(_minX, boundsMin.x); insert(_minY, boundsMin.y); insert(_minZ, boundsMin.z);
+	insert(_maxX, boundsMax.x); insert(_maxY, boundsMax.y); insert(_maxZ, boundsMax.z);
+
+	for (int i = (int)type + 1; i <= (int)PrimitiveType::Count; i++) ++_typeStart[i];
+	return index;
+}
+
+int PrimitiveTable::AddQuad(const glm::vec3& p0, const glm::vec3& edge1, const glm::vec3& edge2, Surface* surface) {
+	glm::vec3 normal = glm::cross(edge1, edge2);
+	if (glm::length(normal) <= 0.0f) throw std::runtime_error("Degenerate quad");
+	normal = glm::normalize(normal);
+
+	// Dual vectors of the edges: dot(uAxis, edge1) = 1 and dot(uAxis, edge2) = 0 (and vice versa).
+	// They give the parallelogram coordinates of a point also when the edges are not orthogonal
+	glm::vec3 uAxis = glm::cross(edge2, normal);
+	uAxis /= glm::dot(edge1, uAxis);
+	glm::vec3 vAxis = glm::cross(normal, edge1);
+	vAxis /= glm::dot(edge2, vAxis);
+
+	glm::vec3 p3 = p0 + edge1 + edge2;
+	glm::vec3 boundsMin = glm::min(glm::min(p0, p3), glm::min(p0 + edge1, p0 + edge2));
+	glm::vec3 boundsMax = glm::max(glm::max(p0, p3), glm::max(p0 + edge1, p0 + edge2));
+
+	return Insert(PrimitiveType::Quad, surface,
+		glm::vec4(normal, -glm::dot(normal, p0)),
+		glm::vec4(uAxis, -glm::dot(uAxis, p0)),
+		glm::vec4(vAxis, -glm::dot(vAxis, p0)),
+		boundsMin, boundsMax);
+}
+
+int PrimitiveTable::AddSphere(const glm::vec3& center, float radius, Surface* surface) {
+	if (radius <= 0.0f) throw std::runtime_error("Invalid sphere radius");
+	return Insert(PrimitiveType::Sphere, surface, glm::vec4(center, radius), glm::vec4(0.0f), glm::vec4(0.0f), center - radius, center + radius);
+}
+
+int PrimitiveTable::AddBox(const glm::vec3& boxMin, const glm::vec3& boxMax, Surface* surface) {
+	if (glm::any(glm::greaterThan(boxMin, boxMax))) throw std::runtime_error("Invalid box bounds");
+	return Insert(PrimitiveType::Box, surface, glm::vec4(0.0f), glm::vec4(0.0f), glm::vec4(0.0f), boxMin, boxMax);
+}
+
+void PrimitiveTable::Clear() {
+	*this = PrimitiveTable();
+}
+
+bool PrimitiveTable::IntersectQuad(int index, const Ray& ray, float& distance) const {
+	const glm::vec3& o = ray.Position();
+	const glm::vec3& d = ray.Direction();
+
+	// Same operations of the SSE loop: a parallel ray gives an infinite or NaN distance that fails the comparisons
+	float denominator = d.x * _planeX[index] + d.y * _planeY[index] + d.z * _planeZ[index];
+	distance = -(o.x * _planeX[index] + o.y * _planeY[index] + o.z * _planeZ[index] + _planeW[index]) / denominator;
+
+	float u = (o.x * _uX[index] + o.y * _uY[index] + o.z * _uZ[index] + _uW[index]) + distance * (d.x * _uX[index] + d.y * _uY[index] + d.z * _uZ[index]);
+	float v = (o.x * _vX[index] + o.y * _vY[index] + o.z * _vZ[index] + _vW[index]) + distance * (d.x * _vX[index] + d.y * _vY[index] + d.z * _vZ[index]);
+	return distance > MinDistance &&
+		u >= -EdgeEpsilon && u <= 1.0f + EdgeEpsilon &&
+		v >= -EdgeEpsilon && v <= 1.0f + EdgeEpsilon;
+}
+
+bool PrimitiveTable::IntersectSphere(int index, const Ray& ray, float& distance) const {
+	glm::vec3 centerToOrigin = ray.Position() - glm::vec3(_planeX[index], _planeY[index], _planeZ[index]);
+	float radius = _planeW[index];
+
+	float b = glm::dot(centerToOrigin, ray.Direction());
+	float c = glm::dot(centerToOrigin, centerToOrigin) - radius * radius;
+	float discriminant = b * b - c;
+	if (discriminant < 0.0f) return false;
+
+	// From inside the sphere the near solution is behind the ray
+	float root = std::sqrt(discriminant);
+	distance = -b - root;
+	if (distance <= MinDistance) distance = -b + root;
+	return distance > MinDistance;
+}
+
+bool PrimitiveTable::IntersectBox(int index, const Ray& ray, float& distance) const {
+	const glm::vec3& o = ray.Position();
+	glm::vec3 inverseDirection = 1.0f / ray.Direction();
+
+	// Slabs test (the infinite values of the axis parallel rays are handled by the min/max)
+	glm::vec3 t1 = (glm::vec3(_minX[index], _minY[index], _minZ[index]) - o) * inverseDirection;
+	glm::vec3 t2 = (glm::vec3(_maxX[index], _maxY[index], _maxZ[index]) - o) * inverseDirection;
+	glm::vec3 tMin = glm::min(t1, t2);
+	glm::vec3 tMax = glm::max(t1, t2);
+	float tNear = std::max(std::max(tMin.x, tMin.y), tMin.z);
+	float tFar = std::min(std::min(tMax.x, tMax.y), tMax.z);
+	if (tNear > tFar) return false;
+
+	// From inside the box we hit the exit face
+	distance = tNear > MinDistance ? tNear : tFar;
+	return distance > MinDistance;
+}
+
+void PrimitiveTable::IntersectQuads(const Ray& ray, PrimitiveHit& hit) const {
+	const int first = _typeStart[(int)PrimitiveType::Quad];
+	const int end = _typeStart[(int)PrimitiveType::Quad + 1];
+	const glm::vec3& o = ray.Position();
+	const glm::vec3& d = ray.Direction();
+
+	const __m128 ox = _mm_set1_ps(o.x), oy = _mm_set1_ps(o.y), oz = _mm_set1_ps(o.z);
+	const __m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y), dz = _mm_set1_ps(d.z);
+	const __m128 minDistance = _mm_set1_ps(MinDistance);
+	const __m128 lowerEdge = _mm_set1_ps(-EdgeEpsilon);
+	const __m128 upperEdge = _mm_set1_ps(1.0f + EdgeEpsilon);
+
+	// Each lane keeps its closest hit. The lanes are reduced at the end
+	__m128 bestDistance = _mm_set1_ps(hit.Distance);
+	__m128 bestIndex = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128i laneIndex = _mm_setr_epi32(first, first + 1, first + 2, first + 3);
+	const __m128i four = _mm_set1_epi32(4);
+
+	// a.x * b.x + a.y * b.y + a.z * b.z (+ w)
+	auto dot = [](__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz) {
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+	};
+
+	int i = first;
+	for (; i + 4 <= end; i += 4, laneIndex = _mm_add_epi32(laneIndex, four))
+	{
+		__m128 nx = _mm_loadu_ps(_planeX.data() + i), ny = _mm_loadu_ps(_planeY.data() + i), nz = _mm_loadu_ps(_planeZ.data() + i);
+		__m128 denominator = dot(dx, dy, dz, nx, ny, nz);
+		__m128 numerator = _mm_add_ps(dot(ox, oy, oz, nx, ny, nz), _mm_loadu_ps(_planeW.data() + i));
+		__m128 distance = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), numerator), denominator);
+
+		__m128 ux = _mm_loadu_ps(_uX.data() + i), uy = _mm_loadu_ps(_uY.data() + i), uz = _mm_loadu_ps(_uZ.data() + i);
+		__m128 u = _mm_add_ps(_mm_add_ps(dot(ox, oy, oz, ux, uy, uz), _mm_loadu_ps(_uW.data() + i)), _mm_mul_ps(distance, dot(dx, dy, dz, ux, uy, uz)));
+		__m128 vx = _mm_loadu_ps(_vX.data() + i), vy = _mm_loadu_ps(_vY.data() + i), vz = _mm_loadu_ps(_vZ.data() + i);
+		__m128 v = _mm_add_ps(_mm_add_ps(dot(ox, oy, oz, vx, vy, vz), _mm_loadu_ps(_vW.data() + i)), _mm_mul_ps(distance, dot(dx, dy, dz, vx, vy, vz)));
+
+		// NaN and infinite distances (parallel rays) fail the ordered comparisons
+		__m128 valid = _mm_and_ps(_mm_cmpgt_ps(distance, minDistance), _mm_cmplt_ps(distance, bestDistance));
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, lowerEdge), _mm_cmple_ps(u, upperEdge)));
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, lowerEdge), _mm_cmple_ps(v, upperEdge)));
+
+		bestDistance = _mm_blendv_ps(bestDistance, distance, valid);
+		bestIndex = _mm_blendv_ps(bestIndex, _mm_castsi128_ps(laneIndex), valid);
+	}
+
+	alignas(16) float laneDistances[4];
+	alignas(16) int laneIndexes[4];
+	_mm_store_ps(laneDistances, bestDistance);
+	_mm_store_si128(reinterpret_cast<__m128i*>(laneIndexes), _mm_castps_si128(bestIndex));
+	for (int lane = 0; lane < 4; lane++)
+	{
+		if (laneIndexes[lane] >= 0 && laneDistances[lane] < hit.Distance) {
+			hit.Index = laneIndexes[lane];
+			hit.Distance = laneDistances[lane];
+		}
+	}
+
+	// Remaining quads
+	for (; i < end; i++)
+	{
+		float distance;
+		if (IntersectQuad(i, ray, distance) && distance < hit.Distance) {
+			hit.Index = i;
+			hit.Distance = distance;
+		}
+	}
+}
+
+glm::vec3 PrimitiveTable::GetNormal(int index, const glm::vec3& point) const {
+	switch (_types[index])
+	{
+	case PrimitiveType::Quad:
+		return glm::vec3(_planeX[index], _planeY[index], _planeZ[index]);
+	case PrimitiveType::Sphere:
+		return glm::normalize(point - glm::vec3(_planeX[index], _planeY[index], _planeZ[index]));
+	default:
+	{
+		// Box: the face nearest to the point, relative to the box extent
+		const glm::vec3 center = (glm::vec3(_minX[index], _minY[index], _minZ[index]) + glm::vec3(_maxX[index], _maxY[index], _maxZ[index])) * 0.5f;
+		const glm::vec3 extent = glm::vec3(_maxX[index], _maxY[index], _maxZ[index]) - center;
+		const glm::vec3 relative = (point - center) / glm::max(extent, glm::vec3(1e-6f));
+		const glm::vec3 distance = glm::abs(relative);
+		if (distance.x >= distance.y && distance.x >= distance.z) return glm::vec3(glm::sign(relative.x), 0.0f, 0.0f);
+		if (distance.y >= distance.z) return glm::vec3(0.0f, glm::sign(relative.y), 0.0f);
+		return glm::vec3(0.0f, 0.0f, glm::sign(relative.z));
+	}
+	}
+}
+
+bool PrimitiveTable::IntersectClosest(const Ray& ray, PrimitiveHit& hit) const {
+	const int previousIndex = hit.Index;
+	const float previousDistance = hit.Distance;
+
+	IntersectQuads(ray, hit);
+	IntersectRange(PrimitiveType::Sphere, ray, hit, &PrimitiveTable::IntersectSphere);
+	IntersectRange(PrimitiveType::Box, ray, hit, &PrimitiveTable::IntersectBox);
+	return hit.Index != previousIndex || hit.Distance != previousDistance;
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <std_include.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include <Ray.hpp>
+#include <Surface.hpp>
+#include <BCube.hpp>
+#include <SceneObject.hpp>
+
+/// <summary>
+/// Closest object hit found by a RayQueryBackend
+/// </summary>
+struct ObjectHit {
+	/// <summary>
+	/// Hit object, null if nothing has been hit
+	/// </summary>
+	const SceneObject* Object = nullptr;
+	/// <summary>
+	/// Hit distance. Only the objects nearer than (or as near as) this value are considered
+	/// </summary>
+	float Distance = std::numeric_limits<float>::max();
+	RayHit Hit;
+
+	bool IsHit() const { return Object != nullptr; }
+};
+
+/// <summary>
+/// Ray casting against the sampling objects (the objects that are not flattened in the static primitives)
+/// </summary>
+/// <remarks>
+/// The queries are batched: a batch is a bundle of directions shot from the same point, like the directions of
+/// a probe. The queries are performed by the sampling threads at the same time, so they must not change the backend
+/// state. The hit surface is always found with SceneObject::IsHitByRay: the backends only change how the
+/// candidate objects are found
+/// </remarks>
+class RayQueryBackend {
+public:
+	virtual ~RayQueryBackend() {
+	}
+
+	virtual const char* GetName() const = 0;
+
+	/// <summary>
+	/// Updates the backend with the objects and their current bounds. It' s called before every sampling pass
+	/// </summary>
+	virtual void Update(const std::vector<const SceneObject*>& objects) = 0;
+
+	/// <summary>
+	/// Finds for each direction the closest object hit nearer than hits[i].Distance
+	/// </summary>
+	virtual void IntersectClosest(const glm::vec3& origin, const glm::vec3* directions, int count, ObjectHit* hits) const = 0;
+
+	/// <summary>
+	/// Finds for each direction if any object is hit nearer than maxDistances[i]
+	/// </summary>
+	virtual void IntersectAny(const glm::vec3& origin, const glm::vec3* directions, const float* maxDistances, int count, bool* occluded) const = 0;
+
+protected:
+	/// <summary>
+	/// Bounds of an object. The accessor is not const, but it does not change the object
+	/// </summary>
+	static const BCube& GetObjectBounds(const SceneObject* object) {
+		return const_cast<SceneObject*>(object)->GetTransformedBoundingCube();
+	}
+
+	/// <summary>
+	/// Exact test of a candidate object
+	/// </summary>
+	/// <returns>True if the hit has been updated</returns>
+	static bool TestObject(const SceneObject* object, const Ray& ray, ObjectHit& hit) {
+		RayHit rayHit = object->IsHitByRay(ray);
+		// At the same distance the object wins over the previous hit (and over the static primitives)
+		if (!rayHit.IsHit() || rayHit.Distance() > hit.Distance) return false;
+
+		hit.Object = object;
+		hit.Distance = rayHit.Distance();
+		hit.Hit = std::move(rayHit);
+		return true;
+	}
+};
+
+/// <summary>
+/// Tests every object with every ray
+/// </summary>
+/// <remarks>
+/// It' s the fastest backend with a few objects, since it has no update cost
+/// </remarks>
+class BruteForceRayQuery : public RayQueryBackend {
+private:
+	std::vector<const SceneObject*> _objects;
+
+public:
+	const char* GetName() const override { return "brute"; }
+
+	void Update(const std::vector<const SceneObject*>& objects) override {
+		_objects = objects;
+	}
+
+	void IntersectClosest(const glm::vec3& origin, const glm::vec3* directions, int count, ObjectHit* hits) const override {
+		for (int i = 0; i < count; i++)
+		{
+			const Ray ray(origin, directions[i]);
+			for (const SceneObject* object : _objects) TestObject(object, ray, hits[i]);
+		}
+	}
+
+	void IntersectAny(const glm::vec3& origin, const glm::vec3* directions, const float* maxDistances, int count, bool* occluded) const override {
+		for (int i = 0; i < count; i++)
+		{
+			const Ray ray(origin, directions[i]);
+			occluded[i] = false;
+			for (const SceneObject* object : _objects)
+			{
+				ObjectHit hit;
+				hit.Distance = maxDistances[i];
+				if (TestObject(object, ray, hit)) {
+					occluded[i] = true;
+					break;
+				}
+			}
+		}
+	}
+};
+
+/// <summary>
+/// Bounding volume hierarchy over the objects bounds
+/// </summary>
+/// <remarks>
+/// The tree is built with a median split on the largest axis of the objects centers. When only the objects bounds
+/// change, the update refits the nodes bottom-up instead of building the tree again: the tree quality degrades
+/// if the objects move a lot, so it' s rebuilt every RebuildInterval refits
+/// </remarks>
+class BvhRayQuery : public RayQueryBackend {
+private:
+	/// <summary>
+	/// Objects in a leaf
+	/// </summary>
+	static const int LeafSize = 2;
+	static const int RebuildInterval = 64;
+	/// <summary>
+	/// Max tree depth. The median split halves the objects at each level, so it' s never reached
+	/// </summary>
+	static const int MaxDepth = 64;
+	/// <summary>
+	/// Bounds expansion, so the flat objects (the quads) do not have an empty box
+	/// </summary>
+	static constexpr float BoundsPadding = 1e-4f;
+
+	struct Node {
+		glm::vec3 Min;
+		/// <summary>
+		/// First object of a leaf, right child of an internal node (the left child follows the node)
+		/// </summary>
+		int Offset;
+		glm::vec3 Max;
+		/// <summary>
+		/// Objects count of a leaf, 0 for an internal node
+		/// </summary>
+		int Count;
+	};
+
+	std::vector<Node> _nodes;
+	/// <summary>
+	/// Objects in the tree order (the leaves point to ranges of this vector)
+	/// </summary>
+	std::vector<const SceneObject*> _objects;
+	/// <summary>
+	/// Objects of the last update, to detect the changes of the objects list
+	/// </summary>
+	std::vector<const SceneObject*> _sourceObjects;
+	int _refitsCount = 0;
+
+	int Build(int first, int count) {
+		const int nodeIndex = (int)_nodes.size();
+		_nodes.emplace_back();
+		if (count <= LeafSize) {
+			_nodes[nodeIndex].Offset = first;
+			_nodes[nodeIndex].Count = count;
+			return nodeIndex;
+		}
+
+		glm::vec3 centerMin(std::numeric_limits<float>::max()), centerMax(-std::numeric_limits<float>::max());
+		for (int i = first; i < first + count; i++)
+		{
+			const BCube& bounds = GetObjectBounds(_objects[i]);
+			const glm::vec3 center = (bounds.Min + bounds.Max) * 0.5f;
+			centerMin = glm::min(centerMin, center);
+			centerMax = glm::max(centerMax, center);
+		}
+		const glm::vec3 extent = centerMax - centerMin;
+		const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+		const int half = count / 2;
+		std::nth_element(_objects.begin() + first, _objects.begin() + first + half, _objects.begin() + first + count,
+			[axis](const SceneObject* a, const SceneObject* b) {
+				const BCube& boundsA = GetObjectBounds(a);
+				const BCube& boundsB = GetObjectBounds(b);
+				return boundsA.Min[axis] + boundsA.Max[axis] < boundsB.Min[axis] + boundsB.Max[axis];
+			});
+
+		Build(first, half);
+		const int right = Build(first + half, count - half);
+		_nodes[nodeIndex].Offset = right;
+		_nodes[nodeIndex].Count = 0;
+		return nodeIndex;
+	}
+
+	/// <summary>
+	/// Updates the nodes bounds. The children always follow their parent, so the nodes are visited backwards
+	/// </summary>
+	void Refit() {
+		for (int i = (int)_nodes.size() - 1; i >= 0; i--)
+		{
+			Node& node = _nodes[i];
+			if (node.Count > 0) {
+				node.Min = glm::vec3(std::numeric_limits<float>::max());
+				node.Max = glm::vec3(-std::numeric_limits<float>::max());
+				for (int j = node.Offset; j < node.Offset + node.Count; j++)
+				{
+					const BCube& bounds = GetObjectBounds(_objects[j]);
+					node.Min = glm::min(node.Min, bounds.Min - BoundsPadding);
+					node.Max = glm::max(node.Max, bounds.Max + BoundsPadding);
+				}
+			}
+			else {
+				const Node& left = _nodes[i + 1];
+				const Node& right = _nodes[node.Offset];
+				node.Min = glm::min(left.Min, right.Min);
+				node.Max = glm::max(left.Max, right.Max);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Slabs test
+	/// </summary>
+	/// <returns>Entry distance, or infinity if the node is missed or it' s farther than maxDistance</returns>
+	static float IntersectNode(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance) {
+		const glm::vec3 t1 = (node.Min - origin) * inverseDirection;
+		const glm::vec3 t2 = (node.Max - origin) * inverseDirection;
+		const glm::vec3 tMin = glm::min(t1, t2);
+		const glm::vec3 tMax = glm::max(t1, t2);
+		const float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+		const float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+		return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+	}
+
+	/// <summary>
+	/// Visits the tree nearest child first
+	/// </summary>
+	/// <param name="anyHit">Stops at the first hit</param>
+	/// <returns>True if something has been hit</returns>
+	bool Traverse(const Ray& ray, ObjectHit& hit, bool anyHit) const {
+		if (_nodes.empty()) return false;
+
+		const glm::vec3 inverseDirection = 1.0f / ray.Direction();
+		int stack[MaxDepth];
+		int stackSize = 0;
+		int nodeIndex = 0;
+		bool result = false;
+		if (IntersectNode(_nodes[0], ray.Position(), inverseDirection, hit.Distance) == std::numeric_limits<float>::infinity()) return false;
+
+		while (true)
+		{
+			const Node& node = _nodes[nodeIndex];
+			if (node.Count > 0) {
+				for (int i = node.Offset; i < node.Offset + node.Count; i++)
+				{
+					if (!TestObject(_objects[i], ray, hit)) continue;
+					result = true;
+					if (anyHit) return true;
+				}
+			}
+			else {
+				int nearChild = nodeIndex + 1, farChild = node.Offset;
+				float nearDistance = IntersectNode(_nodes[nearChild], ray.Position(), inverseDirection, hit.Distance);
+				float farDistance = IntersectNode(_nodes[farChild], ray.Position(), inverseDirection, hit.Distance);
+				if (farDistance < nearDistance) {
+					std::swap(nearChild, farChild);
+					std::swap(nearDistance, farDistance);
+				}
+
+				if (nearDistance != std::numeric_limits<float>::infinity()) {
+					if (farDistance != std::numeric_limits<float>::infinity()) {
+						assert(stackSize < MaxDepth);
+						stack[stackSize++] = farChild;
+					}
+					nodeIndex = nearChild;
+					continue;
+				}
+			}
+
+			if (stackSize == 0) break;
+			nodeIndex = stack[--stackSize];
+		}
+		return result;
+	}
+
+public:
+	const char* GetName() const override { return "bvh"; }
+
+	void Update(const std::vector<const SceneObject*>& objects) override {
+		if (objects != _sourceObjects || ++_refitsCount >= RebuildInterval) {
+			_sourceObjects = objects;
+			_objects = objects;
+			_nodes.clear();
+			_refitsCount = 0;
+			if (!_objects.empty()) {
+				_nodes.reserve(_objects.size() * 2);
+				Build(0, (int)_objects.size());
+			}
+		}
+		Refit();
+	}
+
+	void IntersectClosest(const glm::vec3& origin, const glm::vec3* directions, int count, ObjectHit* hits) const override {
+		for (int i = 0; i < count; i++)
+		{
+			Traverse(Ray(origin, directions[i]), hits[i], false);
+		}
+	}
+
+	void IntersectAny(const glm::vec3& origin, const glm::vec3* directions, const float* maxDistances, int count, bool* occluded) const override {
+		for (int i = 0; i < count; i++)
+		{
+			ObjectHit hit;
+			hit.Distance = maxDistances[i];
+			occluded[i] = Traverse(Ray(origin, directions[i]), hit, true);
+		}
+	}
+
+	int GetNodesCount() const { return (int)_nodes.size(); }
+};
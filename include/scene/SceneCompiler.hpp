@@ -0,0 +1,32 @@
+#pragma once
+
+#include <std_include.h>
+#include <vector>
+
+#include <SceneObject.hpp>
+#include <scene/PrimitiveTable.hpp>
+
+/// <summary>
+/// Flattens the static scene objects in a PrimitiveTable, so the sampling hot path does not go
+/// through the SceneObject virtual hierarchy
+/// </summary>
+/// <remarks>
+/// The table is a snapshot of the objects transform: a compiled object that is moved must be compiled again
+/// </remarks>
+class SceneCompiler {
+public:
+	/// <summary>
+	/// Appends the objects primitives to the table
+	/// </summary>
+	/// <returns>The objects that can' t be flattened. They have to be intersected with SceneObject::IsHitByRay</returns>
+	template<class Iterator>
+	static std::vector<const SceneObject*> Compile(const Iterator& begin, const Iterator& end, PrimitiveTable& table) {
+		std::vector<const SceneObject*> remainingObjects;
+		for (Iterator it = begin; it != end; ++it)
+		{
+			const SceneObject* object = *it;
+			if (!object->CompileTo(table)) remainingObjects.push_back(object);
+		}
+		return remainingObjects;
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <std_include.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#ifndef ISWINPLATFORM
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/// <summary>
+/// Read-only view of an entire file
+/// </summary>
+/// <remarks>
+/// On POSIX platform the file is memory mapped, so only the pages effectively used are read from disk.
+/// On Windows the file is read in a single block to avoid the windows.h inclusion in the application.
+/// In both cases the data is at least 16-byte aligned
+/// </remarks>
+class MappedFile {
+private:
+	const uint8_t* _data = nullptr;
+	uint64_t _size = 0;
+#ifdef ISWINPLATFORM
+	std::vector<glm::vec4> _storage;
+#else
+	void* _mapping = nullptr;
+#endif
+
+	void Release() {
+#ifdef ISWINPLATFORM
+		_storage.clear();
+#else
+		if (_mapping) munmap(_mapping, _size);
+		_mapping = nullptr;
+#endif
+		_data = nullptr;
+		_size = 0;
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(MappedFile);
+
+	/// <summary>
+	/// Opens the file. Empty files are not valid
+	/// </summary>
+	explicit MappedFile(const std::string& path) {
+#ifdef ISWINPLATFORM
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file) throw std::runtime_error("Unable to open file " + path);
+
+		_size = file.tellg();
+		if (_size == 0) throw std::runtime_error("Unable to read file " + path);
+		_storage.resize((_size + sizeof(glm::vec4) - 1) / sizeof(glm::vec4));
+		file.seekg(0);
+		if (!file.read(reinterpret_cast<char*>(_storage.data()), _size)) throw std::runtime_error("Unable to read file " + path);
+		_data = reinterpret_cast<const uint8_t*>(_storage.data());
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("Unable to open file " + path);
+
+		struct stat fileStat;
+		if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+			close(fd);
+			throw std::runtime_error("Unable to read file " + path);
+		}
+
+		_size = fileStat.st_size;
+		_mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps its own reference to the file
+		close(fd);
+		if (_mapping == MAP_FAILED) {
+			_mapping = nullptr;
+			throw std::runtime_error("Unable to map file " + path);
+		}
+		_data = reinterpret_cast<const uint8_t*>(_mapping);
+#endif
+	}
+
+	~MappedFile() {
+		Release();
+	}
+
+	const uint8_t* Data() const { return _data; }
+	uint64_t Size() const { return _size; }
+};
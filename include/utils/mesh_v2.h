@@ -74,6 +74,12 @@ public:
         this->setupMesh();
     }
 
+    // Same as above, for the callers that hand over the vectors explicitly with std::move
+    Mesh(vector<Vertex>&& vertices, vector<GLuint>&& indices) noexcept
+        : Mesh(vertices, indices)
+    {
+    }
+
     // We implement a user-defined move constructor and move assignment
     // see:
     // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
@@ -138,6 +144,14 @@ public:
         glBindVertexArray(0);
     }
 
+    // instanced rendering of mesh: the per instance data must be read by the shader (for example from a storage buffer using gl_InstanceID)
+    void DrawInstanced(GLsizei instancesCount)
+    {
+        glBindVertexArray(this->VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, instancesCount);
+        glBindVertexArray(0);
+    }
+
 private:
 
     // VBO and EBO
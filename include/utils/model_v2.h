@@ -75,6 +75,11 @@ public:
         this->loadModel(path);
     }
 
+    // constructor from already created meshes (for example loaded from the binary mesh cache)
+    explicit Model(vector<Mesh>&& meshes) : meshes(std::move(meshes))
+    {
+    }
+
     //////////////////////////////////////////
 
     // model rendering: calls rendering methods of each instance of Mesh class in the vector
@@ -84,6 +89,13 @@ public:
             this->meshes[i].Draw();
     }
 
+    // instanced rendering: calls the instanced rendering methods of each instance of Mesh class in the vector
+    void DrawInstanced(GLsizei instancesCount)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawInstanced(instancesCount);
+    }
+
     //////////////////////////////////////////
 
 
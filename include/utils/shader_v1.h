@@ -19,6 +19,8 @@ using namespace std;
 #include <glm/glm.hpp>
 #include <utils/include_shader.h>
 #include <string>
+#include <cstring>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -97,6 +99,8 @@ public:
 		glLinkProgram(this->Program);
 		// check linking errors
 		checkCompileErrors(this->Program, "PROGRAM");
+		// the uniform locations are fixed after the link, so we resolve them only once
+		cacheUniformLocations();
 
 		// Step 4: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
 		glDeleteShader(vertex);
@@ -111,25 +115,73 @@ public:
 	// We delete the Shader Program when application closes
 	void Delete() { glDeleteProgram(this->Program); }
 
+	// Location of an active uniform of the program, -1 if the uniform does not exist (same as glGetUniformLocation)
+	GLint GetUniformLocation(const GLchar* uniformName) const {
+		// Programs have few active uniforms: a linear search does not allocate and it' s faster than hashing the name
+		for (const UniformLocation& uniform : _uniformLocations)
+		{
+			if (strcmp(uniform.Name.c_str(), uniformName) == 0) return uniform.Location;
+		}
+		return -1;
+	}
+
 	void SetUniform(const GLchar* uniformName, const glm::mat3& mat) {
-		glUniformMatrix3fv(glGetUniformLocation(Program, uniformName), 1, GL_FALSE, glm::value_ptr(mat));
+		glUniformMatrix3fv(GetUniformLocation(uniformName), 1, GL_FALSE, glm::value_ptr(mat));
 	}
 
 	void SetUniform(const GLchar* uniformName, const glm::mat4& mat) {
-		glUniformMatrix4fv(glGetUniformLocation(Program, uniformName), 1, GL_FALSE, glm::value_ptr(mat));
+		glUniformMatrix4fv(GetUniformLocation(uniformName), 1, GL_FALSE, glm::value_ptr(mat));
 	}
 
 	void SetUniform(const GLchar* uniformName, const glm::vec3& vec) {
-		glUniform3fv(glGetUniformLocation(Program, uniformName), 1, glm::value_ptr(vec));
+		glUniform3fv(GetUniformLocation(uniformName), 1, glm::value_ptr(vec));
 	}
 
 	void SetUniform(const GLchar* uniformName, const int value) {
-		glUniform1i(glGetUniformLocation(Program, uniformName), value);
+		glUniform1i(GetUniformLocation(uniformName), value);
+	}
+
+	void SetUniform(const GLchar* uniformName, const float value) {
+		glUniform1f(GetUniformLocation(uniformName), value);
 	}
 
 private:
+	struct UniformLocation {
+		string Name;
+		GLint Location;
+	};
+
+	// Locations of the active uniforms, resolved at link time
+	vector<UniformLocation> _uniformLocations;
+
 	//////////////////////////////////////////
 
+	void cacheUniformLocations()
+	{
+		GLint uniformsCount = 0, maxNameLength = 0;
+		glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &uniformsCount);
+		glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+		vector<GLchar> name(maxNameLength + 1);
+		for (GLint i = 0; i < uniformsCount; i++)
+		{
+			GLsizei nameLength = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(this->Program, (GLuint)i, (GLsizei)name.size(), &nameLength, &size, &type, name.data());
+
+			string uniformName(name.data(), nameLength);
+			// Arrays are reported with the first element suffix
+			if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+				uniformName.resize(uniformName.size() - 3);
+			}
+
+			// The members of the uniform blocks don' t have a location
+			GLint location = glGetUniformLocation(this->Program, uniformName.c_str());
+			if (location >= 0) _uniformLocations.push_back({ uniformName, location });
+		}
+	}
+
 	// Check compilation and linking errors
 	void checkCompileErrors(GLuint shader, string type)
 	{
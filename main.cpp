@@ -30,6 +30,7 @@
 #include <utils/camera.h>
 
 #include <irradiancegrid/Grid.hpp>
+#include <irradiancegrid/VolumeManager.hpp>
 #include <ViewUniform.hpp>
 
 #include "DebuggingSphere.hpp"
@@ -43,6 +44,9 @@
 #include "TrilinearSphere.hpp"
 
 #include <RadianceSampler.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
+#include <input/InputRecording.hpp>
 #include <objects/Cube.hpp>
 #include <utils/include_shader.h>
 #include <objects/Bunny.hpp>
@@ -53,31 +57,51 @@
 // dimensions of application's window
 const GLuint ScreenWidth = 800;
 const GLuint ScreenHeight = 600;
+// baked irradiance volume file (F5 to save, F6 to load, F7 to return to live sampling)
+const char* BakedVolumePath = "irradiance.irvb";
+// profiler trace (F8 to start/stop the profiling, F9 to export). The trace is also exported at exit while profiling
+const char* ProfilerTracePath = "profile_trace.json";
+// max zones shown in the profiler overlay
+const int ProfilerOverlayZones = 10;
+// metrics time series (M to show the metrics page, F10 to export)
+const char* MetricsCsvPath = "metrics.csv";
+const char* MetricsJsonPath = "metrics.json";
+// distance from the faces of an irradiance volume where it blends with the overlapping ones
+const float VolumeBlendDistance = 0.5f;
+// default GPU memory of the resident bricks of a streamed volume (see ParseCommandLine)
+const int DefaultStreamBudgetMB = 64;
 
 struct ApplicationFlags {
 	bool Wireframe;
 	bool PrintText;
+	bool MetricsPage;
 
-	ApplicationFlags() : Wireframe(false), PrintText(true) {
+	ApplicationFlags() : Wireframe(false), PrintText(true), MetricsPage(false) {
 
 	}
 };
 
 
 /* Forward declarations */
+bool ParseCommandLine(int argc, char** argv);
 void Initialize();
 // callback functions for keyboard and mouse events
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void MouseCallback(GLFWwindow* window, double xpos, double ypos);
 // if one of the WASD keys is pressed, we call the corresponding method of the Camera class
 void apply_camera_movements(GLfloat deltaTime);
-void Update(GLfloat deltaTime);
-void Draw();
+void Update(GLfloat deltaTime, const Frustum& frustum);
+void Draw(const Frustum& frustum);
 void RenderDebugInfo(GLfloat updateTime, GLfloat drawTime, int fps);
+void RenderProfilerInfo();
+void RenderMetricsPage();
+InputFrameSettings CaptureInputSettings();
+void RecordInputFrame(GLfloat deltaTime);
+GLfloat ReplayInputFrame(const InputFrame& frame);
 
 /* Variables sections */
 // we initialize an array of booleans for each keybord key
-bool keys[1024];
+bool keys[InputKeysCount];
 // we need to store the previous mouse position to calculate the offset with the current frame
 GLfloat lastX, lastY;
 // when rendering the first frame, we do not have a "previous state" for the mouse, so we need to manage this situation
@@ -91,17 +115,41 @@ TextRenderer* _debugWriter = nullptr;
 CCube* _sceneCube = nullptr;
 ApplicationFlags _appFlags;
 RadianceSampler* _radianceSampler = nullptr;
+VolumeManager* _volumes = nullptr;
+// Volume controlled by the grid settings keys (the room volume)
 Grid* _irradianceGrid = nullptr;
 RadianceSphere* _radianceSphere = nullptr;
 vector<SceneObject*> _sceneObjects;
 TrilinearSphere* _trilinearSphere = nullptr;
 TrilinearSphere* _secondTrilinear = nullptr;
 Bunny* _bunny = nullptr;
-
-int main()
+RenderQueue _renderQueue;
+CullingBuffers _sceneCulling;
+
+/* Input record/replay (see ParseCommandLine) */
+InputRecorder* _inputRecorder = nullptr;
+InputReplayer* _inputReplayer = nullptr;
+FrameTimings* _frameTimings = nullptr;
+std::string _frameTimingsPath;
+// constant replay timestep (0 to use the recorded delta times)
+GLfloat _replayTimestep = 0.0f;
+// baked volume loaded at startup instead of the live sampling (see ParseCommandLine)
+std::string _startupBakedPath;
+/* Streamed volume (see ParseCommandLine) */
+std::string _streamPath;
+int _streamBudgetMB = DefaultStreamBudgetMB;
+StreamedVolume* _streamedVolume = nullptr;
+bool _replayDiverged = false;
+// mouse offset accumulated in the current frame
+glm::vec2 _frameMouseOffset = glm::vec2(0.0f);
+
+int main(int argc, char** argv)
 {
+	if (!ParseCommandLine(argc, argv)) return 1;
+
 	/* initialize random seed: */
-	srand(time(NULL));
+	// Recorded and replayed runs use a fixed seed (the debug colors are random)
+	srand((_inputRecorder || _inputReplayer) ? 0 : time(NULL));
 
 	Initialize();
 
@@ -143,12 +191,33 @@ int main()
 	// Projection matrix: FOV angle, aspect ratio, near and far planes
 	viewSharedBuffer.SetProjection(glm::perspective(45.0f, (float)ScreenWidth / (float)ScreenHeight, 0.1f, 10000.0f));
 	_sceneCube = new CCube();
+	_sceneCube->UpdateTransform();
 
 	_radianceSampler = new RadianceSampler();
 	_radianceSampler->GetSamplingObjects().push_back(_sceneCube);
-
-	_irradianceGrid = new Grid(_sceneCube->GetBoundingCube());
-	_irradianceGrid->SetTransform(_sceneCube->GetTransform());
+	// The room never moves: it' s flattened in the sampler static primitives
+	_radianceSampler->CompileSamplingObjects();
+
+	_volumes = new VolumeManager();
+	_irradianceGrid = _volumes->AddVolume(_sceneCube->GetBoundingCube(), _sceneCube->GetTransform(), VolumeBlendDistance);
+	if (!_startupBakedPath.empty()) {
+		// The room volume starts frozen, without sampling the probes (F7 to resume the sampling)
+		try {
+			_irradianceGrid->LoadBaked(_startupBakedPath);
+			std::cout << "Baked volume loaded from " << _startupBakedPath << std::endl;
+		}
+		catch (const std::exception& e) {
+			std::cout << "ERROR::BAKEDVOLUME: " << e.what() << std::endl;
+		}
+	}
+	if (!_streamPath.empty()) {
+		try {
+			_streamedVolume = _volumes->AddStreamedVolume(_streamPath, _sceneCube->GetTransform(), VolumeBlendDistance, (GLsizeiptr)_streamBudgetMB * 1024 * 1024);
+		}
+		catch (const std::exception& e) {
+			std::cout << "ERROR::STREAMEDVOLUME: " << e.what() << std::endl;
+		}
+	}
 	_radianceSphere = new RadianceSphere();
 
 	_secondTrilinear = new TrilinearSphere();
@@ -169,6 +238,7 @@ int main()
 #endif
 
 	DebuggingShere sphere;
+	Profiler::Instance.SetThreadName("Main");
 
 	GLfloat lastTime = glfwGetTime();
 	GLfloat lastFrame = 0;
@@ -193,6 +263,17 @@ int main()
 
 		// Check is an I/O event is happening
 		glfwPollEvents();
+
+		// Input record/replay. The replay overwrites the live keyboard state and the delta time
+		if (_inputReplayer) {
+			if (!_inputReplayer->HasNextFrame()) break;
+			deltaTime = ReplayInputFrame(_inputReplayer->NextFrame());
+		}
+		else if (_inputRecorder) {
+			RecordInputFrame(deltaTime);
+		}
+		_frameMouseOffset = glm::vec2(0.0f);
+
 		// we apply FPS camera movements
 		apply_camera_movements(deltaTime);
 		viewSharedBuffer.SetCamera(_camera->GetViewMatrix());
@@ -205,22 +286,62 @@ int main()
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
 
-		GLfloat beforeUpdate = glfwGetTime();
-		Update(deltaTime);
-		GLfloat afterUpdate = glfwGetTime();
+		// The frustum is shared by the volumes update priorities and the culling
+		const Frustum frustum = Frustum::FromMatrix(viewSharedBuffer.GetViewProjection());
+		double beforeUpdate = glfwGetTime();
+		{
+			PROFILE_SCOPE("Update");
+			Update(deltaTime, frustum);
+		}
+		double afterUpdate = glfwGetTime();
+
+		double beforeDraw = glfwGetTime();
+		{
+			PROFILE_SCOPE("Draw");
+			//sphere.Draw(glm::vec3(0.0f), 0.2f);
+			Draw(frustum);
+		}
+		double afterDraw = glfwGetTime();
 
-		GLfloat beforeDraw = glfwGetTime();
-		//sphere.Draw(glm::vec3(0.0f), 0.2f);
-		Draw();
-		GLfloat afterDraw = glfwGetTime();
+		if (_frameTimings) {
+			_frameTimings->Add((afterUpdate - beforeUpdate) * 1000.0, (afterDraw - beforeDraw) * 1000.0);
+		}
 
 #ifdef DEBUGSHADER
 #else
-		RenderDebugInfo(afterUpdate - beforeUpdate, afterDraw - beforeDraw, fps);
+		{
+			PROFILE_SCOPE("DebugText");
+			// All the overlay lines are drawn with a single draw call
+			_debugWriter->BeginBatch();
+			RenderDebugInfo(afterUpdate - beforeUpdate, afterDraw - beforeDraw, fps);
+			_debugWriter->EndBatch();
+		}
 #endif
 
 		glfwSwapBuffers(window);
+		Profiler::Instance.EndFrame();
+		Metrics::Instance.EndFrame();
+	}
+
+	if (Profiler::Instance.IsEnabled() && Profiler::Instance.WriteChromeTrace(ProfilerTracePath)) {
+		std::cout << "Profiler trace saved to " << ProfilerTracePath << std::endl;
+	}
+
+	if (_inputRecorder) {
+		std::cout << "Recorded " << _inputRecorder->GetFramesCount() << " frames" << std::endl;
+	}
+	if (_frameTimings) {
+		_frameTimings->PrintSummary(std::cout);
+		try {
+			if (!_frameTimingsPath.empty()) _frameTimings->WriteCsv(_frameTimingsPath);
+		}
+		catch (const std::exception& e) {
+			std::cout << "ERROR::TIMINGS: " << e.what() << std::endl;
+		}
 	}
+	delete _frameTimings;
+	delete _inputReplayer;
+	delete _inputRecorder;
 
 	_sceneObjects.clear();
 	_radianceSampler->GetSamplingObjects().clear();
@@ -229,7 +350,7 @@ int main()
 	delete _secondTrilinear;
 	delete _trilinearSphere;
 	delete _radianceSphere;
-	delete _irradianceGrid;
+	delete _volumes;
 	delete _radianceSampler;
 	delete _sceneCube;
 	delete _debugWriter;
@@ -243,6 +364,49 @@ int main()
 	return 0;
 }
 
+/// <summary>
+/// Parses the command line:
+/// --record file       Records the per-frame input to a file
+/// --replay file       Plays back a recording and closes the application at the end
+/// --timestep seconds  Constant replay timestep (default: the recorded delta times)
+/// --timings file.csv  Writes the per-frame update/draw times
+/// --baked file.irvb   Starts from a baked volume (IrradianceBake) instead of sampling the room volume
+/// --stream file.irbk  Streams the bricks of a baked volume (IrradianceBake --bricks) around the camera
+/// --stream-budget MB  GPU memory of the resident bricks (default 64)
+/// </summary>
+bool ParseCommandLine(int argc, char** argv) {
+	std::string recordPath;
+	std::string replayPath;
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--record") == 0 && hasValue) recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && hasValue) replayPath = argv[++i];
+		else if (strcmp(argv[i], "--timestep") == 0 && hasValue) _replayTimestep = (GLfloat)atof(argv[++i]);
+		else if (strcmp(argv[i], "--timings") == 0 && hasValue) _frameTimingsPath = argv[++i];
+		else if (strcmp(argv[i], "--baked") == 0 && hasValue) _startupBakedPath = argv[++i];
+		else if (strcmp(argv[i], "--stream") == 0 && hasValue) _streamPath = argv[++i];
+		else if (strcmp(argv[i], "--stream-budget") == 0 && hasValue) _streamBudgetMB = std::max(atoi(argv[++i]), 1);
+		else {
+			std::cout << "Usage: IrradianceVolumes [--record file | --replay file [--timestep seconds]] [--timings file.csv]"
+				" [--baked file.irvb] [--stream file.irbk [--stream-budget MB]]" << std::endl;
+			return false;
+		}
+	}
+
+	try {
+		if (!recordPath.empty() && !replayPath.empty()) throw std::runtime_error("Recording and replay cannot be used together");
+		if (!recordPath.empty()) _inputRecorder = new InputRecorder(recordPath);
+		if (!replayPath.empty()) _inputReplayer = new InputReplayer(replayPath);
+	}
+	catch (const std::exception& e) {
+		std::cout << "ERROR::INPUT: " << e.what() << std::endl;
+		return false;
+	}
+
+	if (_inputReplayer || !_frameTimingsPath.empty()) _frameTimings = new FrameTimings();
+	return true;
+}
+
 void Initialize() {
 	// Initialization of OpenGL context using GLFW
 	glfwInit();
@@ -268,11 +432,16 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mode
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 
+	// While replaying, the keyboard state comes only from the recording
+	if (_inputReplayer || key < 0 || key >= InputKeysCount) return;
+
 	// if L is pressed, we activate/deactivate wireframe rendering of models
 	if (key == GLFW_KEY_L && action == GLFW_PRESS)
 		_appFlags.Wireframe = !_appFlags.Wireframe;
 	if (key == GLFW_KEY_T && action == GLFW_PRESS)
 		_appFlags.PrintText = !_appFlags.PrintText;
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+		_appFlags.MetricsPage = !_appFlags.MetricsPage;
 
 	// we keep trace of the pressed keys
 	// with this method, we can manage 2 keys pressed at the same time:
@@ -304,6 +473,8 @@ void apply_camera_movements(GLfloat deltaTime)
 /// </summary>
 void MouseCallback(GLFWwindow* window, double xpos, double ypos)
 {
+	if (_inputReplayer) return;
+
 	// we move the camera view following the mouse cursor
 	// we calculate the offset of the mouse cursor from the position in the last frame
 	// when rendering the first frame, we do not have a "previous state" for the mouse, so we set the previous state equal to the initial values (thus, the offset will be = 0)
@@ -324,6 +495,7 @@ void MouseCallback(GLFWwindow* window, double xpos, double ypos)
 
 	// we pass the offset to the Camera class instance in order to update the rendering
 	_camera->ProcessMouseMovement(xoffset, yoffset);
+	_frameMouseOffset += glm::vec2(xoffset, yoffset);
 }
 
 void ApplyForTrilinearSphereMovement(GLfloat deltaTime) {
@@ -385,6 +557,10 @@ void ApplyGridSettingsUpdates() {
 		_irradianceGrid->SetParallelUpdate(!_irradianceGrid->IsParallelUpdateEnabled());
 		keys[GLFW_KEY_P] = false;
 	}
+	if (keys[GLFW_KEY_I]) {
+		_irradianceGrid->SetInstancedDraw(!_irradianceGrid->IsInstancedDrawEnabled());
+		keys[GLFW_KEY_I] = false;
+	}
 	if (keys[GLFW_KEY_C]) {
 		bool debugColor = !_irradianceGrid->IsDebugColorEnabled();
 		_irradianceGrid->SetDebugColorEnabled(debugColor);
@@ -399,14 +575,131 @@ void ApplyGridSettingsUpdates() {
 		_radianceSampler->SetResolution(_radianceSampler->GetResolution() == 9 ? 29 : 9);
 		keys[GLFW_KEY_R] = false;
 	}
+	if (keys[GLFW_KEY_H]) {
+		// Cycle through the available direction sets
+		int nextSet = ((int)_radianceSampler->GetDirectionSetType() + 1) % (int)DirectionSetType::Count;
+		_radianceSampler->SetDirectionSet((DirectionSetType)nextSet);
+		keys[GLFW_KEY_H] = false;
+	}
+
+	if (keys[GLFW_KEY_V]) {
+		_irradianceGrid->SetAdaptiveSampling(!_irradianceGrid->IsAdaptiveSamplingEnabled());
+		keys[GLFW_KEY_V] = false;
+	}
+	if (keys[GLFW_KEY_B]) {
+		// The volumes reflect the irradiance of their previous updates
+		_radianceSampler->SetBounceSource(_radianceSampler->GetBounceSource() ? nullptr : _volumes);
+		// The bounce changes all the radiance at once: the accumulated one would fade it in over the temporal latency
+		for (int i = 0; i < _volumes->GetVolumesCount(); i++) _volumes->GetVolume(i)->ResetTemporalHistory();
+		keys[GLFW_KEY_B] = false;
+	}
+	if (keys[GLFW_KEY_J]) {
+		_irradianceGrid->SetTemporalAccumulation(!_irradianceGrid->IsTemporalAccumulationEnabled());
+		keys[GLFW_KEY_J] = false;
+	}
+#if WITH_BULLET
+	if (keys[GLFW_KEY_G]) {
+		_irradianceGrid->SetBroadphaseRefinement(!_irradianceGrid->IsBroadphaseRefinementEnabled());
+		keys[GLFW_KEY_G] = false;
+	}
+#endif
 
 	if (keys[GLFW_KEY_K]) {
 		_spinning = !_spinning;
 		keys[GLFW_KEY_K] = false;
 	}
+
+	// Baked volume handling
+	try {
+		if (keys[GLFW_KEY_F5]) {
+			_irradianceGrid->SaveBaked(BakedVolumePath);
+			std::cout << "Baked volume saved to " << BakedVolumePath << std::endl;
+		}
+		if (keys[GLFW_KEY_F6]) {
+			_irradianceGrid->LoadBaked(BakedVolumePath);
+			std::cout << "Baked volume loaded from " << BakedVolumePath << std::endl;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << "ERROR::BAKEDVOLUME: " << e.what() << std::endl;
+	}
+	keys[GLFW_KEY_F5] = false;
+	keys[GLFW_KEY_F6] = false;
+
+	if (keys[GLFW_KEY_F7]) {
+		_irradianceGrid->DiscardBaked();
+		keys[GLFW_KEY_F7] = false;
+	}
+
+	// Profiler handling
+	if (keys[GLFW_KEY_F8]) {
+		Profiler::Instance.SetEnabled(!Profiler::Instance.IsEnabled());
+		keys[GLFW_KEY_F8] = false;
+	}
+	if (keys[GLFW_KEY_F9]) {
+		if (Profiler::Instance.WriteChromeTrace(ProfilerTracePath)) {
+			std::cout << "Profiler trace saved to " << ProfilerTracePath << std::endl;
+		}
+		keys[GLFW_KEY_F9] = false;
+	}
+
+	// Metrics export
+	if (keys[GLFW_KEY_F10]) {
+		if (Metrics::Instance.Write(MetricsCsvPath) && Metrics::Instance.Write(MetricsJsonPath)) {
+			std::cout << "Metrics saved to " << MetricsCsvPath << " and " << MetricsJsonPath << std::endl;
+		}
+		keys[GLFW_KEY_F10] = false;
+	}
+}
+
+InputFrameSettings CaptureInputSettings()
+{
+	InputFrameSettings settings;
+	settings.GridDivision = _irradianceGrid->GetGridDivision().x;
+	settings.MaxSubGridLevel = _irradianceGrid->GetMaxSubGridLevel();
+	settings.Resolution = _radianceSampler->GetResolution();
+	settings.ParallelUpdate = _irradianceGrid->IsParallelUpdateEnabled();
+	settings.Wireframe = _appFlags.Wireframe;
+	settings.PrintText = _appFlags.PrintText;
+	return settings;
+}
+
+void RecordInputFrame(GLfloat deltaTime)
+{
+	InputFrame frame;
+	frame.DeltaTime = deltaTime;
+	frame.MouseOffset = _frameMouseOffset;
+	frame.Settings = CaptureInputSettings();
+	for (int key = 0; key < InputKeysCount; key++)
+	{
+		if (keys[key]) frame.PressedKeys.push_back(key);
+	}
+	_inputRecorder->Record(frame);
+}
+
+GLfloat ReplayInputFrame(const InputFrame& frame)
+{
+	// The settings are the result of the previous frames toggles so they must match the recorded ones
+	InputFrameSettings settings = CaptureInputSettings();
+	settings.Wireframe = frame.Settings.Wireframe;
+	settings.PrintText = frame.Settings.PrintText;
+	if (!_replayDiverged && settings != frame.Settings) {
+		std::cout << "WARNING::REPLAY: frame " << _inputReplayer->GetCurrentFrameIndex() << " settings differ from the recording" << std::endl;
+		_replayDiverged = true;
+	}
+
+	// The text and wireframe toggles are handled directly in the key callback
+	_appFlags.Wireframe = frame.Settings.Wireframe;
+	_appFlags.PrintText = frame.Settings.PrintText;
+
+	std::fill(std::begin(keys), std::end(keys), false);
+	for (int key : frame.PressedKeys) keys[key] = true;
+
+	if (frame.MouseOffset != glm::vec2(0.0f)) _camera->ProcessMouseMovement(frame.MouseOffset.x, frame.MouseOffset.y);
+	return _replayTimestep > 0.0f ? _replayTimestep : frame.DeltaTime;
 }
 
-void Update(GLfloat deltaTime)
+void Update(GLfloat deltaTime, const Frustum& frustum)
 {
 	if (_spinning) {
 		float orientationY = _bunny->GetYRotation();
@@ -418,60 +711,159 @@ void Update(GLfloat deltaTime)
 	ApplyForTrilinearSphereMovement(deltaTime);
 	ApplyGridSettingsUpdates();	
 
+	// The moves above are only recorded: the changed transforms are rebuilt once, before the grid update
+	SceneObject::UpdateTransforms(_sceneObjects.cbegin(), _sceneObjects.cend());
+
 	// Irradiance update
-	_irradianceGrid->Update(_sceneObjects.cbegin(), _sceneObjects.cend(), _radianceSampler);
+	_volumes->Update(_sceneObjects.cbegin(), _sceneObjects.cend(), _radianceSampler, _camera->Position, frustum);
 }
 
-void Draw()
+void Draw(const Frustum& frustum)
 {
-	_sceneCube->Draw();
-	_irradianceGrid->Draw(_radianceSphere);
-
+	// The scene cube is the first box of the batch
+	_sceneCulling.Boxes.Clear();
+	_sceneCulling.Boxes.Add(_sceneCube->GetTransformedBoundingCube());
 	for (SceneObject* sceneObject : _sceneObjects) {
-		sceneObject->Draw();
+		_sceneCulling.Boxes.Add(sceneObject->GetTransformedBoundingCube());
+	}
+	int visibleCount = frustum.Cull(_sceneCulling.Boxes, _sceneCulling.Visible);
+	Metrics::Instance.Add(MetricCounter::CulledObjects, (int64_t)_sceneCulling.Boxes.Size() - visibleCount);
+
+	if (_sceneCulling.Visible[0]) _sceneCube->Draw(_renderQueue);
+	_volumes->Draw(_renderQueue, _radianceSphere, frustum);
+
+	for (size_t i = 0; i < _sceneObjects.size(); i++) {
+		if (_sceneCulling.Visible[i + 1]) _sceneObjects[i]->Draw(_renderQueue);
 	}
+
+	// Objects sharing the program and the vertex array are drawn one after the other
+	_renderQueue.Flush();
 }
 
 void RenderDebugInfo(GLfloat updateTime, GLfloat drawTime, int fps)
 {
-
-	// ~ WARN: This function will spend most of its time creating strings ~
-	// Disable or ENTIRELY REMOVE the function while analizing performance
+	// The lines are formatted in stack buffers and queued in the text batch, so no string is allocated per frame
 	static const glm::vec3 textColor = glm::vec3(0.8);
 	static const GLfloat scaling = 0.30;
-	static const std::string  fpsStr = "FPS: ";
+	char line[128];
 
+	snprintf(line, sizeof(line), "FPS: %d", fps);
 	if (!_appFlags.PrintText)
 	{
 		// Let's print the FPS just for reference
-		_debugWriter->RenderText(fpsStr + std::to_string(fps), 5, 5, scaling, textColor);
+		_debugWriter->RenderText(line, 5, 5, scaling, textColor);
+		return;
+	}
+
+	if (_appFlags.MetricsPage)
+	{
+		RenderMetricsPage();
+		_debugWriter->RenderText(line, 5, 5, scaling, textColor);
 		return;
 	}
 
-	// String cache
-	static const std::string parallelEnabled = "Parallel update: Enabled";
-	static const std::string parallelDisabled = "Parallel update: Disabled";
-	static const std::string resolution = "Resolution: ";
-	static const std::string gridMaxLevels = "Grid max levels: ";
-	static const std::string gridResolution = " Grid resolution: ";
-	static const std::string debugColorStr = "DebugColor Active ";
+	_debugWriter->RenderText(line, 5, 27, scaling, textColor);
+
+	static const char* parallelEnabled = "Parallel update: Enabled";
+	static const char* parallelDisabled = "Parallel update: Disabled";
+	static const char* debugColorStr = "DebugColor Active ";
+	static const char* bakedStr = "Baked volume (F7 to resume sampling)";
+	static const char* perProbeDrawStr = "Per-probe draw (I to use instanced draw)";
+	static const char* bounceStr = "Secondary bounce (B to disable)";
 
+	if (_irradianceGrid->IsBaked()) {
+		_debugWriter->RenderText(bakedStr, 5, 87, scaling, textColor);
+	}
+	if (!_irradianceGrid->IsInstancedDrawEnabled()) {
+		_debugWriter->RenderText(perProbeDrawStr, 5, 99, scaling, textColor);
+	}
 	if (_irradianceGrid->IsDebugColorEnabled()) {
 		_debugWriter->RenderText(debugColorStr, 5, 75, scaling, textColor);
 	}
+	if (_irradianceGrid->IsAdaptiveSamplingEnabled()) {
+		snprintf(line, sizeof(line), "Adaptive sampling: %d low resolution probes (V to disable)", _irradianceGrid->GetLowTierProbeCount());
+		_debugWriter->RenderText(line, 5, 111, scaling, textColor);
+	}
+	if (_irradianceGrid->IsTemporalAccumulationEnabled()) {
+		snprintf(line, sizeof(line), "Temporal accumulation: 1/%d directions per update, %d updates latency (J to disable)",
+			_irradianceGrid->GetTemporalPeriod(), _irradianceGrid->GetTemporalLatency());
+		_debugWriter->RenderText(line, 5, 123, scaling, textColor);
+	}
+	if (_radianceSampler->GetBounceSource()) {
+		_debugWriter->RenderText(bounceStr, 5, 135, scaling, textColor);
+	}
+#if WITH_BULLET
+	if (_irradianceGrid->IsBroadphaseRefinementEnabled()) {
+		snprintf(line, sizeof(line), "Broadphase refinement: %d objects moved (G to disable)", (int)Metrics::Instance.GetLastFrame().Counters[(int)MetricCounter::BroadphaseObjectsMoved]);
+		_debugWriter->RenderText(line, 5, 147, scaling, textColor);
+	}
+#endif
+	if (_streamedVolume) {
+		snprintf(line, sizeof(line), "Streamed bricks: %d/%d resident (%d pending), page-in %.2f ms (max %.2f ms)",
+			_streamedVolume->GetResidentCount(), _streamedVolume->GetSlotsCount(), _streamedVolume->GetPendingCount(),
+			_streamedVolume->GetLastPageInMilliseconds(), _streamedVolume->GetMaxPageInMilliseconds());
+		_debugWriter->RenderText(line, 5, 159, scaling, textColor);
+	}
 
-	_debugWriter->RenderText(resolution + std::to_string(_radianceSampler->GetResolution()), 5, 63, scaling, textColor);
+	snprintf(line, sizeof(line), "Resolution: %d Directions: %s", _radianceSampler->GetResolution(),
+		_radianceSampler->GetDirections().GetDirectionSet().GetName());
+	_debugWriter->RenderText(line, 5, 63, scaling, textColor);
 	_debugWriter->RenderText(_irradianceGrid->IsParallelUpdateEnabled() ? parallelEnabled : parallelDisabled, 5, 51, scaling, textColor);
 
-	const string gridInfo =
-		gridMaxLevels + std::to_string(_irradianceGrid->GetMaxSubGridLevel()) +
-		gridResolution + std::to_string(_irradianceGrid->GetGridDivision().x);
-	_debugWriter->RenderText(gridInfo, 5, 39, scaling, textColor);
+	snprintf(line, sizeof(line), "Grid max levels: %d Grid resolution: %d Volumes: %d (%d updated)", _irradianceGrid->GetMaxSubGridLevel(),
+		_irradianceGrid->GetGridDivision().x, _volumes->GetVolumesCount(), _volumes->GetLastUpdatedCount());
+	_debugWriter->RenderText(line, 5, 39, scaling, textColor);
+
+	snprintf(line, sizeof(line), "Update time: %f ms, Draw time: %f ms", updateTime, drawTime);
+	_debugWriter->RenderText(line, 5, 15, scaling, textColor);
+
+	RenderProfilerInfo();
+}
+
+void RenderMetricsPage()
+{
+	static const glm::vec3 textColor = glm::vec3(0.8);
+	static const GLfloat scaling = 0.30;
+
+	// Last frame counters (and totals), then the buffers memory
+	const MetricsFrame frame = Metrics::Instance.GetLastFrame();
+	char line[128];
+	GLfloat y = 17;
+	for (int i = MetricBuffersCount - 1; i >= 0; i--)
+	{
+		snprintf(line, sizeof(line), "%s: %.1f KB (peak %.1f KB)", Metrics::GetBufferName((MetricBuffer)i),
+			frame.BufferBytes[i] / 1024.0, frame.BufferPeakBytes[i] / 1024.0);
+		_debugWriter->RenderText(line, 5, y, scaling, textColor);
+		y += 12;
+	}
+	for (int i = MetricCountersCount - 1; i >= 0; i--)
+	{
+		MetricCounter counter = (MetricCounter)i;
+		snprintf(line, sizeof(line), "%s: %lld (total %lld)", Metrics::GetCounterName(counter),
+			(long long)frame.Counters[i], (long long)Metrics::Instance.GetTotal(counter));
+		_debugWriter->RenderText(line, 5, y, scaling, textColor);
+		y += 12;
+	}
+	_debugWriter->RenderText("Metrics (M to close, F10 to export)", 5, y, scaling, textColor);
+}
 
-	_debugWriter->RenderText(fpsStr + std::to_string(fps), 5, 27, scaling, textColor);
+void RenderProfilerInfo()
+{
+	if (!Profiler::Instance.IsEnabled()) return;
 
-	std::string timesString = std::string("Update time: ") + std::to_string(updateTime) + " ms, Draw time: " + std::to_string(drawTime) + " ms";
-	_debugWriter->RenderText(timesString, 5, 15, scaling, textColor);
+	static const glm::vec3 textColor = glm::vec3(0.8);
+	static const GLfloat scaling = 0.30;
 
+	// Zones of the last frame from the top of the screen. Zones executed in parallel sum the threads time
+	_debugWriter->RenderText("Profiler (F9 to export the trace)", 5, ScreenHeight - 15, scaling, textColor);
 
+	const std::vector<ProfileZoneSummary>& zones = Profiler::Instance.GetLastFrameSummary();
+	int count = std::min((int)zones.size(), ProfilerOverlayZones);
+	char line[128];
+	for (int i = 0; i < count; i++)
+	{
+		const ProfileZoneSummary& zone = zones[i];
+		snprintf(line, sizeof(line), "%*s%s: %.2f ms (%d)", zone.Depth * 2, "", zone.Name, zone.TotalMilliseconds, zone.Calls);
+		_debugWriter->RenderText(line, 5, ScreenHeight - 27 - (12 * i), scaling, textColor);
+	}
 }
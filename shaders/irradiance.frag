@@ -4,17 +4,62 @@ const float PI = 3.14159265359f;
 
 // Forward declaration
 vec2 SemisphereToPoint(vec3 direction);
+vec2 DirectionToOctahedral(vec3 direction);
 
+// Samples layouts (DirectionLayout in DirectionSets.hpp)
+const int LAYOUT_CONCENTRIC = 0;
+const int LAYOUT_OCTAHEDRAL = 1;
+const int LAYOUT_LOOKUP = 2;
 
-layout (std430, binding = 1) buffer GridInfoUniform
+
+// Max number of volumes in the table (MAX_IRRADIANCE_VOLUMES in VolumeManager.hpp)
+const int MAX_VOLUMES = 16;
+// Pages of the packed cells maps (MAX_CELLS_MAP_PAGES in VolumeManager.hpp)
+const int MAX_CELLS_MAP_PAGES = 4;
+
+// Volume entry of the table. The bases are the first entries of the volume in the packed buffers
+struct VolumeInfo
 {
 	vec3 GridMin;
+	float BlendDistance;
 	vec3 GridMax;
+	int CellsMapBase;
 	ivec3 NumCellsPerDimension;
+	int SubGridsBase;
 	mat4 GridTransform;
-	int SamplesResolution;
-	int _aligment_;
-	int CellsSampleIndex[];
+	int IrradianceBase;
+	int ProbesBase;
+	// 1 for a streamed volume: the cells map section is the bricks table (brick slot, -1 if not resident)
+	int Streamed;
+	int DirectionLookupBase;
+};
+
+layout (std430, binding = 1) buffer VolumesInfo
+{
+	int VolumesCount;
+	int CellsMapPageLength;
+	int _volumesAligment1_;
+	int _volumesAligment2_;
+	VolumeInfo Volumes[MAX_VOLUMES];
+};
+
+// Packed cells maps: for each subgrid, the probe index of each vertex of its lattice.
+// The maps can exceed the max block size, so they are split in pages of CellsMapPageLength entries
+layout (std430, binding = 8) buffer CellsMapPage0
+{
+	int CellsSampleIndex0[];
+};
+layout (std430, binding = 9) buffer CellsMapPage1
+{
+	int CellsSampleIndex1[];
+};
+layout (std430, binding = 10) buffer CellsMapPage2
+{
+	int CellsSampleIndex2[];
+};
+layout (std430, binding = 11) buffer CellsMapPage3
+{
+	int CellsSampleIndex3[];
 };
 
 layout (std430, binding = 2) buffer IrradianceData
@@ -33,10 +78,54 @@ layout (std430, binding = 4) buffer DebugB
 	vec3 Debug2[10];
 };
 
-vec3 radianceSimple(vec3 direction, int samples, int sampleOffset){
+// Samples layout of the probes, a section for each volume (DirectionLookupBase). Each section starts with
+// the layout and the lookup resolution. With the lookup layout the section also contains the nearest sample
+// of each concentric cell (the lookup resolution is zero otherwise), a table for each sampling tier
+layout (std430, binding = 5) buffer DirectionLookupBuffer
+{
+	int DirectionLookup[];
+};
+
+// Span of each probe in the irradiance buffer (ProbeLayout in CellSample.hpp)
+struct ProbeLayout
+{
+	int Offset;
+	int SamplesCount;
+	int Tier;
+};
+
+layout (std430, binding = 7) buffer ProbesLayoutBuffer
+{
+	ProbeLayout ProbesLayout[];
+};
+
+int octahedralStorageIndex(vec3 direction, int samples) {
+	// The whole sphere is a single square: no hemisphere offset
+	int side = int(round(sqrt(float(samples))));
+	ivec2 texel = clamp(ivec2(DirectionToOctahedral(direction) * float(side)), ivec2(0), ivec2(side - 1));
+	return texel.x * side + texel.y;
+}
+
+vec3 radianceSimple(vec3 direction, int probeIndex, int probesBase, int irradianceBase, int lookupBase){
     direction = normalize(direction);
+	// Each probe has its own resolution, so its span is read from the layout table
+	ProbeLayout probe = ProbesLayout[probesBase + probeIndex];
+	int samples = probe.SamplesCount;
+	int probeOffset = irradianceBase + probe.Offset;
+	// The volumes can be sampled with different direction sets
+	int directionLayout = DirectionLookup[lookupBase];
+	int lookupResolution = DirectionLookup[lookupBase + 1];
+	if (directionLayout == LAYOUT_OCTAHEDRAL) {
+		return IrradianceBuffer[probeOffset + octahedralStorageIndex(direction, samples)].rgb;
+	}
+
 	float resolutionF = sqrt(samples / 2.0f);
 	int resolution = int(resolutionF);
+	// With a lookup table the direction is mapped on the table cells instead of the samples
+	if (directionLayout == LAYOUT_LOOKUP) {
+		resolution = lookupResolution;
+		resolutionF = float(lookupResolution);
+	}
 
 	int hemisphereOffset = 0;
 	if (direction.y < 0) {
@@ -50,10 +139,13 @@ vec3 radianceSimple(vec3 direction, int samples, int sampleOffset){
 	int ptY = int(floor(point.y * resolutionF));
 
 	int storageIndex = hemisphereOffset + ptX * resolution + ptY;
+	if (directionLayout == LAYOUT_LOOKUP) {
+		int tableSize = 2 * resolution * resolution;
+		storageIndex = DirectionLookup[lookupBase + 2 + probe.Tier * tableSize + clamp(storageIndex, 0, tableSize - 1)];
+	}
 
-
-	if(storageIndex >= 0 && storageIndex <= samples){
-		storageIndex = (sampleOffset * samples) + storageIndex;
+	if(storageIndex >= 0 && storageIndex < samples){
+		storageIndex = probeOffset + storageIndex;
 	    return IrradianceBuffer[storageIndex].rgb;
 	}
 	else
@@ -64,16 +156,18 @@ vec3 radianceSimple(vec3 direction, int samples, int sampleOffset){
 
 
 /**
-	Calculate a grid cell position from a given point and grid bounds
+	Calculate a grid cell position from a given point and grid bounds of a volume
 
 	OUT ->
 		cellFinalIndex: Global cell index in the grid
 		offset : point offset in the grid
 		cellPos : Cell position in the subgrid
 */
-void GetCellIndex(vec3 pos, int subGridIndex, vec3 gridMin, vec3 gridMax,
+void GetCellIndex(int volume, vec3 pos, int subGridIndex, vec3 gridMin, vec3 gridMax,
 					out int cellFinalIndex, out vec3 offset, out ivec3 cellPos){
 
+	ivec3 NumCellsPerDimension = Volumes[volume].NumCellsPerDimension;
+	mat4 GridTransform = Volumes[volume].GridTransform;
 	// We first calculate the grid step
 	vec3 gridStep = (gridMax - gridMin) / NumCellsPerDimension;
 
@@ -107,12 +201,31 @@ void GetCellIndex(vec3 pos, int subGridIndex, vec3 gridMin, vec3 gridMax,
 }
 
 
-void GetFinalCellIndex(vec3 pos, out int cellFinalIndex, out vec3 offset){
+/**
+	Entry of the packed cells maps. The blocks cannot be indexed with a dynamic index, so we select the page
+*/
+int GetCellsSampleIndex(int index){
+	int page = index / CellsMapPageLength;
+	int pageIndex = index - page * CellsMapPageLength;
+	if (page == 0) return CellsSampleIndex0[pageIndex];
+	if (page == 1) return CellsSampleIndex1[pageIndex];
+	if (page == 2) return CellsSampleIndex2[pageIndex];
+	return CellsSampleIndex3[pageIndex];
+}
+
+void GetFinalCellIndex(int volume, vec3 pos, out int cellFinalIndex, out vec3 offset){
+
+	vec3 GridMin = Volumes[volume].GridMin;
+	vec3 GridMax = Volumes[volume].GridMax;
+	ivec3 NumCellsPerDimension = Volumes[volume].NumCellsPerDimension;
+	int subGridsBase = Volumes[volume].SubGridsBase;
+	bool streamed = Volumes[volume].Streamed != 0;
+	int cellsMapBase = Volumes[volume].CellsMapBase;
 
 	// We calculate the cell index and offset for the main subgrid (0)
 	vec3 currentGridStep = (GridMax - GridMin) / NumCellsPerDimension;
 	ivec3 cellPos;
-	GetCellIndex(pos, 0, GridMin, GridMax, cellFinalIndex, offset, cellPos);
+	GetCellIndex(volume, pos, 0, GridMin, GridMax, cellFinalIndex, offset, cellPos);
 
 	if(cellPos.x < 0 || cellPos.y < 0 || cellPos.z < 0
 		|| cellPos.x >= NumCellsPerDimension.x
@@ -140,10 +253,12 @@ void GetFinalCellIndex(vec3 pos, out int cellFinalIndex, out vec3 offset){
 	
 
 	// We loop until we reach the end of the array (-1)
-	while(SubGridsData[subGridIndex] >= 0){
+	while(SubGridsData[subGridsBase + subGridIndex] >= 0){
 		// In the array, if at cell Y there is the subgrid (X+1), Array[X] = Y
 		// So we need only to do a simple linear search
-		if (SubGridsData[subGridIndex] == cellFinalIndex) {
+		// The bricks of a streamed volume that are not resident are skipped: we stay on the coarser level
+		if (SubGridsData[subGridsBase + subGridIndex] == cellFinalIndex
+			&& (!streamed || GetCellsSampleIndex(cellsMapBase + subGridIndex + 1) >= 0)) {
 			// Here we have found that the cell at {cellIndex} contains the subgrid {subGridIndex + 1}
 
 			// We have to calculate the subgrid "area" and then we do another index step search
@@ -151,7 +266,7 @@ void GetFinalCellIndex(vec3 pos, out int cellFinalIndex, out vec3 offset){
 			subgridMin += (currentGridStep * cellPos);
 			vec3 subgridMax = subgridMin + currentGridStep;
 
-			GetCellIndex(pos, subGridIndex + 1, subgridMin, subgridMax, 
+			GetCellIndex(volume, pos, subGridIndex + 1, subgridMin, subgridMax, 
 						 cellFinalIndex, offset, cellPos);
 			// Debug[2 + subGridIndex] = cellFinalIndex;
 			// We reduce the dimension of the grid step since we are moving to the next grid level
@@ -166,24 +281,54 @@ void GetFinalCellIndex(vec3 pos, out int cellFinalIndex, out vec3 offset){
 
 }
 
-vec3 GetIrradiance(vec3 pos, vec3 normal, float reflectance)
-{
-	int finalCellIndex;
-	vec3 offset;
-	GetFinalCellIndex(pos, finalCellIndex, offset);
-	
-	if (finalCellIndex < 0) {
-		// We are outside the grid. Let's return the a zero vector
-		return vec3(0.0f);
-	}
-
-	// We add in our finalCellIndex the 8-samples space
-	finalCellIndex *= 8;
+/**
+	Weight of a volume in a point: it fades from 1 to 0 in the last BlendDistance units before the volume faces,
+	so the overlapping volumes blend without seams. Zero outside the volume
+*/
+float GetVolumeWeight(int volume, vec3 pos){
+	vec3 gridMinTransformed = vec3(Volumes[volume].GridTransform * vec4(Volumes[volume].GridMin, 1.0f));
+	vec3 gridMaxTransformed = vec3(Volumes[volume].GridTransform * vec4(Volumes[volume].GridMax, 1.0f));
+	vec3 lower = min(gridMinTransformed, gridMaxTransformed);
+	vec3 upper = max(gridMinTransformed, gridMaxTransformed);
+
+	// Distance from the nearest face
+	vec3 faceDistance = min(pos - lower, upper - pos);
+	float distance = min(faceDistance.x, min(faceDistance.y, faceDistance.z));
+	if (distance < 0.0f) return 0.0f;
+
+	float blendDistance = Volumes[volume].BlendDistance;
+	if (blendDistance <= 0.0f) return 1.0f;
+	// A volume alone must not fade to black on its faces, so the weight never reaches zero inside
+	return max(clamp(distance / blendDistance, 0.0f, 1.0f), 1e-4f);
+}
 
+vec3 GetVolumeIrradiance(int volume, int finalCellIndex, vec3 offset, vec3 normal)
+{
+	// We split the finalCellIndex in the subgrid and the cell position
+	ivec3 numCells = Volumes[volume].NumCellsPerDimension;
+	int subGridCells = numCells.x * numCells.y * numCells.z;
+	int subGrid = finalCellIndex / subGridCells;
+	int cellIndex = finalCellIndex - subGrid * subGridCells;
+	ivec3 cell = ivec3(cellIndex / (numCells.y * numCells.z), (cellIndex / numCells.z) % numCells.y, cellIndex % numCells.z);
+
+	// The eight samples are the vertices of the cell in the subgrid lattice
+	ivec3 lattice = numCells + ivec3(1);
+	int latticeSize = lattice.x * lattice.y * lattice.z;
+	bool streamed = Volumes[volume].Streamed != 0;
+	int latticeIndex = Volumes[volume].CellsMapBase + subGrid * latticeSize;
+	// A streamed brick has all the lattice probes in order, from the first probe of its slot
+	int brickBase = streamed ? GetCellsSampleIndex(Volumes[volume].CellsMapBase + subGrid) * latticeSize : 0;
+	int probesBase = Volumes[volume].ProbesBase;
+	int irradianceBase = Volumes[volume].IrradianceBase;
+	int lookupBase = Volumes[volume].DirectionLookupBase;
 
 	vec3 eightColors[8];
 	for(int i = 0; i < 8; i++){
-		vec3 color = radianceSimple(normal, SamplesResolution, CellsSampleIndex[finalCellIndex + i]);
+		// Sample i is the vertex at the (bit 2, bit 1, bit 0) offset from the cell min
+		ivec3 vertex = cell + ivec3((i >> 2) & 1, (i >> 1) & 1, i & 1);
+		int vertexIndex = (vertex.x * lattice.y + vertex.y) * lattice.z + vertex.z;
+		int probeIndex = streamed ? brickBase + vertexIndex : GetCellsSampleIndex(latticeIndex + vertexIndex);
+		vec3 color = radianceSimple(normal, probeIndex, probesBase, irradianceBase, lookupBase);
 		eightColors[i] = color;
 	}	
 	
@@ -196,8 +341,31 @@ vec3 GetIrradiance(vec3 pos, vec3 normal, float reflectance)
 	vec3 c0 = c00 * (1.0f - offset.y) + c10 * (offset.y);
 	vec3 c1 = c01 * (1.0f - offset.y) + c11 * (offset.y);
 	// Trilinear interpolation - < dimension
-	vec3 finalIrradiance = c0 * (1.0f - offset.z) + c1 * (offset.z);
+	return c0 * (1.0f - offset.z) + c1 * (offset.z);
+}
+
+vec3 GetIrradiance(vec3 pos, vec3 normal, float reflectance)
+{
+	vec3 finalIrradiance = vec3(0.0f);
+	float totalWeight = 0.0f;
+	for (int volume = 0; volume < VolumesCount; volume++) {
+		float weight = GetVolumeWeight(volume, pos);
+		if (weight <= 0.0f) continue;
+
+		int finalCellIndex;
+		vec3 offset;
+		GetFinalCellIndex(volume, pos, finalCellIndex, offset);
+		if (finalCellIndex < 0) continue;
+
+		finalIrradiance += weight * GetVolumeIrradiance(volume, finalCellIndex, offset, normal);
+		totalWeight += weight;
+	}
+
+	if (totalWeight <= 0.0f) {
+		// We are outside all the volumes. Let's return the a zero vector
+		return vec3(0.0f);
+	}
 
-	finalIrradiance = (reflectance * finalIrradiance / PI);
+	finalIrradiance = (reflectance * (finalIrradiance / totalWeight) / PI);
 	return finalIrradiance;
 }
\ No newline at end of file
@@ -1,90 +1,54 @@
-
 #version 430 core
 
 const float PI = 3.14159265359f;
-const float M_PI = 3.14159265359f;
-const float M_PI_2 = PI / 2;
-const float M_PI_4 = PI / 4;
-const float OCTANT_8_OFFSET = (7 * M_PI) / 4;
-const float OCTANT_7_OFFSET = (6 * M_PI) / 4;
-const float OCTANT_6_OFFSET = (5 * M_PI) / 4;
-const float OCTANT_5_OFFSET = (4 * M_PI) / 4;
-const float OCTANT_4_OFFSET = (3 * M_PI) / 4;
-const float OCTANT_3_OFFSET = (2 * M_PI) / 4;
-const float OCTANT_2_OFFSET = (1 * M_PI) / 4;
-const float OCTANT_1_OFFSET = 0;
-
-vec2 SemisphereToPoint(vec3 direction) {
-	// direction.y is the cos of the theta angle
-	// theta angle is the acos of (1 - xx ^ 2) so we can easily calculate xx from direction.y
-	// (1 - xx ^ 2) is always >= 0 so direction.y >= 0 and theta angle does' t require adjustem to calculare
-	// sin(theta)
-	float xx = sqrt(1 - direction.y);
-	if (xx == 0.0f) {
-		return vec2(0.5f, 0.5f);
-	}
 
-	float theta = acos(direction.y);
+/*
+* Branch-free concentric inverse mapping (same as SemisphereToPoint4() in SemisphereMap.hpp).
+* The octant if-chain is replaced by abs/min/max/selects and the acos/sin calls by a polynomial atan
+*/
+
+// atan(t) for t in [0; 1]. Abramowitz and Stegun 4.4.49, |error| <= 2e-8
+float AtanUnit(float t) {
+	float t2 = t * t;
+	float result = 0.0028662257f;
+	result = result * t2 - 0.0161657367f;
+	result = result * t2 + 0.0429096138f;
+	result = result * t2 - 0.0752896400f;
+	result = result * t2 + 0.1065626393f;
+	result = result * t2 - 0.1420889944f;
+	result = result * t2 + 0.1999355085f;
+	result = result * t2 - 0.3333314528f;
+	result = result * t2 + 1.0f;
+	return result * t;
+}
 
-	float sinPhi = direction.z / sin(theta);
-	float cosPhi = direction.x / sin(theta);
-	float phi = acos(cosPhi);
-
-	
-
-	// phi must be corrected in ordet to calculate the correct quadrant offset
-	// Base angle is phi but if sin is < 0 we have to consider the "negative" angle
-	float originalAngle = sinPhi < 0 ? 2 * M_PI - phi : phi;
-	vec2 result = vec2(0.0f);
-	if (originalAngle >= OCTANT_8_OFFSET) {
-		/* Octant 8 */
-		float yy = (originalAngle - OCTANT_8_OFFSET) * (xx / M_PI_4);
-		result.x = xx;
-		result.y = yy - result.x;
-	}
-	else if (originalAngle >= OCTANT_7_OFFSET) {
-		/* Octant 7 */
-		float yy = (originalAngle - OCTANT_7_OFFSET) * (xx / M_PI_4);
-		result.y = -xx;
-		result.x = yy;
-	}
-	else if (originalAngle >= OCTANT_6_OFFSET) {
-		/* Octant 6 */
-		float yy = (originalAngle - OCTANT_6_OFFSET) * (xx / M_PI_4);
-		result.y = -xx;
-		result.x = yy + result.y;
-	}
-	else if (originalAngle >= OCTANT_5_OFFSET) {
-		/* Octant 5 */
-		float yy = (originalAngle - OCTANT_5_OFFSET) * (xx / M_PI_4);
-		result.x = -xx;
-		result.y = -yy;
-	}
-	else if (originalAngle >= OCTANT_4_OFFSET) {
-		/* Octant 4 */
-		float yy = (originalAngle - OCTANT_4_OFFSET) * (xx / M_PI_4);
-		result.x = -xx;
-		result.y = -(yy + result.x);
-	}
-	else if (originalAngle >= OCTANT_3_OFFSET) {
-		/* Octant 3 */
-		float yy = (originalAngle - OCTANT_3_OFFSET) * (xx / M_PI_4);
-		result.y = xx;
-		result.x = -yy;
-	}
-	else if (originalAngle >= OCTANT_2_OFFSET) {
-		/* Octant 2 */
-		float yy = (originalAngle - OCTANT_2_OFFSET) * (xx / M_PI_4);
-		result.y = xx;
-		result.x = result.y - yy;
-	}
-	else {
-		/* Octant 1 */
-		float yy = (originalAngle - OCTANT_1_OFFSET) * (xx / M_PI_4);
-		result.x = xx;
-		result.y = yy;
-	}
+vec2 SemisphereToPoint(vec3 direction) {
+	// Disk radius from cos(theta) = 1 - r^2. The direction xz has the same angle of the disk point,
+	// so we don't need to normalize it by sin(theta)
+	float radius = sqrt(max(0.0f, 1.0f - direction.y));
+	vec2 planar = abs(direction.xz);
+	float major = max(planar.x, planar.y);
+	float ratio = min(planar.x, planar.y) / max(major, 1e-30f);
+	float minor = radius * (4.0f / PI) * AtanUnit(ratio);
+
+	// The major coordinate is the concentric square, the minor one is linear in the angle from the major axis
+	vec2 result = planar.x >= planar.y ? vec2(radius, minor) : vec2(minor, radius);
+	result = mix(result, -result, lessThan(direction.xz, vec2(0.0f)));
 
 	/* Re - normalization */
 	return (result + 1.0f) / 2.0f;
-}
\ No newline at end of file
+}
+
+/*
+* Octahedral inverse mapping (same as DirectionToOctahedral() in OctahedralMap.hpp): only abs/add operations
+*/
+vec2 DirectionToOctahedral(vec3 direction) {
+	vec3 octahedron = direction / (abs(direction.x) + abs(direction.y) + abs(direction.z));
+	vec2 square = octahedron.xz;
+	if (octahedron.y < 0.0f) {
+		// Lower hemisphere: we fold the point on the corners
+		vec2 signs = mix(vec2(1.0f), vec2(-1.0f), lessThan(square, vec2(0.0f)));
+		square = (1.0f - abs(square.yx)) * signs;
+	}
+	return square * 0.5f + 0.5f;
+}
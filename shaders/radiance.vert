@@ -16,9 +16,18 @@ layout (std140, binding = 0) uniform ViewMatrices
 
 uniform mat4 modelMatrix;
 uniform mat3 normalMatrix;
+uniform int probeIndex;
+uniform int probesBase;
+uniform int irradianceBase;
+uniform int lookupBase;
 
 out vec2 interp_UV;
 out vec3 interpNormal;
+// The fragment shader is shared with the instanced draw, where the probe is per-instance
+flat out int interpProbeIndex;
+flat out int interpProbesBase;
+flat out int interpIrradianceBase;
+flat out int interpLookupBase;
 
 void main()
 {
@@ -32,4 +41,8 @@ void main()
 
         interp_UV = UV;
         interpNormal = normal;     
+        interpProbeIndex = probeIndex;
+        interpProbesBase = probesBase;
+        interpIrradianceBase = irradianceBase;
+        interpLookupBase = lookupBase;
 }
@@ -0,0 +1,53 @@
+#version 430 core
+
+// vertex position in world coordinates
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+// the numbers used for the location in the layout qualifier are the positions of the vertex attribute
+// as defined in the Mesh class
+layout (location = 2) in vec2 UV;
+
+// ViewMatrices binding is always at index 0
+layout (std140, binding = 0) uniform ViewMatrices
+{
+    mat4 projectionMatrix;
+    mat4 viewMatrix;
+};
+
+struct ProbeInstance
+{
+    // xyz: sphere center, w: sphere scale
+    vec4 translationScale;
+    // x: probe index, y: first probe layout of the volume, z: first irradiance entry of the volume,
+    // w: direction lookup section of the volume
+    ivec4 samples;
+};
+
+// One entry for each probe, indexed by the instance id
+layout (std430, binding = 6) readonly buffer ProbeInstances
+{
+    ProbeInstance instances[];
+};
+
+out vec2 interp_UV;
+out vec3 interpNormal;
+flat out int interpProbeIndex;
+flat out int interpProbesBase;
+flat out int interpIrradianceBase;
+flat out int interpLookupBase;
+
+void main()
+{
+        ProbeInstance probe = instances[gl_InstanceID];
+
+        // The sphere transform is only a uniform scale and a translation, so we don' t need a full matrix
+        vec3 worldPos = position * probe.translationScale.w + probe.translationScale.xyz;
+        gl_Position = projectionMatrix * viewMatrix * vec4(worldPos, 1.0);
+
+        interp_UV = UV;
+        interpNormal = normal;
+        interpProbeIndex = probe.samples.x;
+        interpProbesBase = probe.samples.y;
+        interpIrradianceBase = probe.samples.z;
+        interpLookupBase = probe.samples.w;
+}
@@ -1,7 +1,8 @@
-
 #version 410 core
 layout (location = 0) in vec4 vertex;
+layout (location = 1) in vec3 vertexColor;
 out vec2 TexCoords;
+out vec3 TextColor;
 
 uniform mat4 projectionMatrix;
 
@@ -9,4 +10,6 @@ void main()
 {
     gl_Position = projectionMatrix * vec4(vertex.xy, 0.0, 1.0);
     TexCoords = vertex.zw;
+    // The color is per vertex so lines with different colors can be drawn in the same batch
+    TextColor = vertexColor;
 }  
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <std_include.h>
+#include <memory>
+#include <stdexcept>
+#include <SceneObject.hpp>
+#include <BCube.hpp>
+#include <objects/Cube.hpp>
+#include <objects/CubeWall.hpp>
+#include <DirectionSets.hpp>
+#include <scene/PrimitiveTable.hpp>
+
+/// <summary>
+/// Invisible scene object that only occupies a region of space
+/// </summary>
+/// <remarks>
+/// It' s not hit by the sampling rays. It only drives the grid refinement
+/// (for example to mark the space in which the dynamic objects will move)
+/// </remarks>
+class BoundingRegion : public SceneObject
+{
+private:
+	BCube _boundingCube;
+	BCube _transformedBoundingCube;
+protected:
+	virtual void OnTransformChanged() override {
+		_transformedBoundingCube = _boundingCube >> GetTransform();
+	}
+
+public:
+	BoundingRegion(const glm::vec3& regionMin, const glm::vec3& regionMax) {
+		_boundingCube = BCube::FromMinMax(regionMin, regionMax);
+		UpdateTransform();
+	}
+
+	virtual RayHit IsHitByRay(const Ray& ray) const override {
+		return RayHit();
+	}
+
+	virtual BCube& GetBoundingCube() override {
+		return _boundingCube;
+	}
+
+	virtual BCube& GetTransformedBoundingCube() override {
+		return _transformedBoundingCube;
+	}
+};
+
+/// <summary>
+/// Scene description used by the offline tools
+/// </summary>
+/// <remarks>
+/// The scene is a plain text file with one directive per line ('#' starts a comment):
+///
+/// room scale                              Open cube used by the application. The grid bounds follow the room
+/// bounds minX minY minZ maxX maxY maxZ    Grid bounds when the scene has no room
+/// quad r g b x0 y0 z0 x1 y1 z1 x2 y2 z2 x3 y3 z3   Emitting quad (same vertices order of the cube walls)
+/// sphere r g b x y z radius               Emitting sphere
+/// box r g b minX minY minZ maxX maxY maxZ Emitting axis aligned box
+/// refine minX minY minZ maxX maxY maxZ    Region in which the grid is refined with the subgrids
+/// division n                              Grid cells per dimension
+/// levels n                                Max subgrid level
+/// resolution n                            Sampling resolution
+/// directions name                         Sampling direction set (concentric, fibonacci, hammersley, cosine, octahedral)
+/// </remarks>
+class BakeScene
+{
+private:
+	std::unique_ptr<CCube> _room;
+	std::vector<std::unique_ptr<SceneObject>> _objects;
+
+	std::vector<const SceneObject*> _samplingObjects;
+	std::vector<SceneObject*> _refinementObjects;
+
+	/// <summary>
+	/// Analytic primitives (spheres and boxes). They have no scene object so they are stored directly flattened
+	/// </summary>
+	PrimitiveTable _staticPrimitives;
+	std::vector<std::unique_ptr<Surface>> _surfaces;
+
+	BCube _gridBounds;
+	TransformParams _gridTransform;
+	bool _hasBounds = false;
+
+	static glm::vec3 ReadVec3(std::istringstream& stream) {
+		glm::vec3 value;
+		stream >> value.x >> value.y >> value.z;
+		return value;
+	}
+
+	Surface* CreateSurface(const glm::vec3& radiance) {
+		_surfaces.push_back(std::make_unique<Surface>());
+		_surfaces.back()->SetRadiance(radiance);
+		return _surfaces.back().get();
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(BakeScene);
+
+	glm::ivec3 Division = glm::ivec3(2);
+	int MaxSubGridLevel = 0;
+	int Resolution = 29;
+	DirectionSetType Directions = DirectionSetType::Concentric;
+
+	/// <summary>
+	/// Loads the scene from a file
+	/// </summary>
+	explicit BakeScene(const std::string& path) {
+		std::ifstream file(path);
+		if (!file) throw std::runtime_error("Unable to open scene file " + path);
+
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line)) {
+			++lineNumber;
+			std::size_t commentStart = line.find('#');
+			if (commentStart != std::string::npos) line.erase(commentStart);
+
+			std::istringstream stream(line);
+			std::string directive;
+			if (!(stream >> directive)) continue;
+
+			if (directive == "room") {
+				float scale = 1.0f;
+				stream >> scale;
+				_room = std::make_unique<CCube>();
+				_room->SetScale(glm::vec3(scale));
+				_room->UpdateTransform();
+				_samplingObjects.push_back(_room.get());
+
+				_gridBounds = _room->GetBoundingCube();
+				_gridTransform = _room->GetTransform();
+				_hasBounds = true;
+			}
+			else if (directive == "bounds") {
+				glm::vec3 boundsMin = ReadVec3(stream);
+				glm::vec3 boundsMax = ReadVec3(stream);
+				_gridBounds = BCube::FromMinMax(boundsMin, boundsMax);
+				_gridTransform = TransformParams();
+				_hasBounds = true;
+			}
+			else if (directive == "quad") {
+				glm::vec3 radiance = ReadVec3(stream);
+				glm::vec3 vertices[4];
+				for (int i = 0; i < 4; i++) vertices[i] = ReadVec3(stream);
+
+				Wall* wall = new Wall(vertices, 4);
+				wall->GetSurface()->SetRadiance(radiance);
+				// Walls compute their hit data only after the first transform update
+				wall->UpdateTransform();
+				_objects.emplace_back(wall);
+				_samplingObjects.push_back(wall);
+			}
+			else if (directive == "sphere") {
+				glm::vec3 radiance = ReadVec3(stream);
+				glm::vec3 center = ReadVec3(stream);
+				float radius = 0.0f;
+				stream >> radius;
+				if (!stream.fail()) _staticPrimitives.AddSphere(center, radius, CreateSurface(radiance));
+			}
+			else if (directive == "box") {
+				glm::vec3 radiance = ReadVec3(stream);
+				glm::vec3 boxMin = ReadVec3(stream);
+				glm::vec3 boxMax = ReadVec3(stream);
+				if (!stream.fail()) _staticPrimitives.AddBox(boxMin, boxMax, CreateSurface(radiance));
+			}
+			else if (directive == "refine") {
+				glm::vec3 regionMin = ReadVec3(stream);
+				glm::vec3 regionMax = ReadVec3(stream);
+				BoundingRegion* region = new BoundingRegion(regionMin, regionMax);
+				_objects.emplace_back(region);
+				_refinementObjects.push_back(region);
+			}
+			else if (directive == "division") {
+				int division = 0;
+				stream >> division;
+				Division = glm::ivec3(division);
+			}
+			else if (directive == "levels") {
+				stream >> MaxSubGridLevel;
+			}
+			else if (directive == "resolution") {
+				stream >> Resolution;
+			}
+			else if (directive == "directions") {
+				std::string name;
+				stream >> name;
+				Directions = DirectionSet::ParseType(name);
+			}
+			else {
+				throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": unknown directive " + directive);
+			}
+
+			if (stream.fail()) throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": invalid " + directive + " arguments");
+		}
+
+		if (!_hasBounds) throw std::runtime_error(path + ": the scene must define a room or the grid bounds");
+	}
+
+	const BCube& GetGridBounds() const { return _gridBounds; }
+	const TransformParams& GetGridTransform() const { return _gridTransform; }
+
+	/// <summary>
+	/// Objects hit by the sampling rays
+	/// </summary>
+	const std::vector<const SceneObject*>& GetSamplingObjects() const { return _samplingObjects; }
+	/// <summary>
+	/// Analytic primitives hit by the sampling rays
+	/// </summary>
+	const PrimitiveTable& GetStaticPrimitives() const { return _staticPrimitives; }
+	/// <summary>
+	/// Objects that drive the grid refinement
+	/// </summary>
+	std::vector<SceneObject*>& GetRefinementObjects() { return _refinementObjects; }
+};
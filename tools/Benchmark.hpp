@@ -0,0 +1,142 @@
+#pragma once
+
+#include <std_include.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Result of a single benchmark. All the times are in nanoseconds per operation
+/// </summary>
+struct BenchmarkResult {
+	std::string Name;
+	int Repetitions;
+	int BatchSize;
+	double Min;
+	double Mean;
+	double P50;
+	double P90;
+	double P99;
+	double Max;
+};
+
+/// <summary>
+/// Minimal benchmark runner with warmup, repetitions and percentiles
+/// </summary>
+/// <remarks>
+/// Each repetition runs the benchmark body once. The body performs "batchSize" operations,
+/// so the reported values are the time of a repetition divided by the batch size.
+/// An optional setup function is executed before each repetition and it' s not timed
+/// </remarks>
+class BenchmarkSuite
+{
+private:
+	int _warmup;
+	int _repetitions;
+	std::string _filter;
+	std::vector<BenchmarkResult> _results;
+
+	static double Percentile(const std::vector<double>& sortedValues, double percentile) {
+		// Nearest-rank percentile
+		std::size_t rank = (std::size_t)std::ceil(percentile * sortedValues.size());
+		return sortedValues[std::min(sortedValues.size() - 1, rank > 0 ? rank - 1 : 0)];
+	}
+
+public:
+	NO_COPY_AND_ASSIGN(BenchmarkSuite);
+
+	BenchmarkSuite(int warmup, int repetitions, const std::string& filter) : _warmup(warmup), _repetitions(std::max(1, repetitions)), _filter(filter) {
+	}
+
+	/// <summary>
+	/// Runs a benchmark without a setup
+	/// </summary>
+	template<class Body>
+	void Run(const std::string& name, int batchSize, Body body) {
+		Run(name, batchSize, []() {}, body);
+	}
+
+	/// <summary>
+	/// Runs a benchmark. The setup is executed before every repetition (warmup included)
+	/// </summary>
+	template<class Setup, class Body>
+	void Run(const std::string& name, int batchSize, Setup setup, Body body) {
+		if (!_filter.empty() && name.find(_filter) == std::string::npos) return;
+
+		for (int i = 0; i < _warmup; i++) {
+			setup();
+			body();
+		}
+
+		std::vector<double> times;
+		times.reserve(_repetitions);
+		for (int i = 0; i < _repetitions; i++) {
+			setup();
+			auto start = std::chrono::steady_clock::now();
+			body();
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::nano>(end - start).count() / batchSize);
+		}
+
+		std::sort(times.begin(), times.end());
+		double sum = 0.0;
+		for (double time : times) sum += time;
+
+		BenchmarkResult result;
+		result.Name = name;
+		result.Repetitions = _repetitions;
+		result.BatchSize = batchSize;
+		result.Min = times.front();
+		result.Mean = sum / times.size();
+		result.P50 = Percentile(times, 0.50);
+		result.P90 = Percentile(times, 0.90);
+		result.P99 = Percentile(times, 0.99);
+		result.Max = times.back();
+		_results.push_back(result);
+
+		std::cout << std::left << std::setw(56) << name << std::right << std::fixed << std::setprecision(1)
+			<< " p50 " << std::setw(12) << result.P50 << " ns"
+			<< " p90 " << std::setw(12) << result.P90 << " ns"
+			<< " p99 " << std::setw(12) << result.P99 << " ns" << std::endl;
+	}
+
+	const std::vector<BenchmarkResult>& GetResults() const { return _results; }
+
+	/// <summary>
+	/// Writes all the results as a JSON document
+	/// </summary>
+	void WriteJson(std::ostream& stream, const std::string& buildType) const {
+		stream << std::setprecision(3) << std::fixed;
+		stream << "{\n";
+		stream << "  \"build\": \"" << buildType << "\",\n";
+		stream << "  \"warmup\": " << _warmup << ",\n";
+		stream << "  \"repetitions\": " << _repetitions << ",\n";
+		stream << "  \"unit\": \"ns/op\",\n";
+		stream << "  \"benchmarks\": [\n";
+		for (std::size_t i = 0; i < _results.size(); i++) {
+			const BenchmarkResult& result = _results[i];
+			stream << "    { \"name\": \"" << result.Name << "\""
+				<< ", \"batch\": " << result.BatchSize
+				<< ", \"min\": " << result.Min
+				<< ", \"mean\": " << result.Mean
+				<< ", \"p50\": " << result.P50
+				<< ", \"p90\": " << result.P90
+				<< ", \"p99\": " << result.P99
+				<< ", \"max\": " << result.Max << " }"
+				<< (i + 1 < _results.size() ? "," : "") << "\n";
+		}
+		stream << "  ]\n";
+		stream << "}\n";
+	}
+};
+
+/// <summary>
+/// Sink used to keep the benchmarked results alive (avoids the dead code elimination)
+/// </summary>
+volatile float BenchmarkSink = 0.0f;
+
+inline void KeepAlive(float value) {
+	BenchmarkSink = BenchmarkSink + value;
+}
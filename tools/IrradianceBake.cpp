@@ -0,0 +1,178 @@
+/*
+* Offline irradiance volume baker
+*
+* Loads a scene description, samples the irradiance volume on all the available cores
+* and writes a baked volume file that the application can load with Grid::LoadBaked() (IrradianceVolumes --baked file, or F6).
+*
+* The tool is built without GL (HEADLESS) so it can run on machines without a display or a GPU:
+* make bake
+* ./IrradianceBake.out scenes/room.scene irradiance.irvb [-r resolution] [-d division] [-l levels] [--directions set] [--serial] [--no-compile] [--trace trace.json] [--metrics metrics.csv] [--bricks file.irbk]
+*
+* With --trace the bake is profiled: the zones summary is printed at the end and the Chrome trace is written to the given file.
+* With --metrics the pipeline counters are written as CSV (or JSON with a .json extension). Each progress step is a time series row.
+* With --directions the sampling direction set is changed (concentric, fibonacci, hammersley, cosine, octahedral).
+* With --no-compile the scene objects are not flattened in the static primitives table (they are intersected with the virtual calls).
+* With --bricks the baked volume is also written as compressed bricks, that the application streams with --stream.
+*/
+
+#ifndef HEADLESS
+#error The bake tool must be compiled with -DHEADLESS
+#endif
+
+#include <std_include.h>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#include <RadianceSampler.hpp>
+#include <irradiancegrid/Grid.hpp>
+#include <irradiancegrid/BrickVolume.hpp>
+#include <profiling/Profiler.hpp>
+#include <profiling/Metrics.hpp>
+#include "BakeScene.hpp"
+
+/// <summary>
+/// Number of progress updates written during the sampling
+/// </summary>
+const int ProgressSteps = 100;
+
+void PrintUsage() {
+	std::cout << "Usage: IrradianceBake <scene> <output> [-r resolution] [-d division] [-l levels] [--directions set] [--serial] [--no-compile] [--trace trace.json] [--metrics metrics.csv] [--bricks file.irbk]" << std::endl;
+}
+
+void PrintProfilerSummary() {
+	Profiler::Instance.EndFrame();
+	for (const ProfileZoneSummary& zone : Profiler::Instance.GetLastFrameSummary()) {
+		std::cout << std::string(zone.Depth * 2, ' ') << zone.Name << ": " << std::fixed << std::setprecision(2)
+			<< zone.TotalMilliseconds << " ms (" << zone.Calls << ")" << std::endl;
+	}
+}
+
+void PrintProgress(int sampledProbes, int totalProbes, double elapsedSeconds, int samplesCount) {
+	double probesPerSecond = elapsedSeconds > 0.0 ? sampledProbes / elapsedSeconds : 0.0;
+	int percentage = totalProbes > 0 ? (int)((100LL * sampledProbes) / totalProbes) : 100;
+
+	std::cout << "\rBaking [" << std::setw(3) << percentage << "%] " << sampledProbes << "/" << totalProbes << " probes | "
+		<< std::fixed << std::setprecision(1) << probesPerSecond << " probes/s | "
+		<< std::setprecision(0) << probesPerSecond * samplesCount << " rays/s" << std::flush;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3) {
+		PrintUsage();
+		return 1;
+	}
+
+	try {
+		BakeScene scene(argv[1]);
+		const std::string outputPath = argv[2];
+		bool parallel = true;
+		bool compile = true;
+		std::string tracePath;
+		std::string metricsPath;
+		std::string bricksPath;
+
+		// Command line settings override the scene ones
+		for (int i = 3; i < argc; i++) {
+			bool hasValue = i + 1 < argc;
+			if (strcmp(argv[i], "-r") == 0 && hasValue) scene.Resolution = atoi(argv[++i]);
+			else if (strcmp(argv[i], "-d") == 0 && hasValue) scene.Division = glm::ivec3(atoi(argv[++i]));
+			else if (strcmp(argv[i], "-l") == 0 && hasValue) scene.MaxSubGridLevel = atoi(argv[++i]);
+			else if (strcmp(argv[i], "--directions") == 0 && hasValue) scene.Directions = DirectionSet::ParseType(argv[++i]);
+			else if (strcmp(argv[i], "--serial") == 0) parallel = false;
+			else if (strcmp(argv[i], "--no-compile") == 0) compile = false;
+			else if (strcmp(argv[i], "--trace") == 0 && hasValue) tracePath = argv[++i];
+			else if (strcmp(argv[i], "--metrics") == 0 && hasValue) metricsPath = argv[++i];
+			else if (strcmp(argv[i], "--bricks") == 0 && hasValue) bricksPath = argv[++i];
+			else {
+				PrintUsage();
+				return 1;
+			}
+		}
+
+		if (scene.Resolution <= 0 || glm::any(glm::lessThanEqual(scene.Division, glm::ivec3(0)))) {
+			throw std::runtime_error("Resolution and division must be positive");
+		}
+
+		if (!tracePath.empty()) {
+			Profiler::Instance.SetThreadName("Main");
+			Profiler::Instance.SetEnabled(true);
+		}
+
+		RadianceSampler sampler;
+		sampler.SetResolution(scene.Resolution);
+		sampler.SetDirectionSet(scene.Directions);
+		sampler.GetStaticPrimitives() = scene.GetStaticPrimitives();
+		for (const SceneObject* object : scene.GetSamplingObjects()) {
+			sampler.GetSamplingObjects().push_back(object);
+		}
+		if (compile) sampler.CompileSamplingObjects();
+
+		Grid grid(scene.GetGridBounds());
+		grid.SetGridDivision(scene.Division);
+		grid.SetMaxSubGridLevel(scene.MaxSubGridLevel);
+		grid.SetTransform(scene.GetGridTransform());
+		grid.SetParallelUpdate(parallel);
+
+		std::vector<SceneObject*>& refinementObjects = scene.GetRefinementObjects();
+		grid.UpdateStructure(refinementObjects.begin(), refinementObjects.end(), &sampler);
+		Metrics::Instance.EndFrame();
+
+		const int probesCount = grid.GetProbeCount();
+		const int samplesCount = sampler.SamplesCount();
+		std::cout << "Grid " << scene.Division.x << "x" << scene.Division.y << "x" << scene.Division.z
+			<< ", max level " << grid.GetMaxSubGridLevel() << ", resolution " << scene.Resolution
+			<< " " << sampler.GetDirections().GetDirectionSet().GetName()
+			<< " (" << samplesCount << " samples per probe), " << probesCount << " probes, "
+			<< sampler.GetStaticPrimitives().Size() << " static primitives, "
+			<< sampler.GetSamplingObjects().size() << " sampling objects" << std::endl;
+
+		// We sample in chunks to report the progress. Each chunk is still parallelized on all the cores
+		const int chunkSize = std::max(1, probesCount / ProgressSteps);
+		auto bakeStart = std::chrono::steady_clock::now();
+		for (int first = 0; first < probesCount; first += chunkSize) {
+			int count = std::min(chunkSize, probesCount - first);
+			grid.SampleProbes(&sampler, first, count);
+			Metrics::Instance.EndFrame();
+
+			double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bakeStart).count();
+			PrintProgress(first + count, probesCount, elapsedSeconds, samplesCount);
+		}
+		double bakeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - bakeStart).count();
+		std::cout << std::endl;
+
+		grid.WriteIrradiance();
+		grid.SaveBaked(outputPath);
+		Metrics::Instance.EndFrame();
+
+		std::cout << "Baked " << probesCount << " probes in " << std::setprecision(3) << bakeSeconds << " s to " << outputPath << std::endl;
+
+		if (!bricksPath.empty()) {
+			// The bricks are taken from the saved file, so they match what the application loads
+			BrickVolumeHeader header = BrickVolume::Write(bricksPath, BakedVolume(outputPath));
+			std::cout << "Bricks " << header.SubGridCount << " (" << header.BrickProbes << " probes each), "
+				<< header.CompressedBytes / 1024 << " KB compressed from " << header.UncompressedBytes / 1024 << " KB ("
+				<< std::setprecision(3) << (double)header.UncompressedBytes / std::max(header.CompressedBytes, (uint64_t)1) << "x) to " << bricksPath << std::endl;
+		}
+
+		std::cout << "Rays cast " << Metrics::Instance.GetTotal(MetricCounter::RaysCast)
+			<< ", hits " << Metrics::Instance.GetTotal(MetricCounter::RayHits) << std::endl;
+		if (!metricsPath.empty()) {
+			if (!Metrics::Instance.Write(metricsPath)) return 1;
+			std::cout << "Metrics saved to " << metricsPath << std::endl;
+		}
+
+		if (!tracePath.empty()) {
+			PrintProfilerSummary();
+			if (!Profiler::Instance.WriteChromeTrace(tracePath)) return 1;
+			std::cout << "Profiler trace saved to " << tracePath << std::endl;
+		}
+	}
+	catch (const std::exception& e) {
+		std::cout << std::endl << "ERROR::BAKE: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
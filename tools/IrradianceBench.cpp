@@ -0,0 +1,567 @@
+/*
+* Micro-benchmarks for the irradiance hot paths
+*
+* The tool is built without GL (HEADLESS) like the bake tool:
+* make bench
+* ./IrradianceBench.out [--json results.json] [--warmup N] [--repetitions N] [--filter name] [--backend name]
+*
+* The JSON output can be stored to compare the results between releases.
+* The --backend switch selects the ray query backends of the ray casting benchmarks (brute, bvh, bullet or all),
+* to find the fastest one for a scene. The bullet backend needs a build with -DWITH_BULLET.
+* The tool fails if the SIMD mapping functions diverge from the scalar ones.
+*/
+
+#ifndef HEADLESS
+#error The benchmark tool must be compiled with -DHEADLESS
+#endif
+
+#include <std_include.h>
+#include <cstring>
+#include <memory>
+#include <random>
+
+#include <SemisphereMap.hpp>
+#include <UnitHemisphereDirections.h>
+#include <RadianceSampler.hpp>
+#include <scene/RayQuery.hpp>
+#include <irradiancegrid/Grid.hpp>
+#include <objects/Cube.hpp>
+#include <objects/CubeWall.hpp>
+#include <BoundingHull.hpp>
+#include "BakeScene.hpp"
+#include "Benchmark.hpp"
+#if WITH_BULLET
+#include <utils/physics.h>
+#include <scene/BulletRayQuery.hpp>
+#endif
+
+/// <summary>
+/// Operations performed by a single repetition of the batched benchmarks
+/// </summary>
+const int BatchSize = 4096;
+/// <summary>
+/// Room scale used by the application
+/// </summary>
+const float RoomScale = 15.5f;
+/// <summary>
+/// Max distance allowed between the SIMD and the scalar mapping results. The scalar functions
+/// lose precision near the pole (acos/sin of float values), so the SIMD ones are the most accurate
+/// </summary>
+const float MappingTolerance = 1e-4f;
+
+void BenchmarkSampler(BenchmarkSuite& suite) {
+	CCube room;
+	room.SetScale(glm::vec3(RoomScale));
+	room.UpdateTransform();
+
+	const int resolutions[] = { 9, 17, 29 };
+	for (int resolution : resolutions) {
+		RadianceSampler sampler;
+		sampler.SetResolution(resolution);
+		sampler.GetSamplingObjects().push_back(&room);
+		sampler.UpdateRayQuery();
+
+		std::vector<glm::vec4> result(sampler.SamplesCount());
+		const glm::vec3 samplingPoint(0.3f, -0.2f, 0.1f);
+		suite.Run("RadianceSampler.Sample/res=" + std::to_string(resolution), 1, [&]() {
+			sampler.Sample(samplingPoint, result.data());
+			KeepAlive(result[0].x);
+		});
+
+		// Same room flattened in the static primitives
+		sampler.CompileSamplingObjects();
+		suite.Run("RadianceSampler.Sample/res=" + std::to_string(resolution) + "/compiled", 1, [&]() {
+			sampler.Sample(samplingPoint, result.data());
+			KeepAlive(result[0].x);
+		});
+
+		// Temporal accumulation pass: an eighth of the directions is traced, the rest comes from the history.
+		// The result of the last pass is the previous irradiance
+		RadianceHistory history;
+		TemporalSampling temporal = { 8, 0, 0.5f, true };
+		sampler.SampleProgressive(samplingPoint, result.data(), SamplingTier::High, temporal, history);
+		suite.Run("RadianceSampler.SampleProgressive/res=" + std::to_string(resolution), 1, [&]() {
+			temporal.Frame++;
+			sampler.SampleProgressive(samplingPoint, result.data(), SamplingTier::High, temporal, history, result.data());
+			KeepAlive(result[0].x);
+		});
+	}
+}
+
+void BenchmarkIrradianceConvolution(BenchmarkSuite& suite) {
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> radianceDistribution(0.0f, 1.0f);
+
+	const int resolutions[] = { 9, 17, 29 };
+	for (int resolution : resolutions) {
+		RadianceSampler sampler;
+		sampler.SetResolution(resolution);
+
+		UnitHemisphereDirections directions;
+		directions.SetResolution(resolution);
+		const std::vector<glm::vec3>& samplingDirections = directions.GetSamplingDirections();
+		const std::vector<float>& weights = directions.GetSolidAngleWeights();
+		const int samplesCount = (int)samplingDirections.size();
+
+		// Same interleaved direction/radiance layout used by the sampler (radiance weighted by the solid angle)
+		std::vector<glm::vec4> dirRadiance(samplesCount * 2);
+		for (int i = 0; i < samplesCount; i++) {
+			glm::vec3 radiance(radianceDistribution(generator), radianceDistribution(generator), radianceDistribution(generator));
+			dirRadiance[i * 2] = glm::vec4(samplingDirections[i], weights[i]);
+			dirRadiance[i * 2 + 1] = glm::vec4(radiance * weights[i], 0.0f);
+		}
+		std::vector<glm::vec4> result(samplesCount);
+
+		suite.Run("RadianceSampler.ComputeIrradiance/res=" + std::to_string(resolution), 1, [&]() {
+			sampler.ComputeIrradiance(dirRadiance.data(), samplesCount, result.data());
+			KeepAlive(result[0].x);
+		});
+		suite.Run("RadianceSampler.ComputeIrradianceFast/res=" + std::to_string(resolution), 1, [&]() {
+			sampler.ComputeIrradianceFast(dirRadiance.data(), samplesCount, result.data());
+			KeepAlive(result[0].x);
+		});
+	}
+}
+
+void BenchmarkMapping(BenchmarkSuite& suite) {
+	// Cells centers of a 32x32 lattice (repeated), like the sampling directions.
+	// Arbitrary points may not pass the round trip check performed by the debug build
+	const int lattice = 32;
+	std::vector<glm::vec2> points(BatchSize);
+	std::vector<glm::vec3> directions(BatchSize);
+	for (int i = 0; i < BatchSize; i++) {
+		int cell = i % (lattice * lattice);
+		points[i] = (glm::vec2(cell / lattice, cell % lattice) + 0.5f) / (float)lattice;
+		directions[i] = PointToSemisphere(points[i]);
+	}
+
+	suite.Run("PointToSemisphere", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const glm::vec2& point : points) sum += PointToSemisphere(point).x;
+		KeepAlive(sum);
+	});
+	suite.Run("SemisphereToPoint", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const glm::vec3& direction : directions) sum += SemisphereToPoint(direction).x;
+		KeepAlive(sum);
+	});
+
+	std::vector<glm::vec3> simdDirections(BatchSize);
+	std::vector<glm::vec2> simdPoints(BatchSize);
+	suite.Run("PointToSemisphere4", BatchSize, [&]() {
+		PointsToSemisphere(points.data(), simdDirections.data(), BatchSize);
+		KeepAlive(simdDirections[0].x);
+	});
+	suite.Run("SemisphereToPoint4", BatchSize, [&]() {
+		SemisphereToPoints(directions.data(), simdPoints.data(), BatchSize);
+		KeepAlive(simdPoints[0].x);
+	});
+}
+
+/// <summary>
+/// Compares the SIMD mapping functions with the scalar ones
+/// </summary>
+/// <returns>True if the results are within the tolerance</returns>
+bool CheckMappingAccuracy() {
+	// Lattice points are required by the debug checks of the scalar PointToSemisphere()
+	std::vector<glm::vec2> points;
+	const int lattices[] = { 9, 17, 29, 32 };
+	for (int lattice : lattices) {
+		for (int cell = 0; cell < lattice * lattice; cell++) {
+			points.push_back((glm::vec2(cell / lattice, cell % lattice) + 0.5f) / (float)lattice);
+		}
+	}
+
+	// Random directions for the inverse mapping
+	std::mt19937 generator(42);
+	std::normal_distribution<float> normalDistribution;
+	std::vector<glm::vec3> directions(BatchSize);
+	for (glm::vec3& direction : directions) {
+		direction = glm::normalize(glm::vec3(normalDistribution(generator), normalDistribution(generator), normalDistribution(generator)));
+		direction.y = std::abs(direction.y);
+	}
+
+	std::vector<glm::vec3> simdDirections(points.size());
+	std::vector<glm::vec2> simdPoints(directions.size());
+	PointsToSemisphere(points.data(), simdDirections.data(), (int)points.size());
+	SemisphereToPoints(directions.data(), simdPoints.data(), (int)directions.size());
+
+	float forwardError = 0.0f, inverseError = 0.0f;
+	for (std::size_t i = 0; i < points.size(); i++) forwardError = std::max(forwardError, glm::length(simdDirections[i] - PointToSemisphere(points[i])));
+	for (std::size_t i = 0; i < directions.size(); i++) inverseError = std::max(inverseError, glm::length(simdPoints[i] - SemisphereToPoint(directions[i])));
+
+	// Diagnostics go to stderr: stdout may be the JSON output
+	std::cerr << "PointToSemisphere4 max error " << forwardError << ", SemisphereToPoint4 max error " << inverseError << std::endl;
+	return forwardError <= MappingTolerance && inverseError <= MappingTolerance;
+}
+
+void BenchmarkCellSamplesContainer(BenchmarkSuite& suite) {
+	// Lattice points like the ones generated by the grid cells
+	std::vector<glm::vec3> points;
+	points.reserve(BatchSize);
+	for (int x = 0; x < 16; x++)
+		for (int y = 0; y < 16; y++)
+			for (int z = 0; z < 16; z++)
+				points.push_back(glm::vec3(x, y, z) / 16.0f);
+
+	const TransformParams transform;
+	std::unique_ptr<CellSamplesContainer> container;
+	std::vector<std::shared_ptr<GridCellSample>> holders;
+	holders.reserve(BatchSize);
+
+	// The holders must always be released before the container
+	auto resetContainer = [&]() {
+		holders.clear();
+		container = std::make_unique<CellSamplesContainer>();
+	};
+	auto fillContainer = [&]() {
+		resetContainer();
+		for (const glm::vec3& point : points) holders.push_back(container->GetCellSample(point, transform));
+	};
+
+	suite.Run("CellSamplesContainer.GetCellSample/insert", BatchSize, resetContainer, [&]() {
+		for (const glm::vec3& point : points) holders.push_back(container->GetCellSample(point, transform));
+	});
+
+	fillContainer();
+	suite.Run("CellSamplesContainer.GetCellSample/hit", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const glm::vec3& point : points) sum += container->GetCellSample(point, transform)->GetSampleGridIndex();
+		KeepAlive(sum);
+	});
+
+	// Half of the samples are released (as when a subgrid is deleted) and must be trimmed
+	suite.Run("CellSamplesContainer.Trim/half", 1, [&]() {
+		fillContainer();
+		for (std::size_t i = 0; i < holders.size(); i += 2) holders[i].reset();
+	}, [&]() {
+		container->Trim();
+	});
+
+	holders.clear();
+	container.reset();
+}
+
+void BenchmarkSubGridStructure(BenchmarkSuite& suite) {
+	CCube room;
+	room.SetScale(glm::vec3(RoomScale));
+	room.UpdateTransform();
+	RadianceSampler sampler;
+
+	// A moving region (like the trilinear sphere in the application) and a static one.
+	// The regions are small: the deepest levels have tiny cells and big regions would allocate millions of cells
+	BoundingRegion movingRegion(glm::vec3(-0.1f), glm::vec3(0.1f));
+	BoundingRegion staticRegion(glm::vec3(-5.1f, -5.1f, 4.9f), glm::vec3(-4.9f, -4.9f, 5.1f));
+	std::vector<SceneObject*> objects = { &movingRegion, &staticRegion };
+
+	for (int division = 2; division <= 6; division++) {
+		for (int level = 0; level <= 3; level++) {
+			Grid grid(room.GetBoundingCube());
+			grid.SetGridDivision(glm::ivec3(division));
+			grid.SetMaxSubGridLevel(level);
+			grid.SetTransform(room.GetTransform());
+
+			// Each repetition moves the region so the subgrids have to be updated
+			bool flip = false;
+			auto moveRegion = [&]() {
+				flip = !flip;
+				movingRegion.SetPosition(glm::vec3(flip ? 1.75f : -2.5f));
+				movingRegion.UpdateTransform();
+			};
+
+			std::string name = "Grid.UpdateStructure/div=" + std::to_string(division) + "/level=" + std::to_string(level);
+			suite.Run(name, 1, moveRegion, [&]() {
+				grid.UpdateStructure(objects.begin(), objects.end(), &sampler);
+			});
+		}
+	}
+}
+
+void BenchmarkTransforms(BenchmarkSuite& suite) {
+	const int objectsCounts[] = { 16, 1024 };
+	for (int objectsCount : objectsCounts) {
+		std::vector<std::unique_ptr<BoundingRegion>> regions;
+		for (int i = 0; i < objectsCount; i++) regions.push_back(std::make_unique<BoundingRegion>(glm::vec3(-0.1f), glm::vec3(0.1f)));
+
+		// Every object is moved and rotated by each repetition, like the keyboard movement
+		float step = 0.0f;
+		auto moveRegions = [&]() {
+			step += 0.01f;
+			for (const std::unique_ptr<BoundingRegion>& region : regions) {
+				region->SetPosition(glm::vec3(step));
+				region->SetYRotation(step * 20.0f);
+			}
+		};
+
+		suite.Run("SceneObject.UpdateTransforms/objects=" + std::to_string(objectsCount), objectsCount, moveRegions, [&]() {
+			KeepAlive(SceneObject::UpdateTransforms(regions.begin(), regions.end()));
+		});
+	}
+
+	// Rotated bounds of a model-like points cloud
+	std::mt19937 generator(7);
+	std::normal_distribution<float> pointDistribution(0.0f, 1.0f);
+	std::vector<glm::vec3> points(5000);
+	for (glm::vec3& point : points) point = glm::vec3(pointDistribution(generator), pointDistribution(generator), pointDistribution(generator));
+	const BoundingHull hull = BoundingHull::FromPoints(points);
+	const BCube cube = BCube::FromMinMax(glm::vec3(-3.0f), glm::vec3(3.0f));
+
+	std::vector<TransformParams> transforms;
+	for (int i = 0; i < BatchSize; i++) transforms.push_back(TransformParams(glm::vec3(0.5f), glm::vec3(0.2f), i * 0.1f));
+	suite.Run("BCube.Transform", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const TransformParams& transform : transforms) sum += (cube >> transform).Max.x;
+		KeepAlive(sum);
+	});
+	suite.Run("BoundingHull.Transform/points=" + std::to_string(hull.PointsCount()), BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const TransformParams& transform : transforms) sum += hull.Transform(transform).Max.x;
+		KeepAlive(sum);
+	});
+}
+
+/// <summary>
+/// Random rays inside the room, half of them pointing to the upper hemisphere
+/// </summary>
+std::vector<Ray> GenerateRoomRays() {
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> positionDistribution(-RoomScale * 0.45f, RoomScale * 0.45f);
+	std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+
+	std::vector<Ray> rays;
+	rays.reserve(BatchSize);
+	for (int i = 0; i < BatchSize; i++) {
+		glm::vec3 position(positionDistribution(generator), positionDistribution(generator), positionDistribution(generator));
+		glm::vec3 direction = glm::normalize(glm::vec3(unitDistribution(generator) - 0.5f, unitDistribution(generator), unitDistribution(generator) - 0.5f));
+		if (i % 2 == 0) direction = -direction;
+		rays.push_back(Ray(position, direction));
+	}
+	return rays;
+}
+
+void BenchmarkWallHit(BenchmarkSuite& suite) {
+	glm::vec3 backVertices[] = {
+		 glm::vec3(-0.5f, -0.5f, -0.5f),
+		 glm::vec3(-0.5f,  0.5f, -0.5f),
+		 glm::vec3(0.5f, -0.5f,  -0.5f),
+		 glm::vec3(0.5f,  0.5f,  -0.5f)
+	};
+	Wall wall(backVertices, 4);
+	wall.SetScale(glm::vec3(RoomScale));
+	wall.UpdateTransform();
+
+	// Half of the rays point to the wall hemisphere
+	std::vector<Ray> rays = GenerateRoomRays();
+	suite.Run("Wall.IsHitByRay", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const Ray& ray : rays) sum += wall.IsHitByRay(ray).Distance();
+		KeepAlive(sum);
+	});
+}
+
+void BenchmarkRoomHit(BenchmarkSuite& suite) {
+	CCube room;
+	room.SetScale(glm::vec3(RoomScale));
+	room.UpdateTransform();
+	PrimitiveTable table;
+	room.CompileTo(table);
+
+	std::vector<Ray> rays = GenerateRoomRays();
+	suite.Run("CCube.IsHitByRay", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const Ray& ray : rays) sum += room.IsHitByRay(ray).Distance();
+		KeepAlive(sum);
+	});
+
+	suite.Run("PrimitiveTable.IntersectClosest/room", BatchSize, [&]() {
+		float sum = 0.0f;
+		for (const Ray& ray : rays) {
+			PrimitiveHit hit;
+			table.IntersectClosest(ray, hit);
+			sum += hit.Distance;
+		}
+		KeepAlive(sum);
+	});
+}
+
+/// <summary>
+/// Ray query backends that can be selected with the --backend switch
+/// </summary>
+const char* const RayQueryBackends[] = { "brute", "bvh", "bullet" };
+
+/// <summary>
+/// Sampling objects in a room: small walls on a lattice, like a room full of furniture. Only the room is compiled in
+/// the static primitives, so the backends intersect the walls
+/// </summary>
+void BenchmarkRayQuery(BenchmarkSuite& suite, const std::string& backend) {
+	glm::vec3 backVertices[] = {
+		 glm::vec3(-0.5f, -0.5f, -0.5f),
+		 glm::vec3(-0.5f,  0.5f, -0.5f),
+		 glm::vec3(0.5f, -0.5f,  -0.5f),
+		 glm::vec3(0.5f,  0.5f,  -0.5f)
+	};
+	CCube room;
+	room.SetScale(glm::vec3(RoomScale));
+	room.UpdateTransform();
+
+	const int latticeSizes[] = { 2, 4, 8 };
+	for (int latticeSize : latticeSizes) {
+		std::vector<std::unique_ptr<Wall>> walls;
+		const float step = RoomScale * 0.8f / latticeSize;
+		for (int x = 0; x < latticeSize; x++)
+			for (int y = 0; y < latticeSize; y++)
+				for (int z = 0; z < latticeSize; z++) {
+					walls.push_back(std::make_unique<Wall>(backVertices, 4));
+					walls.back()->SetScale(glm::vec3(step * 0.5f));
+					walls.back()->SetPosition((glm::vec3(x, y, z) + 0.5f) * step - RoomScale * 0.4f);
+				}
+		SceneObject::UpdateTransforms(walls.begin(), walls.end());
+		const std::string objects = "/objects=" + std::to_string(walls.size());
+
+#if WITH_BULLET
+		// The walls bounds as static boxes of a physics world
+		Physics physics;
+#endif
+		for (const char* backendName : RayQueryBackends) {
+			if (backend != "all" && backend != backendName) continue;
+
+			std::unique_ptr<RayQueryBackend> rayQuery;
+			if (strcmp(backendName, "brute") == 0) rayQuery = std::make_unique<BruteForceRayQuery>();
+			else if (strcmp(backendName, "bvh") == 0) rayQuery = std::make_unique<BvhRayQuery>();
+#if WITH_BULLET
+			else {
+				auto bulletQuery = std::make_unique<BulletRayQuery>(physics.dynamicWorld);
+				for (const std::unique_ptr<Wall>& wall : walls) {
+					const BCube& bounds = wall->GetTransformedBoundingCube();
+					const glm::vec3 halfSize = (bounds.Max - bounds.Min) * 0.5f + 1e-3f;
+					bulletQuery->Register(wall.get(), physics.CreateRigidBody(BOX, (bounds.Min + bounds.Max) * 0.5f, halfSize, glm::vec3(0.0f), 0.0f, 0.0f, 0.0f));
+				}
+				// The static bodies bounds are computed by the first step
+				physics.dynamicWorld->updateAabbs();
+				rayQuery = std::move(bulletQuery);
+			}
+#else
+			else continue;
+#endif
+
+			RadianceSampler sampler;
+			sampler.SetResolution(17);
+			sampler.GetSamplingObjects().push_back(&room);
+			sampler.CompileSamplingObjects();
+			// The walls are added after the compilation, so they stay to the backend
+			for (const std::unique_ptr<Wall>& wall : walls) sampler.GetSamplingObjects().push_back(wall.get());
+			sampler.SetRayQuery(std::move(rayQuery));
+			const std::string name = "/backend=" + std::string(backendName) + objects;
+
+			suite.Run("RayQueryBackend.Update" + name, 1, [&]() {
+				sampler.UpdateRayQuery();
+			});
+
+			// The directions of a probe, shot from random points in the room
+			const std::vector<glm::vec3>& directions = sampler.GetDirections().GetSamplingDirections();
+			std::vector<Ray> rays = GenerateRoomRays();
+			std::vector<ObjectHit> hits(directions.size());
+			const int batches = 16;
+			suite.Run("RayQueryBackend.IntersectClosest" + name, batches * (int)directions.size(), [&]() {
+				float sum = 0.0f;
+				for (int i = 0; i < batches; i++) {
+					for (ObjectHit& hit : hits) hit = ObjectHit();
+					sampler.GetRayQuery().IntersectClosest(rays[i].Position(), directions.data(), (int)directions.size(), hits.data());
+					sum += hits[0].Distance;
+				}
+				KeepAlive(sum);
+			});
+
+			std::vector<float> maxDistances(directions.size(), RoomScale);
+			std::unique_ptr<bool[]> occluded(new bool[directions.size()]);
+			suite.Run("RayQueryBackend.IntersectAny" + name, batches * (int)directions.size(), [&]() {
+				int sum = 0;
+				for (int i = 0; i < batches; i++) {
+					sampler.GetRayQuery().IntersectAny(rays[i].Position(), directions.data(), maxDistances.data(), (int)directions.size(), occluded.get());
+					sum += occluded[0];
+				}
+				KeepAlive(sum);
+			});
+
+			std::vector<glm::vec4> result(sampler.SamplesCount());
+			suite.Run("RadianceSampler.Sample/res=17" + name, 1, [&]() {
+				sampler.Sample(rays[0].Position(), result.data());
+				KeepAlive(result[0].x);
+			});
+		}
+#if WITH_BULLET
+		physics.Clear();
+#endif
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string jsonPath;
+	std::string filter;
+	std::string backend = "all";
+	int warmup = 5;
+	int repetitions = 50;
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--json") == 0 && hasValue) jsonPath = argv[++i];
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue) warmup = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--repetitions") == 0 && hasValue) repetitions = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--filter") == 0 && hasValue) filter = argv[++i];
+		else if (strcmp(argv[i], "--backend") == 0 && hasValue) backend = argv[++i];
+		else {
+			std::cout << "Usage: IrradianceBench [--json results.json] [--warmup N] [--repetitions N] [--filter name] [--backend brute|bvh|bullet|all]" << std::endl;
+			return 1;
+		}
+	}
+
+	bool knownBackend = backend == "all";
+	for (const char* backendName : RayQueryBackends) knownBackend |= backend == backendName;
+	if (!knownBackend) {
+		std::cout << "ERROR::BENCH: unknown ray query backend " << backend << std::endl;
+		return 1;
+	}
+#if !WITH_BULLET
+	if (backend == "bullet") {
+		std::cout << "ERROR::BENCH: the bullet backend needs a build with -DWITH_BULLET" << std::endl;
+		return 1;
+	}
+#endif
+
+#if DEBUG
+	const std::string buildType = "debug";
+	std::cout << "WARNING: benchmarking a debug build" << std::endl;
+#else
+	const std::string buildType = "release";
+#endif
+
+	if (!CheckMappingAccuracy()) {
+		std::cerr << "ERROR::BENCH: the SIMD mapping functions diverge from the scalar ones" << std::endl;
+		return 1;
+	}
+
+	BenchmarkSuite suite(warmup, repetitions, filter);
+	BenchmarkSampler(suite);
+	BenchmarkIrradianceConvolution(suite);
+	BenchmarkMapping(suite);
+	BenchmarkCellSamplesContainer(suite);
+	BenchmarkSubGridStructure(suite);
+	BenchmarkTransforms(suite);
+	BenchmarkWallHit(suite);
+	BenchmarkRoomHit(suite);
+	BenchmarkRayQuery(suite, backend);
+
+	if (!jsonPath.empty()) {
+		std::ofstream jsonFile(jsonPath);
+		if (!jsonFile) {
+			std::cout << "ERROR::BENCH: unable to write " << jsonPath << std::endl;
+			return 1;
+		}
+		suite.WriteJson(jsonFile, buildType);
+	}
+	else {
+		suite.WriteJson(std::cout, buildType);
+	}
+	return 0;
+}